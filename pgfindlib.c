@@ -23,12 +23,17 @@
   Package: https://github.com/pgulutzan/pgfindlib
 */
 
+#if (!defined(_GNU_SOURCE))
+#define _GNU_SOURCE /* for dl_iterate_phdr() in link.h with glibc, see the "loaded" source */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <libgen.h>
 #include <dirent.h>
+#include <fcntl.h>
 
 #include "pgfindlib.h" /* definition of pgfindlib(), and some #define PGFINDLIB_... */
 
@@ -37,6 +42,10 @@
 #include <link.h>
 #endif
 
+#if (PGFINDLIB_INCLUDE_LOADED != 0)
+#include <link.h> /* dl_iterate_phdr() */
+#endif
+
 /* todo: don't ask for this if we do not stat */
 #include <sys/stat.h>
 
@@ -45,6 +54,85 @@
 #endif
 
 #include <errno.h>
+#include <sys/utsname.h> /* uname() for $PLATFORM if the dynamic loader can't tell */
+#include <spawn.h>       /* posix_spawn() for ldconfig and the dynamic loader, instead of popen() */
+#include <sys/wait.h>
+
+#if (PGFINDLIB_INCLUDE_GETDENTS != 0) && defined(__linux__)
+#include <sys/syscall.h> /* SYS_getdents64, glibc before 2.30 has no getdents64() */
+#define PGFINDLIB_GETDENTS 1
+/* What getdents64 puts in the buffer, the kernel's struct linux_dirent64 */
+struct pgfindlib_dirent64
+{
+  unsigned long long d_ino;
+  long long d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+#else
+#define PGFINDLIB_GETDENTS 0
+#endif
+
+#if (PGFINDLIB_INCLUDE_DLOPEN != 0)
+#include <dlfcn.h>   /* dlopen() for pgfindlib_dlopen() */
+#endif
+#if (PGFINDLIB_INCLUDE_SYSROOT != 0) && defined(__linux__)
+#include <sys/syscall.h> /* SYS_openat2 */
+#include <fnmatch.h>     /* ld.so.conf include patterns */
+#define PGFINDLIB_SYSROOT 1
+#ifndef SYS_openat2
+#define SYS_openat2 437  /* the same number on every architecture */
+#endif
+/* The kernel's struct open_how and RESOLVE_IN_ROOT, from linux/openat2.h which older systems lack */
+struct pgfindlib_open_how
+{
+  unsigned long long flags;
+  unsigned long long mode;
+  unsigned long long resolve;
+};
+#define PGFINDLIB_RESOLVE_IN_ROOT 0x10
+#else
+#define PGFINDLIB_SYSROOT 0
+#endif
+
+#if (PGFINDLIB_INCLUDE_DLOPEN != 0) || (PGFINDLIB_INCLUDE_WARMUP != 0) || (PGFINDLIB_SYSROOT != 0) || (PGFINDLIB_INCLUDE_ASYNC != 0) \
+ || (PGFINDLIB_INCLUDE_DEADLINE != 0) || (PGFINDLIB_INCLUDE_BACKEND_MEMORY != 0)
+#include <pthread.h> /* the mutex for pgfindlib_dlopen()'s decision table, the warm-up thread, pgfindlib_batch(), pgfindlib_async_submit(),
+                        the thread that reads a remote directory, the memory backend's fd table */
+#endif
+#if (PGFINDLIB_INCLUDE_BACKEND_MEMORY != 0)
+#include <time.h>    /* nanosleep() for the memory backend's latency */
+#endif
+#if (PGFINDLIB_INCLUDE_DEADLINE != 0)
+#include <time.h>    /* clock_gettime() */
+#ifdef PGFINDLIB_FREEBSD
+#include <sys/param.h>
+#include <sys/ucred.h>
+#include <sys/mount.h> /* getmntinfo() */
+#else
+#include <mntent.h>    /* getmntent_r() */
+#endif
+#endif
+#if (PGFINDLIB_INCLUDE_ASYNC != 0) && defined(__linux__)
+#include <sys/eventfd.h>
+#define PGFINDLIB_EVENTFD 1
+#else
+#define PGFINDLIB_EVENTFD 0 /* pgfindlib_async_submit() uses a pipe */
+#endif
+#if (PGFINDLIB_INCLUDE_WARMUP != 0)
+#include <elf.h>
+#include <link.h>    /* ElfW() */
+#include <sys/mman.h>
+#include <time.h>
+#ifdef PGFINDLIB_FREEBSD
+#define PGFINDLIB_MAP_POPULATE MAP_PREFAULT_READ
+#else
+#define PGFINDLIB_MAP_POPULATE MAP_POPULATE
+#endif
+#endif
+
+extern char **environ;
 
 struct tokener
 {
@@ -53,15 +141,467 @@ struct tokener
   char tokener_comment_id;
 };
 
+/*
+  One path found in phase 1. source_number is the tokener_number of the source, kept apart from the path
+  so that the sort key is (source_number, path) and there is no limit on the number of sources.
+  The path is a directory prefix, which is stored once however many of the directory's files match,
+  followed by the name. Both are in malloc_buffer_1, and the path is only put together for a row,
+  see pgfindlib_candidate_path().
+*/
+struct pgfindlib_candidate
+{
+  unsigned int source_number;
+  unsigned int directory_number; /* context->candidate_directories[directory_number] */
+  unsigned int name_offset;   /* malloc_buffer_1 + name_offset is the name, ending with \0 */
+  unsigned char d_type;       /* from the directory entry (or fstatat() if that said DT_UNKNOWN), DT_UNKNOWN if not known */
+  ino_t d_ino;                /* from the directory entry, 0 if not known */
+};
+
+/* A directory prefix of candidates, e.g. "/usr/lib/", or "" if a path has no "/". It's in malloc_buffer_1 too. */
+struct pgfindlib_candidate_directory
+{
+  unsigned int offset;
+  unsigned int length;
+  int next_in_bucket;
+};
+
+#define PGFINDLIB_CANDIDATE_DIRECTORY_BUCKETS 64
+
+/* For the WHERE matcher, see pgfindlib_matcher_init() */
+struct pgfindlib_glob_position
+{
+  char type;                 /* PGFINDLIB_GLOB_LITERAL | _CLASS | _STAR | _ACCEPT */
+  unsigned char literal;
+  unsigned int class_number;
+};
+
+struct pgfindlib_dfa_state
+{
+  unsigned int set_offset;   /* this state is the set of positions matcher->sets[set_offset .. set_offset+set_count-1] */
+  unsigned int set_count;    /* 0 means dead i.e. nothing can match */
+  unsigned int hash;
+  int next_in_bucket;
+  char is_accepting;
+  char is_accepting_forever; /* a star just before an accept, so whatever follows will match */
+  int transitions[256];      /* -1 means not computed yet */
+};
+
+struct pgfindlib_where_matcher
+{
+  struct pgfindlib_glob_position *positions; unsigned int positions_count; unsigned int positions_max;
+  unsigned char (*classes)[32]; unsigned int classes_count; unsigned int classes_max;
+  unsigned int *pattern_starts; unsigned int pattern_starts_count;
+  struct pgfindlib_dfa_state *states; unsigned int states_count; unsigned int states_max;
+  unsigned int *sets; unsigned int sets_length; unsigned int sets_max;
+  int *buckets; unsigned int buckets_count;
+  unsigned int *marks; unsigned int mark_generation;
+  unsigned int *work; unsigned int *work_2;
+  int start_state;           /* made by pgfindlib_matcher_reset_states(), so at init and after the cache fills */
+  int is_glob;               /* at least one WHERE item is a glob rather than a prefix */
+};
+
+/* For the symlink memo, see pgfindlib_symlink_memo_init() */
+struct pgfindlib_symlink_memo_entry
+{
+  dev_t dir_dev;
+  ino_t dir_ino;
+  char *name;
+  unsigned int hash;
+  int next_in_bucket;
+  char *final_target;        /* path that the chain ends at, NULL while the chain is being walked */
+  dev_t target_dev;
+  ino_t target_ino;
+  int is_broken;             /* chain ends at something missing, or is too long */
+};
+
+struct pgfindlib_symlink_memo_directory
+{
+  char *path;
+  int fd;                    /* -1 if missing, or if closed to stay under PGFINDLIB_SYMLINK_MEMO_MAX_FDS */
+  int is_missing;
+  dev_t dev;
+  ino_t ino;
+  unsigned int last_used;
+};
+
+struct pgfindlib_row_target
+{
+  dev_t dev;
+  ino_t ino;
+  unsigned int row_number;
+  int next_in_bucket;
+};
+
+/* A GNU build-id, length is 0 if there's none */
+struct pgfindlib_build_id
+{
+  unsigned int length;
+  unsigned char bytes[PGFINDLIB_MAX_BUILD_ID_LENGTH];
+};
+
+/*
+  For a build-id, pgfindlib_read_elf_header() reads the file's first page, and pgfindlib_read_build_id() the program
+  headers and notes if they're not in it. The three buffers are one malloc'd block, see pgfindlib_context.elf_scratch.
+*/
+#define PGFINDLIB_ELF_PAGE_SIZE 4096
+#define PGFINDLIB_MAX_PHDRS 64
+#define PGFINDLIB_MAX_NOTES_LENGTH 4096
+#define PGFINDLIB_ELF_SCRATCH_LENGTH (PGFINDLIB_ELF_PAGE_SIZE + PGFINDLIB_MAX_PHDRS * 128 + PGFINDLIB_MAX_NOTES_LENGTH)
+
+/*
+  What pgfindlib_file()'s system calls said about one path, facts says which members are known.
+  A snapshot keeps them so that the next call needn't ask again, see pgfindlib_snapshot_facts().
+*/
+#define PGFINDLIB_FACT_ACCESS   0x01
+#define PGFINDLIB_FACT_LSTAT    0x02
+#define PGFINDLIB_FACT_SYMLINK  0x04
+#define PGFINDLIB_FACT_ELF      0x08
+#define PGFINDLIB_FACT_BUILD_ID 0x10
+struct pgfindlib_file_facts
+{
+  unsigned int facts;
+  int is_access_failed;
+  int is_lstat_failed;
+  mode_t st_mode;
+  dev_t st_dev;
+  ino_t st_ino;
+  int is_symlink_resolved;  /* pgfindlib_symlink_target() had an entry, the rest is its final_target etc. */
+  int is_broken;
+  dev_t target_dev;
+  ino_t target_ino;
+  const char *final_target;
+  int elf_rval;
+  struct pgfindlib_build_id build_id;
+};
+
+/* The first row of each (build-id, file), see pgfindlib_symlink_memo_row_build() */
+struct pgfindlib_row_build
+{
+  struct pgfindlib_build_id build_id;
+  dev_t dev;
+  ino_t ino;                /* dev and ino are 0 if the file isn't known */
+  unsigned int row_number;
+  int next_in_bucket;
+};
+
+struct pgfindlib_symlink_memo
+{
+  struct pgfindlib_symlink_memo_entry *entries; unsigned int entries_count; unsigned int entries_max;
+  int *buckets;
+  struct pgfindlib_symlink_memo_directory *directories; unsigned int directories_count; unsigned int directories_max;
+  unsigned int directories_open; unsigned int directories_clock;
+  struct pgfindlib_row_target *row_targets; unsigned int row_targets_count; unsigned int row_targets_max;
+  int *row_target_buckets;
+  struct pgfindlib_row_build *row_builds; unsigned int row_builds_count; unsigned int row_builds_max;
+  int *row_build_buckets;   /* NULL until the first build-id */
+  char *path_buffer; char *next_path_buffer; char *link_buffer;
+  int sysroot_fd;           /* context->sysroot_fd */
+  const struct pgfindlib_backend *backend; /* context->backend */
+};
+
+/*
+  A directory that pgfindlib_directory_scan() read in this phase 1, and its candidates,
+  which are malloc_buffer_2[first .. first + count - 1].
+*/
+struct pgfindlib_scanned_directory
+{
+  dev_t dev;
+  ino_t ino;
+  unsigned int first;
+  unsigned int count;
+  int directory_number;     /* the candidate directory prefix, -1 if none, which is only if there are no candidates */
+  long long mtime_sec;      /* for the snapshot */
+  long long mtime_nsec;
+};
+
+/* A mount point and its file system type e.g. "/mnt/build" "nfs4", see pgfindlib_mount_type() */
+struct pgfindlib_mount
+{
+  char *mount_point;        /* mount_point and fs_type are in the same malloc */
+  unsigned int mount_point_length;
+  const char *fs_type;
+  int is_remote;            /* NFS, CIFS, FUSE etc., a directory that might not answer */
+};
+
+/* A directory that pgfindlib_directory_scan() didn't read because of the deadline or the budget */
+struct pgfindlib_skipped_directory
+{
+  char *path;               /* path and comment are in the same malloc */
+  const char *comment;      /* e.g. "skipped, nfs4, no answer in 200 ms" */
+  unsigned int tokener_number;
+};
+
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+/*
+  The snapshot file is text, one record per line, the fields are separated by tabs. See "Re snapshots" in README.md.
+    pgfindlib snapshot 1 key      key = a hash of what decides which files are candidates and what's checked
+    t sec nsec                    when the call that wrote it started, by the clock that file times come from
+    d prefix dev ino mtime_sec mtime_nsec is_listed   a candidate directory prefix e.g. "/usr/lib/"
+    e name d_ino d_type           a candidate of the "d" before it, which is_listed
+    c dev ino mtime_sec mtime_nsec   /etc/ld.so.cache
+    l path has_newline            a candidate from ld.so.cache
+    f path facts ...              what pgfindlib_file() learned, see pgfindlib_snapshot_write_facts()
+    r row                         a row of the output
+  Strings with tabs or newlines aren't written, so whatever they'd say is looked at again the next time.
+*/
+struct pgfindlib_snapshot_directory
+{
+  const char *prefix;
+  dev_t dev;
+  ino_t ino;
+  long long mtime_sec;
+  long long mtime_nsec;
+  int is_listed;            /* entries are all the directory's candidates, else it's only there for its files' facts */
+  unsigned int first_entry;
+  unsigned int entries_count;
+  int next_in_bucket;
+};
+
+struct pgfindlib_snapshot_entry
+{
+  const char *name;         /* or a path from ld.so.cache */
+  ino_t d_ino;
+  unsigned char d_type;     /* or has_newline if it's from ld.so.cache */
+};
+
+struct pgfindlib_snapshot_file
+{
+  const char *path;
+  struct pgfindlib_file_facts facts;
+  int next_in_bucket;
+};
+
+/* This call's view of a candidate directory prefix, see pgfindlib_snapshot_facts() */
+#define PGFINDLIB_SNAPSHOT_PREFIX_UNKNOWN   0  /* not stat()ed yet */
+#define PGFINDLIB_SNAPSHOT_PREFIX_UNCHANGED 1  /* (dev, ino, mtime) are the same as in the last snapshot */
+#define PGFINDLIB_SNAPSHOT_PREFIX_CHANGED   2  /* or new */
+#define PGFINDLIB_SNAPSHOT_PREFIX_UNUSABLE  3  /* stat() failed, or the prefix can't be written */
+struct pgfindlib_snapshot_prefix
+{
+  int state;
+  dev_t dev;
+  ino_t ino;
+  long long mtime_sec;
+  long long mtime_nsec;
+};
+
+/*
+  The last snapshot, whose strings point into text (it's empty if there was none or its key is different),
+  and the new one, which is written to temporary_path and renamed to path when the call succeeds.
+*/
+struct pgfindlib_snapshot
+{
+  char *text;
+  struct pgfindlib_snapshot_directory *directories; unsigned int directories_count;
+  struct pgfindlib_snapshot_entry *entries; unsigned int entries_count;
+  struct pgfindlib_snapshot_file *files; unsigned int files_count;
+  int *directory_buckets; int *file_buckets; unsigned int buckets_count;
+  int is_cache; struct pgfindlib_snapshot_directory cache;   /* /etc/ld.so.cache, its entries are the "l" lines */
+  long long written_sec; long long written_nsec;             /* the "t" line, 0 if there was none */
+  char **rows; unsigned int rows_count;
+  const char *path;
+  char *temporary_path;
+  FILE *fp;
+  struct pgfindlib_snapshot_prefix *prefixes; unsigned int prefixes_count; /* [directory_number], after phase 1 */
+  int is_cache_statted; struct pgfindlib_snapshot_prefix new_cache;
+  int is_cache_recorded; unsigned int cache_first; unsigned int cache_count;  /* this call's ld.so.cache candidates */
+  char file_path[PGFINDLIB_MAX_PATH_LENGTH * 2 + 1];         /* pgfindlib_snapshot_facts() */
+  struct pgfindlib_file_facts learned;
+};
+#endif
+
+/* An object that was in the process's link_map, see pgfindlib_loaded_init() */
+struct pgfindlib_loaded
+{
+  char *path;               /* copied, because another thread could dlclose() it during the call */
+  unsigned long address;    /* dlpi_addr */
+  dev_t dev;
+  ino_t ino;
+  int is_stat_ok;
+};
+
+#define PGFINDLIB_AUDIT_PENDING_MAX 64 /* processes with a search in progress at the same time in the log */
+
+/* An object that the loader mapped, from options->audit_log, see pgfindlib_audit_log_read() */
+struct pgfindlib_audited
+{
+  const char *path;         /* in audited_paths, with no "//" */
+  unsigned int failures;    /* directories (or ld.so.cache) that the loader tried before this one */
+  unsigned long long nanoseconds; /* from the search's start to la_objopen() */
+  unsigned int sequence;    /* the order in the log, the last one for a path counts */
+};
+
+/*
+  Everything one pgfindlib_ex() call needs that's too big for the stack or mustn't be shared with another thread.
+  It is malloc'd once per call, so there's no global state and nested calls use little stack, see "Re threads" in README.md.
+  Each scratch buffer belongs to one function, which never calls anything that uses the same buffer while it's in use.
+*/
+struct pgfindlib_context
+{
+  unsigned int option_flags;
+  char **envp;                                               /* snapshot of the environment when the call started */
+  int sysroot_fd;                                            /* options->sysroot opened with O_PATH, or -1 */
+  struct pgfindlib_elf_verdicts *elf_verdicts;               /* pgfindlib_batch()'s, or NULL */
+  unsigned char *elf_scratch;                                /* PGFINDLIB_ELF_SCRATCH_LENGTH if PGFINDLIB_OPTION_BUILD_ID, else NULL */
+  const struct pgfindlib_architecture *architectures; unsigned int architectures_count; /* options->architectures */
+  char *envp_block;                                          /* one malloc for envp pointers and strings */
+  struct pgfindlib_loaded *loaded; unsigned int loaded_count; unsigned int loaded_max;
+  ino_t inode_list[PGFINDLIB_MAX_INODE_COUNT];               /* pgfindlib_ex() */
+  unsigned char inode_is_d_ino[PGFINDLIB_MAX_INODE_COUNT];   /* pgfindlib_file(): 1 if its inode_list entry is a d_ino */
+  int is_d_ino_comparable;                                   /* no source's candidates lack a d_ino, see pgfindlib_file() */
+  char lib[PGFINDLIB_MAX_PATH_LENGTH];
+  char platform[PGFINDLIB_MAX_PATH_LENGTH];
+  char origin[PGFINDLIB_MAX_PATH_LENGTH];
+  char source_name[PGFINDLIB_MAX_TOKEN_LENGTH + 1];
+  char replace_output[PGFINDLIB_MAX_PATH_LENGTH * 2 + 1];    /* pgfindlib_replace_lib_or_platform_or_origin() */
+  char comment[PGFINDLIB_MAX_PATH_LENGTH * 2 + 128];         /* pgfindlib_get_origin_and_lib_and_platform(), pgfindlib_source_scan() */
+  char spawn_line[PGFINDLIB_MAX_PATH_LENGTH * 5];            /* pgfindlib_so_cache(), pgfindlib_ookpik() */
+  char column_lib[PGFINDLIB_MAX_PATH_LENGTH + 100];          /* pgfindlib_row_lib() */
+  char column_platform[PGFINDLIB_MAX_PATH_LENGTH + 100];
+  char column_origin[PGFINDLIB_MAX_PATH_LENGTH + 100];
+  char line_copy[PGFINDLIB_MAX_PATH_LENGTH + 1];             /* pgfindlib_file() */
+  char one_library_or_file[PGFINDLIB_MAX_PATH_LENGTH + 1];   /* pgfindlib_source_scan() */
+  char orig_one_library_or_file[PGFINDLIB_MAX_PATH_LENGTH + 1];
+  char combo[PGFINDLIB_MAX_PATH_LENGTH * 2 + 1];              /* pgfindlib_directory_scan() */
+  char candidate_path[PGFINDLIB_MAX_PATH_LENGTH * 2 + 1];     /* pgfindlib_execute() phase 2 */
+  const struct pgfindlib_backend *backend;                   /* options->backend, or &pgfindlib_backend_posix */
+  struct pgfindlib_scanned_directory *scanned; unsigned int scanned_count; unsigned int scanned_max; /* emptied for each phase 1 */
+  struct pgfindlib_candidate_directory *candidate_directories; unsigned int candidate_directories_count; /* emptied for each phase 1 */
+  unsigned int candidate_directories_max;
+  int candidate_directory_buckets[PGFINDLIB_CANDIDATE_DIRECTORY_BUCKETS];
+  const int *cancelled;                                      /* pgfindlib_async_cancel() sets it, NULL if not async */
+  const char *sysroot;                                       /* options->sysroot, for pgfindlib_mount_type() */
+  long long deadline_ns;                                     /* CLOCK_MONOTONIC, or 0, from options->deadline_milliseconds */
+  long long directory_budget_ns;                             /* or 0, from options->directory_budget_milliseconds */
+  struct pgfindlib_mount *mounts; unsigned int mounts_count; int is_mounts_read; /* the mount table, read when first needed */
+  struct pgfindlib_skipped_directory *skipped; unsigned int skipped_count; unsigned int skipped_max;
+  unsigned int skipped_reported_count;                       /* how many skipped directories have their 063 row */
+  const char *snapshot_path;                                 /* options->snapshot_path */
+  struct pgfindlib_snapshot *snapshot;                       /* NULL unless snapshot_path, see pgfindlib_snapshot_open() */
+  const char *link_farm;                                     /* options->link_farm */
+  const char *audit_log;                                     /* options->audit_log */
+  int (*rows_ready)(void *state, const char *rows, unsigned int rows_length); void *rows_ready_state; /* options->rows_ready */
+  struct pgfindlib_audited *audited; unsigned int audited_count; char *audited_paths; /* from audit_log, sorted by path */
+  char audit_path[PGFINDLIB_MAX_PATH_LENGTH + 1];            /* pgfindlib_audit_find() */
+};
+
+/*
+  What pgfindlib_prepare() makes, see pgfindlib.h. Token names point into names, each ends with \0.
+  rows are the rows made before any source is searched (version, $LIB, etc.), every pgfindlib_execute() starts with them.
+*/
+struct pgfindlib_prepared
+{
+  struct pgfindlib_options options;
+  const struct pgfindlib_options *options_pointer;          /* &options, or NULL if pgfindlib_prepare() had options == NULL */
+  struct tokener *tokener_list; unsigned int tokener_max;
+  char *names;
+  struct pgfindlib_where_matcher matcher;
+  char lib[PGFINDLIB_MAX_PATH_LENGTH];                       /* what $LIB etc. are replaced with */
+  char platform[PGFINDLIB_MAX_PATH_LENGTH];
+  char origin[PGFINDLIB_MAX_PATH_LENGTH];
+  int program_e_machine;
+  const char *rpath;                                         /* this program's DT_RPATH, or NULL */
+  const char *runpath;                                       /* this program's DT_RUNPATH, or NULL */
+  unsigned int rpath_or_runpath_count;
+  unsigned int loaded_source_count;
+  unsigned int so_cache_source_count;
+  char *rows; unsigned int rows_length; unsigned int row_number;
+  ino_t *inode_list; unsigned int inode_count;               /* what the rows put in inode_list */
+};
+
+struct pgfindlib_elf_verdicts;
+static int pgfindlib_ex_with_verdicts(const char *statement, char *buffer, unsigned int buffer_max_length, const struct pgfindlib_options *options,
+                                      struct pgfindlib_elf_verdicts *elf_verdicts);
+static int pgfindlib_execute_with_verdicts(struct pgfindlib_prepared *prepared, char *buffer, unsigned int buffer_max_length,
+                                           struct pgfindlib_elf_verdicts *elf_verdicts);
+static int pgfindlib_prepare_in_context(const char *statement, char *buffer, unsigned int buffer_max_length,
+                                        const struct pgfindlib_options *options, struct pgfindlib_context *context,
+                                        struct pgfindlib_prepared **prepared);
+static int pgfindlib_execute_in_context(struct pgfindlib_prepared *prepared, char *buffer, unsigned int buffer_max_length,
+                                        struct pgfindlib_context *context);
+static int pgfindlib_context_init(struct pgfindlib_context **context, const struct pgfindlib_options *options);
+static void pgfindlib_context_free(struct pgfindlib_context *context);
+static int pgfindlib_is_cancelled(const struct pgfindlib_context *context);
+static int pgfindlib_candidate_rows(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                                    unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count, unsigned int *inode_warning_count,
+                                    struct tokener tokener_list[], int program_e_machine, struct pgfindlib_symlink_memo *memo,
+                                    const char *malloc_buffer_1, const struct pgfindlib_candidate *candidates, unsigned int candidates_count,
+                                    unsigned int *token_number_of_last_source);
+static int pgfindlib_rows_ready(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length);
+#if (PGFINDLIB_INCLUDE_DEADLINE != 0)
+static long long pgfindlib_now_ns(void);
+static int pgfindlib_directory_scan_guarded(const char *directory, unsigned int tokener_number, struct pgfindlib_where_matcher *matcher,
+                                            char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                            struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
+                                            struct pgfindlib_context *context, int *is_done);
+static int pgfindlib_rows_skipped(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                                  unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count, const struct tokener tokener_list[]);
+static int pgfindlib_file_guarded(struct pgfindlib_context *context, const char *path, unsigned int wanted, int elf_reason,
+                                  int program_e_machine, struct pgfindlib_file_facts *facts, char *comment);
+#endif
+static int pgfindlib_loaded_init(struct pgfindlib_context *context);
+#if (PGFINDLIB_INCLUDE_AUDIT_LOG != 0)
+static int pgfindlib_audit_log_read(struct pgfindlib_context *context);
+static const struct pgfindlib_audited *pgfindlib_audit_find(struct pgfindlib_context *context, const char *path);
+#endif
+#if (PGFINDLIB_INCLUDE_LOADED != 0)
+static const struct pgfindlib_loaded *pgfindlib_loaded_find(const struct pgfindlib_context *context, dev_t dev, ino_t ino);
+#endif
+static int pgfindlib_loaded_source(struct pgfindlib_context *context, struct pgfindlib_where_matcher *matcher, int tokener_number,
+                                   char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                   struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length);
+static const char *pgfindlib_getenv(const struct pgfindlib_context *context, const char *name);
+static FILE *pgfindlib_spawn(const struct pgfindlib_context *context, const char *const spawn_argv[],
+                             const char *const environment_changes[], int is_stderr_wanted, pid_t *pid);
+static void pgfindlib_spawn_close(FILE *fp, pid_t pid);
+static int pgfindlib_ookpik(struct pgfindlib_context *context, const char *const spawn_argv[], const char *replacee, char *replacement);
+#if (PGFINDLIB_INCLUDE_PROBE_COST != 0)
+static int pgfindlib_probe_cost(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                                unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count,
+                                const struct tokener tokener_list[], const char *malloc_buffer_1,
+                                const struct pgfindlib_candidate *candidates, unsigned int candidates_count,
+                                const char *lib, const char *platform, const char *origin, const char *rpath, const char *runpath);
+#endif
+#if (PGFINDLIB_INCLUDE_ARCHITECTURES != 0)
+static int pgfindlib_architecture_views(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                                        unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count,
+                                        const struct tokener tokener_list[], const char *malloc_buffer_1,
+                                        const struct pgfindlib_candidate *candidates, unsigned int candidates_count,
+                                        const char *lib, const char *platform, const char *origin, const char *rpath, const char *runpath);
+#endif
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+static int pgfindlib_snapshot_open(struct pgfindlib_context *context, const struct pgfindlib_prepared *prepared);
+static void pgfindlib_snapshot_free(struct pgfindlib_snapshot *snapshot);
+static int pgfindlib_snapshot_directory_scan(const char *directory, const struct stat *directory_sb, unsigned int tokener_number,
+                                             char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                             struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
+                                             struct pgfindlib_context *context, int *is_reused);
+static int pgfindlib_snapshot_so_cache(struct pgfindlib_context *context, int tokener_number,
+                                       char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                       struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
+                                       int *is_reused);
+static void pgfindlib_snapshot_so_cache_candidates(struct pgfindlib_snapshot *snapshot, unsigned int first, unsigned int end);
+static int pgfindlib_snapshot_write_listings(struct pgfindlib_context *context, const char *malloc_buffer_1,
+                                             const struct pgfindlib_candidate *malloc_buffer_2);
+static void pgfindlib_snapshot_facts(struct pgfindlib_context *context, const char *malloc_buffer_1, unsigned int directory_number,
+                                     const char *path, const struct pgfindlib_file_facts **known, struct pgfindlib_file_facts **learned);
+static void pgfindlib_snapshot_write_facts(struct pgfindlib_snapshot *snapshot, const struct pgfindlib_file_facts *facts);
+static int pgfindlib_snapshot_close(struct pgfindlib_snapshot *snapshot, const char *buffer);
+static int pgfindlib_snapshot_commit(struct pgfindlib_snapshot *snapshot);
+static int pgfindlib_snapshot_delta(const struct pgfindlib_snapshot *snapshot, char *buffer, unsigned int *buffer_length,
+                                    unsigned int buffer_max_length);
+#endif
+
 #define PGFINDLIB_REASON_SO_CHECK 1
 #define PGFINDLIB_REASON_SO_LIST 2
+#define PGFINDLIB_REASON_SO_IDENTIFY 3
 
 static int pgfindlib_strcat(char *buffer, unsigned int *buffer_length, const char *line, unsigned int buffer_max_length);
 /* todo: make this obsolete */
 static int pgfindlib_comment_in_row(char *comment, unsigned int comment_number, int additional_number);
 
 static int pgfindlib_keycmp(const char *a, unsigned int a_len, const char *b);
-static int pgfindlib_tokenize(const char *statement, struct tokener tokener_list[],
+static int pgfindlib_tokenize(const char *statement, struct tokener **tokener_list_pointer, unsigned int *tokener_max,
                               unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count,
                               char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length);
 
@@ -69,12 +609,18 @@ static int pgfindlib_tokenize(const char *statement, struct tokener tokener_list
 static int pgfindlib_file(char *buffer, unsigned int *buffer_length, const char *line, unsigned int buffer_max_length,
                           unsigned int *row_number,
                           ino_t inode_list[], unsigned int *inode_count, unsigned int *inode_warning_count,
-                          struct tokener tokener_list_item, int program_e_machine);
+                          struct tokener tokener_list_item, int program_e_machine, ino_t d_ino, unsigned char d_type,
+                          struct pgfindlib_symlink_memo *memo, struct pgfindlib_context *context,
+                          const struct pgfindlib_file_facts *known, struct pgfindlib_file_facts *learned);
+static int pgfindlib_symlink_memo_init(struct pgfindlib_symlink_memo *memo);
+static void pgfindlib_symlink_memo_free(struct pgfindlib_symlink_memo *memo);
 
-static int pgfindlib_find_line_in_statement(const struct tokener tokener_list[], const char *line);
+static int pgfindlib_matcher_init(struct pgfindlib_where_matcher *matcher, const struct tokener tokener_list[]);
+static void pgfindlib_matcher_free(struct pgfindlib_where_matcher *matcher);
+static int pgfindlib_find_line_in_statement(struct pgfindlib_where_matcher *matcher, const char *line);
 static int pgfindlib_row_version(char *buffer, unsigned int *buffer_length, unsigned buffer_max_length, unsigned int *row_number,
                                  ino_t inode_list[], unsigned int *inode_count);
-static int pgfindlib_row_lib(char *buffer, unsigned int *buffer_length, unsigned buffer_max_length, unsigned int *row_number,
+static int pgfindlib_row_lib(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length, unsigned buffer_max_length, unsigned int *row_number,
                              ino_t inode_list[], unsigned int *inode_count,
                              const char *lib, const char *platform, const char *origin);
 #if (PGFINDLIB_INCLUDE_ROW_SOURCE_NAME == 1)
@@ -82,17 +628,32 @@ static int pgfindlib_row_source_name(char *buffer, unsigned int *buffer_length,
                              ino_t inode_list[], unsigned int *inode_count,
                              const char *source_name);
 #endif
-static int pgfindlib_replace_lib_or_platform_or_origin(char *one_library_or_file, unsigned int *replacements_count, const char *lib, const char *platform, const char *origin);
+static int pgfindlib_replace_lib_or_platform_or_origin(char *one_library_or_file, unsigned int *replacements_count, const char *lib, const char *platform, const char *origin,
+                                                       struct pgfindlib_context *context);
 static int pgfindlib_get_origin_and_lib_and_platform(char *origin, char *lib, char *platform,
                                               char *buffer, unsigned int *buffer_length, unsigned buffer_max_length,
                                               int *program_e_machine, unsigned int *row_number,
-                                              ino_t inode_list[], unsigned int *inode_count);
-static int pgfindlib_so_cache(const struct tokener tokener_list[], int tokener_number,
+                                              ino_t inode_list[], unsigned int *inode_count, struct pgfindlib_context *context);
+static int pgfindlib_so_cache(struct pgfindlib_context *context, struct pgfindlib_where_matcher *matcher, int tokener_number,
                        char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
-                       char **malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length);
-static int pgfindlib_add_to_malloc_buffers(const char *new_item, int source_number,
+                       struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length);
+#if (PGFINDLIB_SYSROOT != 0)
+static int pgfindlib_so_cache_sysroot(struct pgfindlib_context *context, struct pgfindlib_where_matcher *matcher, int tokener_number,
+                                      char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                      struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length);
+#endif
+static void pgfindlib_candidates_reset(struct pgfindlib_context *context);
+static int pgfindlib_candidate_directory(struct pgfindlib_context *context, const char *prefix, unsigned int prefix_length,
+                                         char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                         unsigned int *directory_number);
+static int pgfindlib_add_candidate(unsigned int directory_number, const char *name, int source_number, ino_t d_ino, unsigned char d_type,
+                                   char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                   struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length);
+static int pgfindlib_add_to_malloc_buffers(struct pgfindlib_context *context, const char *new_item, int source_number,
                                     char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
-                                    char **malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length);
+                                    struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length);
+static int pgfindlib_candidate_path(const struct pgfindlib_context *context, const char *malloc_buffer_1,
+                                    const struct pgfindlib_candidate *candidate, char *path, unsigned int path_max_length);
 static int pgfindlib_row_bottom_level(char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length, unsigned int *row_number, 
                                const char *columns_list[]);
 
@@ -103,96 +664,243 @@ extern __attribute__((weak)) ElfW(Dyn) _DYNAMIC[];
 
 /* pgfindlib_standard_source_array and pgfindlib_standard_source_array_n must match. */
 const char *pgfindlib_standard_source_array[] = {"LD_AUDIT", "LD_PRELOAD", "DT_RPATH", "LD_LIBRARY_PATH", "DT_RUNPATH",
-                                                 "LD_RUN_PATH", "ld.so.cache", "default_paths", "LD_PGFINDLIB_PATH", ""};
+                                                 "LD_RUN_PATH", "ld.so.cache", "default_paths", "LD_PGFINDLIB_PATH", "loaded", ""};
 const char pgfindlib_standard_source_array_n[]= {PGFINDLIB_TOKEN_SOURCE_LD_AUDIT,PGFINDLIB_TOKEN_SOURCE_LD_PRELOAD,
                                                  PGFINDLIB_TOKEN_SOURCE_DT_RPATH, PGFINDLIB_TOKEN_SOURCE_LD_LIBRARY_PATH,
                                                  PGFINDLIB_TOKEN_SOURCE_DT_RUNPATH, PGFINDLIB_TOKEN_SOURCE_LD_RUN_PATH,
                                                  PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE, PGFINDLIB_TOKEN_SOURCE_DEFAULT_PATHS,
-                                                 PGFINDLIB_TOKEN_SOURCE_LD_PGFINDLIB_PATH, 0};
-static int pgfindlib_qsort_compare(const void *p1, const void *p2);
+                                                 PGFINDLIB_TOKEN_SOURCE_LD_PGFINDLIB_PATH, PGFINDLIB_TOKEN_SOURCE_LOADED, 0};
+/* LD_AUDIT .. NONSTANDARD are consecutive, LOADED is not */
+#define PGFINDLIB_TOKEN_IS_SOURCE(id) ((((id) >= PGFINDLIB_TOKEN_SOURCE_LD_AUDIT) && ((id) <= PGFINDLIB_TOKEN_SOURCE_NONSTANDARD)) \
+                                       || ((id) == PGFINDLIB_TOKEN_SOURCE_LOADED))
+static int pgfindlib_candidate_compare(const char *malloc_buffer_1, const struct pgfindlib_candidate_directory *directories,
+                                       const struct pgfindlib_candidate *c1, const struct pgfindlib_candidate *c2);
+static void pgfindlib_sort_candidates(const char *malloc_buffer_1, const struct pgfindlib_candidate_directory *directories,
+                                      struct pgfindlib_candidate *candidates, unsigned int count);
+static int pgfindlib_directory_scan(const char *directory, unsigned int tokener_number, struct pgfindlib_where_matcher *matcher,
+                                    char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                    struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
+                                    struct pgfindlib_context *context);
 static int pgfindlib_source_scan(const char *librarylist, char *buffer, unsigned int *buffer_length,
                                 unsigned int tokener_number, unsigned int buffer_max_length,
                                 const char *lib, const char *platform, const char *origin,
                                 unsigned int *row_number,
                                 ino_t inode_list[], unsigned int *inode_count, unsigned int *inode_warning_count,
-                                struct tokener tokener_list[],
+                                struct tokener tokener_list[], struct pgfindlib_where_matcher *matcher,
                                 char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
-                                char **malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
-                                int program_e_machine);
-static int pgfindlib_read_elf(const struct tokener tokener_list[], const char* possible_elf_file, int reason, int program_e_machine);
+                                struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
+                                int program_e_machine, struct pgfindlib_symlink_memo *symlink_memo,
+                                struct pgfindlib_context *context);
+static int pgfindlib_read_elf(const struct tokener tokener_list[], const char* possible_elf_file, int reason, int program_e_machine,
+                              const struct pgfindlib_context *context, unsigned char *elf_class, unsigned int *e_machine,
+                              struct pgfindlib_build_id *build_id);
+static int pgfindlib_read_elf_header(FILE *fd, ElfW(Ehdr) *elf_header, unsigned char *elf_class, unsigned int *e_machine,
+                                     struct pgfindlib_build_id *build_id, unsigned char *scratch);
+static int pgfindlib_elf_machine_check(const struct pgfindlib_context *context, int program_e_machine,
+                                       unsigned char elf_class, unsigned int e_machine);
 static int pgfindlib_comment_is_row(const char *comment, unsigned int comment_number,
                              char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length, unsigned int *row_number,
                              ino_t inode_list[], unsigned int *inode_count);
 
+/*
+  Every file or directory that pgfindlib looks at goes through context->backend, usually pgfindlib_backend_posix,
+  these three for paths and the backend's other functions for what they opened.
+*/
+static int pgfindlib_open(const struct pgfindlib_backend *backend, int sysroot_fd, const char *path, int flags)
+{
+  return backend->open(backend->state, sysroot_fd, path, flags);
+}
+
+static int pgfindlib_stat(const struct pgfindlib_backend *backend, int sysroot_fd, const char *path, struct stat *sb, int is_lstat)
+{
+  return backend->stat(backend->state, sysroot_fd, path, sb, is_lstat);
+}
+
+static int pgfindlib_access(const struct pgfindlib_backend *backend, int sysroot_fd, const char *path, int mode)
+{
+  return backend->access(backend->state, sysroot_fd, path, mode);
+}
+
 #define PGFINDLIB_FREE_AND_RETURN \
 { \
   if (malloc_buffer_1 != NULL) { free(malloc_buffer_1); } \
   if (malloc_buffer_2 != NULL) { free(malloc_buffer_2); } \
+  pgfindlib_symlink_memo_free(&symlink_memo); \
   return rval; \
 }
 
 int pgfindlib(const char *statement, char *buffer, unsigned int buffer_max_length)
+{
+  return pgfindlib_ex(statement, buffer, buffer_max_length, NULL);
+}
+
+/*
+  Same as pgfindlib() but options->flags says which checks are done, see PGFINDLIB_OPTION_... in pgfindlib.h.
+  options == NULL means PGFINDLIB_OPTIONS_DEFAULT i.e. everything that was compiled in.
+  A flag can only turn off something that was compiled in, it can't turn on something that's #if'd out.
+*/
+int pgfindlib_ex(const char *statement, char *buffer, unsigned int buffer_max_length, const struct pgfindlib_options *options)
+{
+  return pgfindlib_ex_with_verdicts(statement, buffer, buffer_max_length, options, NULL);
+}
+
+/* pgfindlib_ex() with the ELF verdicts that pgfindlib_batch() shares among its calls, or NULL */
+int pgfindlib_ex_with_verdicts(const char *statement, char *buffer, unsigned int buffer_max_length, const struct pgfindlib_options *options,
+                               struct pgfindlib_elf_verdicts *elf_verdicts)
+{
+  if (buffer == NULL) return PGFINDLIB_ERROR_BUFFER_NULL;
+  struct pgfindlib_context *context;
+  struct pgfindlib_prepared *prepared= NULL;
+  int rval= pgfindlib_context_init(&context, options);
+  if (rval == PGFINDLIB_OK) rval= pgfindlib_prepare_in_context(statement, buffer, buffer_max_length, options, context, &prepared);
+  if (rval == PGFINDLIB_OK)
+  {
+    context->elf_verdicts= elf_verdicts;
+    rval= pgfindlib_execute_in_context(prepared, buffer, buffer_max_length, context);
+  }
+  pgfindlib_prepared_free(prepared);
+  pgfindlib_context_free(context);
+  return rval;
+}
+
+int pgfindlib_prepare(const char *statement, char *buffer, unsigned int buffer_max_length, const struct pgfindlib_options *options,
+                      struct pgfindlib_prepared **prepared)
+{
+  *prepared= NULL;
+  if (buffer == NULL) return PGFINDLIB_ERROR_BUFFER_NULL;
+  struct pgfindlib_context *context;
+  int rval= pgfindlib_context_init(&context, options);
+  if (rval == PGFINDLIB_OK) rval= pgfindlib_prepare_in_context(statement, buffer, buffer_max_length, options, context, prepared);
+  pgfindlib_context_free(context);
+  return rval;
+}
+
+/*
+  prepared == NULL (e.g. because pgfindlib_prepare() failed) is PGFINDLIB_ERROR_STATEMENT_SYNTAX.
+  The rows that pgfindlib_prepare() made are copied to buffer first, so the result is the same as pgfindlib_ex().
+*/
+int pgfindlib_execute(struct pgfindlib_prepared *prepared, char *buffer, unsigned int buffer_max_length)
+{
+  return pgfindlib_execute_with_verdicts(prepared, buffer, buffer_max_length, NULL);
+}
+
+/* pgfindlib_execute() with pgfindlib_batch()'s ELF verdicts, or NULL */
+int pgfindlib_execute_with_verdicts(struct pgfindlib_prepared *prepared, char *buffer, unsigned int buffer_max_length,
+                                    struct pgfindlib_elf_verdicts *elf_verdicts)
 {
   if (buffer == NULL) return PGFINDLIB_ERROR_BUFFER_NULL;
+  if (prepared == NULL) return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+  struct pgfindlib_context *context;
+  int rval= pgfindlib_context_init(&context, prepared->options_pointer);
+  if (rval == PGFINDLIB_OK)
+  {
+    context->elf_verdicts= elf_verdicts;
+    rval= pgfindlib_execute_in_context(prepared, buffer, buffer_max_length, context);
+  }
+  pgfindlib_context_free(context);
+  return rval;
+}
+
+void pgfindlib_prepared_free(struct pgfindlib_prepared *prepared)
+{
+  if (prepared == NULL) return;
+  pgfindlib_matcher_free(&prepared->matcher);
+  if (prepared->tokener_list != NULL) free(prepared->tokener_list);
+  if (prepared->names != NULL) free(prepared->names);
+  if (prepared->rows != NULL) free(prepared->rows);
+  if (prepared->inode_list != NULL) free(prepared->inode_list);
+  free(prepared);
+}
 
+/*
+  Everything up to and including the compiling of the WHERE list. Rows go to buffer, and are copied to
+  (*prepared)->rows because every pgfindlib_execute() starts with them.
+*/
+static int pgfindlib_prepare_in_context(const char *statement, char *buffer, unsigned int buffer_max_length,
+                                        const struct pgfindlib_options *options, struct pgfindlib_context *context,
+                                        struct pgfindlib_prepared **prepared)
+{
   unsigned int buffer_length= 0;
   int rval;
   unsigned int row_number= 1;
-
-  ino_t inode_list[PGFINDLIB_MAX_INODE_COUNT]; /* todo: disable if duplicate checking is off */
+  unsigned int option_flags= context->option_flags;
+  ino_t *inode_list= context->inode_list;
   unsigned int inode_count= 0;
-  unsigned int inode_warning_count= 0;
 
-  char *malloc_buffer_1= NULL;
-  char **malloc_buffer_2= NULL;
+  struct pgfindlib_prepared *p= (struct pgfindlib_prepared *)calloc(1, sizeof(struct pgfindlib_prepared));
+  *prepared= p;
+  if (p == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  if (options != NULL)
+  {
+    p->options= *options;
+    p->options_pointer= &p->options;
+  }
 
 #if (PGFINDLIB_INCLUDE_ROW_VERSION != 0)
-  rval= pgfindlib_row_version(buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count); /* first row including version number */
-  if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN;
+  if ((option_flags & PGFINDLIB_OPTION_ROW_VERSION) != 0)
+  {
+    rval= pgfindlib_row_version(buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count); /* first row including version number */
+    if (rval != PGFINDLIB_OK) goto error_return;
+  }
 #endif
 
-  int program_e_machine;
-  char lib[PGFINDLIB_MAX_PATH_LENGTH]= ""; /* Usually this will be changed to whatever $LIB is. */
-  char platform[PGFINDLIB_MAX_PATH_LENGTH]= ""; /* Usually this will be changed to whatever $LIB is. */
-  char origin[PGFINDLIB_MAX_PATH_LENGTH]= ""; /* Usually this will be changed to whatever $LIB is. */
-
-  rval= pgfindlib_get_origin_and_lib_and_platform(origin, lib, platform, buffer, &buffer_length, buffer_max_length,
-                                                  &program_e_machine, &row_number, inode_list, &inode_count);
-  if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN;
+  rval= pgfindlib_get_origin_and_lib_and_platform(p->origin, p->lib, p->platform, buffer, &buffer_length, buffer_max_length,
+                                                  &p->program_e_machine, &row_number, inode_list, &inode_count, context);
+  if (rval != PGFINDLIB_OK) goto error_return;
+#if (PGFINDLIB_COMMENT_SYSROOT != 0)
+  if ((options != NULL) && (options->sysroot != NULL) && (strlen(options->sysroot) < PGFINDLIB_MAX_PATH_LENGTH))
+  {
+    sprintf(context->comment, "sysroot %s", options->sysroot);
+    rval= pgfindlib_comment_is_row(context->comment, PGFINDLIB_COMMENT_SYSROOT,
+                                   buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count);
+    if (rval != PGFINDLIB_OK) goto error_return;
+  }
+#endif
 
 #if (PGFINDLIB_INCLUDE_ROW_LIB != 0)
+  if ((option_flags & PGFINDLIB_OPTION_ROW_LIB) != 0)
   {
-    rval= pgfindlib_row_lib(buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count, lib, platform, origin);
-    if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
+    rval= pgfindlib_row_lib(context, buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count, p->lib, p->platform, p->origin);
+    if (rval != PGFINDLIB_OK) goto error_return;
   }
 #endif
 
   /* Put together the list of sources and sonames from the FROM and WHERE of the input. */
-  /* MAX_TOKENS_COUNT is fixed but more than twice the number of official tokeners */
-  struct tokener tokener_list[PGFINDLIB_MAX_TOKENS_COUNT];
+  rval= pgfindlib_tokenize(statement, &p->tokener_list, &p->tokener_max, &row_number, inode_list, &inode_count, buffer, &buffer_length, buffer_max_length);
+  if (rval != PGFINDLIB_OK) goto error_return;
+  /* Copy the names so that each ends with \0 and doesn't depend on statement, then execute can use them as they are */
   {
-    rval= pgfindlib_tokenize(statement, tokener_list, &row_number, inode_list, &inode_count, buffer, &buffer_length, buffer_max_length);
-    if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
+    unsigned int names_length= 0;
+    unsigned int tokener_number;
+    for (tokener_number= 0; p->tokener_list[tokener_number].tokener_comment_id != PGFINDLIB_TOKEN_END; ++tokener_number)
+      names_length+= p->tokener_list[tokener_number].tokener_length + 1;
+    p->names= (char *)malloc(names_length + 1);
+    if (p->names == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto error_return; }
+    char *name= p->names;
+    for (tokener_number= 0; p->tokener_list[tokener_number].tokener_comment_id != PGFINDLIB_TOKEN_END; ++tokener_number)
+    {
+      unsigned int name_length= p->tokener_list[tokener_number].tokener_length;
+      memcpy(name, p->tokener_list[tokener_number].tokener_name, name_length);
+      name[name_length]= '\0';
+      p->tokener_list[tokener_number].tokener_name= name;
+      name+= name_length + 1;
+    }
   }
-  unsigned int rpath_or_runpath_count= 0;
-  for (int i= 0; tokener_list[i].tokener_comment_id != PGFINDLIB_TOKEN_END; ++i)
+  /* Compile the WHERE items once, the matcher is used for every directory entry and every ld.so.cache line */
+  rval= pgfindlib_matcher_init(&p->matcher, p->tokener_list);
+  if (rval != PGFINDLIB_OK) goto error_return;
+  for (int i= 0; p->tokener_list[i].tokener_comment_id != PGFINDLIB_TOKEN_END; ++i)
   {
-    if ((tokener_list[i].tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_DT_RPATH)
-     || (tokener_list[i].tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_DT_RUNPATH))
-      ++rpath_or_runpath_count;
+    if ((p->tokener_list[i].tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_DT_RPATH)
+     || (p->tokener_list[i].tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_DT_RUNPATH))
+      ++p->rpath_or_runpath_count;
+    if (p->tokener_list[i].tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_LOADED) ++p->loaded_source_count;
+    if (p->tokener_list[i].tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE) ++p->so_cache_source_count;
   }
 
-  pgfindlib_read_elf(tokener_list, "/tmp/pgfindlib_tests/test", 2, 1); 
-  /* pgfindlib_read_elf(tokener_list, "/home/pgulutzan/pgfindlib/main", 1, 1); */
-  /* pgfindlib_read_elf(tokener_list, "/lib32/libnsl.so.1", 1, 1); */
-  
 /* Preparation if DT_RPATH or DT_RUNPATH */
 #if (PGFINDLIB_TOKEN_SOURCE_DT_RPATH_OR_DT_RUNPATH != 0)
-  const ElfW(Dyn) *dynamic= _DYNAMIC;
-  const ElfW(Dyn) *dt_rpath= NULL;
-  const ElfW(Dyn) *dt_runpath= NULL;
-  const char *dt_strtab= NULL;
-  if (rpath_or_runpath_count > 0)
+  if (p->rpath_or_runpath_count > 0)
   {
     /* in theory "extern __attribute__((weak)) ... _DYNAMIC[];" could result in _DYNAMIC == NULL */
     if (_DYNAMIC == NULL)
@@ -201,11 +909,15 @@ int pgfindlib(const char *statement, char *buffer, unsigned int buffer_max_lengt
       rval= pgfindlib_comment_is_row("Cannot read DT_RPATH because _DYNAMIC is NULL",
                                      PGFINDLIB_COMMENT_CANNOT_READ_RPATH,
                                      buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count);
-      if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
+      if (rval != PGFINDLIB_OK) goto error_return;
 #endif
     }
     else /* _DYNAMIC != NULL */
     {
+      const ElfW(Dyn) *dynamic= _DYNAMIC;
+      const ElfW(Dyn) *dt_rpath= NULL;
+      const ElfW(Dyn) *dt_runpath= NULL;
+      const char *dt_strtab= NULL;
       while (dynamic->d_tag != DT_NULL)
       {
         if (dynamic->d_tag == DT_RPATH) dt_rpath= dynamic;
@@ -213,11 +925,103 @@ int pgfindlib(const char *statement, char *buffer, unsigned int buffer_max_lengt
         if (dynamic->d_tag == DT_STRTAB) dt_strtab= (const char *)dynamic->d_un.d_val;
         ++dynamic;
       }
+      if ((dt_strtab != NULL) && (dt_rpath != NULL)) p->rpath= dt_strtab + dt_rpath->d_un.d_val;
+      if ((dt_strtab != NULL) && (dt_runpath != NULL)) p->runpath= dt_strtab + dt_runpath->d_un.d_val;
     }
   }
-  /* So now we have dt_rpath and dt_runpath */
+  /* So now we have rpath and runpath */
+#endif
+
+  p->rows= (char *)malloc(buffer_length + 1);
+  p->inode_list= (ino_t *)malloc((inode_count + 1) * sizeof(ino_t));
+  if ((p->rows == NULL) || (p->inode_list == NULL)) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto error_return; }
+  memcpy(p->rows, buffer, buffer_length);
+  p->rows[buffer_length]= '\0';
+  p->rows_length= buffer_length;
+  p->row_number= row_number;
+  memcpy(p->inode_list, inode_list, inode_count * sizeof(ino_t));
+  p->inode_count= inode_count;
+  return PGFINDLIB_OK;
+error_return:
+  pgfindlib_prepared_free(p);
+  *prepared= NULL;
+  return rval;
+}
+
+/* Search the sources and make the rows, starting with the rows that pgfindlib_prepare() made */
+static int pgfindlib_execute_in_context(struct pgfindlib_prepared *prepared, char *buffer, unsigned int buffer_max_length,
+                                        struct pgfindlib_context *context)
+{
+  int rval= PGFINDLIB_OK;
+  if (prepared->rows_length >= buffer_max_length) return PGFINDLIB_ERROR_BUFFER_MAX_LENGTH_TOO_SMALL;
+  memcpy(buffer, prepared->rows, prepared->rows_length + 1);
+  unsigned int buffer_length= prepared->rows_length;
+  unsigned int row_number= prepared->row_number;
+  unsigned int option_flags= context->option_flags;
+  ino_t *inode_list= context->inode_list; /* todo: disable if duplicate checking is off */
+  memcpy(inode_list, prepared->inode_list, prepared->inode_count * sizeof(ino_t));
+  unsigned int inode_count= prepared->inode_count;
+  unsigned int inode_warning_count= 0;
+  int program_e_machine= prepared->program_e_machine;
+  const char *lib= prepared->lib;
+  const char *platform= prepared->platform;
+  const char *origin= prepared->origin;
+  struct tokener *tokener_list= prepared->tokener_list;
+  struct pgfindlib_where_matcher *matcher= &prepared->matcher;
+
+  char *malloc_buffer_1= NULL;
+  struct pgfindlib_candidate *malloc_buffer_2= NULL;
+  struct pgfindlib_symlink_memo symlink_memo;
+  memset(&symlink_memo, 0, sizeof(symlink_memo));
+
+  rval= pgfindlib_symlink_memo_init(&symlink_memo);
+  if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
+  symlink_memo.sysroot_fd= context->sysroot_fd;
+  symlink_memo.backend= context->backend;
+  context->is_d_ino_comparable= ((prepared->loaded_source_count == 0) && (prepared->so_cache_source_count == 0));
+  /* Before any row is made, because every row can say "already mapped", including LD_PRELOAD rows made during phase 1 */
+  if ((prepared->loaded_source_count > 0) && (context->sysroot_fd < 0)) /* this process's objects aren't in a sysroot */
+  {
+    rval= pgfindlib_loaded_init(context);
+    if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
+  }
+#if (PGFINDLIB_INCLUDE_AUDIT_LOG != 0)
+  if (context->audit_log != NULL)
+  {
+    rval= pgfindlib_audit_log_read(context);
+    if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
+  }
+#endif
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+  if (context->snapshot_path != NULL)
+  {
+    rval= pgfindlib_snapshot_open(context, prepared);
+    if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
+  }
+#endif
+
+  /* The reports after the rows, and the snapshot, need every source's candidates at once, so then there's no streaming */
+  int is_streamed= ((option_flags & PGFINDLIB_OPTION_STREAM) != 0);
+#if (PGFINDLIB_INCLUDE_PROBE_COST != 0)
+  if (((option_flags & (PGFINDLIB_OPTION_PROBE_COST | PGFINDLIB_OPTION_OPTIMIZE_PATHS)) != 0) || (context->link_farm != NULL)) is_streamed= 0;
 #endif
+#if (PGFINDLIB_INCLUDE_ARCHITECTURES != 0)
+  if (context->architectures_count > 0) is_streamed= 0;
+#endif
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+  if (context->snapshot != NULL) is_streamed= 0;
+#endif
+  unsigned int token_number_of_last_source= 0; /* for PGFINDLIB_INCLUDE_ROW_SOURCE_NAME */
+  /* Where phase 1 starts again after a malloc buffer overflow: the first source, or if streamed the source that overflowed */
+  unsigned int first_tokener_number= 0;
+  unsigned int restart_buffer_length= buffer_length;
+  unsigned int restart_row_number= row_number;
+  unsigned int restart_inode_count= inode_count;
 
+  if ((option_flags & PGFINDLIB_OPTION_ELF) != 0) pgfindlib_read_elf(tokener_list, "/tmp/pgfindlib_tests/test", 2, 1, NULL, NULL, NULL, NULL);
+  /* pgfindlib_read_elf(tokener_list, "/home/pgulutzan/pgfindlib/main", 1, 1); */
+  /* pgfindlib_read_elf(tokener_list, "/lib32/libnsl.so.1", 1, 1); */
+  
   /* Go through the list of sources and add to the lists: source# length pointer-to-path */
 
   unsigned int malloc_buffer_1_length; unsigned int malloc_buffer_1_max_length;
@@ -227,30 +1031,39 @@ int pgfindlib(const char *statement, char *buffer, unsigned int buffer_max_lengt
   malloc_buffer_2_max_length= 100;
 
 repeat_malloc:
+  buffer_length= restart_buffer_length; /* rows that phase 1 made before the overflow would be made again */
+  buffer[buffer_length]= '\0';
+  row_number= restart_row_number;
+  inode_count= restart_inode_count;
   malloc_buffer_1_length= 0;
   malloc_buffer_1= (char *)malloc(malloc_buffer_1_max_length);
   if (malloc_buffer_1 == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; PGFINDLIB_FREE_AND_RETURN }
   malloc_buffer_2_length= 0;
-  malloc_buffer_2= (char **)malloc(malloc_buffer_2_max_length * sizeof(char *));
+  malloc_buffer_2= (struct pgfindlib_candidate *)malloc(malloc_buffer_2_max_length * sizeof(struct pgfindlib_candidate));
   if (malloc_buffer_2 == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW; PGFINDLIB_FREE_AND_RETURN }
+  context->scanned_count= 0; /* they pointed into the old malloc_buffer_2 */
+  pgfindlib_candidates_reset(context);
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+  if (context->snapshot != NULL) { context->snapshot->is_cache_recorded= 0; context->snapshot->is_cache_statted= 0; }
+#endif
 
-  for (unsigned int tokener_number= 0; ; ++tokener_number) /* for each source in source name list */
+  for (unsigned int tokener_number= first_tokener_number; ; ++tokener_number) /* for each source in source name list */
   {
     int comment_number;
     comment_number= tokener_list[tokener_number].tokener_comment_id;
     if (comment_number == PGFINDLIB_TOKEN_END) break;
-    if ((comment_number < PGFINDLIB_TOKEN_SOURCE_LD_AUDIT) || (comment_number > PGFINDLIB_TOKEN_SOURCE_NONSTANDARD)) continue;
-    char tmp_source_name[PGFINDLIB_MAX_TOKEN_LENGTH + 1]= ""; /* only needed momentarily for nonstandard sources */
+    if (!PGFINDLIB_TOKEN_IS_SOURCE(comment_number)) continue;
+    if (pgfindlib_is_cancelled(context)) { rval= PGFINDLIB_ERROR_CANCELLED; PGFINDLIB_FREE_AND_RETURN }
     const char *ld= NULL;
     if (comment_number == PGFINDLIB_TOKEN_SOURCE_DT_RPATH)
     {
-      if ((dt_strtab == NULL) || (dt_rpath == NULL)) continue;
-      ld= dt_strtab + dt_rpath->d_un.d_val;
+      if (prepared->rpath == NULL) continue;
+      ld= prepared->rpath;
     }
     else if (comment_number == PGFINDLIB_TOKEN_SOURCE_DT_RUNPATH)
     {
-      if ((dt_strtab == NULL) || (dt_runpath == NULL)) continue;
-      ld= dt_strtab + dt_runpath->d_un.d_val;
+      if (prepared->runpath == NULL) continue;
+      ld= prepared->runpath;
     }
     else if (comment_number == PGFINDLIB_TOKEN_SOURCE_DEFAULT_PATHS)
     {
@@ -258,25 +1071,47 @@ repeat_malloc:
     }
     else if (comment_number == PGFINDLIB_TOKEN_SOURCE_NONSTANDARD)
     {
-      int tmp_source_name_length= tokener_list[tokener_number].tokener_length;
-      memcpy(tmp_source_name, tokener_list[tokener_number].tokener_name, tmp_source_name_length);
-      tmp_source_name[tmp_source_name_length]= '\0';
-      ld= tmp_source_name;
+      ld= tokener_list[tokener_number].tokener_name; /* pgfindlib_prepare() made it end with \0 */
     }
-    else if (comment_number != PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE)
+    else if ((comment_number != PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE) && (comment_number != PGFINDLIB_TOKEN_SOURCE_LOADED))
     {
-      /* Not DT_RPATH | DT_RUNPATH | default_paths | nonstandard | ld_so_cache */
+      /* Not DT_RPATH | DT_RUNPATH | default_paths | nonstandard | ld_so_cache | loaded */
       /* So it must be LD_AUDIT | LD_PRELOAD | LD_LIBRARY_PATH | LD_RUN_PATH LD_PGFINDLIB_PATH */
-      int tmp_source_name_length= tokener_list[tokener_number].tokener_length;
-      memcpy(tmp_source_name, tokener_list[tokener_number].tokener_name, tmp_source_name_length);
-      tmp_source_name[tmp_source_name_length]= '\0';
-      ld= getenv(tmp_source_name);
+      ld= pgfindlib_getenv(context, tokener_list[tokener_number].tokener_name);
     }
     if (comment_number == PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE)
     {
-      rval= pgfindlib_so_cache(tokener_list, tokener_number,
-                               malloc_buffer_1, &malloc_buffer_1_length, malloc_buffer_1_max_length,
-                               malloc_buffer_2, &malloc_buffer_2_length, malloc_buffer_2_max_length);
+      int is_reused= 0;
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+      unsigned int so_cache_first= malloc_buffer_2_length;
+      if (context->snapshot != NULL)
+        rval= pgfindlib_snapshot_so_cache(context, tokener_number,
+                                          malloc_buffer_1, &malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                          malloc_buffer_2, &malloc_buffer_2_length, malloc_buffer_2_max_length, &is_reused);
+#endif
+      if ((rval == PGFINDLIB_OK) && (is_reused == 0))
+      {
+#if (PGFINDLIB_SYSROOT != 0)
+        if (context->sysroot_fd >= 0)
+          rval= pgfindlib_so_cache_sysroot(context, matcher, tokener_number,
+                                           malloc_buffer_1, &malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                           malloc_buffer_2, &malloc_buffer_2_length, malloc_buffer_2_max_length);
+        else
+#endif
+        rval= pgfindlib_so_cache(context, matcher, tokener_number,
+                                 malloc_buffer_1, &malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                 malloc_buffer_2, &malloc_buffer_2_length, malloc_buffer_2_max_length);
+      }
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+      if ((rval == PGFINDLIB_OK) && (context->snapshot != NULL))
+        pgfindlib_snapshot_so_cache_candidates(context->snapshot, so_cache_first, malloc_buffer_2_length);
+#endif
+    }
+    else if (comment_number == PGFINDLIB_TOKEN_SOURCE_LOADED)
+    {
+      rval= pgfindlib_loaded_source(context, matcher, tokener_number,
+                                    malloc_buffer_1, &malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                    malloc_buffer_2, &malloc_buffer_2_length, malloc_buffer_2_max_length);
     }
     else
     {
@@ -284,10 +1119,10 @@ repeat_malloc:
                                  buffer_max_length, lib, platform, origin,
                                  &row_number,
                                  inode_list, &inode_count, &inode_warning_count,
-                                 tokener_list,
+                                 tokener_list, matcher,
                                  malloc_buffer_1, &malloc_buffer_1_length, malloc_buffer_1_max_length,
                                  malloc_buffer_2, &malloc_buffer_2_length, malloc_buffer_2_max_length,
-                                 program_e_machine);
+                                 program_e_machine, &symlink_memo, context);
     }
 
     if (rval == PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW)
@@ -295,6 +1130,7 @@ repeat_malloc:
       free(malloc_buffer_1); malloc_buffer_1= NULL;
       free(malloc_buffer_2); malloc_buffer_2= NULL;
       malloc_buffer_1_max_length+= 1000;
+      if (is_streamed) first_tokener_number= tokener_number;
       goto repeat_malloc;
     }
     if (rval == PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW)
@@ -302,39 +1138,70 @@ repeat_malloc:
       free(malloc_buffer_1); malloc_buffer_1= NULL;
       free(malloc_buffer_2); malloc_buffer_2= NULL;
       malloc_buffer_2_max_length+= 1000;
+      if (is_streamed) first_tokener_number= tokener_number;
       goto repeat_malloc;
     }
 
     if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
 
+    /*
+      PGFINDLIB_OPTION_STREAM: this source's candidates are sorted and made into rows now, since the sort key starts
+      with the source number. Then the malloc buffers are emptied, so they only need room for the biggest source.
+      A directory that an earlier source read is read again, its candidates were in the emptied buffers.
+    */
+    if (is_streamed)
+    {
+      pgfindlib_sort_candidates(malloc_buffer_1, context->candidate_directories, malloc_buffer_2, malloc_buffer_2_length);
+      rval= pgfindlib_candidate_rows(context, buffer, &buffer_length, buffer_max_length, &row_number,
+                                     inode_list, &inode_count, &inode_warning_count, tokener_list, program_e_machine, &symlink_memo,
+                                     malloc_buffer_1, malloc_buffer_2, malloc_buffer_2_length, &token_number_of_last_source);
+#if (PGFINDLIB_INCLUDE_DEADLINE != 0) && (PGFINDLIB_COMMENT_DIRECTORY_SKIPPED != 0)
+      if (rval == PGFINDLIB_OK)
+        rval= pgfindlib_rows_skipped(context, buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count, tokener_list);
+#endif
+      if (rval == PGFINDLIB_OK) rval= pgfindlib_rows_ready(context, buffer, &buffer_length);
+      if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
+      malloc_buffer_1_length= 0;
+      malloc_buffer_2_length= 0;
+      context->scanned_count= 0;
+      pgfindlib_candidates_reset(context);
+      restart_buffer_length= buffer_length;
+      restart_row_number= row_number;
+      restart_inode_count= inode_count;
+    }
+  }
+#if (PGFINDLIB_INCLUDE_DEADLINE != 0) && (PGFINDLIB_COMMENT_DIRECTORY_SKIPPED != 0)
+  rval= pgfindlib_rows_skipped(context, buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count, tokener_list);
+  if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
+#endif
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+  if (context->snapshot != NULL)
+  {
+    rval= pgfindlib_snapshot_write_listings(context, malloc_buffer_1, malloc_buffer_2);
+    if (rval != PGFINDLIB_OK) PGFINDLIB_FREE_AND_RETURN
   }
+#endif
 
-  qsort(malloc_buffer_2, malloc_buffer_2_length, sizeof(char *), pgfindlib_qsort_compare);
+  pgfindlib_sort_candidates(malloc_buffer_1, context->candidate_directories, malloc_buffer_2, malloc_buffer_2_length);
 
   /*
     Phase 1 complete. At this point, we seem to have a sorted list of all the paths.
     In Phase 2, we must dump the paths into the output buffer along with the warnings.
     todo: malloc an inode_list about equal to malloc_buffer_2 i.e. # of rows (but more needed for comments I guess)
           the problem is that even comments look at node, and they could come before this
-    todo: with a large number of sources, > 127 - 32, and signed char, the sort order might become wrong
   */
-  rval= PGFINDLIB_OK;
+  rval= pgfindlib_candidate_rows(context, buffer, &buffer_length, buffer_max_length, &row_number,
+                                 inode_list, &inode_count, &inode_warning_count, tokener_list, program_e_machine, &symlink_memo,
+                                 malloc_buffer_1, malloc_buffer_2, malloc_buffer_2_length, &token_number_of_last_source);
 #if (PGFINDLIB_INCLUDE_ROW_SOURCE_NAME == 1)
-  int token_number_of_last_source= 0;
-#endif
-  for (unsigned int i= 0; i < malloc_buffer_2_length; ++i)
+  if (rval == PGFINDLIB_OK)
   {
-    const char *item= malloc_buffer_2[i];
-    /* First char is source number + 32 */
-    int token_number_of_source= *item - 32;
-#if (PGFINDLIB_INCLUDE_ROW_SOURCE_NAME == 1)
+    /* todo: repetitious */
     for (unsigned int j= token_number_of_last_source;; ++j)
     {
       unsigned short int type= tokener_list[j].tokener_comment_id;
       if (type == PGFINDLIB_TOKEN_END) break;
-      if ((type < PGFINDLIB_TOKEN_SOURCE_LD_AUDIT) || (type > PGFINDLIB_TOKEN_SOURCE_NONSTANDARD)) continue;
-      if (j > token_number_of_source) break;
-      if ((j > token_number_of_last_source) && (j <= token_number_of_source))
+      if (!PGFINDLIB_TOKEN_IS_SOURCE(type)) continue;
       {
         char source_name[64];
         unsigned short int len= tokener_list[j].tokener_length;
@@ -346,42 +1213,113 @@ repeat_malloc:
         if (rval != PGFINDLIB_OK) break;
       }
     }
-    if (rval != PGFINDLIB_OK) break;
-    token_number_of_last_source= token_number_of_source + 1;
+  }
 #endif
-    rval= pgfindlib_file(buffer, &buffer_length, item + 1, buffer_max_length, &row_number,
-                       inode_list, &inode_count, &inode_warning_count, tokener_list[token_number_of_source], program_e_machine);
-    if (rval != PGFINDLIB_OK) break;
+#if (PGFINDLIB_INCLUDE_PROBE_COST != 0)
+  if ((rval == PGFINDLIB_OK) && (((option_flags & (PGFINDLIB_OPTION_PROBE_COST | PGFINDLIB_OPTION_OPTIMIZE_PATHS)) != 0) || (context->link_farm != NULL)))
+  {
+    rval= pgfindlib_probe_cost(context, buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count,
+                               tokener_list, malloc_buffer_1, malloc_buffer_2, malloc_buffer_2_length, lib, platform, origin,
+                               prepared->rpath, prepared->runpath);
   }
-#if (PGFINDLIB_INCLUDE_ROW_SOURCE_NAME == 1)
-  if (rval == PGFINDLIB_OK)
+#endif
+#if (PGFINDLIB_INCLUDE_ARCHITECTURES != 0)
+  if ((rval == PGFINDLIB_OK) && (context->architectures_count > 0))
   {
-    /* todo: repetitious */
-    for (unsigned int j= token_number_of_last_source;; ++j)
+    rval= pgfindlib_architecture_views(context, buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count,
+                                       tokener_list, malloc_buffer_1, malloc_buffer_2, malloc_buffer_2_length, lib, platform, origin,
+                                       prepared->rpath, prepared->runpath);
+  }
+#endif
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+  if ((rval == PGFINDLIB_OK) && (context->snapshot != NULL))
+  {
+    rval= pgfindlib_snapshot_close(context->snapshot, buffer);
+    if ((rval == PGFINDLIB_OK) && ((option_flags & PGFINDLIB_OPTION_DELTA) != 0))
+      rval= pgfindlib_snapshot_delta(context->snapshot, buffer, &buffer_length, buffer_max_length);
+    if (rval == PGFINDLIB_OK) rval= pgfindlib_snapshot_commit(context->snapshot);
+  }
+#endif
+  if (rval == PGFINDLIB_OK) rval= pgfindlib_rows_ready(context, buffer, &buffer_length);
+/* free_and_return: */
+  if (malloc_buffer_1 != NULL) { free(malloc_buffer_1); }
+  if (malloc_buffer_2 != NULL) { free(malloc_buffer_2); }
+  pgfindlib_symlink_memo_free(&symlink_memo);
+  return rval;
+}
+
+/*
+  Phase 2: make the rows for candidates[0 .. candidates_count-1], which are sorted.
+  With PGFINDLIB_INCLUDE_ROW_SOURCE_NAME, sources before *token_number_of_last_source have their name row already.
+*/
+int pgfindlib_candidate_rows(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                             unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count, unsigned int *inode_warning_count,
+                             struct tokener tokener_list[], int program_e_machine, struct pgfindlib_symlink_memo *memo,
+                             const char *malloc_buffer_1, const struct pgfindlib_candidate *candidates, unsigned int candidates_count,
+                             unsigned int *token_number_of_last_source)
+{
+  int rval= PGFINDLIB_OK;
+#if (PGFINDLIB_INCLUDE_ROW_SOURCE_NAME != 1)
+  (void) token_number_of_last_source;
+#endif
+  for (unsigned int i= 0; i < candidates_count; ++i)
+  {
+    if (pgfindlib_is_cancelled(context)) { rval= PGFINDLIB_ERROR_CANCELLED; break; }
+    char *item= context->candidate_path;
+    rval= pgfindlib_candidate_path(context, malloc_buffer_1, &candidates[i], item, sizeof(context->line_copy)); /* pgfindlib_file() copies it there */
+    if (rval != PGFINDLIB_OK) break;
+    unsigned int token_number_of_source= candidates[i].source_number;
+#if (PGFINDLIB_INCLUDE_ROW_SOURCE_NAME == 1)
+    for (unsigned int j= *token_number_of_last_source;; ++j)
     {
       unsigned short int type= tokener_list[j].tokener_comment_id;
       if (type == PGFINDLIB_TOKEN_END) break;
-      if ((type < PGFINDLIB_TOKEN_SOURCE_LD_AUDIT) || (type > PGFINDLIB_TOKEN_SOURCE_NONSTANDARD)) continue;
+      if (!PGFINDLIB_TOKEN_IS_SOURCE(type)) continue;
+      if (j > token_number_of_source) break;
+      if ((j > *token_number_of_last_source) && (j <= token_number_of_source))
       {
         char source_name[64];
         unsigned short int len= tokener_list[j].tokener_length;
         if (len > 64 - 1) len= 64 - 1;
         memcpy(source_name, tokener_list[j].tokener_name, len);
         source_name[len]= '\0';
-        rval= pgfindlib_row_source_name(buffer, &buffer_length, buffer_max_length, &row_number,
-                             inode_list, &inode_count, source_name);
+        rval= pgfindlib_row_source_name(buffer, buffer_length, buffer_max_length, row_number,
+                             inode_list, inode_count, source_name);
         if (rval != PGFINDLIB_OK) break;
       }
     }
-  }
+    if (rval != PGFINDLIB_OK) break;
+    *token_number_of_last_source= token_number_of_source + 1;
 #endif
-/* free_and_return: */
-  if (malloc_buffer_1 != NULL) { free(malloc_buffer_1); }
-  if (malloc_buffer_2 != NULL) { free(malloc_buffer_2); }
-  
+    const struct pgfindlib_file_facts *known= NULL;
+    struct pgfindlib_file_facts *learned= NULL;
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+    if (context->snapshot != NULL) pgfindlib_snapshot_facts(context, malloc_buffer_1, candidates[i].directory_number, item, &known, &learned);
+#endif
+    rval= pgfindlib_file(buffer, buffer_length, item, buffer_max_length, row_number,
+                       inode_list, inode_count, inode_warning_count, tokener_list[token_number_of_source], program_e_machine,
+                       candidates[i].d_ino, candidates[i].d_type, memo, context, known, learned);
+    if (rval != PGFINDLIB_OK) break;
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+    if (learned != NULL) pgfindlib_snapshot_write_facts(context->snapshot, learned);
+#endif
+  }
   return rval;
 }
 
+/*
+  options->rows_ready: pass the rows in buffer, then empty it, so buffer only needs room for the rows made since the last call.
+  It's called for each source with PGFINDLIB_OPTION_STREAM, and at the end. A non-zero return stops the search.
+*/
+int pgfindlib_rows_ready(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length)
+{
+  if ((context->rows_ready == NULL) || (*buffer_length == 0)) return PGFINDLIB_OK;
+  int is_stopped= (context->rows_ready(context->rows_ready_state, buffer, *buffer_length) != 0);
+  *buffer_length= 0;
+  buffer[0]= '\0';
+  return (is_stopped) ? PGFINDLIB_ERROR_CANCELLED : PGFINDLIB_OK;
+}
+
 int pgfindlib_strcat(char *buffer, unsigned int *buffer_length, const char *line, unsigned int buffer_max_length)
 {
   unsigned int line_length= strlen(line);
@@ -396,939 +1334,7067 @@ int pgfindlib_strcat(char *buffer, unsigned int *buffer_length, const char *line
 }
 
 /*
-  Compare line to each of the items in statement. If match for number-of-characters-in-soname: 1 true. Else: 0 false.
-  Assume that line cannot contain ':' and ':' within statement is a delimiter. (Actually so is ',' the way tokenize works.)
-  Ignore lead or trail spaces.
-  Treat \n as end of line and ignore it.
-  We have already checked that strlen(each soname) is <= PGFINDLIB_MAX_PATH_LENGTH.
-  Beware: ldconfig -p lines start with a control character (tab?).
+  Allocate the context for one call and take a snapshot of the environment,
+  from options->envp if it's not NULL, else from environ.
+  After this nothing in the call looks at environ or getenv(), so a caller whose other threads might
+  call setenv() should pass its own envp.
 */
-int pgfindlib_find_line_in_statement(const struct tokener tokener_list[], const char *line)
+int pgfindlib_context_init(struct pgfindlib_context **context, const struct pgfindlib_options *options)
 {
-  const char *pointer_to_line= line;
-  while (*pointer_to_line <= ' ') ++pointer_to_line; /* skip lead spaces (or control characters!) in line */
-  unsigned int line_length= strlen(pointer_to_line);
-  if ((line_length > 1) && (pointer_to_line[line_length - 1] == '\n')) --line_length; /* skip trail \n */
-  while ((line_length > 0) && (pointer_to_line[line_length - 1] == ' ')) --line_length; /* skip trail spaces */
-  if (line_length == 0) return 0; /* false */
-  for (unsigned int tokener_number= 0; ; ++tokener_number) /* for each source in source name list */
+  struct pgfindlib_context *c= (struct pgfindlib_context *)malloc(sizeof(struct pgfindlib_context));
+  *context= c;
+  if (c == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  c->envp= NULL;
+  c->envp_block= NULL;
+  c->sysroot_fd= -1;
+  c->elf_verdicts= NULL;
+  c->elf_scratch= NULL;
+  c->loaded= NULL;
+  c->loaded_count= 0;
+  c->loaded_max= 0;
+  c->is_d_ino_comparable= 0;
+  c->backend= &pgfindlib_backend_posix;
+  c->cancelled= NULL;
+  c->sysroot= NULL;
+  c->deadline_ns= 0;
+  c->directory_budget_ns= 0;
+  c->mounts= NULL; c->mounts_count= 0; c->is_mounts_read= 0;
+  c->skipped= NULL; c->skipped_count= 0; c->skipped_max= 0; c->skipped_reported_count= 0;
+  c->architectures= NULL;
+  c->architectures_count= 0;
+  c->scanned= NULL;
+  c->scanned_count= 0;
+  c->scanned_max= 0;
+  c->candidate_directories= NULL;
+  c->candidate_directories_max= 0;
+  pgfindlib_candidates_reset(c);
+  c->snapshot_path= NULL;
+  c->snapshot= NULL;
+  c->link_farm= NULL;
+  c->audit_log= NULL;
+  c->rows_ready= NULL;
+  c->rows_ready_state= NULL;
+  c->audited= NULL; c->audited_count= 0; c->audited_paths= NULL;
+  c->option_flags= PGFINDLIB_OPTIONS_DEFAULT;
+  char *const *envp= environ;
+  if (options != NULL)
   {
-    int comment_number;
-    comment_number= tokener_list[tokener_number].tokener_comment_id;
-    if (comment_number == PGFINDLIB_TOKEN_END) break;
-    if (comment_number != PGFINDLIB_TOKEN_FILE) continue;
-    const char *pointer_to_statement= tokener_list[tokener_number].tokener_name;
-    unsigned soname_length= tokener_list[tokener_number].tokener_length;
-    if (memcmp(pointer_to_line, pointer_to_statement, soname_length) == 0)
+    c->option_flags= options->flags;
+    if (options->envp != NULL) envp= options->envp;
+    c->architectures= options->architectures;
+    c->architectures_count= (options->architectures != NULL) ? options->architectures_count : 0;
+#if (PGFINDLIB_INCLUDE_DEADLINE != 0)
+    if (options->deadline_milliseconds > 0) c->deadline_ns= pgfindlib_now_ns() + options->deadline_milliseconds * 1000000LL;
+    c->directory_budget_ns= options->directory_budget_milliseconds * 1000000LL;
+#endif
+    c->sysroot= options->sysroot;
+    c->snapshot_path= options->snapshot_path;
+    c->link_farm= options->link_farm;
+    c->audit_log= options->audit_log;
+    c->rows_ready= options->rows_ready;
+    c->rows_ready_state= options->rows_ready_state;
+    if (options->backend != NULL) c->backend= options->backend;
+    if (options->sysroot != NULL)
     {
-      return 1; /* true */
+      if (c->backend != &pgfindlib_backend_posix) return PGFINDLIB_ERROR_SYSROOT; /* another backend has its own root */
+#if (PGFINDLIB_SYSROOT != 0)
+      c->sysroot_fd= open(options->sysroot, O_PATH | O_DIRECTORY | O_CLOEXEC);
+      if (c->sysroot_fd == -1) return PGFINDLIB_ERROR_SYSROOT;
+      int fd= pgfindlib_open(&pgfindlib_backend_posix, c->sysroot_fd, "/", O_PATH | O_DIRECTORY); /* fails if the kernel is older than 5.6 */
+      if (fd == -1) return PGFINDLIB_ERROR_SYSROOT;
+      close(fd);
+#else
+      return PGFINDLIB_ERROR_SYSROOT;
+#endif
     }
   }
-  return 0; /* false (though actually we shouldn't get this far) */
-}
-
-/*
-  Pass: library or file name
-  Do: replace with same library or file name, except that $ORIGIN or $LIB or $PLATFORM is replaced
-  Return: rval
-  Todo: It seems loader replaces $LIB or $LIB/ but not $LIB in $LIBxxx, this replaces $LIB in $LIBxxx too.
-  Todo: https://bugs.freebsd.org/bugzilla/show_bug.cgi?id=187114 suggests no need to check DF_ORIGIN flag nowadays
-        but that hasn't been tested
-*/
-int pgfindlib_replace_lib_or_platform_or_origin(char *one_library_or_file, unsigned int *replacements_count, const char *lib, const char *platform, const char *origin)
-{
-  *replacements_count= 0;
-  if (strchr(one_library_or_file, '$') == NULL) return PGFINDLIB_OK;
-  char buffer_for_output[PGFINDLIB_MAX_PATH_LENGTH*2 + 1];
-  char *p_line_out= &buffer_for_output[0];
-  *p_line_out= '\0';
-  for (const char *p_line_in= one_library_or_file; *p_line_in != '\0';)
+#if (PGFINDLIB_INCLUDE_BUILD_ID != 0)
+  if ((c->option_flags & PGFINDLIB_OPTION_BUILD_ID) != 0)
   {
-    if ((strncmp(p_line_in, "$ORIGIN", 7) == 0) || (strncmp(p_line_in, "${ORIGIN}", 9) == 0))
-    {
-      strcpy(p_line_out, origin);
-      p_line_out+= strlen(origin);
-      if (*(p_line_in + 1) == '{') p_line_in+= 9 - 7;
-      p_line_in+= 7;
-      ++*replacements_count;
-    }
-    else if ((strncmp(p_line_in, "$LIB", 4) == 0) || (strncmp(p_line_in, "${LIB}", 6) == 0))
-    {
-      strcpy(p_line_out, lib);
-      p_line_out+= strlen(lib);
-      if (*(p_line_in + 1) == '{') p_line_in+= 6 - 4;
-      p_line_in+= 4;
-      ++*replacements_count;
-    }
-    else if ((strncmp(p_line_in, "$PLATFORM", 9) == 0) || (strncmp(p_line_in, "${PLATFORM}", 11) == 0))
-    {
-      strcpy(p_line_out, platform);
-      p_line_out+= strlen(platform);
-      if (*(p_line_in + 1) == '{') p_line_in+= 11 - 9;
-      p_line_in+= 9;
-      ++*replacements_count;
-    }
-    else
-    {
-      *p_line_out= *p_line_in;
-      ++p_line_out;
-      ++p_line_in;
-    }
-    if ((p_line_out - &buffer_for_output[0]) > PGFINDLIB_MAX_PATH_LENGTH)
-      return PGFINDLIB_ERROR_MAX_PATH_LENGTH_TOO_SMALL;
-    *p_line_out= '\0';
+    c->elf_scratch= (unsigned char *)malloc(PGFINDLIB_ELF_SCRATCH_LENGTH);
+    if (c->elf_scratch == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
   }
-  strcpy(one_library_or_file, buffer_for_output);
-  return PGFINDLIB_OK;
-}
-
-/*
-  Return: what would loader change "$LIB" or "$PLATFORM" or "$ORIGIN" to
-  Re method: Use a dummy utility, preferably bin/true, ls should also work but isn't as good
-            (any program anywhere will work provided it requires any .so, and libc.so is such).
-            First attempt: read ELF to get "ELF interpreter" i.e. loader name,
-            which probably is /lib64/ld-linux-x86-64.so.2 or /lib/ld-linux.so.2,
-            then use it with LD_DEBUG to see search_path when executing the dummy utility.
-            If that fails: same idea but just running the dummy.
-            If that fails: (lib) lib64 for 64-bit, lib for 32-bit. (platform) uname -m.
-            FreeBSD is different.
-  Todo: get PT_DYNAMIC the way we get PT_INTERN, instead of depending on extern _DYNAMIC (but this is hard, see read_elf()
-  Todo: If there is a /tls (thread local storage) subdirectory or an x86_64 subdirectory,
-        search all. But show library search path=main, main-tls, main/x86_64
-  Todo: If dynamic loader is not the usual e.g. due to "-Wl,-I/tmp/my_ld.so" then add a comment.
-*/
-int pgfindlib_get_origin_and_lib_and_platform(char *origin, char *lib, char *platform,
-                                              char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
-                                              int *program_e_machine, unsigned int *row_number,
-                                              ino_t inode_list[], unsigned int *inode_count)
-{
-  int platform_change_count= 0;
-  int rval= PGFINDLIB_OK;
-  int lib_change_count= 0;
-
-#ifdef PGFINDLIB_FREEBSD
-  int aux_info_return= elf_aux_info(AT_EXECPATH, origin, PGFINDLIB_MAX_PATH_LENGTH);
-  if (aux_info_return != 0)
-  {
-#if (PGFINDLIB_COMMENT_ELF_AUX_INFO_FAILED != 0)
-    rval= pgfindlib_comment_is_row("elf_aux_info failed so $ORIGIN is unknown",
-                                   PGFINDLIB_COMMENT_ELF_AUX_INFO_FAILED,
-                                   buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-    if (rval != PGFINDLIB_OK) return rval;
 #endif
-    strcpy(origin, "");
-  }
-  strcpy(lib, "lib");
-  /* platform should be set after the if/else/endif */
-#else
+  unsigned int envp_count= 0;
+  size_t envp_bytes= 0;
+  if (envp != NULL)
   {
-    int readlink_return;
-    readlink_return= readlink("/proc/self/exe", origin, PGFINDLIB_MAX_PATH_LENGTH);
-    if ((readlink_return < 0) || (readlink_return >= PGFINDLIB_MAX_PATH_LENGTH))
-    {
-#if (PGFINDLIB_COMMENT_READLINK_FAILED != 0)
-      rval= pgfindlib_comment_is_row("readlink failed so $ORIGIN is unknown",
-                         PGFINDLIB_COMMENT_READLINK_FAILED,
-                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-      if (rval != PGFINDLIB_OK) return rval;
-#endif
-      strcpy(origin, "");
-    }
-    else *(origin + readlink_return)= '\0';
-    for (char *p= origin + strlen(origin); p != origin; --p)
-    {
-      if (*p == '/')
-      {
-        *p= '\0';
-        break;
-      }
-    }
+    for (; envp[envp_count] != NULL; ++envp_count) envp_bytes+= strlen(envp[envp_count]) + 1;
   }
-#endif /* ifdef PGFINDLIB_FREEBSD */
-
-#if (PGFINDLIB_IF_GET_LIB_OR_PLATFORM != 0)
-  /* utility name */
-  /* FreeBSD probably won't have /bin/true, it seems to be a Linux thing, but maybe it will have id */
-  char utility_name[256]= ""; /* todo: change to const char * */
-  if (access("/bin/true", X_OK) == 0) strcpy(utility_name, "/bin/true");
-  else if (access("/bin/cp", X_OK) == 0) strcpy(utility_name, "/bin/cp");
-  else if (access("/usr/bin/true", X_OK) == 0) strcpy(utility_name, "/usr/bin/true");
-  else if (access("/usr/bin/cp", X_OK) == 0) strcpy(utility_name, "/usr/bin/cp");
-  else if (access("/bin/id", X_OK) == 0) strcpy(utility_name, "/bin/id");
-  else if (access("/usr/bin/id", X_OK) == 0) strcpy(utility_name, "/usr/bin/id");
-#if (PGFINDLIB_COMMENT_NO_TRUE_OR_CP != 0)
-  if (strcmp(utility_name, "") == 0)
+  c->envp_block= (char *)malloc((envp_count + 1) * sizeof(char *) + envp_bytes);
+  if (c->envp_block == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  c->envp= (char **)c->envp_block;
+  char *p= c->envp_block + (envp_count + 1) * sizeof(char *);
+  for (unsigned int i= 0; i < envp_count; ++i)
   {
-    rval= pgfindlib_comment_is_row("no access to [/usr]/bin/true or [/usr]/bin/cp or /bin/id",
-                         PGFINDLIB_COMMENT_NO_TRUE_OR_CP,
-                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-    if (rval != PGFINDLIB_OK) return rval;
+    size_t length= strlen(envp[i]) + 1;
+    memcpy(p, envp[i], length);
+    c->envp[i]= p;
+    p+= length;
   }
-#endif
+  c->envp[envp_count]= NULL;
+  c->lib[0]= '\0';
+  c->platform[0]= '\0';
+  c->origin[0]= '\0';
+  return PGFINDLIB_OK;
+}
 
-/* todo: move this up, and if it's zilch then we cannot read elf here */
-/* This was void* but that triggered -Warray-bounds during an rpm build. */
-extern ElfW(Ehdr) __executable_start;
-  ElfW(Ehdr)*ehdr= NULL;
-  ehdr= (ElfW(Ehdr)*) &__executable_start; /* linker e.g. ld.bfd or ld.lld is supposed to add this */
-  if (ehdr != NULL)
-  {
+void pgfindlib_context_free(struct pgfindlib_context *context)
+{
+  if (context == NULL) return;
+  if (context->envp_block != NULL) free(context->envp_block);
+  if (context->elf_scratch != NULL) free(context->elf_scratch);
+  if (context->sysroot_fd >= 0) close(context->sysroot_fd);
+  for (unsigned int i= 0; i < context->loaded_count; ++i) free(context->loaded[i].path);
+  if (context->loaded != NULL) free(context->loaded);
+  if (context->scanned != NULL) free(context->scanned);
+  if (context->candidate_directories != NULL) free(context->candidate_directories);
+  for (unsigned int i= 0; i < context->mounts_count; ++i) free(context->mounts[i].mount_point);
+  if (context->mounts != NULL) free(context->mounts);
+  for (unsigned int i= 0; i < context->skipped_count; ++i) free(context->skipped[i].path);
+  if (context->skipped != NULL) free(context->skipped);
+  if (context->audited != NULL) free(context->audited);
+  if (context->audited_paths != NULL) free(context->audited_paths);
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+  pgfindlib_snapshot_free(context->snapshot);
+#endif
+  free(context);
+}
 
-    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0)
-    {
-#if (PGFINDLIB_COMMENT_EHDR_IDENT != 0)
-      rval= pgfindlib_comment_is_row("ehdr->ident not valid",
-                         PGFINDLIB_COMMENT_EHDR_IDENT,
-                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-      if (rval != PGFINDLIB_OK) return rval;
+/* Whether pgfindlib_async_cancel() was called. Relaxed is enough, it only has to be seen eventually. */
+int pgfindlib_is_cancelled(const struct pgfindlib_context *context)
+{
+#if (PGFINDLIB_INCLUDE_ASYNC != 0)
+  return ((context->cancelled != NULL) && (__atomic_load_n(context->cancelled, __ATOMIC_RELAXED) != 0));
+#else
+  (void) context;
+  return 0;
 #endif
-      ehdr= NULL;
-    }
-  }
+}
 
-  if (ehdr != NULL)
+/* Like getenv() but from the snapshot */
+const char *pgfindlib_getenv(const struct pgfindlib_context *context, const char *name)
+{
+  size_t name_length= strlen(name);
+  for (unsigned int i= 0; context->envp[i] != NULL; ++i)
   {
-    *program_e_machine= ehdr->e_machine;
+    if ((strncmp(context->envp[i], name, name_length) == 0) && (context->envp[i][name_length] == '='))
+      return context->envp[i] + name_length + 1;
   }
-  else *program_e_machine= 0;
-  
-  /* first attempt */
+  return NULL;
+}
 
-  const char *dynamic_loader_name= NULL;
-  if (ehdr != NULL)
+/*
+  Start spawn_argv[0] (a path, there's no search of $PATH) with spawn_argv and with the environment snapshot
+  changed by environment_changes: "NAME=value" replaces or adds, "NAME" without "=" removes.
+  Return a FILE * to read its stdout, and its stderr too if is_stderr_wanted, else stderr is /dev/null.
+  Return NULL if anything fails. Pass the FILE * and *pid to pgfindlib_spawn_close().
+  This replaces popen(), which needs a shell and the process's current environment, and which
+  isn't safe if another thread is changing the environment or also starting processes.
+*/
+FILE *pgfindlib_spawn(const struct pgfindlib_context *context, const char *const spawn_argv[],
+                      const char *const environment_changes[], int is_stderr_wanted, pid_t *pid)
+{
+  unsigned int envp_count= 0;
+  unsigned int changes_count= 0;
+  while (context->envp[envp_count] != NULL) ++envp_count;
+  while (environment_changes[changes_count] != NULL) ++changes_count;
+  char **child_envp= (char **)malloc((envp_count + changes_count + 1) * sizeof(char *));
+  if (child_envp == NULL) return NULL;
+  unsigned int child_envp_count= 0;
+  for (unsigned int i= 0; i < envp_count; ++i)
   {
-    const char *cc= (char *)ehdr; /* offsets are in bytes so I prefer to use a byte pointer */
-    cc+= ehdr->e_phoff; /* -> start of program headers */
-    ElfW(Phdr)*phdr;
-    for (unsigned int i= 0; i < ehdr->e_phnum; ++i) /* loop through program headers */
+    const char *equal_sign= strchr(context->envp[i], '=');
+    size_t name_length= (equal_sign == NULL) ? strlen(context->envp[i]) : (size_t)(equal_sign - context->envp[i]);
+    int is_changed= 0;
+    for (unsigned int j= 0; j < changes_count; ++j)
     {
-      phdr= (ElfW(Phdr)*)cc;
-      if (phdr->p_type == PT_INTERP) /* i.e. ELF interpreter */
+      size_t change_name_length= strcspn(environment_changes[j], "=");
+      if ((change_name_length == name_length) && (memcmp(environment_changes[j], context->envp[i], name_length) == 0))
       {
-        char *cc2= (char *)ehdr;
-        cc2+= phdr->p_offset;
-        dynamic_loader_name= cc2;
+        is_changed= 1;
         break;
       }
-      cc+= ehdr->e_phentsize;
     }
+    if (is_changed == 0) child_envp[child_envp_count++]= context->envp[i];
   }
-
-  if (dynamic_loader_name == NULL)
+  for (unsigned int j= 0; j < changes_count; ++j)
   {
-    if ((sizeof(void*)) == 8) dynamic_loader_name= "/lib64/ld-linux-x86-64.so.2"; /* make some gcc/glibc assumptions */
-    else dynamic_loader_name= "/lib/ld-linux.so.2";
-#if (PGFINDLIB_COMMENT_CANT_FIND_DYNAMIC_LOADER != 0)
-    char comment[512];
-    sprintf(comment, "can't get ehdr dynamic loader so assume %s", dynamic_loader_name);
-    rval= pgfindlib_comment_is_row(comment,
-                         PGFINDLIB_COMMENT_CANT_FIND_DYNAMIC_LOADER,
-                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-    if (rval != PGFINDLIB_OK) return rval;
-#endif
+    if (strchr(environment_changes[j], '=') != NULL) child_envp[child_envp_count++]= (char *)environment_changes[j];
   }
+  child_envp[child_envp_count]= NULL;
+  FILE *fp= context->backend->spawn(context->backend->state, spawn_argv, child_envp, is_stderr_wanted, pid);
+  free(child_envp);
+  return fp;
+}
+
+void pgfindlib_spawn_close(FILE *fp, pid_t pid)
+{
+  int status;
+  fclose(fp);
+  if (pid <= 0) return; /* not a process, e.g. pgfindlib_backend_memory_open()'s */
+  while ((waitpid(pid, &status, 0) == -1) && (errno == EINTR)) {;}
+}
 
-  if (access(dynamic_loader_name, X_OK) != 0)
+/*
+  pgfindlib_backend_posix, the real system calls.
+  open() of path, or if there's a sysroot, openat2() of path with RESOLVE_IN_ROOT, so that ".." and symlinks
+  (including absolute ones like libz.so -> /usr/lib/libz.so.1) are resolved as if sysroot were /, and can't leave it.
+*/
+static int pgfindlib_posix_open(void *state, int sysroot_fd, const char *path, int flags)
+{
+  (void) state;
+#if (PGFINDLIB_SYSROOT != 0)
+  if (sysroot_fd >= 0)
   {
-#if (PGFINDLIB_COMMENT_CANT_ACCESS_DYNAMIC_LOADER != 0)
-    char comment[512];
-    sprintf(comment, "can't access %s", dynamic_loader_name);
-    rval= pgfindlib_comment_is_row(comment,
-                         PGFINDLIB_COMMENT_CANT_ACCESS_DYNAMIC_LOADER,
-                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-    if (rval != PGFINDLIB_OK) return rval;
-#endif
-    dynamic_loader_name= NULL;
+    struct pgfindlib_open_how how;
+    memset(&how, 0, sizeof(how));
+    how.flags= flags | O_CLOEXEC;
+    how.resolve= PGFINDLIB_RESOLVE_IN_ROOT;
+    return (int) syscall(SYS_openat2, sysroot_fd, path, &how, sizeof(how));
   }
+#else
+  (void) sysroot_fd;
+#endif
+  return open(path, flags | O_CLOEXEC);
+}
 
-  if (dynamic_loader_name != NULL)
-  {
-#define REPLACEE_IS_LIB 0
-#define REPLACEE_IS_PLATFORM 1
-    for (int i= REPLACEE_IS_LIB; i <= REPLACEE_IS_PLATFORM; ++i) /* 0 means "$LIB", 1 means "$PLATFORM" */
-    {
-      char replacee[16];
-      if (i == REPLACEE_IS_LIB) strcpy(replacee, "$LIB");
-      else strcpy(replacee, "$PLATFORM");
-      int change_count= 0;
-      FILE *fp;
-      char popen_arg[PGFINDLIB_MAX_PATH_LENGTH + 1];
-      sprintf(popen_arg,
-      "env -u LD_DEBUG_OUTPUT LD_LIBRARY_PATH='/PRE_OOKPIK/%s/POST_OOKPIK' LD_DEBUG=libs %s --inhibit-cache %s 2>/dev/stdout",
-      replacee, dynamic_loader_name, utility_name);
-      fp= popen(popen_arg, "r");
-      if (fp != NULL)
-      {
-        char buffer_for_ookpik[PGFINDLIB_MAX_PATH_LENGTH + 1];
-        while (fgets(buffer_for_ookpik, sizeof(buffer_for_ookpik), fp) != NULL)
+static int pgfindlib_posix_close(void *state, int fd)
+{
+  (void) state;
+  return close(fd);
+}
+
+static int pgfindlib_posix_fstat(void *state, int fd, struct stat *sb)
+{
+  (void) state;
+  return fstat(fd, sb);
+}
+
+static int pgfindlib_posix_fstatat(void *state, int fd, const char *name, struct stat *sb)
+{
+  (void) state;
+  return fstatat(fd, name, sb, AT_SYMLINK_NOFOLLOW);
+}
+
+static ssize_t pgfindlib_posix_readlinkat(void *state, int fd, const char *name, char *buffer, size_t buffer_size)
+{
+  (void) state;
+  return readlinkat(fd, name, buffer, buffer_size);
+}
+
+/* stat(), or lstat() if is_lstat, of path, which is in the sysroot if there is one */
+static int pgfindlib_posix_stat(void *state, int sysroot_fd, const char *path, struct stat *sb, int is_lstat)
+{
+  if (sysroot_fd < 0) return is_lstat ? lstat(path, sb) : stat(path, sb);
+  int fd= pgfindlib_posix_open(state, sysroot_fd, path, O_PATH | (is_lstat ? O_NOFOLLOW : 0));
+  if (fd == -1) return -1;
+  int rval= fstat(fd, sb);
+  close(fd);
+  return rval;
+}
+
+/* access() for R_OK or F_OK of path, which is in the sysroot if there is one */
+static int pgfindlib_posix_access(void *state, int sysroot_fd, const char *path, int mode)
+{
+  if (sysroot_fd < 0) return access(path, mode);
+  int fd= pgfindlib_posix_open(state, sysroot_fd, path, (mode == F_OK) ? O_PATH : O_RDONLY);
+  if (fd == -1) return -1;
+  close(fd);
+  return 0;
+}
+
+/*
+  On Linux a directory is read with getdents64 into PGFINDLIB_DIRENT_BUFFER_SIZE bytes per open directory.
+  Elsewhere it's readdir(), which glibc also batches with getdents64 but into a smaller buffer of its own.
+  Each variant is a whole set of functions, pgfindlib_backend_posix doesn't care which.
+*/
+#if (PGFINDLIB_GETDENTS != 0)
+struct pgfindlib_posix_dir
+{
+  struct pgfindlib_backend_entry entry;
+  int fd;
+  long bytes_count;
+  long offset;
+  char buffer[PGFINDLIB_DIRENT_BUFFER_SIZE];
+};
+
+static void *pgfindlib_posix_opendir(void *state, int fd)
+{
+  (void) state;
+  struct pgfindlib_posix_dir *posix_dir= (struct pgfindlib_posix_dir *)malloc(sizeof(struct pgfindlib_posix_dir));
+  if (posix_dir == NULL) { close(fd); return NULL; }
+  posix_dir->fd= fd;
+  posix_dir->bytes_count= 0;
+  posix_dir->offset= 0;
+  return posix_dir;
+}
+
+static const struct pgfindlib_backend_entry *pgfindlib_posix_readdir(void *state, void *dir)
+{
+  (void) state;
+  struct pgfindlib_posix_dir *posix_dir= (struct pgfindlib_posix_dir *)dir;
+  if (posix_dir->offset >= posix_dir->bytes_count)
+  {
+    posix_dir->bytes_count= syscall(SYS_getdents64, posix_dir->fd, posix_dir->buffer, PGFINDLIB_DIRENT_BUFFER_SIZE);
+    posix_dir->offset= 0;
+    if (posix_dir->bytes_count <= 0) return NULL; /* 0 = end of directory, -1 = error which we treat as end */
+  }
+  const struct pgfindlib_dirent64 *dirent= (const struct pgfindlib_dirent64 *)(posix_dir->buffer + posix_dir->offset);
+  posix_dir->offset+= dirent->d_reclen;
+  posix_dir->entry.d_name= dirent->d_name;
+  posix_dir->entry.d_type= dirent->d_type;
+  posix_dir->entry.d_ino= dirent->d_ino;
+  return &posix_dir->entry;
+}
+
+static void pgfindlib_posix_closedir(void *state, void *dir)
+{
+  (void) state;
+  struct pgfindlib_posix_dir *posix_dir= (struct pgfindlib_posix_dir *)dir;
+  close(posix_dir->fd);
+  free(posix_dir);
+}
+#else
+struct pgfindlib_posix_dir
+{
+  struct pgfindlib_backend_entry entry;
+  DIR *dir;
+};
+
+static void *pgfindlib_posix_opendir(void *state, int fd)
+{
+  (void) state;
+  struct pgfindlib_posix_dir *posix_dir= (struct pgfindlib_posix_dir *)malloc(sizeof(struct pgfindlib_posix_dir));
+  if (posix_dir == NULL) { close(fd); return NULL; }
+  posix_dir->dir= fdopendir(fd);
+  if (posix_dir->dir == NULL) { close(fd); free(posix_dir); return NULL; }
+  return posix_dir;
+}
+
+static const struct pgfindlib_backend_entry *pgfindlib_posix_readdir(void *state, void *dir)
+{
+  (void) state;
+  struct pgfindlib_posix_dir *posix_dir= (struct pgfindlib_posix_dir *)dir;
+  const struct dirent *dirent= readdir(posix_dir->dir);
+  if (dirent == NULL) return NULL;
+  posix_dir->entry.d_name= dirent->d_name;
+  posix_dir->entry.d_type= dirent->d_type;
+  posix_dir->entry.d_ino= dirent->d_ino;
+  return &posix_dir->entry;
+}
+
+static void pgfindlib_posix_closedir(void *state, void *dir)
+{
+  (void) state;
+  struct pgfindlib_posix_dir *posix_dir= (struct pgfindlib_posix_dir *)dir;
+  closedir(posix_dir->dir);
+  free(posix_dir);
+}
+#endif
+
+static FILE *pgfindlib_posix_fdopen(void *state, int fd)
+{
+  (void) state;
+  return fdopen(fd, "r");
+}
+
+/* See pgfindlib_spawn() */
+static FILE *pgfindlib_posix_spawn(void *state, const char *const spawn_argv[], char *const child_envp[], int is_stderr_wanted, pid_t *pid)
+{
+  (void) state;
+  FILE *fp= NULL;
+  int pipe_fds[2];
+  /* Close-on-exec from the start, so children that other threads start meanwhile won't hold the pipe open. dup2() in the child clears it. */
+  if (pipe2(pipe_fds, O_CLOEXEC) != 0) return NULL;
+  posix_spawn_file_actions_t file_actions;
+  int is_spawned= 0;
+  if (posix_spawn_file_actions_init(&file_actions) == 0)
+  {
+    posix_spawn_file_actions_adddup2(&file_actions, pipe_fds[1], STDOUT_FILENO);
+    if (is_stderr_wanted) posix_spawn_file_actions_adddup2(&file_actions, pipe_fds[1], STDERR_FILENO);
+    else posix_spawn_file_actions_addopen(&file_actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    if (posix_spawn(pid, spawn_argv[0], &file_actions, NULL, (char *const *)spawn_argv, child_envp) == 0) is_spawned= 1;
+    posix_spawn_file_actions_destroy(&file_actions);
+  }
+  close(pipe_fds[1]);
+  if (is_spawned) fp= fdopen(pipe_fds[0], "r");
+  if (fp == NULL)
+  {
+    close(pipe_fds[0]);
+    if (is_spawned) { int status; while ((waitpid(*pid, &status, 0) == -1) && (errno == EINTR)) {;} }
+  }
+  return fp;
+}
+
+const struct pgfindlib_backend pgfindlib_backend_posix=
+{
+  NULL,
+  pgfindlib_posix_open, pgfindlib_posix_close, pgfindlib_posix_fstat, pgfindlib_posix_fstatat, pgfindlib_posix_readlinkat,
+  pgfindlib_posix_stat, pgfindlib_posix_access,
+  pgfindlib_posix_opendir, pgfindlib_posix_readdir, pgfindlib_posix_closedir,
+  pgfindlib_posix_fdopen, pgfindlib_posix_spawn
+};
+
+#if (PGFINDLIB_INCLUDE_BACKEND_MEMORY != 0)
+/*
+  The memory backend. Nodes are in one array and node 0 is "/". A node's name and content (a file's bytes,
+  a symlink's target) are offsets in one string pool, so nothing points into memory that realloc() moves.
+  A hash of (parent, name) finds a child, and each directory's children are a list for readdir().
+  Nothing changes after pgfindlib_backend_memory_open() except the fd table, which has a mutex.
+*/
+#define PGFINDLIB_MEMORY_FD_BASE 0x40000000  /* memory fds are this + index in the fd table, never a real fd */
+#define PGFINDLIB_MEMORY_DEV 0x6d656d        /* st_dev of every node */
+#define PGFINDLIB_MEMORY_MAX_SYMLINKS 40     /* as the kernel's limit before ELOOP */
+#define PGFINDLIB_MEMORY_MAX_WORDS 16        /* per manifest line */
+#define PGFINDLIB_MEMORY_OP_OPEN 0
+#define PGFINDLIB_MEMORY_OP_STAT 1           /* also fstat(), fstatat(), readlinkat(), access() */
+#define PGFINDLIB_MEMORY_OP_OPENDIR 2
+#define PGFINDLIB_MEMORY_OP_READDIR 3        /* per entry */
+#define PGFINDLIB_MEMORY_OP_READ 4           /* per fdopen() */
+#define PGFINDLIB_MEMORY_OP_SPAWN 5
+#define PGFINDLIB_MEMORY_OP_COUNT 6
+static const char *const pgfindlib_memory_op_names[PGFINDLIB_MEMORY_OP_COUNT]= { "open", "stat", "opendir", "readdir", "read", "spawn" };
+
+struct pgfindlib_memory_node
+{
+  unsigned int parent;
+  unsigned int hash_next;      /* node + 1 of the next with the same hash, 0 at the end */
+  unsigned int first_child;    /* node + 1, 0 if none */
+  unsigned int next_sibling;   /* node + 1, 0 if none */
+  unsigned int name;           /* offset in strings */
+  unsigned int content;        /* offset in strings */
+  unsigned int content_length;
+  unsigned char d_type;
+};
+
+/* A spawn block: argv words each with '\0' then another '\0', and the output, both in strings */
+struct pgfindlib_memory_spawn
+{
+  unsigned int argv;
+  unsigned int output;
+  unsigned int output_length;
+};
+
+struct pgfindlib_memory
+{
+  struct pgfindlib_backend backend; /* first, so pgfindlib_backend_memory_close() can cast */
+  struct pgfindlib_memory_node *nodes; unsigned int nodes_count; unsigned int nodes_max;
+  unsigned int *buckets; unsigned int buckets_count; /* a power of 2 */
+  char *strings; unsigned int strings_length; unsigned int strings_max;
+  struct pgfindlib_memory_spawn *spawns; unsigned int spawns_count; unsigned int spawns_max;
+  unsigned int latency_microseconds[PGFINDLIB_MEMORY_OP_COUNT];
+  pthread_mutex_t mutex;
+  unsigned int *fds; unsigned int fds_count; unsigned int fds_max; /* node + 1 per fd, 0 if closed */
+};
+
+struct pgfindlib_memory_dir
+{
+  struct pgfindlib_backend_entry entry;
+  int fd;
+  unsigned int next;           /* node + 1 of the next child, 0 at the end */
+};
+
+static void pgfindlib_memory_wait(const struct pgfindlib_memory *m, int op)
+{
+  unsigned int microseconds= m->latency_microseconds[op];
+  if (microseconds == 0) return;
+  struct timespec ts;
+  ts.tv_sec= microseconds / 1000000;
+  ts.tv_nsec= (long) (microseconds % 1000000) * 1000;
+  while ((nanosleep(&ts, &ts) == -1) && (errno == EINTR)) {;}
+}
+
+static unsigned int pgfindlib_memory_hash(unsigned int parent, const char *name, size_t name_length)
+{
+  unsigned int hash= 2166136261U ^ parent; /* FNV-1a */
+  for (size_t i= 0; i < name_length; ++i) hash= (hash ^ (unsigned char) name[i]) * 16777619U;
+  return hash;
+}
+
+/* Return node + 1 of parent's child that's named name, or 0 */
+static unsigned int pgfindlib_memory_child(const struct pgfindlib_memory *m, unsigned int parent, const char *name, size_t name_length)
+{
+  unsigned int hash= pgfindlib_memory_hash(parent, name, name_length);
+  for (unsigned int i= m->buckets[hash & (m->buckets_count - 1)]; i != 0; i= m->nodes[i - 1].hash_next)
+  {
+    const struct pgfindlib_memory_node *node= &m->nodes[i - 1];
+    const char *node_name= m->strings + node->name;
+    if ((node->parent == parent) && (memcmp(node_name, name, name_length) == 0) && (node_name[name_length] == '\0')) return i;
+  }
+  return 0;
+}
+
+/*
+  Return node + 1 of path, which starts at directory node start if it's relative. Symlinks are followed,
+  the last component's only if is_follow. Return 0 with errno set if there's no such node.
+*/
+static unsigned int pgfindlib_memory_resolve(const struct pgfindlib_memory *m, unsigned int start, const char *path, int is_follow,
+                                             unsigned int *links_count)
+{
+  unsigned int current= (*path == '/') ? 0 : start;
+  const char *p= path;
+  for (;;)
+  {
+    p+= strspn(p, "/");
+    if (*p == '\0') return current + 1;
+    if (m->nodes[current].d_type != DT_DIR) { errno= ENOTDIR; return 0; }
+    size_t length= strcspn(p, "/");
+    const char *next= p + length;
+    if ((length == 1) && (p[0] == '.')) { p= next; continue; }
+    if ((length == 2) && (p[0] == '.') && (p[1] == '.')) { current= m->nodes[current].parent; p= next; continue; }
+    unsigned int child= pgfindlib_memory_child(m, current, p, length);
+    if (child == 0) { errno= ENOENT; return 0; }
+    const struct pgfindlib_memory_node *node= &m->nodes[child - 1];
+    if ((node->d_type == DT_LNK) && ((is_follow != 0) || (next[strspn(next, "/")] != '\0')))
+    {
+      if (++*links_count > PGFINDLIB_MEMORY_MAX_SYMLINKS) { errno= ELOOP; return 0; }
+      child= pgfindlib_memory_resolve(m, current, m->strings + node->content, 1, links_count);
+      if (child == 0) return 0;
+    }
+    current= child - 1;
+    p= next;
+  }
+}
+
+static unsigned int pgfindlib_memory_find(const struct pgfindlib_memory *m, unsigned int start, const char *path, int is_follow)
+{
+  unsigned int links_count= 0;
+  return pgfindlib_memory_resolve(m, start, path, is_follow, &links_count);
+}
+
+static void pgfindlib_memory_stat_fill(const struct pgfindlib_memory *m, unsigned int node, struct stat *sb)
+{
+  memset(sb, 0, sizeof(struct stat));
+  sb->st_dev= PGFINDLIB_MEMORY_DEV;
+  sb->st_ino= node + 2; /* so "/" is 2 as on ext4, and readdir()'s d_ino is the same */
+  sb->st_nlink= 1;
+  if (m->nodes[node].d_type == DT_DIR) sb->st_mode= S_IFDIR | 0755;
+  else if (m->nodes[node].d_type == DT_LNK) sb->st_mode= S_IFLNK | 0777;
+  else sb->st_mode= S_IFREG | 0755;
+  sb->st_size= m->nodes[node].content_length;
+}
+
+static int pgfindlib_memory_fd_new(struct pgfindlib_memory *m, unsigned int node)
+{
+  int fd= -1;
+  pthread_mutex_lock(&m->mutex);
+  unsigned int i;
+  for (i= 0; i < m->fds_count; ++i) if (m->fds[i] == 0) break;
+  if (i == m->fds_count)
+  {
+    if (m->fds_count == m->fds_max)
+    {
+      unsigned int new_max= (m->fds_max == 0) ? 64 : m->fds_max * 2;
+      unsigned int *new_fds= (unsigned int *)realloc(m->fds, new_max * sizeof(unsigned int));
+      if (new_fds == NULL) { errno= EMFILE; goto unlock_and_return; }
+      m->fds= new_fds;
+      m->fds_max= new_max;
+    }
+    ++m->fds_count;
+  }
+  m->fds[i]= node + 1;
+  fd= PGFINDLIB_MEMORY_FD_BASE + (int) i;
+unlock_and_return:
+  pthread_mutex_unlock(&m->mutex);
+  return fd;
+}
+
+/* Return node + 1 of an open fd, or 0 with errno= EBADF. If is_close, the fd is closed too. */
+static unsigned int pgfindlib_memory_fd_node(struct pgfindlib_memory *m, int fd, int is_close)
+{
+  unsigned int node= 0;
+  pthread_mutex_lock(&m->mutex);
+  if ((fd >= PGFINDLIB_MEMORY_FD_BASE) && ((unsigned int) (fd - PGFINDLIB_MEMORY_FD_BASE) < m->fds_count))
+  {
+    node= m->fds[fd - PGFINDLIB_MEMORY_FD_BASE];
+    if (is_close) m->fds[fd - PGFINDLIB_MEMORY_FD_BASE]= 0;
+  }
+  pthread_mutex_unlock(&m->mutex);
+  if (node == 0) errno= EBADF;
+  return node;
+}
+
+/* A FILE for reading length bytes of strings, fmemopen() can't do 0 bytes everywhere */
+static FILE *pgfindlib_memory_fmemopen(struct pgfindlib_memory *m, unsigned int offset, unsigned int length)
+{
+  if (length == 0) return fopen("/dev/null", "r");
+  return fmemopen(m->strings + offset, length, "r");
+}
+
+static int pgfindlib_memory_open(void *state, int sysroot_fd, const char *path, int flags)
+{
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)state;
+  (void) sysroot_fd;
+  pgfindlib_memory_wait(m, PGFINDLIB_MEMORY_OP_OPEN);
+  unsigned int node= pgfindlib_memory_find(m, 0, path, (flags & O_NOFOLLOW) == 0);
+  if (node == 0) return -1;
+  if (((flags & O_DIRECTORY) != 0) && (m->nodes[node - 1].d_type != DT_DIR)) { errno= ENOTDIR; return -1; }
+  return pgfindlib_memory_fd_new(m, node - 1);
+}
+
+static int pgfindlib_memory_close(void *state, int fd)
+{
+  return (pgfindlib_memory_fd_node((struct pgfindlib_memory *)state, fd, 1) == 0) ? -1 : 0;
+}
+
+static int pgfindlib_memory_fstat(void *state, int fd, struct stat *sb)
+{
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)state;
+  pgfindlib_memory_wait(m, PGFINDLIB_MEMORY_OP_STAT);
+  unsigned int node= pgfindlib_memory_fd_node(m, fd, 0);
+  if (node == 0) return -1;
+  pgfindlib_memory_stat_fill(m, node - 1, sb);
+  return 0;
+}
+
+static int pgfindlib_memory_fstatat(void *state, int fd, const char *name, struct stat *sb)
+{
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)state;
+  pgfindlib_memory_wait(m, PGFINDLIB_MEMORY_OP_STAT);
+  unsigned int directory= pgfindlib_memory_fd_node(m, fd, 0);
+  if (directory == 0) return -1;
+  unsigned int node= pgfindlib_memory_find(m, directory - 1, name, 0);
+  if (node == 0) return -1;
+  pgfindlib_memory_stat_fill(m, node - 1, sb);
+  return 0;
+}
+
+static ssize_t pgfindlib_memory_readlinkat(void *state, int fd, const char *name, char *buffer, size_t buffer_size)
+{
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)state;
+  pgfindlib_memory_wait(m, PGFINDLIB_MEMORY_OP_STAT);
+  unsigned int directory= pgfindlib_memory_fd_node(m, fd, 0);
+  if (directory == 0) return -1;
+  unsigned int node= pgfindlib_memory_find(m, directory - 1, name, 0);
+  if (node == 0) return -1;
+  const struct pgfindlib_memory_node *link= &m->nodes[node - 1];
+  if (link->d_type != DT_LNK) { errno= EINVAL; return -1; }
+  size_t length= (link->content_length < buffer_size) ? link->content_length : buffer_size; /* truncated, as readlink() does */
+  memcpy(buffer, m->strings + link->content, length);
+  return (ssize_t) length;
+}
+
+static int pgfindlib_memory_stat(void *state, int sysroot_fd, const char *path, struct stat *sb, int is_lstat)
+{
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)state;
+  (void) sysroot_fd;
+  pgfindlib_memory_wait(m, PGFINDLIB_MEMORY_OP_STAT);
+  unsigned int node= pgfindlib_memory_find(m, 0, path, is_lstat == 0);
+  if (node == 0) return -1;
+  pgfindlib_memory_stat_fill(m, node - 1, sb);
+  return 0;
+}
+
+static int pgfindlib_memory_access(void *state, int sysroot_fd, const char *path, int mode)
+{
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)state;
+  (void) sysroot_fd;
+  pgfindlib_memory_wait(m, PGFINDLIB_MEMORY_OP_STAT);
+  if (pgfindlib_memory_find(m, 0, path, 1) == 0) return -1;
+  if ((mode & W_OK) != 0) { errno= EROFS; return -1; }
+  return 0;
+}
+
+static void *pgfindlib_memory_opendir(void *state, int fd)
+{
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)state;
+  pgfindlib_memory_wait(m, PGFINDLIB_MEMORY_OP_OPENDIR);
+  unsigned int node= pgfindlib_memory_fd_node(m, fd, 0);
+  if ((node != 0) && (m->nodes[node - 1].d_type != DT_DIR)) { errno= ENOTDIR; node= 0; }
+  struct pgfindlib_memory_dir *memory_dir= NULL;
+  if (node != 0) memory_dir= (struct pgfindlib_memory_dir *)malloc(sizeof(struct pgfindlib_memory_dir));
+  if (memory_dir == NULL) { pgfindlib_memory_fd_node(m, fd, 1); return NULL; }
+  memory_dir->fd= fd;
+  memory_dir->next= m->nodes[node - 1].first_child;
+  return memory_dir;
+}
+
+static const struct pgfindlib_backend_entry *pgfindlib_memory_readdir(void *state, void *dir)
+{
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)state;
+  struct pgfindlib_memory_dir *memory_dir= (struct pgfindlib_memory_dir *)dir;
+  if (memory_dir->next == 0) return NULL;
+  pgfindlib_memory_wait(m, PGFINDLIB_MEMORY_OP_READDIR);
+  const struct pgfindlib_memory_node *node= &m->nodes[memory_dir->next - 1];
+  memory_dir->entry.d_name= m->strings + node->name;
+  memory_dir->entry.d_type= node->d_type;
+  memory_dir->entry.d_ino= memory_dir->next + 1;
+  memory_dir->next= node->next_sibling;
+  return &memory_dir->entry;
+}
+
+static void pgfindlib_memory_closedir(void *state, void *dir)
+{
+  struct pgfindlib_memory_dir *memory_dir= (struct pgfindlib_memory_dir *)dir;
+  pgfindlib_memory_fd_node((struct pgfindlib_memory *)state, memory_dir->fd, 1);
+  free(memory_dir);
+}
+
+static FILE *pgfindlib_memory_fdopen(void *state, int fd)
+{
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)state;
+  pgfindlib_memory_wait(m, PGFINDLIB_MEMORY_OP_READ);
+  unsigned int node= pgfindlib_memory_fd_node(m, fd, 0);
+  if (node == 0) return NULL;
+  if (m->nodes[node - 1].d_type == DT_DIR) { errno= EISDIR; return NULL; }
+  FILE *fp= pgfindlib_memory_fmemopen(m, m->nodes[node - 1].content, m->nodes[node - 1].content_length);
+  if (fp != NULL) pgfindlib_memory_fd_node(m, fd, 1); /* fdopen() took it over */
+  return fp;
+}
+
+/* The output of the spawn block with exactly these argv words, there's no process */
+static FILE *pgfindlib_memory_spawn(void *state, const char *const spawn_argv[], char *const child_envp[], int is_stderr_wanted, pid_t *pid)
+{
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)state;
+  (void) child_envp;
+  (void) is_stderr_wanted;
+  *pid= 0;
+  pgfindlib_memory_wait(m, PGFINDLIB_MEMORY_OP_SPAWN);
+  for (unsigned int i= 0; i < m->spawns_count; ++i)
+  {
+    const char *word= m->strings + m->spawns[i].argv;
+    unsigned int j;
+    for (j= 0; (spawn_argv[j] != NULL) && (*word != '\0') && (strcmp(spawn_argv[j], word) == 0); ++j) word+= strlen(word) + 1;
+    if ((spawn_argv[j] == NULL) && (*word == '\0')) return pgfindlib_memory_fmemopen(m, m->spawns[i].output, m->spawns[i].output_length);
+  }
+  errno= ENOENT;
+  return NULL;
+}
+
+/* Append length bytes and a '\0' to strings, return the offset or -1 */
+static long long pgfindlib_memory_string(struct pgfindlib_memory *m, const char *bytes, size_t length)
+{
+  if ((size_t) m->strings_length + length + 1 > m->strings_max)
+  {
+    size_t new_max= ((size_t) m->strings_length + length + 1) * 2;
+    if (new_max > 0xffffffffU) return -1;
+    char *new_strings= (char *)realloc(m->strings, new_max);
+    if (new_strings == NULL) return -1;
+    m->strings= new_strings;
+    m->strings_max= (unsigned int) new_max;
+  }
+  long long offset= m->strings_length;
+  memcpy(m->strings + offset, bytes, length);
+  m->strings[offset + length]= '\0';
+  m->strings_length+= (unsigned int) length + 1;
+  return offset;
+}
+
+static void pgfindlib_memory_hash_insert(struct pgfindlib_memory *m, unsigned int node)
+{
+  const char *name= m->strings + m->nodes[node].name;
+  unsigned int bucket= pgfindlib_memory_hash(m->nodes[node].parent, name, strlen(name)) & (m->buckets_count - 1);
+  m->nodes[node].hash_next= m->buckets[bucket];
+  m->buckets[bucket]= node + 1;
+}
+
+/* Add a node as parent's first child, return node + 1 or 0 */
+static unsigned int pgfindlib_memory_node_add(struct pgfindlib_memory *m, unsigned int parent, const char *name, size_t name_length,
+                                              unsigned char d_type)
+{
+  if (m->nodes_count == m->nodes_max)
+  {
+    unsigned int new_max= (m->nodes_max == 0) ? 1024 : m->nodes_max * 2;
+    struct pgfindlib_memory_node *new_nodes= (struct pgfindlib_memory_node *)realloc(m->nodes, new_max * sizeof(struct pgfindlib_memory_node));
+    if (new_nodes == NULL) return 0;
+    m->nodes= new_nodes;
+    m->nodes_max= new_max;
+  }
+  if (m->nodes_count >= m->buckets_count) /* keep chains short */
+  {
+    unsigned int new_count= (m->buckets_count == 0) ? 1024 : m->buckets_count * 2;
+    unsigned int *new_buckets= (unsigned int *)calloc(new_count, sizeof(unsigned int));
+    if (new_buckets == NULL) return 0;
+    free(m->buckets);
+    m->buckets= new_buckets;
+    m->buckets_count= new_count;
+    for (unsigned int i= 1; i < m->nodes_count; ++i) pgfindlib_memory_hash_insert(m, i);
+  }
+  long long name_offset= pgfindlib_memory_string(m, name, name_length);
+  if (name_offset < 0) return 0;
+  unsigned int node= m->nodes_count++;
+  memset(&m->nodes[node], 0, sizeof(struct pgfindlib_memory_node));
+  m->nodes[node].parent= parent;
+  m->nodes[node].name= (unsigned int) name_offset;
+  m->nodes[node].content= (unsigned int) name_offset + (unsigned int) name_length; /* the '\0', i.e. empty */
+  m->nodes[node].d_type= d_type;
+  if (node == 0) return 1; /* "/" is its own parent and isn't anyone's child */
+  m->nodes[node].next_sibling= m->nodes[parent].first_child;
+  m->nodes[parent].first_child= node + 1;
+  pgfindlib_memory_hash_insert(m, node);
+  return node + 1;
+}
+
+/*
+  Add path, which must be absolute, and any missing directories before it. Return node + 1,
+  or 0 if a component is "." or ".." or isn't a directory, or if path is already there and isn't a directory.
+*/
+static unsigned int pgfindlib_memory_make(struct pgfindlib_memory *m, const char *path, unsigned char d_type)
+{
+  if (*path != '/') return 0;
+  unsigned int current= 0;
+  const char *p= path;
+  for (;;)
+  {
+    p+= strspn(p, "/");
+    size_t length= strcspn(p, "/");
+    if ((length == 0) || ((p[0] == '.') && ((length == 1) || ((length == 2) && (p[1] == '.'))))) return 0;
+    const char *next= p + length;
+    int is_last= (next[strspn(next, "/")] == '\0');
+    unsigned char component_d_type= is_last ? d_type : DT_DIR;
+    unsigned int child= pgfindlib_memory_child(m, current, p, length);
+    if (child == 0) child= pgfindlib_memory_node_add(m, current, p, length, component_d_type);
+    else if ((component_d_type != DT_DIR) || (m->nodes[child - 1].d_type != DT_DIR)) return 0;
+    if ((child == 0) || is_last) return child;
+    current= child - 1;
+    p= next;
+  }
+}
+
+/*
+  An ELF header for "elf" (this program's class and machine) or "elf32 E_MACHINE" or "elf64 E_MACHINE",
+  in this program's byte order. Return its offset in strings, or -1 if the words are wrong.
+*/
+static long long pgfindlib_memory_elf(struct pgfindlib_memory *m, char *const words[], unsigned int words_count, unsigned int *length)
+{
+  extern ElfW(Ehdr) __executable_start;
+  unsigned char elf_class= __executable_start.e_ident[EI_CLASS];
+  unsigned char elf_data= __executable_start.e_ident[EI_DATA];
+  unsigned int e_machine= __executable_start.e_machine;
+  if ((words_count == 1) && (strcmp(words[0], "elf") == 0)) {;}
+  else if ((words_count == 2) && ((strcmp(words[0], "elf32") == 0) || (strcmp(words[0], "elf64") == 0)))
+  {
+    char *end;
+    unsigned long number= strtoul(words[1], &end, 0);
+    if ((*end != '\0') || (number > 0xffff)) return -1;
+    elf_class= (words[0][3] == '3') ? ELFCLASS32 : ELFCLASS64;
+    e_machine= (unsigned int) number;
+  }
+  else return -1;
+  unsigned char header[64];
+  memset(header, 0, sizeof(header));
+  memcpy(header, ELFMAG, SELFMAG);
+  header[EI_CLASS]= elf_class;
+  header[EI_DATA]= elf_data;
+  header[EI_VERSION]= EV_CURRENT;
+  int is_msb= (elf_data == ELFDATA2MSB);
+  header[16 + is_msb]= ET_DYN;                                  /* e_type */
+  header[18 + is_msb]= e_machine & 0xff;                        /* e_machine */
+  header[19 - is_msb]= (e_machine >> 8) & 0xff;
+  header[is_msb ? 23 : 20]= EV_CURRENT;                         /* e_version */
+  *length= (elf_class == ELFCLASS64) ? 64 : 52;
+  return pgfindlib_memory_string(m, (const char *) header, *length);
+}
+
+int pgfindlib_backend_memory_open(const char *manifest_path, struct pgfindlib_backend **backend, unsigned int *error_line)
+{
+  const struct pgfindlib_backend functions=
+  {
+    NULL,
+    pgfindlib_memory_open, pgfindlib_memory_close, pgfindlib_memory_fstat, pgfindlib_memory_fstatat, pgfindlib_memory_readlinkat,
+    pgfindlib_memory_stat, pgfindlib_memory_access,
+    pgfindlib_memory_opendir, pgfindlib_memory_readdir, pgfindlib_memory_closedir,
+    pgfindlib_memory_fdopen, pgfindlib_memory_spawn
+  };
+  *backend= NULL;
+  if (error_line != NULL) *error_line= 0;
+  FILE *fp= fopen(manifest_path, "r");
+  if (fp == NULL) return PGFINDLIB_ERROR_NOT_FOUND;
+  int rval= PGFINDLIB_OK;
+  unsigned int line_number= 0, block_line_number= 0;
+  const unsigned int line_max_length= PGFINDLIB_MAX_PATH_LENGTH * 2 + 2;
+  char *line= (char *)malloc(line_max_length * 2); /* and path, not on the stack, see "Re threads" */
+  char *path= line + line_max_length;
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)calloc(1, sizeof(struct pgfindlib_memory));
+  if ((m == NULL) || (line == NULL))
+  {
+    if (m != NULL) free(m);
+    if (line != NULL) free(line);
+    fclose(fp);
+    return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  }
+  m->backend= functions;
+  m->backend.state= m;
+  pthread_mutex_init(&m->mutex, NULL);
+  if (pgfindlib_memory_node_add(m, 0, "", 0, DT_DIR) == 0) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto error; }
+  struct pgfindlib_memory_node *block_node= NULL;     /* while in a text block */
+  struct pgfindlib_memory_spawn *block_spawn= NULL;   /* while in a spawn block */
+  long long block_start= 0;
+  while (fgets(line, line_max_length, fp) != NULL)
+  {
+    ++line_number;
+    size_t line_length= strlen(line);
+    if ((line[line_length - 1] != '\n') && (feof(fp) == 0)) goto syntax_error; /* too long */
+    if ((block_node != NULL) || (block_spawn != NULL))
+    {
+      if ((strcspn(line, "\n") != 3) || (memcmp(line, "end", 3) != 0))
+      {
+        /* The block's bytes are contiguous because nothing else is added to strings meanwhile. Drop the '\0' after them. */
+        if (pgfindlib_memory_string(m, line, line_length) < 0) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto error; }
+        --m->strings_length;
+        continue;
+      }
+      if (pgfindlib_memory_string(m, "", 0) < 0) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto error; }
+      unsigned int block_length= m->strings_length - 1 - (unsigned int) block_start;
+      if (block_node != NULL) { block_node->content= (unsigned int) block_start; block_node->content_length= block_length; }
+      else { block_spawn->output= (unsigned int) block_start; block_spawn->output_length= block_length; }
+      block_node= NULL;
+      block_spawn= NULL;
+      continue;
+    }
+    line[strcspn(line, "#\n")]= '\0';
+    char *words[PGFINDLIB_MEMORY_MAX_WORDS];
+    unsigned int words_count= 0;
+    char *save_pointer;
+    for (char *word= strtok_r(line, " \t", &save_pointer); word != NULL; word= strtok_r(NULL, " \t", &save_pointer))
+    {
+      if (words_count == PGFINDLIB_MEMORY_MAX_WORDS) goto syntax_error;
+      words[words_count++]= word;
+    }
+    if (words_count == 0) continue;
+    const char *command= words[0];
+    unsigned int node= 0;
+    if ((strcmp(command, "dir") == 0) && (words_count == 2))
+    {
+      if (pgfindlib_memory_make(m, words[1], DT_DIR) == 0) goto syntax_error;
+    }
+    else if ((strcmp(command, "file") == 0) && (words_count >= 2) && (words_count <= 4))
+    {
+      if ((node= pgfindlib_memory_make(m, words[1], DT_REG)) == 0) goto syntax_error;
+      if (words_count > 2)
+      {
+        unsigned int length;
+        long long offset= pgfindlib_memory_elf(m, words + 2, words_count - 2, &length);
+        if (offset < 0) goto syntax_error;
+        m->nodes[node - 1].content= (unsigned int) offset;
+        m->nodes[node - 1].content_length= length;
+      }
+    }
+    else if ((strcmp(command, "link") == 0) && (words_count == 3))
+    {
+      if ((node= pgfindlib_memory_make(m, words[1], DT_LNK)) == 0) goto syntax_error;
+      long long offset= pgfindlib_memory_string(m, words[2], strlen(words[2]));
+      if (offset < 0) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto error; }
+      m->nodes[node - 1].content= (unsigned int) offset;
+      m->nodes[node - 1].content_length= (unsigned int) strlen(words[2]);
+    }
+    else if ((strcmp(command, "text") == 0) && (words_count == 2))
+    {
+      if ((node= pgfindlib_memory_make(m, words[1], DT_REG)) == 0) goto syntax_error;
+      block_node= &m->nodes[node - 1];
+    }
+    else if ((strcmp(command, "spawn") == 0) && (words_count >= 2))
+    {
+      if (m->spawns_count == m->spawns_max)
+      {
+        unsigned int new_max= (m->spawns_max == 0) ? 8 : m->spawns_max * 2;
+        struct pgfindlib_memory_spawn *new_spawns= (struct pgfindlib_memory_spawn *)realloc(m->spawns, new_max * sizeof(struct pgfindlib_memory_spawn));
+        if (new_spawns == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto error; }
+        m->spawns= new_spawns;
+        m->spawns_max= new_max;
+      }
+      block_spawn= &m->spawns[m->spawns_count++];
+      memset(block_spawn, 0, sizeof(struct pgfindlib_memory_spawn));
+      for (unsigned int i= 1; i < words_count; ++i)
+      {
+        long long offset= pgfindlib_memory_string(m, words[i], strlen(words[i]));
+        if (offset < 0) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto error; }
+        if (i == 1) block_spawn->argv= (unsigned int) offset;
+      }
+      if (pgfindlib_memory_string(m, "", 0) < 0) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto error; }
+    }
+    else if ((strcmp(command, "files") == 0) && (words_count >= 4) && (words_count <= 6))
+    {
+      /* files DIR NAME COUNT [elf...]: COUNT files in DIR, named NAME with its one * replaced by 0, 1, 2 ... */
+      const char *star= strchr(words[2], '*');
+      char *end;
+      unsigned long count= strtoul(words[3], &end, 10);
+      if ((star == NULL) || (strchr(star + 1, '*') != NULL) || (*end != '\0') || (count > 100000000)) goto syntax_error;
+      unsigned int elf_length= 0;
+      long long elf_offset= -1;
+      if (words_count > 4)
+      {
+        elf_offset= pgfindlib_memory_elf(m, words + 4, words_count - 4, &elf_length);
+        if (elf_offset < 0) goto syntax_error;
+      }
+      if (strlen(words[1]) + strlen(words[2]) + 12 > line_max_length) goto syntax_error;
+      for (unsigned long i= 0; i < count; ++i)
+      {
+        sprintf(path, "%s/%.*s%lu%s", words[1], (int) (star - words[2]), words[2], i, star + 1);
+        if ((node= pgfindlib_memory_make(m, path, DT_REG)) == 0) goto syntax_error;
+        if (elf_offset >= 0) { m->nodes[node - 1].content= (unsigned int) elf_offset; m->nodes[node - 1].content_length= elf_length; }
+      }
+    }
+    else if ((strcmp(command, "latency") == 0) && (words_count == 3))
+    {
+      int op;
+      for (op= 0; op < PGFINDLIB_MEMORY_OP_COUNT; ++op) if (strcmp(words[1], pgfindlib_memory_op_names[op]) == 0) break;
+      char *end;
+      unsigned long microseconds= strtoul(words[2], &end, 10);
+      if ((op == PGFINDLIB_MEMORY_OP_COUNT) || (*end != '\0') || (microseconds > 60000000)) goto syntax_error;
+      m->latency_microseconds[op]= (unsigned int) microseconds;
+    }
+    else goto syntax_error;
+    if ((block_node != NULL) || (block_spawn != NULL))
+    {
+      block_line_number= line_number;
+      block_start= m->strings_length;
+    }
+  }
+  if ((block_node != NULL) || (block_spawn != NULL)) { line_number= block_line_number; goto syntax_error; } /* no "end" */
+  free(line);
+  fclose(fp);
+  *backend= &m->backend;
+  return PGFINDLIB_OK;
+syntax_error:
+  rval= PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+  if (error_line != NULL) *error_line= line_number;
+error:
+  free(line);
+  fclose(fp);
+  pgfindlib_backend_memory_close(&m->backend);
+  return rval;
+}
+
+void pgfindlib_backend_memory_close(struct pgfindlib_backend *backend)
+{
+  if (backend == NULL) return;
+  struct pgfindlib_memory *m= (struct pgfindlib_memory *)backend;
+  pthread_mutex_destroy(&m->mutex);
+  free(m->nodes);
+  free(m->buckets);
+  free(m->strings);
+  free(m->spawns);
+  free(m->fds);
+  free(m);
+}
+#endif
+
+/*
+  Run spawn_argv with LD_DEBUG=libs and LD_LIBRARY_PATH=/PRE_OOKPIK/$LIB/POST_OOKPIK (or $PLATFORM),
+  the loader's debug output shows the search path with replacee expanded, copy the expansion to replacement.
+  Return 1 if it was found, else 0.
+*/
+int pgfindlib_ookpik(struct pgfindlib_context *context, const char *const spawn_argv[], const char *replacee, char *replacement)
+{
+  char ld_library_path[64];
+  sprintf(ld_library_path, "LD_LIBRARY_PATH=/PRE_OOKPIK/%s/POST_OOKPIK", replacee);
+  const char *environment_changes[]= { "LD_DEBUG_OUTPUT", ld_library_path, "LD_DEBUG=libs", NULL };
+  pid_t pid;
+  FILE *fp= pgfindlib_spawn(context, spawn_argv, environment_changes, 1, &pid);
+  if (fp == NULL) return 0;
+  int change_count= 0;
+  while (fgets(context->spawn_line, sizeof(context->spawn_line), fp) != NULL)
+  {
+    const char *pre_ookpik= strstr(context->spawn_line, "PRE_OOKPIK/");
+    if (pre_ookpik == NULL) continue;
+    const char *post_ookpik= strstr(pre_ookpik, "POST_OOKPIK");
+    if (post_ookpik == NULL) continue;
+    pre_ookpik+= strlen("PRE_OOKPIK/");
+    if (post_ookpik <= pre_ookpik) continue;
+    unsigned int len= post_ookpik - (pre_ookpik + 1);
+    if (len >= PGFINDLIB_MAX_PATH_LENGTH) continue;
+    memcpy(replacement, pre_ookpik, len);
+    *(replacement + len)= '\0';
+    ++change_count;
+    break;
+  }
+  pgfindlib_spawn_close(fp, pid);
+  return change_count;
+}
+
+/*
+  WHERE matcher.
+  Every FILE token in the statement is compiled once into a list of glob positions, and all of them together
+  are run as one DFA over each name, so a name is read once no matter how many items WHERE has.
+  A token without * ? [ { keeps its old meaning, a prefix: "libx.so" is treated as "libx.so*".
+  A token with any of those is a glob that must match the whole name:
+    *        any sequence of characters including none
+    ?        any one character
+    [0-9]    any one character in the class, [!...] or [^...] means not in the class
+    {a,b}    either a or b (expanded before compiling, may nest)
+    \c       c literally
+  The DFA is built lazily, a state is only made when some name needs it, and if there are too many states
+  the cache is thrown away and built again, so memory is bounded and there is never any backtracking.
+*/
+#define PGFINDLIB_GLOB_LITERAL 0
+#define PGFINDLIB_GLOB_CLASS   1
+#define PGFINDLIB_GLOB_STAR    2
+#define PGFINDLIB_GLOB_ACCEPT  3
+
+#ifndef PGFINDLIB_MAX_DFA_STATES
+#define PGFINDLIB_MAX_DFA_STATES 4096
+#endif
+
+#define PGFINDLIB_MAX_BRACE_EXPANSIONS 1024
+
+static int pgfindlib_matcher_add_position(struct pgfindlib_where_matcher *matcher, char type, unsigned char literal)
+{
+  if (matcher->positions_count == matcher->positions_max)
+  {
+    unsigned int new_max= matcher->positions_max * 2 + 64;
+    struct pgfindlib_glob_position *new_positions;
+    new_positions= (struct pgfindlib_glob_position *)realloc(matcher->positions, new_max * sizeof(struct pgfindlib_glob_position));
+    if (new_positions == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+    matcher->positions= new_positions;
+    matcher->positions_max= new_max;
+  }
+  matcher->positions[matcher->positions_count].type= type;
+  matcher->positions[matcher->positions_count].literal= literal;
+  matcher->positions[matcher->positions_count].class_number= 0;
+  ++matcher->positions_count;
+  return PGFINDLIB_OK;
+}
+
+/* Parse [...] starting at pattern[*i] == '['. Return 0 and leave *i alone if there is no closing ']' */
+static int pgfindlib_matcher_add_class(struct pgfindlib_where_matcher *matcher, const char *pattern, unsigned int pattern_length,
+                                       unsigned int *i, int *rval)
+{
+  unsigned int j= *i + 1;
+  int is_negated= 0;
+  if ((j < pattern_length) && ((pattern[j] == '!') || (pattern[j] == '^'))) { is_negated= 1; ++j; }
+  unsigned int first= j;
+  while ((j < pattern_length) && ((pattern[j] != ']') || (j == first))) ++j; /* ']' first is literal */
+  if (j >= pattern_length) return 0;
+  if (matcher->classes_count == matcher->classes_max)
+  {
+    unsigned int new_max= matcher->classes_max * 2 + 8;
+    unsigned char (*new_classes)[32]= (unsigned char (*)[32])realloc(matcher->classes, new_max * 32);
+    if (new_classes == NULL) { *rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; return 1; }
+    matcher->classes= new_classes;
+    matcher->classes_max= new_max;
+  }
+  unsigned char *bits= matcher->classes[matcher->classes_count];
+  memset(bits, 0, 32);
+  for (unsigned int k= first; k < j; ++k)
+  {
+    unsigned char from= (unsigned char) pattern[k];
+    unsigned char to= from;
+    if ((k + 2 < j) && (pattern[k + 1] == '-')) { to= (unsigned char) pattern[k + 2]; k+= 2; }
+    for (unsigned int c= from; c <= to; ++c) bits[c >> 3]|= (1 << (c & 7));
+  }
+  if (is_negated) for (int k= 0; k < 32; ++k) bits[k]= ~bits[k];
+  *rval= pgfindlib_matcher_add_position(matcher, PGFINDLIB_GLOB_CLASS, 0);
+  if (*rval != PGFINDLIB_OK) return 1;
+  matcher->positions[matcher->positions_count - 1].class_number= matcher->classes_count;
+  ++matcher->classes_count;
+  *i= j;
+  return 1;
+}
+
+/* Compile one brace-free pattern. is_prefix means it had no glob characters so it gets a trailing star. */
+static int pgfindlib_matcher_add_pattern(struct pgfindlib_where_matcher *matcher, const char *pattern, unsigned int pattern_length,
+                                         int is_prefix)
+{
+  int rval= PGFINDLIB_OK;
+  for (unsigned int i= 0; i < pattern_length; ++i)
+  {
+    char c= pattern[i];
+    if ((c == '\\') && (i + 1 < pattern_length)) rval= pgfindlib_matcher_add_position(matcher, PGFINDLIB_GLOB_LITERAL, pattern[++i]);
+    else if (is_prefix) rval= pgfindlib_matcher_add_position(matcher, PGFINDLIB_GLOB_LITERAL, c);
+    else if (c == '*')
+    {
+      if ((matcher->positions_count > 0) && (matcher->positions[matcher->positions_count - 1].type == PGFINDLIB_GLOB_STAR)
+       && (i > 0) && (pattern[i - 1] == '*')) continue; /* ** is the same as * */
+      rval= pgfindlib_matcher_add_position(matcher, PGFINDLIB_GLOB_STAR, 0);
+    }
+    else if (c == '?')
+    {
+      rval= pgfindlib_matcher_add_position(matcher, PGFINDLIB_GLOB_CLASS, 0);
+      if (rval == PGFINDLIB_OK) matcher->positions[matcher->positions_count - 1].class_number= 0; /* class 0 is "any" */
+    }
+    else if ((c == '[') && (pgfindlib_matcher_add_class(matcher, pattern, pattern_length, &i, &rval) != 0)) {;}
+    else rval= pgfindlib_matcher_add_position(matcher, PGFINDLIB_GLOB_LITERAL, c);
+    if (rval != PGFINDLIB_OK) return rval;
+  }
+  if (is_prefix) rval= pgfindlib_matcher_add_position(matcher, PGFINDLIB_GLOB_STAR, 0);
+  if (rval != PGFINDLIB_OK) return rval;
+  return pgfindlib_matcher_add_position(matcher, PGFINDLIB_GLOB_ACCEPT, 0);
+}
+
+/*
+  Expand the first top-level {a,b,...} in pattern and recurse for each alternative, or compile if there is none.
+  *expansions_count limits the total for one WHERE item so that {a,b}{c,d}{e,f}... can't explode.
+  is_expanded means pattern came from a brace expansion so it is a glob even if no glob characters are left.
+*/
+static int pgfindlib_matcher_expand(struct pgfindlib_where_matcher *matcher, const char *pattern, unsigned int pattern_length,
+                                    unsigned int *expansions_count, int is_expanded)
+{
+  unsigned int open= pattern_length, close= pattern_length;
+  int depth= 0;
+  for (unsigned int i= 0; i < pattern_length; ++i)
+  {
+    if ((pattern[i] == '\\') && (i + 1 < pattern_length)) { ++i; continue; }
+    if (pattern[i] == '{') { if (depth == 0) open= i; ++depth; }
+    else if ((pattern[i] == '}') && (depth > 0)) { --depth; if (depth == 0) { close= i; break; } }
+  }
+  if (close == pattern_length) /* no braces (or unmatched { which is then literal) */
+  {
+    if (++*expansions_count > PGFINDLIB_MAX_BRACE_EXPANSIONS) return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+    int is_prefix= (is_expanded == 0);
+    for (unsigned int i= 0; i < pattern_length; ++i)
+    {
+      if ((pattern[i] == '\\') && (i + 1 < pattern_length)) { ++i; continue; }
+      if ((pattern[i] == '*') || (pattern[i] == '?') || (pattern[i] == '[') || (pattern[i] == '{')) { is_prefix= 0; break; }
+    }
+    if (is_prefix == 0) matcher->is_glob= 1;
+    return pgfindlib_matcher_add_pattern(matcher, pattern, pattern_length, is_prefix);
+  }
+  matcher->is_glob= 1;
+  char *alternative= (char *)malloc(pattern_length + 1);
+  if (alternative == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  int rval= PGFINDLIB_OK;
+  unsigned int item_start= open + 1;
+  depth= 0;
+  for (unsigned int i= open + 1; i <= close; ++i)
+  {
+    if ((pattern[i] == '\\') && (i + 1 < close)) { ++i; continue; }
+    if (pattern[i] == '{') ++depth;
+    else if ((pattern[i] == '}') && (depth > 0)) --depth;
+    else if (((pattern[i] == ',') && (depth == 0)) || (i == close))
+    {
+      unsigned int length= 0;
+      memcpy(alternative, pattern, open); length+= open;
+      memcpy(alternative + length, pattern + item_start, i - item_start); length+= i - item_start;
+      memcpy(alternative + length, pattern + close + 1, pattern_length - (close + 1)); length+= pattern_length - (close + 1);
+      alternative[length]= '\0';
+      rval= pgfindlib_matcher_expand(matcher, alternative, length, expansions_count, 1);
+      if (rval != PGFINDLIB_OK) break;
+      item_start= i + 1;
+    }
+  }
+  free(alternative);
+  return rval;
+}
+
+/* Add position and everything reachable from it without reading a character. Uses matcher->marks to avoid duplicates. */
+static void pgfindlib_matcher_closure(struct pgfindlib_where_matcher *matcher, unsigned int position, unsigned int *set, unsigned int *set_count)
+{
+  for (;;)
+  {
+    if (matcher->marks[position] == matcher->mark_generation) return;
+    matcher->marks[position]= matcher->mark_generation;
+    set[(*set_count)++]= position;
+    if (matcher->positions[position].type != PGFINDLIB_GLOB_STAR) return;
+    ++position; /* a star can match nothing */
+  }
+}
+
+static int pgfindlib_matcher_uint_compare(const void *p1, const void *p2)
+{
+  unsigned int u1= *(const unsigned int *) p1, u2= *(const unsigned int *) p2;
+  return (u1 < u2) ? -1 : (u1 > u2);
+}
+
+static int pgfindlib_matcher_state(struct pgfindlib_where_matcher *matcher, const unsigned int *set, unsigned int set_count);
+
+/*
+  Empty the state cache and make the start state again, the closure of every pattern start, so that
+  pgfindlib_find_line_in_statement() begins each line at matcher->start_state without a closure or sort.
+  The cache is empty and init() made room for it, so pgfindlib_matcher_state() can't fail here.
+  This overwrites matcher->work, so a caller that was using it must start again, as callers of a -1 do.
+*/
+static void pgfindlib_matcher_reset_states(struct pgfindlib_where_matcher *matcher)
+{
+  matcher->states_count= 0;
+  matcher->sets_length= 0;
+  for (unsigned int i= 0; i < matcher->buckets_count; ++i) matcher->buckets[i]= -1;
+  unsigned int set_count= 0;
+  ++matcher->mark_generation;
+  for (unsigned int i= 0; i < matcher->pattern_starts_count; ++i)
+    pgfindlib_matcher_closure(matcher, matcher->pattern_starts[i], matcher->work, &set_count);
+  qsort(matcher->work, set_count, sizeof(unsigned int), pgfindlib_matcher_uint_compare);
+  matcher->start_state= pgfindlib_matcher_state(matcher, matcher->work, set_count);
+}
+
+/*
+  Find or make the state for set[0 .. set_count-1] which must be sorted.
+  Return state number, or -1 if the cache was full and has been reset (then caller starts again).
+*/
+static int pgfindlib_matcher_state(struct pgfindlib_where_matcher *matcher, const unsigned int *set, unsigned int set_count)
+{
+  unsigned int hash= 2166136261u;
+  for (unsigned int i= 0; i < set_count; ++i) hash= (hash ^ set[i]) * 16777619u;
+  unsigned int bucket= hash % matcher->buckets_count;
+  for (int s= matcher->buckets[bucket]; s != -1; s= matcher->states[s].next_in_bucket)
+  {
+    const struct pgfindlib_dfa_state *state= &matcher->states[s];
+    if ((state->hash == hash) && (state->set_count == set_count)
+     && (memcmp(matcher->sets + state->set_offset, set, set_count * sizeof(unsigned int)) == 0))
+      return s;
+  }
+  if ((matcher->states_count == matcher->states_max) || (matcher->sets_length + set_count > matcher->sets_max))
+  {
+    unsigned int new_states_max= matcher->states_max;
+    unsigned int new_sets_max= matcher->sets_max;
+    if (matcher->states_count == matcher->states_max) new_states_max*= 2;
+    if (matcher->sets_length + set_count > matcher->sets_max) new_sets_max= (matcher->sets_length + set_count) * 2;
+    struct pgfindlib_dfa_state *new_states= NULL;
+    unsigned int *new_sets= NULL;
+    if (new_states_max <= PGFINDLIB_MAX_DFA_STATES)
+    {
+      new_states= (struct pgfindlib_dfa_state *)realloc(matcher->states, new_states_max * sizeof(struct pgfindlib_dfa_state));
+      if (new_states != NULL) { matcher->states= new_states; matcher->states_max= new_states_max; }
+      new_sets= (unsigned int *)realloc(matcher->sets, new_sets_max * sizeof(unsigned int));
+      if (new_sets != NULL) { matcher->sets= new_sets; matcher->sets_max= new_sets_max; }
+    }
+    if ((new_states == NULL) || (new_sets == NULL))
+    {
+      /* Too many states or out of memory. Start the cache again, init() made sure there is room for a few states. */
+      pgfindlib_matcher_reset_states(matcher);
+      return -1;
+    }
+  }
+  struct pgfindlib_dfa_state *state= &matcher->states[matcher->states_count];
+  state->set_offset= matcher->sets_length;
+  state->set_count= set_count;
+  state->hash= hash;
+  state->is_accepting= 0;
+  state->is_accepting_forever= 0;
+  for (unsigned int i= 0; i < set_count; ++i)
+  {
+    const struct pgfindlib_glob_position *position= &matcher->positions[set[i]];
+    if (position->type == PGFINDLIB_GLOB_ACCEPT) state->is_accepting= 1;
+    if ((position->type == PGFINDLIB_GLOB_STAR) && (matcher->positions[set[i] + 1].type == PGFINDLIB_GLOB_ACCEPT))
+      state->is_accepting_forever= 1; /* e.g. a prefix token is fully matched, what follows doesn't matter */
+  }
+  for (int c= 0; c < 256; ++c) state->transitions[c]= -1;
+  memcpy(matcher->sets + matcher->sets_length, set, set_count * sizeof(unsigned int));
+  matcher->sets_length+= set_count;
+  state->next_in_bucket= matcher->buckets[bucket];
+  matcher->buckets[bucket]= matcher->states_count;
+  return matcher->states_count++;
+}
+
+
+/* Put in out[] every position reachable from set[] by reading c. Return count. out[] is not sorted. */
+static unsigned int pgfindlib_matcher_next_set(struct pgfindlib_where_matcher *matcher, const unsigned int *set, unsigned int set_count,
+                                               unsigned char c, unsigned int *out)
+{
+  unsigned int out_count= 0;
+  ++matcher->mark_generation;
+  for (unsigned int i= 0; i < set_count; ++i)
+  {
+    const struct pgfindlib_glob_position *position= &matcher->positions[set[i]];
+    if (position->type == PGFINDLIB_GLOB_STAR)
+      pgfindlib_matcher_closure(matcher, set[i], out, &out_count);
+    else if ((position->type == PGFINDLIB_GLOB_LITERAL) && ((unsigned char) position->literal == c))
+      pgfindlib_matcher_closure(matcher, set[i] + 1, out, &out_count);
+    else if ((position->type == PGFINDLIB_GLOB_CLASS) && ((matcher->classes[position->class_number][c >> 3] & (1 << (c & 7))) != 0))
+      pgfindlib_matcher_closure(matcher, set[i] + 1, out, &out_count);
+  }
+  return out_count;
+}
+
+/* Compute transition from state s on byte c. Return -1 if the cache was reset meanwhile. */
+static int pgfindlib_matcher_next_state(struct pgfindlib_where_matcher *matcher, int s, unsigned char c)
+{
+  unsigned int set_count= pgfindlib_matcher_next_set(matcher, matcher->sets + matcher->states[s].set_offset,
+                                                     matcher->states[s].set_count, c, matcher->work);
+  qsort(matcher->work, set_count, sizeof(unsigned int), pgfindlib_matcher_uint_compare);
+  int next= pgfindlib_matcher_state(matcher, matcher->work, set_count);
+  if (next == -1) return -1;
+  matcher->states[s].transitions[c]= next;
+  return next;
+}
+
+/*
+  Run the positions directly without making DFA states. Slower, but needs no memory, so it is what happens
+  for the rest of a line if the DFA cache fills up in the middle of it.
+*/
+static int pgfindlib_matcher_simulate(struct pgfindlib_where_matcher *matcher, const char *line, unsigned int line_length)
+{
+  unsigned int *set= matcher->work, *next_set= matcher->work_2, *tmp;
+  unsigned int set_count= 0;
+  ++matcher->mark_generation;
+  for (unsigned int i= 0; i < matcher->pattern_starts_count; ++i)
+    pgfindlib_matcher_closure(matcher, matcher->pattern_starts[i], set, &set_count);
+  for (unsigned int i= 0; (i < line_length) && (set_count > 0); ++i)
+  {
+    set_count= pgfindlib_matcher_next_set(matcher, set, set_count, (unsigned char) line[i], next_set);
+    tmp= set; set= next_set; next_set= tmp;
+  }
+  for (unsigned int i= 0; i < set_count; ++i)
+  {
+    if (matcher->positions[set[i]].type == PGFINDLIB_GLOB_ACCEPT) return 1;
+  }
+  return 0;
+}
+
+/*
+  Compile the FILE tokens of tokener_list into matcher.
+  Return PGFINDLIB_OK, or PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW, or PGFINDLIB_ERROR_STATEMENT_SYNTAX if braces expand too much.
+  Call pgfindlib_matcher_free() afterwards regardless.
+*/
+static int pgfindlib_matcher_init(struct pgfindlib_where_matcher *matcher, const struct tokener tokener_list[])
+{
+  int rval= PGFINDLIB_OK;
+  memset(matcher, 0, sizeof(struct pgfindlib_where_matcher));
+  /* class 0 is "any character", for ? */
+  matcher->classes= (unsigned char (*)[32])malloc(8 * 32);
+  if (matcher->classes == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  matcher->classes_max= 8;
+  memset(matcher->classes[0], 0xff, 32);
+  matcher->classes_count= 1;
+  for (unsigned int tokener_number= 0; tokener_list[tokener_number].tokener_comment_id != PGFINDLIB_TOKEN_END; ++tokener_number)
+  {
+    if (tokener_list[tokener_number].tokener_comment_id != PGFINDLIB_TOKEN_FILE) continue;
+    unsigned int expansions_count= 0; /* per item, so a long WHERE list isn't mistaken for an explosion */
+    const char *name= tokener_list[tokener_number].tokener_name;
+    unsigned int name_length= tokener_list[tokener_number].tokener_length;
+    /* a quoted token includes its opening quote, see pgfindlib_tokenize() */
+    if ((name_length > 0) && ((*name == '"') || (*name == 0x27) || (*name == ':'))) { ++name; --name_length; }
+    if (name_length == 0) continue;
+    unsigned int first_position= matcher->positions_count;
+    rval= pgfindlib_matcher_expand(matcher, name, name_length, &expansions_count, 0);
+    if (rval != PGFINDLIB_OK) return rval;
+    /* Each ACCEPT is followed by the start of the next pattern. Remember the starts. */
+    for (unsigned int i= first_position; i < matcher->positions_count; ++i)
+    {
+      if ((i != first_position) && (matcher->positions[i - 1].type != PGFINDLIB_GLOB_ACCEPT)) continue;
+      if ((matcher->pattern_starts_count % 64) == 0)
+      {
+        unsigned int *new_starts= (unsigned int *)realloc(matcher->pattern_starts, (matcher->pattern_starts_count + 64) * sizeof(unsigned int));
+        if (new_starts == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+        matcher->pattern_starts= new_starts;
+      }
+      matcher->pattern_starts[matcher->pattern_starts_count++]= i;
+    }
+  }
+  /* Guarantee room for a dead state + start state + one more so that a reset always makes progress */
+  unsigned int n= matcher->positions_count + 1;
+  matcher->marks= (unsigned int *)calloc(n, sizeof(unsigned int));
+  matcher->work= (unsigned int *)malloc(n * sizeof(unsigned int));
+  matcher->work_2= (unsigned int *)malloc(n * sizeof(unsigned int));
+  matcher->states_max= 16;
+  matcher->states= (struct pgfindlib_dfa_state *)malloc(matcher->states_max * sizeof(struct pgfindlib_dfa_state));
+  matcher->sets_max= n * 4;
+  matcher->sets= (unsigned int *)malloc(matcher->sets_max * sizeof(unsigned int));
+  matcher->buckets_count= 1021;
+  matcher->buckets= (int *)malloc(matcher->buckets_count * sizeof(int));
+  if ((matcher->marks == NULL) || (matcher->work == NULL) || (matcher->work_2 == NULL) || (matcher->states == NULL)
+   || (matcher->sets == NULL) || (matcher->buckets == NULL))
+    return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  pgfindlib_matcher_reset_states(matcher);
+  return PGFINDLIB_OK;
+}
+
+static void pgfindlib_matcher_free(struct pgfindlib_where_matcher *matcher)
+{
+  if (matcher->positions != NULL) free(matcher->positions);
+  if (matcher->classes != NULL) free(matcher->classes);
+  if (matcher->pattern_starts != NULL) free(matcher->pattern_starts);
+  if (matcher->marks != NULL) free(matcher->marks);
+  if (matcher->work != NULL) free(matcher->work);
+  if (matcher->work_2 != NULL) free(matcher->work_2);
+  if (matcher->states != NULL) free(matcher->states);
+  if (matcher->sets != NULL) free(matcher->sets);
+  if (matcher->buckets != NULL) free(matcher->buckets);
+  memset(matcher, 0, sizeof(struct pgfindlib_where_matcher));
+}
+
+/*
+  Compare line to each of the items in statement, in one pass. If match: 1 true. Else: 0 false.
+  Assume that line cannot contain ':' and ':' within statement is a delimiter. (Actually so is ',' the way tokenize works.)
+  Ignore lead or trail spaces.
+  Treat \n as end of line and ignore it.
+  We have already checked that strlen(each soname) is <= PGFINDLIB_MAX_PATH_LENGTH.
+  Beware: ldconfig -p lines start with a control character (tab?).
+*/
+int pgfindlib_find_line_in_statement(struct pgfindlib_where_matcher *matcher, const char *line)
+{
+  const char *pointer_to_line= line;
+  while ((*pointer_to_line != '\0') && (*pointer_to_line <= ' ')) ++pointer_to_line; /* skip lead spaces (or control characters!) in line */
+  unsigned int line_length= strlen(pointer_to_line);
+  if ((line_length > 1) && (pointer_to_line[line_length - 1] == '\n')) --line_length; /* skip trail \n */
+  while ((line_length > 0) && (pointer_to_line[line_length - 1] == ' ')) --line_length; /* skip trail spaces */
+  if (line_length == 0) return 0; /* false */
+  if (matcher->pattern_starts_count == 0) return 0;
+  int s= matcher->start_state;
+  for (unsigned int i= 0; i < line_length; ++i)
+  {
+    if (matcher->states[s].is_accepting_forever) return 1;
+    if (matcher->states[s].set_count == 0) return 0; /* dead */
+    unsigned char c= (unsigned char) pointer_to_line[i];
+    int next= matcher->states[s].transitions[c];
+    if (next == -1)
+    {
+      next= pgfindlib_matcher_next_state(matcher, s, c);
+      if (next == -1) return pgfindlib_matcher_simulate(matcher, pointer_to_line, line_length); /* cache was reset, rare */
+    }
+    s= next;
+  }
+  return matcher->states[s].is_accepting;
+}
+/*
+  Pass: library or file name
+  Do: replace with same library or file name, except that $ORIGIN or $LIB or $PLATFORM is replaced
+  Return: rval
+  Todo: It seems loader replaces $LIB or $LIB/ but not $LIB in $LIBxxx, this replaces $LIB in $LIBxxx too.
+  Todo: https://bugs.freebsd.org/bugzilla/show_bug.cgi?id=187114 suggests no need to check DF_ORIGIN flag nowadays
+        but that hasn't been tested
+*/
+int pgfindlib_replace_lib_or_platform_or_origin(char *one_library_or_file, unsigned int *replacements_count, const char *lib, const char *platform, const char *origin,
+                                                struct pgfindlib_context *context)
+{
+  *replacements_count= 0;
+  if (strchr(one_library_or_file, '$') == NULL) return PGFINDLIB_OK;
+  char *buffer_for_output= context->replace_output;
+  char *p_line_out= &buffer_for_output[0];
+  *p_line_out= '\0';
+  for (const char *p_line_in= one_library_or_file; *p_line_in != '\0';)
+  {
+    if ((strncmp(p_line_in, "$ORIGIN", 7) == 0) || (strncmp(p_line_in, "${ORIGIN}", 9) == 0))
+    {
+      strcpy(p_line_out, origin);
+      p_line_out+= strlen(origin);
+      if (*(p_line_in + 1) == '{') p_line_in+= 9 - 7;
+      p_line_in+= 7;
+      ++*replacements_count;
+    }
+    else if ((strncmp(p_line_in, "$LIB", 4) == 0) || (strncmp(p_line_in, "${LIB}", 6) == 0))
+    {
+      strcpy(p_line_out, lib);
+      p_line_out+= strlen(lib);
+      if (*(p_line_in + 1) == '{') p_line_in+= 6 - 4;
+      p_line_in+= 4;
+      ++*replacements_count;
+    }
+    else if ((strncmp(p_line_in, "$PLATFORM", 9) == 0) || (strncmp(p_line_in, "${PLATFORM}", 11) == 0))
+    {
+      strcpy(p_line_out, platform);
+      p_line_out+= strlen(platform);
+      if (*(p_line_in + 1) == '{') p_line_in+= 11 - 9;
+      p_line_in+= 9;
+      ++*replacements_count;
+    }
+    else
+    {
+      *p_line_out= *p_line_in;
+      ++p_line_out;
+      ++p_line_in;
+    }
+    if ((p_line_out - &buffer_for_output[0]) > PGFINDLIB_MAX_PATH_LENGTH)
+      return PGFINDLIB_ERROR_MAX_PATH_LENGTH_TOO_SMALL;
+    *p_line_out= '\0';
+  }
+  strcpy(one_library_or_file, buffer_for_output);
+  return PGFINDLIB_OK;
+}
+
+/*
+  Return: what would loader change "$LIB" or "$PLATFORM" or "$ORIGIN" to
+  Re method: Use a dummy utility, preferably bin/true, ls should also work but isn't as good
+            (any program anywhere will work provided it requires any .so, and libc.so is such).
+            First attempt: read ELF to get "ELF interpreter" i.e. loader name,
+            which probably is /lib64/ld-linux-x86-64.so.2 or /lib/ld-linux.so.2,
+            then use it with LD_DEBUG to see search_path when executing the dummy utility.
+            If that fails: same idea but just running the dummy.
+            If that fails: (lib) lib64 for 64-bit, lib for 32-bit. (platform) uname -m.
+            FreeBSD is different.
+  Todo: get PT_DYNAMIC the way we get PT_INTERN, instead of depending on extern _DYNAMIC (but this is hard, see read_elf()
+  Todo: If there is a /tls (thread local storage) subdirectory or an x86_64 subdirectory,
+        search all. But show library search path=main, main-tls, main/x86_64
+  Todo: If dynamic loader is not the usual e.g. due to "-Wl,-I/tmp/my_ld.so" then add a comment.
+*/
+/* Return the PT_INTERP string of the mapped executable whose ELF header is ehdr, i.e. the dynamic loader, or NULL. */
+static const char *pgfindlib_interpreter_name(const ElfW(Ehdr) *ehdr)
+{
+  if (ehdr == NULL) return NULL;
+  const char *cc= (const char *)ehdr; /* offsets are in bytes so I prefer to use a byte pointer */
+  cc+= ehdr->e_phoff; /* -> start of program headers */
+  for (unsigned int i= 0; i < ehdr->e_phnum; ++i) /* loop through program headers */
+  {
+    const ElfW(Phdr) *phdr= (const ElfW(Phdr) *)cc;
+    if (phdr->p_type == PT_INTERP) return (const char *)ehdr + phdr->p_offset; /* i.e. ELF interpreter */
+    cc+= ehdr->e_phentsize;
+  }
+  return NULL;
+}
+
+int pgfindlib_get_origin_and_lib_and_platform(char *origin, char *lib, char *platform,
+                                              char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                                              int *program_e_machine, unsigned int *row_number,
+                                              ino_t inode_list[], unsigned int *inode_count, struct pgfindlib_context *context)
+{
+  unsigned int option_flags= context->option_flags;
+  int platform_change_count= 0;
+  int rval= PGFINDLIB_OK;
+  int lib_change_count= 0;
+
+#ifdef PGFINDLIB_FREEBSD
+  int aux_info_return= elf_aux_info(AT_EXECPATH, origin, PGFINDLIB_MAX_PATH_LENGTH);
+  if (aux_info_return != 0)
+  {
+#if (PGFINDLIB_COMMENT_ELF_AUX_INFO_FAILED != 0)
+    rval= pgfindlib_comment_is_row("elf_aux_info failed so $ORIGIN is unknown",
+                                   PGFINDLIB_COMMENT_ELF_AUX_INFO_FAILED,
+                                   buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+    if (rval != PGFINDLIB_OK) return rval;
+#endif
+    strcpy(origin, "");
+  }
+  strcpy(lib, "lib");
+  /* platform should be set after the if/else/endif */
+#else
+  {
+    int readlink_return;
+    readlink_return= readlink("/proc/self/exe", origin, PGFINDLIB_MAX_PATH_LENGTH);
+    if ((readlink_return < 0) || (readlink_return >= PGFINDLIB_MAX_PATH_LENGTH))
+    {
+#if (PGFINDLIB_COMMENT_READLINK_FAILED != 0)
+      rval= pgfindlib_comment_is_row("readlink failed so $ORIGIN is unknown",
+                         PGFINDLIB_COMMENT_READLINK_FAILED,
+                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+      if (rval != PGFINDLIB_OK) return rval;
+#endif
+      strcpy(origin, "");
+    }
+    else *(origin + readlink_return)= '\0';
+    for (char *p= origin + strlen(origin); p != origin; --p)
+    {
+      if (*p == '/')
+      {
+        *p= '\0';
+        break;
+      }
+    }
+  }
+#endif /* ifdef PGFINDLIB_FREEBSD */
+
+#if (PGFINDLIB_IF_GET_LIB_OR_PLATFORM != 0)
+  /* utility name */
+  /* FreeBSD probably won't have /bin/true, it seems to be a Linux thing, but maybe it will have id */
+  char utility_name[256]= ""; /* todo: change to const char * */
+  if ((option_flags & PGFINDLIB_OPTION_GET_LIB_OR_PLATFORM) == 0) {;} /* no probing so utility_name isn't needed */
+  else if (access("/bin/true", X_OK) == 0) strcpy(utility_name, "/bin/true");
+  else if (access("/bin/cp", X_OK) == 0) strcpy(utility_name, "/bin/cp");
+  else if (access("/usr/bin/true", X_OK) == 0) strcpy(utility_name, "/usr/bin/true");
+  else if (access("/usr/bin/cp", X_OK) == 0) strcpy(utility_name, "/usr/bin/cp");
+  else if (access("/bin/id", X_OK) == 0) strcpy(utility_name, "/bin/id");
+  else if (access("/usr/bin/id", X_OK) == 0) strcpy(utility_name, "/usr/bin/id");
+#if (PGFINDLIB_COMMENT_NO_TRUE_OR_CP != 0)
+  if (((option_flags & PGFINDLIB_OPTION_GET_LIB_OR_PLATFORM) != 0) && (strcmp(utility_name, "") == 0))
+  {
+    rval= pgfindlib_comment_is_row("no access to [/usr]/bin/true or [/usr]/bin/cp or /bin/id",
+                         PGFINDLIB_COMMENT_NO_TRUE_OR_CP,
+                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+    if (rval != PGFINDLIB_OK) return rval;
+  }
+#endif
+
+/* todo: move this up, and if it's zilch then we cannot read elf here */
+/* This was void* but that triggered -Warray-bounds during an rpm build. */
+extern ElfW(Ehdr) __executable_start;
+  ElfW(Ehdr)*ehdr= NULL;
+  ehdr= (ElfW(Ehdr)*) &__executable_start; /* linker e.g. ld.bfd or ld.lld is supposed to add this */
+  if (ehdr != NULL)
+  {
+
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0)
+    {
+#if (PGFINDLIB_COMMENT_EHDR_IDENT != 0)
+      rval= pgfindlib_comment_is_row("ehdr->ident not valid",
+                         PGFINDLIB_COMMENT_EHDR_IDENT,
+                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+      if (rval != PGFINDLIB_OK) return rval;
+#endif
+      ehdr= NULL;
+    }
+  }
+
+  if (ehdr != NULL)
+  {
+    *program_e_machine= ehdr->e_machine;
+  }
+  else *program_e_machine= 0;
+  
+  /* Without PGFINDLIB_OPTION_GET_LIB_OR_PLATFORM there is no popen() of the dynamic loader, $LIB and $PLATFORM are assumed */
+  if ((option_flags & PGFINDLIB_OPTION_GET_LIB_OR_PLATFORM) != 0)
+  {
+    /* first attempt */
+
+    const char *dynamic_loader_name= pgfindlib_interpreter_name(ehdr);
+
+    if (dynamic_loader_name == NULL)
+    {
+      if ((sizeof(void*)) == 8) dynamic_loader_name= "/lib64/ld-linux-x86-64.so.2"; /* make some gcc/glibc assumptions */
+      else dynamic_loader_name= "/lib/ld-linux.so.2";
+#if (PGFINDLIB_COMMENT_CANT_FIND_DYNAMIC_LOADER != 0)
+      char *comment= context->comment;
+      sprintf(comment, "can't get ehdr dynamic loader so assume %s", dynamic_loader_name);
+      rval= pgfindlib_comment_is_row(comment,
+                           PGFINDLIB_COMMENT_CANT_FIND_DYNAMIC_LOADER,
+                           buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+      if (rval != PGFINDLIB_OK) return rval;
+#endif
+    }
+
+    if (access(dynamic_loader_name, X_OK) != 0)
+    {
+#if (PGFINDLIB_COMMENT_CANT_ACCESS_DYNAMIC_LOADER != 0)
+      char *comment= context->comment;
+      sprintf(comment, "can't access %s", dynamic_loader_name);
+      rval= pgfindlib_comment_is_row(comment,
+                           PGFINDLIB_COMMENT_CANT_ACCESS_DYNAMIC_LOADER,
+                           buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+      if (rval != PGFINDLIB_OK) return rval;
+#endif
+      dynamic_loader_name= NULL;
+    }
+
+    if (dynamic_loader_name != NULL)
+    {
+#define REPLACEE_IS_LIB 0
+#define REPLACEE_IS_PLATFORM 1
+      for (int i= REPLACEE_IS_LIB; i <= REPLACEE_IS_PLATFORM; ++i) /* 0 means "$LIB", 1 means "$PLATFORM" */
+      {
+        const char *replacee= (i == REPLACEE_IS_LIB) ? "$LIB" : "$PLATFORM";
+        char *replacement= (i == REPLACEE_IS_LIB) ? lib : platform;
+        const char *spawn_argv[4]= { dynamic_loader_name, "--inhibit-cache", utility_name, NULL };
+        int change_count= pgfindlib_ookpik(context, spawn_argv, replacee, replacement);
+        /* second attempt */
+        if (change_count == 0)
+        {
+          spawn_argv[0]= utility_name;
+          spawn_argv[1]= NULL;
+          change_count= pgfindlib_ookpik(context, spawn_argv, replacee, replacement);
+        }
+        if (i == REPLACEE_IS_LIB) lib_change_count+= change_count;
+        else platform_change_count+= change_count;
+      }
+    }
+  }
+#endif /* if (PGFINDLIB_IF_GET_LIB_OR_PLATFORM != 0) */
+  if (lib_change_count == 0)
+  {
+    if ((sizeof(void*)) == 8) strcpy(lib, "lib64"); /* default $LIB if pgfindlib__get_lib_or_platform doesn't work */
+    else strcpy(lib, "lib");
+#if (PGFINDLIB_COMMENT_ASSUMING_LIB != 0)
+    char *comment= context->comment;
+    sprintf(comment, "assuming $LIB is %s", lib);
+    rval= pgfindlib_comment_is_row(comment,
+                         PGFINDLIB_COMMENT_ASSUMING_LIB,
+                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+    if (rval != PGFINDLIB_OK) return rval;
+#endif
+  }
+
+  if (platform_change_count == 0)
+  {
+    /* uname(2) gives the same machine as uname -m, without starting a process */
+    struct utsname utsname_buffer;
+    strcpy(platform, "?");
+    if ((uname(&utsname_buffer) == 0) && (strlen(utsname_buffer.machine) < PGFINDLIB_MAX_PATH_LENGTH))
+      strcpy(platform, utsname_buffer.machine);
+#if (PGFINDLIB_COMMENT_UNAME_FAILED != 0)
+    if (strcmp(platform, "?") == 0)
+    {
+      rval= pgfindlib_comment_is_row("uname -m failed",
+                         PGFINDLIB_COMMENT_UNAME_FAILED,
+                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+      if (rval != PGFINDLIB_OK) return rval;
+    }
+#endif
+#if (PGFINDLIB_COMMENT_ASSUMING_PLATFORM != 0)
+    char *comment= context->comment;
+    sprintf(comment, "assuming $PLATFORM is %s", platform);
+    rval= pgfindlib_comment_is_row(comment,
+                         PGFINDLIB_COMMENT_ASSUMING_PLATFORM,
+                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+    if (rval != PGFINDLIB_OK) return rval;
+#endif
+  }
+  return rval; /* which is doubtless PGFINDLIB_OK */
+}
+
+/*
+ *For a comment column
+  Put column of row in buffer.
+  All warnings and comments must have form: 3-decimal-digit-number text delimiter
+  The number should never change, the text should rarely change.
+  Todo: flag to ignore column because column_number
+        flag to exclude text and only show number
+        limit text length
+        enclose in ''s or ""s if contains delimiter
+*/
+int pgfindlib_comment_in_row(char *comment, unsigned int comment_number, int additional_number)
+{
+  const char *text;
+  if (comment_number == PGFINDLIB_COMMENT_DUPLICATE) sprintf(comment, "%03d %s %d", comment_number, "duplicate of", additional_number);
+  else if (comment_number == PGFINDLIB_COMMENT_SAME_TARGET) sprintf(comment, "%03d %s %d", comment_number, "same target as", additional_number);
+  else if (comment_number == PGFINDLIB_COMMENT_SAME_BUILD) sprintf(comment, "%03d %s %d", comment_number, "same build as", additional_number);
+  else if (comment_number == PGFINDLIB_COMMENT_DELTA_ADDED) sprintf(comment, "%03d %s %d", comment_number, "added as row", additional_number);
+  else if (comment_number == PGFINDLIB_COMMENT_DELTA_REMOVED) sprintf(comment, "%03d %s %d", comment_number, "removed from row", additional_number);
+  else if (comment_number == PGFINDLIB_COMMENT_DELTA_CHANGED) sprintf(comment, "%03d %s %d", comment_number, "changed in row", additional_number);
+  else if (comment_number == PGFINDLIB_COMMENT_DELTA_MOVED) sprintf(comment, "%03d %s %d", comment_number, "moved to row", additional_number);
+  else
+  {
+    if (comment_number == PGFINDLIB_COMMENT_ACCESS_FAILED) text= "access(filename, R_OK) failed";
+    if (comment_number == PGFINDLIB_COMMENT_LSTAT_FAILED) text= "lstat(filename) failed";
+    if (comment_number == PGFINDLIB_COMMENT_SYMLINK) text= "symlink";
+    if (comment_number == PGFINDLIB_COMMENT_SYMLINK_BROKEN) text= "symlink target not found";
+    if (comment_number == PGFINDLIB_COMMENT_MAX_INODE_COUNT_TOO_SMALL) text= "MAX_INODE_COUNT is too small";
+    if (comment_number == PGFINDLIB_COMMENT_ELF_OPEN_FAILED) text= "elf open failed";
+    if (comment_number == PGFINDLIB_COMMENT_ELF_READ_FAILED) text= "elf read failed";
+    if (comment_number == PGFINDLIB_COMMENT_ELF_HAS_INVALID_IDENT) text= "elf has invalid ident";
+    if (comment_number == PGFINDLIB_COMMENT_ELF_IS_NOT_EXEC_OR_DYN) text= "elf is not exec or dyn";
+    if (comment_number == PGFINDLIB_COMMENT_ELF_SHT_DYNAMIC_NOT_FOUND) text= "elf sht_dynamic not found";
+    if (comment_number == PGFINDLIB_COMMENT_ELF_MACHINE_DOES_NOT_MATCH) text= "elf machine does not match";
+    sprintf(comment, "%03d %s", comment_number, text);
+  }
+  return PGFINDLIB_OK;
+}
+
+/* This can be called when a warning|error will be the only item in the row, e.g. when about to return syntax error
+   But notice the fixed size of comment_with_number, don't call unless it's certain that the message is short
+*/
+int pgfindlib_comment_is_row(const char *comment, unsigned int comment_number,
+                             char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length, unsigned int *row_number,
+                             ino_t inode_list[], unsigned int *inode_count)
+{
+  if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
+  const char *columns_list[MAX_COLUMNS_PER_ROW];  
+  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
+  char comment_with_number[256];
+  sprintf(comment_with_number, "%03d %s", comment_number, comment);
+  columns_list[COLUMN_FOR_COMMENT_1]= comment_with_number;
+  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+}
+
+/*
+  called "bottom level" because ultimately all pgfindlib_row_* functions should call here
+  todo: move overflow check to here
+*/
+int pgfindlib_row_bottom_level(char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length, unsigned int *row_number, 
+                               const char *columns_list[])
+{
+  int rval;
+  char row_number_string[8];
+  unsigned int buffer_length_save= *buffer_length;
+  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i)
+  {
+    if (i == COLUMN_FOR_ROW_NUMBER)
+    {
+      sprintf(row_number_string, "%d", *row_number);
+      rval= pgfindlib_strcat(buffer, buffer_length, row_number_string, buffer_max_length);
+    }
+    else rval= pgfindlib_strcat(buffer, buffer_length, columns_list[i], buffer_max_length);
+    if (rval != PGFINDLIB_OK) goto overflow;
+    rval= pgfindlib_strcat(buffer, buffer_length, PGFINDLIB_COLUMN_DELIMITER, buffer_max_length); /* ":" */
+    if (rval != PGFINDLIB_OK) goto overflow;
+  }
+  rval= pgfindlib_strcat(buffer, buffer_length, PGFINDLIB_ROW_DELIMITER, buffer_max_length); /* "\n" */
+  if (rval != PGFINDLIB_OK) goto overflow;
+  ++*row_number;
+  return rval;
+overflow:
+/* todo: this should be a row and there should be a guarantee that it will fit i.e. the regular strcat check is buffer_length - what's needed for overflow message */
+  *buffer_length= buffer_length_save;
+  pgfindlib_strcat(buffer, buffer_length, "OVFLW", buffer_max_length);
+  return rval; /* i.e. return the rval that caused overflow */
+}
+
+static int pgfindlib_row_version(char *buffer, unsigned int *buffer_length, unsigned buffer_max_length, unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count)
+{
+  if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
+  char row_program[64];
+  sprintf(row_program, "%03d pgfindlib", PGFINDLIB_COMMENT_PGFINDLIB);
+  char row_version[64];
+  sprintf(row_version, "%03d version %d.%d.%d", PGFINDLIB_COMMENT_VERSION, PGFINDLIB_VERSION_MAJOR, PGFINDLIB_VERSION_MINOR, PGFINDLIB_VERSION_PATCH);
+  char row_url[64];
+  sprintf(row_url, "%03d https://github.com/pgulutzan/pgfindlib", PGFINDLIB_COMMENT_URL);
+  const char *columns_list[MAX_COLUMNS_PER_ROW];
+  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
+  columns_list[COLUMN_FOR_COMMENT_1]= row_program;
+  columns_list[COLUMN_FOR_COMMENT_2]= row_version;
+  columns_list[COLUMN_FOR_COMMENT_3]= row_url;
+  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+}
+
+int pgfindlib_row_lib(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length, unsigned buffer_max_length, unsigned int *row_number,
+                      ino_t inode_list[], unsigned int *inode_count,
+                      const char *lib, const char *platform, const char *origin)
+{
+  if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
+  char *column_lib= context->column_lib;
+  char *column_platform= context->column_platform;
+  char *column_origin= context->column_origin;
+  sprintf(column_lib, "%03d $LIB=%s", PGFINDLIB_COMMENT_LIB_STRING, lib);
+  sprintf(column_platform, "%03d $PLATFORM=%s", PGFINDLIB_COMMENT_PLATFORM_STRING, platform);
+  sprintf(column_origin, "%03d $ORIGIN=%s", PGFINDLIB_COMMENT_ORIGIN_STRING, origin);
+  const char *columns_list[MAX_COLUMNS_PER_ROW];
+  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
+  columns_list[COLUMN_FOR_COMMENT_1]= column_lib;
+  columns_list[COLUMN_FOR_COMMENT_2]= column_platform;
+  columns_list[COLUMN_FOR_COMMENT_3]= column_origin;
+  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+}
+
+/* Dump source name as a row-level comment. By default PGFINDLIB_INCLUDE_ROW_SOURCE_NAME == 0 so this is disabled */
+int pgfindlib_row_source_name(char *buffer, unsigned int *buffer_length, unsigned buffer_max_length, unsigned int *row_number,
+                             ino_t inode_list[], unsigned int *inode_count,
+                             const char *source_name)
+{
+#if (PGFINDLIB_INCLUDE_ROW_SOURCE_NAME == 1)
+  if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
+  const char *columns_list[MAX_COLUMNS_PER_ROW];
+  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
+  columns_list[COLUMN_FOR_SOURCE]= source_name;
+  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+#else
+  (void) buffer; (void) buffer_length; (void) buffer_max_length; (void) row_number; (void) inode_list; (void) inode_count; (void) source_name;
+  return PGFINDLIB_OK;
+#endif
+}
+
+/*
+  Symlink memo.
+  For a symlink row we want the final target, e.g. libfoo.so -> libfoo.so.3 -> libfoo.so.3.2.1.
+  Chains share links (libfoo.so and libfoo.so.3 both end at libfoo.so.3.2.1) so every readlinkat() result
+  is kept for the rest of the call, keyed by (directory dev + inode, name), and each link is read only once.
+  Directories are opened with O_PATH and kept open until pgfindlib_symlink_memo_free(), but no more than
+  PGFINDLIB_SYMLINK_MEMO_MAX_FDS at a time: the least recently used is closed, and opened again if it's needed again.
+  The memo also knows the (dev, inode) of the final target of each row, so a row whose target has
+  already appeared can say which row that was.
+*/
+#define PGFINDLIB_MAX_SYMLINK_CHAIN 40 /* like the kernel's MAXSYMLINKS */
+#define PGFINDLIB_SYMLINK_MEMO_BUCKETS 1021
+#define PGFINDLIB_SYMLINK_MEMO_MAX_FDS 32
+
+#ifndef O_PATH
+#define O_PATH O_RDONLY
+#endif
+
+static int pgfindlib_symlink_memo_init(struct pgfindlib_symlink_memo *memo)
+{
+  memset(memo, 0, sizeof(struct pgfindlib_symlink_memo));
+  memo->buckets= (int *)malloc(PGFINDLIB_SYMLINK_MEMO_BUCKETS * sizeof(int));
+  memo->row_target_buckets= (int *)malloc(PGFINDLIB_SYMLINK_MEMO_BUCKETS * sizeof(int));
+  memo->path_buffer= (char *)malloc(PGFINDLIB_MAX_PATH_LENGTH * 2 + 2);
+  memo->next_path_buffer= (char *)malloc(PGFINDLIB_MAX_PATH_LENGTH * 2 + 2);
+  memo->link_buffer= (char *)malloc(PGFINDLIB_MAX_PATH_LENGTH + 1);
+  if ((memo->buckets == NULL) || (memo->row_target_buckets == NULL)
+   || (memo->path_buffer == NULL) || (memo->next_path_buffer == NULL) || (memo->link_buffer == NULL))
+    return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  for (unsigned int i= 0; i < PGFINDLIB_SYMLINK_MEMO_BUCKETS; ++i) { memo->buckets[i]= -1; memo->row_target_buckets[i]= -1; }
+  return PGFINDLIB_OK;
+}
+
+static void pgfindlib_symlink_memo_free(struct pgfindlib_symlink_memo *memo)
+{
+  for (unsigned int i= 0; i < memo->entries_count; ++i)
+  {
+    free(memo->entries[i].name);
+    if (memo->entries[i].final_target != NULL) free(memo->entries[i].final_target);
+  }
+  for (unsigned int i= 0; i < memo->directories_count; ++i)
+  {
+    free(memo->directories[i].path);
+    if (memo->directories[i].fd >= 0) memo->backend->close(memo->backend->state, memo->directories[i].fd);
+  }
+  if (memo->entries != NULL) free(memo->entries);
+  if (memo->directories != NULL) free(memo->directories);
+  if (memo->row_targets != NULL) free(memo->row_targets);
+  if (memo->buckets != NULL) free(memo->buckets);
+  if (memo->row_target_buckets != NULL) free(memo->row_target_buckets);
+  if (memo->row_builds != NULL) free(memo->row_builds);
+  if (memo->row_build_buckets != NULL) free(memo->row_build_buckets);
+  if (memo->path_buffer != NULL) free(memo->path_buffer);
+  if (memo->next_path_buffer != NULL) free(memo->next_path_buffer);
+  if (memo->link_buffer != NULL) free(memo->link_buffer);
+  memset(memo, 0, sizeof(struct pgfindlib_symlink_memo));
+}
+
+#if (PGFINDLIB_INCLUDE_SYMLINKS != 0)
+static void pgfindlib_symlink_memo_close_lru(struct pgfindlib_symlink_memo *memo)
+{
+  int lru= -1;
+  for (unsigned int i= 0; i < memo->directories_count; ++i)
+  {
+    if (memo->directories[i].fd < 0) continue;
+    if ((lru == -1) || (memo->directories[i].last_used < memo->directories[lru].last_used)) lru= i;
+  }
+  if (lru == -1) return;
+  memo->backend->close(memo->backend->state, memo->directories[lru].fd);
+  memo->directories[lru].fd= -1;
+  --memo->directories_open;
+}
+
+/*
+  Open directory->path, closing the least recently used if there are PGFINDLIB_SYMLINK_MEMO_MAX_FDS already,
+  or if the process is out of file descriptors. Return 0, or -1 if it's missing, or -3 if it's EMFILE or ENFILE
+  and none of the memo's are left to close.
+*/
+static int pgfindlib_symlink_memo_open(struct pgfindlib_symlink_memo *memo, struct pgfindlib_symlink_memo_directory *directory)
+{
+  const struct pgfindlib_backend *backend= memo->backend;
+  if (memo->directories_open >= PGFINDLIB_SYMLINK_MEMO_MAX_FDS) pgfindlib_symlink_memo_close_lru(memo);
+  for (;;)
+  {
+    directory->fd= pgfindlib_open(backend, memo->sysroot_fd, directory->path, O_PATH | O_DIRECTORY);
+    if (directory->fd >= 0) break;
+    if ((errno != EMFILE) && (errno != ENFILE)) { directory->is_missing= 1; return -1; }
+    if (memo->directories_open == 0) return -3;
+    pgfindlib_symlink_memo_close_lru(memo);
+  }
+  struct stat sb;
+  if (backend->fstat(backend->state, directory->fd, &sb) != 0)
+  {
+    backend->close(backend->state, directory->fd);
+    directory->fd= -1;
+    directory->is_missing= 1;
+    return -1;
+  }
+  directory->dev= sb.st_dev;
+  directory->ino= sb.st_ino;
+  ++memo->directories_open;
+  return 0;
+}
+
+/* Return index in memo->directories, or -1 if it can't be opened, or -2 if malloc failed, or -3 if out of file descriptors */
+static int pgfindlib_symlink_memo_directory(struct pgfindlib_symlink_memo *memo, const char *directory_path)
+{
+  struct pgfindlib_symlink_memo_directory *directory;
+  for (unsigned int i= 0; i < memo->directories_count; ++i)
+  {
+    directory= &memo->directories[i];
+    if (strcmp(directory->path, directory_path) != 0) continue;
+    if (directory->is_missing) return -1;
+    directory->last_used= ++memo->directories_clock;
+    if (directory->fd >= 0) return (int) i;
+    int open_rval= pgfindlib_symlink_memo_open(memo, directory);
+    return (open_rval < 0) ? open_rval : (int) i;
+  }
+  if (memo->directories_count == memo->directories_max)
+  {
+    unsigned int new_max= memo->directories_max * 2 + 16;
+    struct pgfindlib_symlink_memo_directory *new_directories;
+    new_directories= (struct pgfindlib_symlink_memo_directory *)realloc(memo->directories, new_max * sizeof(struct pgfindlib_symlink_memo_directory));
+    if (new_directories == NULL) return -2;
+    memo->directories= new_directories;
+    memo->directories_max= new_max;
+  }
+  directory= &memo->directories[memo->directories_count];
+  memset(directory, 0, sizeof(struct pgfindlib_symlink_memo_directory));
+  directory->fd= -1;
+  directory->path= strdup(directory_path);
+  if (directory->path == NULL) return -2;
+  directory->last_used= ++memo->directories_clock;
+  ++memo->directories_count;
+  int open_rval= pgfindlib_symlink_memo_open(memo, directory);
+  return (open_rval < 0) ? open_rval : (int) memo->directories_count - 1;
+}
+
+/*
+  Take out "." and ".." segments and repeated slashes, so the same file has the same final target however the
+  links spelled it, e.g. /usr/lib64/../lib/./libfoo.so.1 is /usr/lib/libfoo.so.1. It's by the text, like realpath -s,
+  ".." at the start of a relative path or after "/" is kept or dropped respectively.
+*/
+static void pgfindlib_path_normalize(char *path)
+{
+  char *out= path;
+  const char *in= path;
+  int is_absolute= (*in == '/');
+  char *root= out;
+  if (is_absolute) { *out++= '/'; root= out; }
+  while (*in != '\0')
+  {
+    while (*in == '/') ++in;
+    if (*in == '\0') break;
+    const char *end= in;
+    while ((*end != '/') && (*end != '\0')) ++end;
+    unsigned int length= (unsigned int) (end - in);
+    if ((length == 1) && (in[0] == '.')) { in= end; continue; }
+    if ((length == 2) && (in[0] == '.') && (in[1] == '.'))
+    {
+      char *previous= out; /* the start of the last segment written */
+      while ((previous > root) && (*(previous - 1) != '/')) --previous;
+      int is_previous_dotdot= ((out - previous == 2) && (previous[0] == '.') && (previous[1] == '.'));
+      if ((out > root) && (!is_previous_dotdot)) { out= (previous > root) ? previous - 1 : root; in= end; continue; }
+      if (is_absolute) { in= end; continue; } /* /.. is / */
+    }
+    if (out > root) *out++= '/'; /* out stays at or behind in, there was a / before this segment */
+    memmove(out, in, length);
+    out+= length;
+    in= end;
+  }
+  if (out == path) *out++= '.';
+  *out= '\0';
+}
+
+static unsigned int pgfindlib_symlink_memo_hash(dev_t dev, ino_t ino, const char *name)
+{
+  unsigned int hash= 2166136261u;
+  hash= (hash ^ (unsigned int) dev) * 16777619u;
+  hash= (hash ^ (unsigned int) ino) * 16777619u;
+  for (const char *p= name; *p != '\0'; ++p) hash= (hash ^ (unsigned char) *p) * 16777619u;
+  return hash;
+}
+
+/* Return index of new entry, or -1 if malloc failed. final_target is NULL until the chain is resolved. */
+static int pgfindlib_symlink_memo_add(struct pgfindlib_symlink_memo *memo, dev_t dir_dev, ino_t dir_ino, const char *name, unsigned int hash)
+{
+  if (memo->entries_count == memo->entries_max)
+  {
+    unsigned int new_max= memo->entries_max * 2 + 64;
+    struct pgfindlib_symlink_memo_entry *new_entries;
+    new_entries= (struct pgfindlib_symlink_memo_entry *)realloc(memo->entries, new_max * sizeof(struct pgfindlib_symlink_memo_entry));
+    if (new_entries == NULL) return -1;
+    memo->entries= new_entries;
+    memo->entries_max= new_max;
+  }
+  struct pgfindlib_symlink_memo_entry *entry= &memo->entries[memo->entries_count];
+  entry->name= strdup(name);
+  if (entry->name == NULL) return -1;
+  entry->dir_dev= dir_dev;
+  entry->dir_ino= dir_ino;
+  entry->hash= hash;
+  entry->final_target= NULL;
+  entry->target_dev= 0;
+  entry->target_ino= 0;
+  entry->is_broken= 0;
+  entry->next_in_bucket= memo->buckets[hash % PGFINDLIB_SYMLINK_MEMO_BUCKETS];
+  memo->buckets[hash % PGFINDLIB_SYMLINK_MEMO_BUCKETS]= memo->entries_count;
+  return memo->entries_count++;
+}
+
+/*
+  Follow the symlink chain starting at path. Each link in the chain gets a memo entry, and when the end is
+  reached (a non-symlink, or something missing, or too many links) every entry in the chain gets the same final target.
+  If a link is already in the memo, its final target is used and the rest of the chain isn't read again.
+  Return PGFINDLIB_OK with *entry_number = the entry for path (or -1 if its directory can't be opened),
+  or PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW, or PGFINDLIB_ERROR_FILE_DESCRIPTORS if the process has none to spare.
+*/
+static int pgfindlib_symlink_target(struct pgfindlib_symlink_memo *memo, const char *path, int *entry_number)
+{
+  int pending[PGFINDLIB_MAX_SYMLINK_CHAIN + 1];
+  unsigned int pending_count= 0;
+  int final_entry= -1;
+  char *current= memo->path_buffer;
+  *entry_number= -1;
+  if (strlen(path) > PGFINDLIB_MAX_PATH_LENGTH * 2) return PGFINDLIB_ERROR_MAX_PATH_LENGTH_TOO_SMALL;
+  strcpy(current, path);
+  pgfindlib_path_normalize(current);
+  for (;;)
+  {
+    char *slash= strrchr(current, '/');
+    const char *name;
+    int d;
+    if (slash == NULL) { d= pgfindlib_symlink_memo_directory(memo, "."); name= current; }
+    else if (slash == current) { d= pgfindlib_symlink_memo_directory(memo, "/"); name= current + 1; }
+    else { *slash= '\0'; d= pgfindlib_symlink_memo_directory(memo, current); *slash= '/'; name= slash + 1; }
+    if (d == -2) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+    if (d == -3) return PGFINDLIB_ERROR_FILE_DESCRIPTORS; /* not a false "symlink target not found" */
+    if (d == -1) break; /* directory is missing so the chain is broken, the last pending entry will say so */
+    const struct pgfindlib_symlink_memo_directory *directory= &memo->directories[d];
+    unsigned int hash= pgfindlib_symlink_memo_hash(directory->dev, directory->ino, name);
+    int e;
+    for (e= memo->buckets[hash % PGFINDLIB_SYMLINK_MEMO_BUCKETS]; e != -1; e= memo->entries[e].next_in_bucket)
+    {
+      const struct pgfindlib_symlink_memo_entry *entry= &memo->entries[e];
+      if ((entry->hash == hash) && (entry->dir_dev == directory->dev) && (entry->dir_ino == directory->ino)
+       && (strcmp(entry->name, name) == 0) && (entry->final_target != NULL))
+        break;
+    }
+    if (e != -1) { final_entry= e; break; } /* already walked, e.g. libfoo.so.3 after libfoo.so */
+    e= pgfindlib_symlink_memo_add(memo, directory->dev, directory->ino, name, hash);
+    if (e == -1) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+    pending[pending_count++]= e;
+    ssize_t link_length= memo->backend->readlinkat(memo->backend->state, directory->fd, name, memo->link_buffer, PGFINDLIB_MAX_PATH_LENGTH);
+    if (link_length < 0)
+    {
+      struct pgfindlib_symlink_memo_entry *entry= &memo->entries[e];
+      struct stat sb;
+      if ((errno == EINVAL) && (memo->backend->fstatat(memo->backend->state, directory->fd, name, &sb) == 0))
+      {
+        entry->target_dev= sb.st_dev; /* not a symlink so this is the end of the chain */
+        entry->target_ino= sb.st_ino;
+      }
+      else entry->is_broken= 1;
+      entry->final_target= strdup(current);
+      if (entry->final_target == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+      final_entry= e;
+      break;
+    }
+    memo->link_buffer[link_length]= '\0';
+    if (pending_count > PGFINDLIB_MAX_SYMLINK_CHAIN) break; /* loop, the last pending entry will say broken */
+    char *next= memo->next_path_buffer;
+    if (memo->link_buffer[0] == '/') strcpy(next, memo->link_buffer);
+    else
+    {
+      const char *link= memo->link_buffer;
+      unsigned int dir_length= (slash == NULL) ? 0 : (unsigned int) (slash - current) + 1; /* including the / */
+      if (dir_length + strlen(link) > PGFINDLIB_MAX_PATH_LENGTH * 2) break;
+      memcpy(next, current, dir_length);
+      strcpy(next + dir_length, link);
+    }
+    pgfindlib_path_normalize(next);
+    memo->next_path_buffer= current;
+    memo->path_buffer= next;
+    current= next;
+  }
+  if (final_entry == -1) /* broken chain: the last link read is the end, and it says is_broken */
+  {
+    if (pending_count == 0) return PGFINDLIB_OK;
+    final_entry= pending[pending_count - 1];
+    struct pgfindlib_symlink_memo_entry *entry= &memo->entries[final_entry];
+    entry->is_broken= 1;
+    if (entry->final_target == NULL) entry->final_target= strdup(current);
+    if (entry->final_target == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  }
+  for (unsigned int i= 0; i < pending_count; ++i)
+  {
+    struct pgfindlib_symlink_memo_entry *entry= &memo->entries[pending[i]];
+    if (pending[i] == final_entry) continue;
+    entry->final_target= strdup(memo->entries[final_entry].final_target);
+    if (entry->final_target == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+    entry->target_dev= memo->entries[final_entry].target_dev;
+    entry->target_ino= memo->entries[final_entry].target_ino;
+    entry->is_broken= memo->entries[final_entry].is_broken;
+  }
+  *entry_number= (pending_count > 0) ? pending[0] : final_entry;
+  return PGFINDLIB_OK;
+}
+
+/*
+  Remember that row_number's final target is (dev, ino), and return the row number where that target first
+  appeared, or 0 if this is the first time. Return -1 if malloc failed.
+*/
+static int pgfindlib_symlink_memo_row_target(struct pgfindlib_symlink_memo *memo, dev_t dev, ino_t ino, unsigned int row_number)
+{
+  unsigned int hash= pgfindlib_symlink_memo_hash(dev, ino, "") % PGFINDLIB_SYMLINK_MEMO_BUCKETS;
+  for (int i= memo->row_target_buckets[hash]; i != -1; i= memo->row_targets[i].next_in_bucket)
+  {
+    if ((memo->row_targets[i].dev == dev) && (memo->row_targets[i].ino == ino)) return memo->row_targets[i].row_number;
+  }
+  if (memo->row_targets_count == memo->row_targets_max)
+  {
+    unsigned int new_max= memo->row_targets_max * 2 + 64;
+    struct pgfindlib_row_target *new_row_targets;
+    new_row_targets= (struct pgfindlib_row_target *)realloc(memo->row_targets, new_max * sizeof(struct pgfindlib_row_target));
+    if (new_row_targets == NULL) return -1;
+    memo->row_targets= new_row_targets;
+    memo->row_targets_max= new_max;
+  }
+  struct pgfindlib_row_target *row_target= &memo->row_targets[memo->row_targets_count];
+  row_target->dev= dev;
+  row_target->ino= ino;
+  row_target->row_number= row_number;
+  row_target->next_in_bucket= memo->row_target_buckets[hash];
+  memo->row_target_buckets[hash]= memo->row_targets_count++;
+  return 0;
+}
+#endif
+
+#if (PGFINDLIB_INCLUDE_BUILD_ID != 0)
+/*
+  Remember that row_number is build_id in file (dev, ino), and return the row number where the same build first
+  appeared in a different file, e.g. a copy on another device, or 0 if it didn't or if it was this file
+  (then the row already says duplicate or same target). dev and ino are 0 if the file isn't known,
+  then any earlier row with the build counts. Return -1 if malloc failed.
+*/
+static int pgfindlib_symlink_memo_row_build(struct pgfindlib_symlink_memo *memo, const struct pgfindlib_build_id *build_id,
+                                            dev_t dev, ino_t ino, unsigned int row_number)
+{
+  if (memo->row_build_buckets == NULL)
+  {
+    memo->row_build_buckets= (int *)malloc(PGFINDLIB_SYMLINK_MEMO_BUCKETS * sizeof(int));
+    if (memo->row_build_buckets == NULL) return -1;
+    for (unsigned int i= 0; i < PGFINDLIB_SYMLINK_MEMO_BUCKETS; ++i) memo->row_build_buckets[i]= -1;
+  }
+  unsigned int hash= 0; /* the build-id is already a hash */
+  memcpy(&hash, build_id->bytes, (build_id->length < sizeof(hash)) ? build_id->length : sizeof(hash));
+  hash%= PGFINDLIB_SYMLINK_MEMO_BUCKETS;
+  int first_row= 0;
+  for (int i= memo->row_build_buckets[hash]; i != -1; i= memo->row_builds[i].next_in_bucket)
+  {
+    const struct pgfindlib_row_build *row_build= &memo->row_builds[i];
+    if ((row_build->build_id.length != build_id->length) || (memcmp(row_build->build_id.bytes, build_id->bytes, build_id->length) != 0))
+      continue;
+    if ((ino != 0) && (row_build->dev == dev) && (row_build->ino == ino)) return 0;
+    first_row= row_build->row_number; /* the list is newest first so the last one found is the first row */
+  }
+  if (memo->row_builds_count == memo->row_builds_max)
+  {
+    unsigned int new_max= memo->row_builds_max * 2 + 64;
+    struct pgfindlib_row_build *new_row_builds;
+    new_row_builds= (struct pgfindlib_row_build *)realloc(memo->row_builds, new_max * sizeof(struct pgfindlib_row_build));
+    if (new_row_builds == NULL) return -1;
+    memo->row_builds= new_row_builds;
+    memo->row_builds_max= new_max;
+  }
+  struct pgfindlib_row_build *row_build= &memo->row_builds[memo->row_builds_count];
+  row_build->build_id= *build_id;
+  row_build->dev= dev;
+  row_build->ino= ino;
+  row_build->row_number= row_number;
+  row_build->next_in_bucket= memo->row_build_buckets[hash];
+  memo->row_build_buckets[hash]= memo->row_builds_count++;
+  return first_row;
+}
+#endif
+
+/* There are COLUMN_FOR_COMMENT_1 .. COLUMN_FOR_COMMENT_3, if there are more comments than that then the last ones are lost */
+#define PGFINDLIB_ADD_COMMENT_COLUMN(comment) \
+{ \
+  if (columns_list_number <= COLUMN_FOR_COMMENT_3) columns_list[columns_list_number++]= (comment); \
+}
+
+/*
+  pgfindlib_file()'s system calls. If known (from a snapshot) has the fact it's used instead of asking again.
+  Either way the fact goes in facts, which is learned if pgfindlib_file() has that, so the next snapshot has it too.
+*/
+static int pgfindlib_file_access(const struct pgfindlib_context *context, const char *path,
+                                 const struct pgfindlib_file_facts *known, struct pgfindlib_file_facts *facts)
+{
+  if ((known != NULL) && ((known->facts & PGFINDLIB_FACT_ACCESS) != 0)) facts->is_access_failed= known->is_access_failed;
+  else facts->is_access_failed= (pgfindlib_access(context->backend, context->sysroot_fd, path, R_OK) != 0);
+  facts->facts|= PGFINDLIB_FACT_ACCESS;
+  return facts->is_access_failed;
+}
+
+/* Return -1 if lstat() failed, else 0 with sb's st_mode, st_dev and st_ino set */
+static int pgfindlib_file_lstat(const struct pgfindlib_context *context, const char *path, struct stat *sb,
+                                const struct pgfindlib_file_facts *known, struct pgfindlib_file_facts *facts)
+{
+  if ((known != NULL) && ((known->facts & PGFINDLIB_FACT_LSTAT) != 0))
+  {
+    facts->is_lstat_failed= known->is_lstat_failed;
+    facts->st_mode= known->st_mode;
+    facts->st_dev= known->st_dev;
+    facts->st_ino= known->st_ino;
+  }
+  else
+  {
+    facts->is_lstat_failed= (pgfindlib_stat(context->backend, context->sysroot_fd, path, sb, 1) == -1);
+    facts->st_mode= sb->st_mode;
+    facts->st_dev= sb->st_dev;
+    facts->st_ino= sb->st_ino;
+  }
+  facts->facts|= PGFINDLIB_FACT_LSTAT;
+  if (facts->is_lstat_failed) return -1;
+  sb->st_mode= facts->st_mode;
+  sb->st_dev= facts->st_dev;
+  sb->st_ino= facts->st_ino;
+  return 0;
+}
+
+#if (PGFINDLIB_INCLUDE_SYMLINKS != 0)
+/* A symlink's final target, facts->is_symlink_resolved is 0 if there's none */
+static int pgfindlib_file_symlink(struct pgfindlib_symlink_memo *memo, const char *path,
+                                  const struct pgfindlib_file_facts *known, struct pgfindlib_file_facts *facts)
+{
+  if ((known != NULL) && ((known->facts & PGFINDLIB_FACT_SYMLINK) != 0))
+  {
+    facts->is_symlink_resolved= known->is_symlink_resolved;
+    facts->is_broken= known->is_broken;
+    facts->target_dev= known->target_dev;
+    facts->target_ino= known->target_ino;
+    facts->final_target= known->final_target;
+  }
+  else
+  {
+    int entry_number;
+    int memo_rval= pgfindlib_symlink_target(memo, path, &entry_number);
+    if (memo_rval != PGFINDLIB_OK) return memo_rval;
+    facts->is_symlink_resolved= (entry_number != -1);
+    if (entry_number != -1)
+    {
+      const struct pgfindlib_symlink_memo_entry *entry= &memo->entries[entry_number];
+      facts->is_broken= entry->is_broken;
+      facts->target_dev= entry->target_dev;
+      facts->target_ino= entry->target_ino;
+      facts->final_target= entry->final_target;
+    }
+  }
+  facts->facts|= PGFINDLIB_FACT_SYMLINK;
+  return PGFINDLIB_OK;
+}
+#endif
+
+/* pgfindlib_read_elf() for reason PGFINDLIB_REASON_SO_CHECK or PGFINDLIB_REASON_SO_IDENTIFY, build_id can be NULL */
+static int pgfindlib_file_elf(const struct pgfindlib_context *context, const char *path, int reason, int program_e_machine,
+                              struct pgfindlib_build_id *build_id,
+                              const struct pgfindlib_file_facts *known, struct pgfindlib_file_facts *facts)
+{
+  unsigned int wanted= (reason == PGFINDLIB_REASON_SO_CHECK) ? PGFINDLIB_FACT_ELF : 0;
+  if (build_id != NULL) wanted|= PGFINDLIB_FACT_BUILD_ID;
+  if ((known != NULL) && ((known->facts & wanted) == wanted))
+  {
+    facts->elf_rval= known->elf_rval;
+    facts->build_id= known->build_id;
+  }
+  else
+  {
+    struct tokener tokener_list[1]; /* won't be used */
+    facts->build_id.length= 0;
+    facts->elf_rval= pgfindlib_read_elf(tokener_list, path, reason, program_e_machine, context, NULL, NULL,
+                                        (build_id != NULL) ? &facts->build_id : NULL);
+  }
+  facts->facts|= wanted;
+  if (build_id != NULL) *build_id= facts->build_id;
+  return facts->elf_rval;
+}
+
+/*
+  Put file name in buffer. Precede with, or include, comments if there are any.
+  todo: pgfindlib_comment = source name if first in source and not done before
+  todo: some parameters unused e.g. inode_warning_count
+  todo: can use st_nlink to see how many hardlinks a file has (expect it to have at least 1)
+  A symlink's final target goes in COLUMN_FOR_TARGET, see pgfindlib_symlink_target().
+  If a row's final target (the file itself if it's not a symlink) was already the final target of an
+  earlier row, and the row isn't simply a duplicate, there is a "same target" comment.
+  context->option_flags decides which checks happen. If PGFINDLIB_OPTION_SYMLINKS and PGFINDLIB_OPTION_HARDLINKS are
+  both off there is no lstat(), if PGFINDLIB_OPTION_ACCESS is off there is no access(),
+  if PGFINDLIB_OPTION_ELF is off the file is not opened. So with no flags this only makes the row.
+  known is NULL, or what a snapshot says the system calls said, and then they're not made again.
+  learned is NULL, or gets what the system calls said (or known said) for the next snapshot.
+*/
+int pgfindlib_file(char *buffer, unsigned int *buffer_length, const char *line, unsigned int buffer_max_length,
+                          unsigned int *row_number,
+                          ino_t inode_list[], unsigned int *inode_count, unsigned int *inode_warning_count,
+                          struct tokener tokener_list_item,
+                          int program_e_machine, ino_t d_ino, unsigned char d_type,
+                          struct pgfindlib_symlink_memo *memo, struct pgfindlib_context *context,
+                          const struct pgfindlib_file_facts *known, struct pgfindlib_file_facts *learned)
+{
+  (void) inode_warning_count;
+  struct pgfindlib_file_facts facts_buffer;
+  struct pgfindlib_file_facts *facts= (learned != NULL) ? learned : &facts_buffer;
+  facts->facts= 0;
+  unsigned int option_flags= context->option_flags;
+  char *line_copy= context->line_copy; /* todo: change following to "get rid of trailing \n" */
+  if (strlen(line) >= sizeof(context->line_copy)) return PGFINDLIB_ERROR_MAX_PATH_LENGTH_TOO_SMALL;
+  {
+    int i= 0; int j= 0;
+    for (;;)
+    {
+      if (*(line + i) != '\n') { *(line_copy + j)= *(line + i); ++j; }
+      if (*(line + i) == '\0') break;
+      ++i;
+    }
+  }
+
+  const char *columns_list[MAX_COLUMNS_PER_ROW];
+  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
+  unsigned int columns_list_number= COLUMN_FOR_COMMENT_1;
+
+  char warning_max_inode_count_is_too_small[64]= ""; /* Do not move warnings into "if ... {} ...", columns_list needs their addresses */
+  char warning_lstat_failed[64]= "";
+  char warning_access_failed[64]= "";
+  char warning_symlink[64]= "";
+  char warning_duplicate[64]= "";
+  char warning_elf[64]= "";
+#if (PGFINDLIB_INCLUDE_SYMLINKS != 0)
+  char warning_same_target[64]= "";
+  char warning_symlink_broken[64]= "";
+#endif
+#if (PGFINDLIB_INCLUDE_LOADED != 0)
+  char warning_already_mapped[64]= "";
+#endif
+  char warning_same_build[64]= "";
+  char warning_build_id[16 + PGFINDLIB_MAX_BUILD_ID_LENGTH * 2]= "";
+#if (PGFINDLIB_INCLUDE_AUDIT_LOG != 0)
+  char warning_audit_observed[64]= "";
+#endif
+  const char *same_target_comment= NULL;
+  int is_duplicate= 0;
+  dev_t build_dev= 0; /* the file that the build-id is from, if it's known */
+  ino_t build_ino= 0;
+  int is_d_ino_enough= (((option_flags & PGFINDLIB_OPTION_SYMLINKS) == 0) && (d_ino != 0)
+                     && ((d_type == DT_REG) || (d_type == DT_LNK)) && (context->loaded_count == 0) && (context->is_d_ino_comparable));
+#if (PGFINDLIB_INCLUDE_DEADLINE != 0)
+  /* A remote file's system calls are made by pgfindlib_file_guarded() with a time limit, and then they're known */
+  struct pgfindlib_file_facts guarded_facts;
+  char warning_checks_skipped[128]= "";
+  if ((context->deadline_ns != 0) || (context->directory_budget_ns != 0))
+  {
+    unsigned int wanted= 0;
+    if ((option_flags & PGFINDLIB_OPTION_ACCESS) != 0) wanted|= PGFINDLIB_FACT_ACCESS;
+    if (((option_flags & (PGFINDLIB_OPTION_SYMLINKS | PGFINDLIB_OPTION_HARDLINKS)) != 0) && (is_d_ino_enough == 0)) wanted|= PGFINDLIB_FACT_LSTAT;
+    if ((option_flags & PGFINDLIB_OPTION_ELF) != 0) wanted|= PGFINDLIB_FACT_ELF;
+#if (PGFINDLIB_INCLUDE_BUILD_ID != 0)
+    if ((option_flags & PGFINDLIB_OPTION_BUILD_ID) != 0) wanted|= PGFINDLIB_FACT_BUILD_ID;
+#endif
+    if (known != NULL) wanted&= ~known->facts;
+    if (wanted != 0)
+    {
+      if (known != NULL) guarded_facts= *known;
+      else memset(&guarded_facts, 0, sizeof(guarded_facts));
+      int elf_reason= ((option_flags & PGFINDLIB_OPTION_ELF) != 0) ? PGFINDLIB_REASON_SO_CHECK : PGFINDLIB_REASON_SO_IDENTIFY;
+      int guarded_rval= pgfindlib_file_guarded(context, line_copy, wanted, elf_reason, program_e_machine, &guarded_facts, warning_checks_skipped);
+      if (guarded_rval != PGFINDLIB_OK) return guarded_rval;
+      if (warning_checks_skipped[0] == '\0') known= &guarded_facts;
+      else
+      {
+        option_flags&= ~(PGFINDLIB_OPTION_ACCESS | PGFINDLIB_OPTION_SYMLINKS | PGFINDLIB_OPTION_HARDLINKS
+                        | PGFINDLIB_OPTION_ELF | PGFINDLIB_OPTION_BUILD_ID);
+#if (PGFINDLIB_COMMENT_CHECKS_SKIPPED != 0)
+        PGFINDLIB_ADD_COMMENT_COLUMN(warning_checks_skipped)
+#endif
+      }
+    }
+  }
+#endif
+  if (((option_flags & PGFINDLIB_OPTION_ACCESS) != 0)
+   && (pgfindlib_file_access(context, line_copy, known, facts) != 0)) /* It's poorly documented but tests indicate X_OK doesn't matter and R_OK matters */
+  {
+#if (PGFINDLIB_COMMENT_ACCESS_FAILED != 0)
+    pgfindlib_comment_in_row(warning_access_failed, PGFINDLIB_COMMENT_ACCESS_FAILED, 0);
+    PGFINDLIB_ADD_COMMENT_COLUMN(warning_access_failed)
+#endif
+  }
+  ino_t inode;
+  unsigned char is_inode_d_ino= 0;
+  struct stat sb;
+  if ((option_flags & (PGFINDLIB_OPTION_SYMLINKS | PGFINDLIB_OPTION_HARDLINKS)) == 0)
+  {
+    inode= -1; /* nothing needs lstat() so don't do it, and treat as if inode is unknown */
+  }
+  else if (is_d_ino_enough)
+  {
+    /*
+      Only the duplicate check needs lstat(), and the directory entry already said the type and an inode.
+      But d_ino needn't be st_ino (on overlayfs it's often the lower layer's), so a d_ino is only compared with d_inos,
+      and this is only done if every source is a directory listing, so there are no st_inos from ld.so.cache rows.
+    */
+    inode= d_ino;
+    is_inode_d_ino= 1;
+    for (unsigned int i= 0; ((option_flags & PGFINDLIB_OPTION_HARDLINKS) != 0) && (i < *inode_count); ++i)
+    {
+      if ((inode_list[i] == inode) && (context->inode_is_d_ino[i] == 1))
+      {
+#if (PGFINDLIB_COMMENT_DUPLICATE != 0)
+       pgfindlib_comment_in_row(warning_duplicate, PGFINDLIB_COMMENT_DUPLICATE, i + 1); /* "+ 1" because row_number starts at 1 */
+       PGFINDLIB_ADD_COMMENT_COLUMN(warning_duplicate)
+#endif
+       is_duplicate= 1;
+       break;
+      }
+    }
+  }
+  else if (pgfindlib_file_lstat(context, line_copy, &sb, known, facts) == -1)
+  {
+#if (PGFINDLIB_COMMENT_LSTAT_FAILED != 0)
+    pgfindlib_comment_in_row(warning_lstat_failed, PGFINDLIB_COMMENT_LSTAT_FAILED, 0);
+    PGFINDLIB_ADD_COMMENT_COLUMN(warning_lstat_failed)
+#endif
+    inode= -1; /* a dummy so count of inodes is right but this won't be found later */
+  }
+  else
+  {
+    mode_t st_mode= sb.st_mode & S_IFMT;
+    if ((st_mode !=S_IFREG) && (st_mode != S_IFLNK)) return PGFINDLIB_OK; /* not file or symlink so not candidate */
+    /* Here, if (st_mode == S_IFLNK) and include_symlinks is off, return */
+    /* Here, if (duplicate) and include duplicates is off, return */
+    dev_t target_dev= sb.st_dev;
+    ino_t target_ino= sb.st_ino;
+    int is_target_known= 1;
+    if ((st_mode == S_IFLNK) && ((option_flags & PGFINDLIB_OPTION_SYMLINKS) != 0))
+    {
+#if (PGFINDLIB_COMMENT_SYMLINK != 0)
+      pgfindlib_comment_in_row(warning_symlink, PGFINDLIB_COMMENT_SYMLINK, 0);
+      PGFINDLIB_ADD_COMMENT_COLUMN(warning_symlink)
+#endif
+      is_target_known= 0;
+#if (PGFINDLIB_INCLUDE_SYMLINKS != 0)
+      int memo_rval= pgfindlib_file_symlink(memo, line_copy, known, facts);
+      if (memo_rval != PGFINDLIB_OK) return memo_rval;
+      if (facts->is_symlink_resolved)
+      {
+        columns_list[COLUMN_FOR_TARGET]= facts->final_target;
+        if (facts->is_broken)
+        {
+#if (PGFINDLIB_COMMENT_SYMLINK_BROKEN != 0)
+          pgfindlib_comment_in_row(warning_symlink_broken, PGFINDLIB_COMMENT_SYMLINK_BROKEN, 0);
+          PGFINDLIB_ADD_COMMENT_COLUMN(warning_symlink_broken)
+#endif
+        }
+        else
+        {
+          target_dev= facts->target_dev;
+          target_ino= facts->target_ino;
+          is_target_known= 1;
+        }
+      }
+#endif
+    }
+    if (is_target_known) { build_dev= target_dev; build_ino= target_ino; }
+    inode= sb.st_ino;
+    for (unsigned int i= 0; ((option_flags & PGFINDLIB_OPTION_HARDLINKS) != 0) && (i < *inode_count); ++i)
+    {
+      if ((inode_list[i] == inode) && (context->inode_is_d_ino[i] == 0))
+      {
+#if (PGFINDLIB_COMMENT_DUPLICATE != 0)
+       pgfindlib_comment_in_row(warning_duplicate, PGFINDLIB_COMMENT_DUPLICATE, i + 1); /* "+ 1" because row_number starts at 1 */
+       PGFINDLIB_ADD_COMMENT_COLUMN(warning_duplicate)
+#endif
+       is_duplicate= 1;
+       break;
+      }
+    }
+#if (PGFINDLIB_INCLUDE_LOADED != 0)
+    if ((is_target_known) && (context->loaded_count > 0))
+    {
+      const struct pgfindlib_loaded *loaded= pgfindlib_loaded_find(context, target_dev, target_ino);
+      if (loaded != NULL)
+      {
+#if (PGFINDLIB_COMMENT_ALREADY_MAPPED != 0)
+        sprintf(warning_already_mapped, "%03d already mapped at 0x%lx", PGFINDLIB_COMMENT_ALREADY_MAPPED, loaded->address);
+        PGFINDLIB_ADD_COMMENT_COLUMN(warning_already_mapped)
+#endif
+      }
+    }
+#endif
+#if (PGFINDLIB_INCLUDE_SYMLINKS != 0)
+    if ((is_target_known) && ((option_flags & PGFINDLIB_OPTION_SYMLINKS) != 0))
+    {
+      int same_target_row= pgfindlib_symlink_memo_row_target(memo, target_dev, target_ino, *row_number);
+      if (same_target_row < 0) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+      if ((same_target_row > 0) && (is_duplicate == 0))
+      {
+#if (PGFINDLIB_COMMENT_SAME_TARGET != 0)
+        pgfindlib_comment_in_row(warning_same_target, PGFINDLIB_COMMENT_SAME_TARGET, same_target_row);
+        same_target_comment= warning_same_target; /* added after the elf comment, which matters more */
+#endif
+      }
+    }
+#else
+    (void) target_dev; (void) target_ino; (void) is_target_known; (void) memo;
+#endif
+  }
+  struct pgfindlib_build_id build_id;
+  build_id.length= 0;
+  struct pgfindlib_build_id *wanted_build_id= NULL;
+#if (PGFINDLIB_INCLUDE_BUILD_ID != 0)
+  if ((option_flags & PGFINDLIB_OPTION_BUILD_ID) != 0) wanted_build_id= &build_id;
+#endif
+  if ((option_flags & PGFINDLIB_OPTION_ELF) != 0)
+  {
+    int elf_rval= pgfindlib_file_elf(context, line_copy, PGFINDLIB_REASON_SO_CHECK, program_e_machine, wanted_build_id, known, facts);
+    if (elf_rval != 0)
+    {
+      int unknown_failures= 0;
+      /* These all have the same warning_elf so suppressing with "#if ... #endif" would be complicated. */
+      if (elf_rval == PGFINDLIB_COMMENT_ELF_OPEN_FAILED)
+        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_OPEN_FAILED, 0);
+      else if (elf_rval == PGFINDLIB_COMMENT_ELF_READ_FAILED)
+        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_READ_FAILED, 0);
+      else if (elf_rval == PGFINDLIB_COMMENT_ELF_HAS_INVALID_IDENT)
+        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_HAS_INVALID_IDENT, 0);
+      else if (elf_rval == PGFINDLIB_COMMENT_ELF_IS_NOT_EXEC_OR_DYN)
+        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_IS_NOT_EXEC_OR_DYN, 0);
+      else if (elf_rval == PGFINDLIB_COMMENT_ELF_SHT_DYNAMIC_NOT_FOUND)
+        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_SHT_DYNAMIC_NOT_FOUND, 0);
+      else if (elf_rval == PGFINDLIB_COMMENT_ELF_MACHINE_DOES_NOT_MATCH)
+        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_MACHINE_DOES_NOT_MATCH, 0);
+      else ++unknown_failures; /* if this happens it's a bug */
+      if (unknown_failures == 0) PGFINDLIB_ADD_COMMENT_COLUMN(warning_elf)
+    }
+  }
+#if (PGFINDLIB_INCLUDE_BUILD_ID != 0)
+  else if (wanted_build_id != NULL) /* the ELF header is read for the build-id, but not checked */
+  {
+    pgfindlib_file_elf(context, line_copy, PGFINDLIB_REASON_SO_IDENTIFY, program_e_machine, wanted_build_id, known, facts);
+  }
+  if (build_id.length > 0)
+  {
+    int same_build_row= pgfindlib_symlink_memo_row_build(memo, &build_id, build_dev, build_ino, *row_number);
+    if (same_build_row < 0) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+#if (PGFINDLIB_COMMENT_SAME_BUILD != 0)
+    if ((same_build_row > 0) && (is_duplicate == 0) && (same_target_comment == NULL))
+      pgfindlib_comment_in_row(warning_same_build, PGFINDLIB_COMMENT_SAME_BUILD, same_build_row);
+#endif
+#if (PGFINDLIB_COMMENT_BUILD_ID != 0)
+    char *p= warning_build_id + sprintf(warning_build_id, "%03d build-id ", PGFINDLIB_COMMENT_BUILD_ID);
+    for (unsigned int i= 0; i < build_id.length; ++i) p+= sprintf(p, "%02x", build_id.bytes[i]);
+#endif
+  }
+#else
+  (void) build_dev; (void) build_ino; (void) build_id;
+#endif
+#if (PGFINDLIB_INCLUDE_AUDIT_LOG != 0)
+  if (context->audited_count > 0)
+  {
+    const struct pgfindlib_audited *audited= pgfindlib_audit_find(context, line_copy);
+    if (audited != NULL)
+    {
+#if (PGFINDLIB_COMMENT_AUDIT_OBSERVED != 0)
+      sprintf(warning_audit_observed, "%03d observed after %u failed directories in %llu ns", PGFINDLIB_COMMENT_AUDIT_OBSERVED,
+              audited->failures, audited->nanoseconds);
+      PGFINDLIB_ADD_COMMENT_COLUMN(warning_audit_observed)
+#endif
+    }
+  }
+#endif
+  /* Least important last, because comments after the third are lost */
+  if (same_target_comment != NULL) PGFINDLIB_ADD_COMMENT_COLUMN(same_target_comment)
+  if (warning_same_build[0] != '\0') PGFINDLIB_ADD_COMMENT_COLUMN(warning_same_build)
+  if (warning_build_id[0] != '\0') PGFINDLIB_ADD_COMMENT_COLUMN(warning_build_id)
+
+  if (*inode_count == PGFINDLIB_MAX_INODE_COUNT)
+  {
+#if (PGFINDLIB_COMMENT_MAX_INODE_COUNT_TOO_SMALL != 0)
+    pgfindlib_comment_in_row(warning_max_inode_count_is_too_small, PGFINDLIB_COMMENT_MAX_INODE_COUNT_TOO_SMALL, 0);
+    PGFINDLIB_ADD_COMMENT_COLUMN(warning_max_inode_count_is_too_small)
+#endif
+  }
+  else
+  {
+    inode_list[*inode_count]= inode;
+    context->inode_is_d_ino[*inode_count]= is_inode_d_ino;
+    ++*inode_count;  
+  }
+  char comment_string[256]; /* todo: check: too small */ /* "LD_AUDIT" "LD_PRELOAD" etc. */
+  memcpy(comment_string, tokener_list_item.tokener_name, tokener_list_item.tokener_length);
+  comment_string[tokener_list_item.tokener_length]= '\0';
+
+  columns_list[COLUMN_FOR_PATH]= line_copy;
+  columns_list[COLUMN_FOR_SOURCE]= comment_string;
+
+  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+}
+
+/*
+  Tokenize comments
+  [SELECT *]                   Possible future addition
+  [FROM source [, source ...]  There's a default if it's missing
+  [WHERE file [, file ...]     There's no default if it's missing but maybe there should be
+  [ORDER BY id]                Possible future addition
+  [LIMIT n]                    Possible future addition
+  Keywords can be any case, source and file are case sensitive.
+  Source and file can be enclosed in either ""s or ''s or ::s, which are stripped.
+    (Although ' and " look more natural, running main 'a b' will fail because argv strips them already,
+    so only : is reliable, say main ':a b:')
+  Source can be: LD_LIBRARY_PATH etc. (the standard sources) but anything not in standard sources is considered a path
+  Spaces are ignored, except that a keyword must be followed by at least one space
+  Only possible end-of-token marks are space and comma and \0
+  Possible errors:
+    ' or " without ending ' or "
+    , without following source name or file name
+    source name or file name is too long (max = 255)
+  End with _END
+    const char *tokener_name;
+    char tokener_length;
+    char tokener_comment_id;
+};
+*/
+/* Compare for equality with an ascii keyword already lower case,  */
+int pgfindlib_keycmp(const char *a, unsigned int a_len, const char *b)
+{
+  if (a_len != strlen(b)) return -1;
+  for (unsigned int i= 0; i < a_len; ++i)
+  {
+    if ((*a != *b) && (*a != (*b) - 32)) return -1;
+    ++a; ++b;
+  }
+  return 0;
+}
+/*
+  Make sure *tokener_list_pointer has room for needed items, realloc'ing it if not.
+  Return PGFINDLIB_OK or PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW.
+*/
+static int pgfindlib_tokener_room(struct tokener **tokener_list_pointer, unsigned int *tokener_max, unsigned int needed)
+{
+  if (needed <= *tokener_max) return PGFINDLIB_OK;
+  unsigned int new_max= (*tokener_max == 0) ? PGFINDLIB_MAX_TOKENS_COUNT : *tokener_max;
+  while (new_max < needed) new_max*= 2;
+  struct tokener *new_list= (struct tokener *)realloc(*tokener_list_pointer, new_max * sizeof(struct tokener));
+  if (new_list == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  *tokener_list_pointer= new_list;
+  *tokener_max= new_max;
+  return PGFINDLIB_OK;
+}
+
+/*
+  Split statement into *tokener_list_pointer, which is malloc'd or realloc'd as needed (*tokener_max is its size),
+  so there's no limit on the number of tokens. The caller frees it. Token names point into statement.
+*/
+int pgfindlib_tokenize(const char *statement, struct tokener **tokener_list_pointer, unsigned int *tokener_max,
+                       unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count,
+                       char *buffer, unsigned int *buffer_length, unsigned buffer_max_length)
+{
+  const char *p= statement;
+  const char *p_next;
+  unsigned int token_number= 0;
+  struct tokener *tokener_list;
+  if (pgfindlib_tokener_room(tokener_list_pointer, tokener_max, PGFINDLIB_MAX_TOKENS_COUNT) != PGFINDLIB_OK)
+    return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  tokener_list= *tokener_list_pointer;
+
+  if (p == NULL)
+  {
+    pgfindlib_comment_is_row("Syntax error. Statement is NULL", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_STATEMENT_IS_NULL,
+                            buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+    return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+  }
+  const char *statement_end= p + strlen(p);
+  for (;;)
+  {
+    if (p > statement_end)
+    {
+      pgfindlib_comment_is_row("Syntax error. p > statement end", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_P_GREATER_STATEMENT_END,
+                            buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+      return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+    }
+    if (*p == ' ') { ++p; continue; }
+    else if (*p == '\0') break;
+    else if ((*p == '"') || (*p == 0x27) || (*p == ':')) /* if " or ' then skip to next " or ' */
+    {
+      p_next= strchr(p + 1, *p);
+      if (p_next == NULL)
+      {
+        pgfindlib_comment_is_row("Syntax error. Quote without end quote", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_QUOTE_WITHOUT_END_QUOTE,
+                                 buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+        return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+      }
+    }
+    else if (*p == ',')
+      p_next= p + 1;
+    else
+    {
+      int brace_depth= (*p == '{') ? 1 : 0; /* so that a glob like libx.so.{1,2} is one token */
+      p_next= p + 1;
+      for (;;)
+      {
+        if (*p_next == '\0') break;
+        if ((*p_next == ' ') || ((*p_next == ',') && (brace_depth == 0))) break;
+        if (*p_next == '{') ++brace_depth;
+        if ((*p_next == '}') && (brace_depth > 0)) --brace_depth;
+        ++p_next;
+      }
+    }
+    tokener_list[token_number].tokener_name= p;
+    tokener_list[token_number].tokener_length= p_next - p;
+    tokener_list[token_number].tokener_comment_id= PGFINDLIB_TOKEN_UNKNOWN; /* malloc'd, it mustn't look like the END */
+    if (tokener_list[token_number].tokener_length >= PGFINDLIB_MAX_TOKEN_LENGTH)
+    {
+      pgfindlib_comment_is_row("Syntax error. Token too long", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_TOKEN_TOO_LONG,
+                               buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+      return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+    }
+    ++token_number;
+    /* room for this token, a comma after it, and the END */
+    if (pgfindlib_tokener_room(tokener_list_pointer, tokener_max, token_number + 2) != PGFINDLIB_OK)
+      return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+    tokener_list= *tokener_list_pointer;
+    if (*p_next == '\0') break;
+    if (*p_next == ',')
+    {
+      tokener_list[token_number].tokener_name= p_next;
+      tokener_list[token_number].tokener_length= 1;
+      tokener_list[token_number].tokener_comment_id= PGFINDLIB_TOKEN_UNKNOWN;
+      ++token_number;
+    }
+    p= p_next + 1;
+  }
+  /* tokener_list[token_number].tokener_name= "END!"; */
+  /* tokener_list[token_number].tokener_length= 4; */
+  tokener_list[token_number].tokener_comment_id= PGFINDLIB_TOKEN_END;
+  unsigned int current_clause= 0;
+  unsigned int from_count= 0;
+  unsigned int where_count= 0; 
+  for (int i= 0; tokener_list[i].tokener_comment_id != PGFINDLIB_TOKEN_END; ++i)
+  {
+    if (pgfindlib_keycmp(tokener_list[i].tokener_name, tokener_list[i].tokener_length, "from") == 0)
+    {
+      if (current_clause != 0)
+      {
+        pgfindlib_comment_is_row("Syntax error. FROM out of order", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_FROM_OUT_OF_ORDER,
+                                 buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+        return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+      }
+      tokener_list[i].tokener_comment_id= PGFINDLIB_TOKEN_FROM;
+      current_clause= PGFINDLIB_TOKEN_FROM;
+      ++from_count;
+    }
+    else if (pgfindlib_keycmp(tokener_list[i].tokener_name, tokener_list[i].tokener_length, "where") == 0)
+    {
+      if ((current_clause != 0) && (current_clause != PGFINDLIB_TOKEN_FROM))
+      {
+        pgfindlib_comment_is_row("Syntax error. WHERE out of order", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_WHERE_OUT_OF_ORDER,
+                                 buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+        return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+      }
+      tokener_list[i].tokener_comment_id= PGFINDLIB_COMMENT_STATEMENT_SYNTAX_WHERE_OUT_OF_ORDER;
+      current_clause= PGFINDLIB_TOKEN_WHERE;
+      ++where_count;
+    }
+    else if (tokener_list[i].tokener_name[0] == ',')
+      tokener_list[i].tokener_comment_id= PGFINDLIB_TOKEN_COMMA;
+    else
+    {
+      if (current_clause == PGFINDLIB_TOKEN_FROM)
+      {
+        for (int k= 0; ; ++k)
+        {
+          const char *c= pgfindlib_standard_source_array[k];
+          if (strcmp(c, "") == 0) break;
+          tokener_list[i].tokener_comment_id= PGFINDLIB_TOKEN_SOURCE_NONSTANDARD;
+          if ((strlen(c) == (unsigned int) tokener_list[i].tokener_length) && (memcmp(c, tokener_list[i].tokener_name, tokener_list[i].tokener_length) == 0))
+          {
+            tokener_list[i].tokener_comment_id= pgfindlib_standard_source_array_n[k];
+            break;
+          }
+        }
+      }
+      else if (current_clause == PGFINDLIB_TOKEN_WHERE)
+      {
+        tokener_list[i].tokener_comment_id= PGFINDLIB_TOKEN_FILE;
+      }
+      else /* presumably an error */
+        tokener_list[i].tokener_comment_id= PGFINDLIB_TOKEN_UNKNOWN;
+    }
+  }
+  /* If there was no FROM, make a list from standard sources and put it at end.
+     (Later the eval doesn't care if FROM is after WHERE, though arbitrarily it's a syntax error if user inputs thus.) */
+  if (from_count == 0)
+  {
+    /* token_number should still be at end, which will be overwritten */
+    for (int i= 0; pgfindlib_standard_source_array_n[i] != 0; ++i)
+    {
+      /* "loaded" isn't a place the loader searches, so it's only used if FROM says so */
+      if (pgfindlib_standard_source_array_n[i] == PGFINDLIB_TOKEN_SOURCE_LOADED) continue;
+      if (pgfindlib_tokener_room(tokener_list_pointer, tokener_max, token_number + 2) != PGFINDLIB_OK)
+        return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+      tokener_list= *tokener_list_pointer;
+      tokener_list[token_number].tokener_name= pgfindlib_standard_source_array[i];
+      tokener_list[token_number].tokener_length= strlen(pgfindlib_standard_source_array[i]);
+      tokener_list[token_number].tokener_comment_id= pgfindlib_standard_source_array_n[i];
+      ++token_number;
+    }
+    tokener_list[token_number].tokener_comment_id= PGFINDLIB_TOKEN_END;
+  }
+  for (int i= 0;; ++i)
+  {
+    /* char token_x[256]; */
+    if (tokener_list[i].tokener_comment_id == PGFINDLIB_TOKEN_END) break;
+  }
+  return PGFINDLIB_OK;
+}
+
+#if (PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE != 0)
+int pgfindlib_so_cache(struct pgfindlib_context *context, struct pgfindlib_where_matcher *matcher, int tokener_number,
+                       char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                       struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length)
+{
+  int rval= PGFINDLIB_OK;
+  const char *ldconfig; /* must be able to access ldconfig in some standard directory or user's path */
+  for (int i= 0; i <= 5; ++i)
+  {
+    if (i == 0) ldconfig= "/sbin/ldconfig";
+    else if (i == 1) ldconfig= "/usr/sbin/ldconfig";
+    else if (i == 2) ldconfig= "/bin/ldconfig";
+    else if (i == 3) ldconfig= "/usr/bin/ldconfig";
+    else if (i == 4) ldconfig= "ldconfig";
+    else if (i == 5) { ldconfig= NULL; break; }
+    if (pgfindlib_access(context->backend, -1, ldconfig, X_OK) == 0) break;
+  }
+  {
+    /* Assume library is whatever's between first and last / on a line */
+    /* Line 1 is probably "[n] libs found in cache `/etc/ld.so.cache'" */
+    /* First ldconfig attempt will be Linux-style ldconfig -p, second will be FreeBSD-style ldconfig -r */
+    int counter= 0;
+    for (int ldconfig_attempts= 0; (ldconfig != NULL) && (ldconfig_attempts < 2); ++ldconfig_attempts)
+    {
+      char *ld_so_cache_line= context->spawn_line;
+      const char *spawn_argv[3]= { ldconfig, "-p", NULL };
+      const char *environment_changes_p[]= { "LD_LIBRARY_PATH=", "LD_DEBUG=", "LD_PRELOAD=", NULL };
+      const char *environment_changes_r[]= { NULL };
+      if (ldconfig_attempts == 1) spawn_argv[1]= "-r";
+      counter= 0;
+      FILE *fp;
+      pid_t pid;
+      fp= pgfindlib_spawn(context, spawn_argv,
+                          (ldconfig_attempts == 0) ? environment_changes_p : environment_changes_r, 0, &pid);
+      if (fp != NULL)
+      {
+        while (fgets(ld_so_cache_line, sizeof(context->spawn_line), fp) != NULL)
+        {
+          if (pgfindlib_is_cancelled(context))
+          {
+            pgfindlib_spawn_close(fp, pid);
+            return PGFINDLIB_ERROR_CANCELLED;
+          }
+          ++counter;
+          char *pointer_to_ld_so_cache_line= ld_so_cache_line + strlen(ld_so_cache_line);
+          for (;;)
+          {
+            if (*pointer_to_ld_so_cache_line == '/') break;
+            if (pointer_to_ld_so_cache_line <= ld_so_cache_line) break;
+            --pointer_to_ld_so_cache_line;
+          }
+          if (pointer_to_ld_so_cache_line == ld_so_cache_line) continue; /* blank line */
+          ++pointer_to_ld_so_cache_line; /* So pointer is just after the final / which should be at the file name */
+          if (pgfindlib_find_line_in_statement(matcher, pointer_to_ld_so_cache_line) == 0) continue;/* doesn't match requirement */
+          char *address= strchr(ld_so_cache_line,'/');
+          if (address != NULL)
+          {
+            rval= pgfindlib_add_to_malloc_buffers(context, address, tokener_number,
+                                                  malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                                  malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
+            if (rval != PGFINDLIB_OK)
+            {
+              pgfindlib_spawn_close(fp, pid);
+              return rval;
+            }
+          }
+        }
+        pgfindlib_spawn_close(fp, pid);
+      }
+      if (counter > 0) break; /* So if ldconfig -p succeeds, don't try ldconfig -r */
+    }
+#ifdef OBSOLETE
+#if (PGFINDLIB_COMMENT_LDCONFIG_FAILED != 0)
+    if (counter == 0)
+    {
+      char comment[256];
+      sprintf(comment, "%s -p or %s -r failed", ldconfig, ldconfig); 
+      rval= pgfindlib_comment_is_row(comment,
+                         PGFINDLIB_COMMENT_LDCONFIG_FAILED,
+                         buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count);
+      if (rval != PGFINDLIB_OK) return rval;
+    }
+#endif
+#endif
+  }
+  return PGFINDLIB_OK;
+}
+#endif /* #if (PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE != 0) */
+
+/* Forget the candidate directories, their strings were in a malloc_buffer_1 that's gone or emptied. */
+void pgfindlib_candidates_reset(struct pgfindlib_context *context)
+{
+  context->candidate_directories_count= 0;
+  for (unsigned int i= 0; i < PGFINDLIB_CANDIDATE_DIRECTORY_BUCKETS; ++i) context->candidate_directory_buckets[i]= -1;
+}
+
+/*
+  Set *directory_number to the candidate directory whose prefix is prefix_length characters of prefix,
+  adding the prefix to malloc_buffer_1 if it isn't there yet. Usually a phase 1 has only tens of different prefixes.
+  The last one added is tried first, because ld.so.cache lists each directory's libraries together.
+  Return PGFINDLIB_OK or PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW.
+*/
+int pgfindlib_candidate_directory(struct pgfindlib_context *context, const char *prefix, unsigned int prefix_length,
+                                  char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                  unsigned int *directory_number)
+{
+  if (context->candidate_directories_count > 0)
+  {
+    const struct pgfindlib_candidate_directory *last= &context->candidate_directories[context->candidate_directories_count - 1];
+    if ((last->length == prefix_length) && (memcmp(malloc_buffer_1 + last->offset, prefix, prefix_length) == 0))
+    {
+      *directory_number= context->candidate_directories_count - 1;
+      return PGFINDLIB_OK;
+    }
+  }
+  unsigned int hash= 2166136261u;
+  for (unsigned int i= 0; i < prefix_length; ++i) hash= (hash ^ (unsigned char) prefix[i]) * 16777619u;
+  hash%= PGFINDLIB_CANDIDATE_DIRECTORY_BUCKETS;
+  for (int d= context->candidate_directory_buckets[hash]; d != -1; d= context->candidate_directories[d].next_in_bucket)
+  {
+    const struct pgfindlib_candidate_directory *directory= &context->candidate_directories[d];
+    if ((directory->length == prefix_length) && (memcmp(malloc_buffer_1 + directory->offset, prefix, prefix_length) == 0))
+    {
+      *directory_number= (unsigned int) d;
+      return PGFINDLIB_OK;
+    }
+  }
+  if (*malloc_buffer_1_length + prefix_length + 1 >= malloc_buffer_1_max_length) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  if (context->candidate_directories_count == context->candidate_directories_max)
+  {
+    unsigned int new_max= context->candidate_directories_max * 2 + 16;
+    struct pgfindlib_candidate_directory *new_directories;
+    new_directories= (struct pgfindlib_candidate_directory *)realloc(context->candidate_directories,
+                                                                     new_max * sizeof(struct pgfindlib_candidate_directory));
+    if (new_directories == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+    context->candidate_directories= new_directories;
+    context->candidate_directories_max= new_max;
+  }
+  struct pgfindlib_candidate_directory *directory= &context->candidate_directories[context->candidate_directories_count];
+  memcpy(malloc_buffer_1 + *malloc_buffer_1_length, prefix, prefix_length);
+  malloc_buffer_1[*malloc_buffer_1_length + prefix_length]= '\0';
+  directory->offset= *malloc_buffer_1_length;
+  directory->length= prefix_length;
+  directory->next_in_bucket= context->candidate_directory_buckets[hash];
+  context->candidate_directory_buckets[hash]= context->candidate_directories_count;
+  *directory_number= context->candidate_directories_count++;
+  *malloc_buffer_1_length+= prefix_length + 1;
+  return PGFINDLIB_OK;
+}
+
+/*
+  Return rval = PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW or PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW
+                if it won't fit, and this should percolate upward to force a new malloc.
+  NB: malloc_buffer_2 is struct pgfindlib_candidate * so length is #-of-items rather than #-of-chars
+  The source number goes in the candidate rather than in malloc_buffer_1, so there is no limit on the number of sources.
+  Only name goes in malloc_buffer_1, the directory prefix is already there.
+*/
+int pgfindlib_add_candidate(unsigned int directory_number, const char *name, int source_number, ino_t d_ino, unsigned char d_type,
+                            char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                            struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length)
+{
+  unsigned int strlen_name= strlen(name) + 1; /* because we'll allocate \0 at end */
+  if (*malloc_buffer_1_length + strlen_name >= malloc_buffer_1_max_length) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  if (*malloc_buffer_2_length + 1 >= malloc_buffer_2_max_length) return PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW;
+  memcpy(malloc_buffer_1 + *malloc_buffer_1_length, name, strlen_name);
+  struct pgfindlib_candidate *candidate= &malloc_buffer_2[*malloc_buffer_2_length];
+  candidate->source_number= source_number;
+  candidate->directory_number= directory_number;
+  candidate->name_offset= *malloc_buffer_1_length;
+  candidate->d_ino= d_ino;
+  candidate->d_type= d_type;
+  *malloc_buffer_1_length+= strlen_name;
+  *malloc_buffer_2_length+= 1;
+  return PGFINDLIB_OK;
+}
+
+/*
+  Add new_item, a whole path (from ld.so.cache or the loaded objects), as a candidate.
+  The directory prefix is up to and including the last "/", and d_ino and d_type are unknown.
+*/
+int pgfindlib_add_to_malloc_buffers(struct pgfindlib_context *context, const char *new_item, int source_number,
+                                    char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                    struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length)
+{
+  const char *name= strrchr(new_item, '/');
+  name= (name == NULL) ? new_item : name + 1;
+  unsigned int directory_number;
+  int rval= pgfindlib_candidate_directory(context, new_item, name - new_item,
+                                          malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length, &directory_number);
+  if (rval != PGFINDLIB_OK) return rval;
+  return pgfindlib_add_candidate(directory_number, name, source_number, 0, DT_UNKNOWN,
+                                 malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                 malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
+}
+
+/*
+  Put candidate's path, i.e. its directory prefix and name, in path.
+  Return PGFINDLIB_OK, or PGFINDLIB_ERROR_MAX_PATH_LENGTH_TOO_SMALL if it's path_max_length characters or more.
+*/
+int pgfindlib_candidate_path(const struct pgfindlib_context *context, const char *malloc_buffer_1,
+                             const struct pgfindlib_candidate *candidate, char *path, unsigned int path_max_length)
+{
+  const struct pgfindlib_candidate_directory *directory= &context->candidate_directories[candidate->directory_number];
+  const char *name= malloc_buffer_1 + candidate->name_offset;
+  unsigned int name_length= strlen(name);
+  if (directory->length + name_length >= path_max_length) return PGFINDLIB_ERROR_MAX_PATH_LENGTH_TOO_SMALL;
+  memcpy(path, malloc_buffer_1 + directory->offset, directory->length);
+  memcpy(path + directory->length, name, name_length + 1);
+  return PGFINDLIB_OK;
+}
+
+/* strcmp(a, b followed by c), where b is b_length characters none of which is \0 */
+static int pgfindlib_strcmp_split(const char *a, const char *b, unsigned int b_length, const char *c)
+{
+  for (unsigned int i= 0; i < b_length; ++i, ++a)
+  {
+    if (*a != b[i]) return ((unsigned char) *a < (unsigned char) b[i]) ? -1 : 1;
+  }
+  return strcmp(a, c);
+}
+
+/*
+  Compare two candidates by (source_number, path), without putting the paths together.
+  Assume unsigned comparison per https://stackoverflow.com/questions/1356741/strcmp-and-signed-unsigned-chars
+  Usually both are in the same directory, and then it's only the names.
+*/
+int pgfindlib_candidate_compare(const char *malloc_buffer_1, const struct pgfindlib_candidate_directory *directories,
+                                const struct pgfindlib_candidate *c1, const struct pgfindlib_candidate *c2)
+{
+  if (c1->source_number != c2->source_number) return (c1->source_number < c2->source_number) ? -1 : 1;
+  const char *name1= malloc_buffer_1 + c1->name_offset;
+  const char *name2= malloc_buffer_1 + c2->name_offset;
+  if (c1->directory_number == c2->directory_number) return strcmp(name1, name2);
+  const struct pgfindlib_candidate_directory *d1= &directories[c1->directory_number];
+  const struct pgfindlib_candidate_directory *d2= &directories[c2->directory_number];
+  unsigned int common_length= (d1->length < d2->length) ? d1->length : d2->length;
+  int c= memcmp(malloc_buffer_1 + d1->offset, malloc_buffer_1 + d2->offset, common_length);
+  if (c != 0) return c;
+  if (d1->length == d2->length) return strcmp(name1, name2);
+  if (d1->length < d2->length)
+    return pgfindlib_strcmp_split(name1, malloc_buffer_1 + d2->offset + common_length, d2->length - common_length, name2);
+  return -pgfindlib_strcmp_split(name2, malloc_buffer_1 + d1->offset + common_length, d1->length - common_length, name1);
+}
+
+/*
+  The radix key is 4 bytes of source_number (most significant first) followed by the path bytes,
+  i.e. the directory prefix then the name.
+  Return 0 for end of key, else byte + 1, so that shorter paths sort first as with strcmp.
+*/
+static unsigned int pgfindlib_radix_byte(const char *malloc_buffer_1, const struct pgfindlib_candidate_directory *directories,
+                                         const struct pgfindlib_candidate *candidate, unsigned int depth)
+{
+  if (depth < 4) return ((candidate->source_number >> (8 * (3 - depth))) & 0xff) + 1;
+  const struct pgfindlib_candidate_directory *directory= &directories[candidate->directory_number];
+  unsigned char c;
+  depth-= 4;
+  if (depth < directory->length) c= (unsigned char) malloc_buffer_1[directory->offset + depth];
+  else c= (unsigned char) malloc_buffer_1[candidate->name_offset + depth - directory->length];
+  if (c == '\0') return 0;
+  return (unsigned int) c + 1;
+}
+
+/* Stable insertion sort, for small partitions. */
+static void pgfindlib_insertion_sort(const char *malloc_buffer_1, const struct pgfindlib_candidate_directory *directories,
+                                     struct pgfindlib_candidate *candidates, unsigned int count)
+{
+  for (unsigned int i= 1; i < count; ++i)
+  {
+    struct pgfindlib_candidate tmp= candidates[i];
+    unsigned int j= i;
+    while ((j > 0) && (pgfindlib_candidate_compare(malloc_buffer_1, directories, &candidates[j - 1], &tmp) > 0))
+    {
+      candidates[j]= candidates[j - 1];
+      --j;
+    }
+    candidates[j]= tmp;
+  }
+}
+
+#define PGFINDLIB_RADIX_INSERTION_SORT_MAX 32
+
+struct pgfindlib_radix_frame
+{
+  unsigned int lo;
+  unsigned int hi;
+  unsigned int depth;
+};
+
+/*
+  Stable MSD radix sort of candidates[0 .. count-1] starting at key byte depth.
+  Iterative with a malloc'd frame stack, because recursion depth would be the length of common prefixes.
+  scratch must have room for count items.
+  Return PGFINDLIB_OK, or PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW if the frame stack can't be malloc'd
+  (then candidates may be partly sorted but every item is still present).
+*/
+static int pgfindlib_radix_sort(const char *malloc_buffer_1, const struct pgfindlib_candidate_directory *directories,
+                                struct pgfindlib_candidate *candidates, unsigned int count, unsigned int depth,
+                                struct pgfindlib_candidate *scratch)
+{
+  unsigned int frames_max= 64;
+  unsigned int frames_count= 0;
+  struct pgfindlib_radix_frame *frames= (struct pgfindlib_radix_frame *)malloc(frames_max * sizeof(struct pgfindlib_radix_frame));
+  if (frames == NULL) return PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW;
+  frames[frames_count].lo= 0; frames[frames_count].hi= count; frames[frames_count].depth= depth; ++frames_count;
+  unsigned int bucket_count[257];
+  unsigned int bucket_start[257];
+  while (frames_count > 0)
+  {
+    --frames_count;
+    unsigned int lo= frames[frames_count].lo;
+    unsigned int hi= frames[frames_count].hi;
+    unsigned int d= frames[frames_count].depth;
+    if (hi - lo <= PGFINDLIB_RADIX_INSERTION_SORT_MAX)
+    {
+      pgfindlib_insertion_sort(malloc_buffer_1, directories, candidates + lo, hi - lo);
+      continue;
+    }
+    if (d >= 4) /* if every item is in the same directory, skip its prefix all at once */
+    {
+      unsigned int directory_number= candidates[lo].directory_number;
+      unsigned int i;
+      for (i= lo + 1; (i < hi) && (candidates[i].directory_number == directory_number); ++i) {}
+      if ((i == hi) && (d < 4 + directories[directory_number].length)) d= 4 + directories[directory_number].length;
+    }
+    for (;;) /* skip key bytes that every item has in common, e.g. source_number or a directory prefix */
+    {
+      unsigned int first_byte= pgfindlib_radix_byte(malloc_buffer_1, directories, &candidates[lo], d);
+      memset(bucket_count, 0, sizeof(bucket_count));
+      for (unsigned int i= lo; i < hi; ++i) ++bucket_count[pgfindlib_radix_byte(malloc_buffer_1, directories, &candidates[i], d)];
+      if (bucket_count[first_byte] != hi - lo) break;
+      if (first_byte == 0) break; /* all equal */
+      ++d;
+    }
+    if (bucket_count[0] == hi - lo) continue;
+    unsigned int start= lo;
+    for (unsigned int b= 0; b < 257; ++b) { bucket_start[b]= start; start+= bucket_count[b]; }
+    for (unsigned int i= lo; i < hi; ++i) scratch[bucket_start[pgfindlib_radix_byte(malloc_buffer_1, directories, &candidates[i], d)]++]= candidates[i];
+    memcpy(candidates + lo, scratch + lo, (hi - lo) * sizeof(struct pgfindlib_candidate));
+    /* Bucket 0 (end of key) and buckets with 1 item need no more sorting. */
+    start= lo + bucket_count[0];
+    for (unsigned int b= 1; b < 257; ++b)
+    {
+      if (bucket_count[b] > 1)
+      {
+        if (frames_count == frames_max)
+        {
+          struct pgfindlib_radix_frame *new_frames;
+          new_frames= (struct pgfindlib_radix_frame *)realloc(frames, frames_max * 2 * sizeof(struct pgfindlib_radix_frame));
+          if (new_frames == NULL) { free(frames); return PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW; }
+          frames= new_frames;
+          frames_max*= 2;
+        }
+        frames[frames_count].lo= start; frames[frames_count].hi= start + bucket_count[b]; frames[frames_count].depth= d + 1;
+        ++frames_count;
+      }
+      start+= bucket_count[b];
+    }
+  }
+  free(frames);
+  return PGFINDLIB_OK;
+}
+
+/* If a source has no more than this many ascending runs (e.g. one per directory) then merge rather than radix sort. */
+#define PGFINDLIB_MAX_RUNS_TO_MERGE 8
+
+/*
+  Sort candidates[0 .. count-1] by (source_number, path), stable.
+  Candidates are added in source order so usually each source is already a contiguous group,
+  and then each group is sorted on its own, skipping the source_number bytes of the key.
+  Within a group: if it is already ascending do nothing, if it is a few ascending runs
+  (for example each directory's list was sorted) merge them, else MSD radix sort.
+  If scratch can't be malloc'd, fall back to insertion sort, which is slow for many candidates but needs no memory.
+  The key is in malloc_buffer_1 and directories, so qsort(), which has no way to pass them, won't do.
+*/
+void pgfindlib_sort_candidates(const char *malloc_buffer_1, const struct pgfindlib_candidate_directory *directories,
+                               struct pgfindlib_candidate *candidates, unsigned int count)
+{
+  if (count < 2) return;
+  struct pgfindlib_candidate *scratch= (struct pgfindlib_candidate *)malloc(count * sizeof(struct pgfindlib_candidate));
+  if (scratch == NULL) goto fallback;
+  unsigned int i;
+  for (i= 1; i < count; ++i)
+  {
+    if (candidates[i - 1].source_number > candidates[i].source_number) break;
+  }
+  if (i < count) /* sources are not grouped, so radix sort everything starting with the source_number bytes */
+  {
+    if (pgfindlib_radix_sort(malloc_buffer_1, directories, candidates, count, 0, scratch) != PGFINDLIB_OK) goto fallback;
+    free(scratch);
+    return;
+  }
+  for (unsigned int lo= 0; lo < count;)
+  {
+    unsigned int hi;
+    unsigned int run_start[PGFINDLIB_MAX_RUNS_TO_MERGE];
+    unsigned int runs_count= 1;
+    run_start[0]= lo;
+    for (hi= lo + 1; (hi < count) && (candidates[hi].source_number == candidates[lo].source_number); ++hi)
+    {
+      if (pgfindlib_candidate_compare(malloc_buffer_1, directories, &candidates[hi - 1], &candidates[hi]) > 0)
+      {
+        if (runs_count < PGFINDLIB_MAX_RUNS_TO_MERGE) run_start[runs_count]= hi;
+        ++runs_count;
+      }
+    }
+    if (runs_count > PGFINDLIB_MAX_RUNS_TO_MERGE)
+    {
+      if (pgfindlib_radix_sort(malloc_buffer_1, directories, candidates + lo, hi - lo, 4, scratch) != PGFINDLIB_OK) goto fallback;
+    }
+    else
+    {
+      /* merge run 0 with run 1, then the result with run 2, and so on */
+      for (unsigned int r= 1; r < runs_count; ++r)
+      {
+        unsigned int mid= run_start[r];
+        unsigned int end= (r + 1 < runs_count) ? run_start[r + 1] : hi;
+        unsigned int a= lo, b= mid, out= lo;
+        while ((a < mid) && (b < end))
+        {
+          if (pgfindlib_candidate_compare(malloc_buffer_1, directories, &candidates[b], &candidates[a]) < 0) scratch[out++]= candidates[b++];
+          else scratch[out++]= candidates[a++];
+        }
+        while (a < mid) scratch[out++]= candidates[a++];
+        while (b < end) scratch[out++]= candidates[b++];
+        memcpy(candidates + lo, scratch + lo, (end - lo) * sizeof(struct pgfindlib_candidate));
+      }
+    }
+    lo= hi;
+  }
+  free(scratch);
+  return;
+fallback:
+  if (scratch != NULL) free(scratch);
+  pgfindlib_insertion_sort(malloc_buffer_1, directories, candidates, count);
+}
+
+/*
+  Given something like /tmp/libcrypto.so, return only the last part i.e. libcrypto.so.
+  Todo: Check whether there are places which could call this but instead are duplicating the instructions.
+*/
+static const char *pgfindlib_file_part(const char *one_library_or_file)
+{
+  const char *p= one_library_or_file + strlen(one_library_or_file);
+  for (;;)
+  {
+    --p;
+    if ((p < one_library_or_file) || (*p == '/')) { ++p; break; }
+  }
+  return p;
+}
+
+#if (PGFINDLIB_INCLUDE_LOADED != 0)
+struct pgfindlib_loaded_iterate
+{
+  struct pgfindlib_context *context;
+  int rval;
+};
+
+/* Called by dl_iterate_phdr() for each object, copy it. The main program has "" and the vdso has no /, skip them. */
+static int pgfindlib_loaded_callback(struct dl_phdr_info *info, size_t size, void *data)
+{
+  (void) size;
+  struct pgfindlib_loaded_iterate *iterate= (struct pgfindlib_loaded_iterate *)data;
+  struct pgfindlib_context *context= iterate->context;
+  if ((info->dlpi_name == NULL) || (strchr(info->dlpi_name, '/') == NULL)) return 0;
+  if (context->loaded_count == context->loaded_max)
+  {
+    unsigned int new_max= (context->loaded_max == 0) ? 32 : context->loaded_max * 2;
+    struct pgfindlib_loaded *new_loaded= (struct pgfindlib_loaded *)realloc(context->loaded, new_max * sizeof(struct pgfindlib_loaded));
+    if (new_loaded == NULL) { iterate->rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; return 1; }
+    context->loaded= new_loaded;
+    context->loaded_max= new_max;
+  }
+  struct pgfindlib_loaded *loaded= &context->loaded[context->loaded_count];
+  size_t path_length= strlen(info->dlpi_name) + 1;
+  loaded->path= (char *)malloc(path_length);
+  if (loaded->path == NULL) { iterate->rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; return 1; }
+  memcpy(loaded->path, info->dlpi_name, path_length);
+  loaded->address= (unsigned long) info->dlpi_addr;
+  loaded->is_stat_ok= 0;
+  ++context->loaded_count;
+  return 0;
+}
+#endif
+
+/*
+  For the "loaded" source: copy the process's link_map with dl_iterate_phdr(), which reads memory and not the disk.
+  Then, if pgfindlib_file() will know rows' (dev, ino) i.e. if it does lstat(), stat() each object once
+  so rows can be cross-referenced with pgfindlib_loaded_find(). stat() follows symlinks like the loader did,
+  and is done after dl_iterate_phdr() returns so there's no file system call while the loader's lock is held.
+*/
+int pgfindlib_loaded_init(struct pgfindlib_context *context)
+{
+#if (PGFINDLIB_INCLUDE_LOADED != 0)
+  struct pgfindlib_loaded_iterate iterate;
+  iterate.context= context;
+  iterate.rval= PGFINDLIB_OK;
+  dl_iterate_phdr(pgfindlib_loaded_callback, &iterate);
+  if (iterate.rval != PGFINDLIB_OK) return iterate.rval;
+  if ((context->option_flags & (PGFINDLIB_OPTION_SYMLINKS | PGFINDLIB_OPTION_HARDLINKS)) == 0) return PGFINDLIB_OK;
+  for (unsigned int i= 0; i < context->loaded_count; ++i)
+  {
+    struct stat sb;
+    if (stat(context->loaded[i].path, &sb) != 0) continue;
+    context->loaded[i].dev= sb.st_dev;
+    context->loaded[i].ino= sb.st_ino;
+    context->loaded[i].is_stat_ok= 1;
+  }
+#else
+  (void) context;
+#endif
+  return PGFINDLIB_OK;
+}
+
+#if (PGFINDLIB_INCLUDE_LOADED != 0)
+/* Return the loaded object that is file (dev, ino), or NULL. There are rarely more than a few hundred so it's a simple loop. */
+const struct pgfindlib_loaded *pgfindlib_loaded_find(const struct pgfindlib_context *context, dev_t dev, ino_t ino)
+{
+  for (unsigned int i= 0; i < context->loaded_count; ++i)
+  {
+    const struct pgfindlib_loaded *loaded= &context->loaded[i];
+    if ((loaded->is_stat_ok) && (loaded->dev == dev) && (loaded->ino == ino)) return loaded;
+  }
+  return NULL;
+}
+#endif
+
+/* Add the loaded objects whose file part matches WHERE, as candidates of source tokener_number. */
+int pgfindlib_loaded_source(struct pgfindlib_context *context, struct pgfindlib_where_matcher *matcher, int tokener_number,
+                            char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                            struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length)
+{
+  for (unsigned int i= 0; i < context->loaded_count; ++i)
+  {
+    const char *path= context->loaded[i].path;
+    if (pgfindlib_find_line_in_statement(matcher, pgfindlib_file_part(path)) == 0) continue; /* doesn't match requirement */
+    int rval= pgfindlib_add_to_malloc_buffers(context, path, tokener_number,
+                                              malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                              malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
+    if (rval != PGFINDLIB_OK) return rval;
+  }
+  return PGFINDLIB_OK;
+}
+
+#if (PGFINDLIB_INCLUDE_AUDIT_LOG != 0)
+/* Copy a path without "//", which the loader doesn't write but a row can have, e.g. from LD_LIBRARY_PATH=/x/ */
+static void pgfindlib_audit_path_copy(char *to, const char *from, unsigned int from_length)
+{
+  unsigned int length= 0;
+  for (unsigned int i= 0; i < from_length; ++i)
+  {
+    if ((from[i] == '/') && (length > 0) && (to[length - 1] == '/')) continue;
+    to[length++]= from[i];
+  }
+  to[length]= '\0';
+}
+
+static int pgfindlib_audited_compare(const void *a, const void *b)
+{
+  const struct pgfindlib_audited *x= (const struct pgfindlib_audited *)a;
+  const struct pgfindlib_audited *y= (const struct pgfindlib_audited *)b;
+  int c= strcmp(x->path, y->path);
+  if (c != 0) return c;
+  return (x->sequence < y->sequence) ? -1 : (x->sequence > y->sequence);
+}
+
+/*
+  For options->audit_log: read the log that pgfindlib_audit.so wrote, see pgfindlib_audit.c and "Re audit log" in README.md.
+  For each object that the loader searched for and then mapped, keep the path it mapped, how many directories it tried
+  before that one, and the nanoseconds from the start of the search to la_objopen(). Chunks of different processes can be
+  interleaved so a search that's in progress is kept per pid. A chunk that's cut short (the end of a log that's being
+  written) ends the log. An empty log is okay, it's PGFINDLIB_ERROR_AUDIT_LOG if the log can't be read or isn't a log.
+*/
+int pgfindlib_audit_log_read(struct pgfindlib_context *context)
+{
+  struct
+  {
+    unsigned int pid;
+    int is_searching;
+    unsigned int tries;
+    unsigned long long start;
+  } pending[PGFINDLIB_AUDIT_PENDING_MAX];
+  unsigned int pending_count= 0;
+  unsigned int pending_next= 0; /* which to replace if there are more processes than that, the oldest */
+  FILE *fp= fopen(context->audit_log, "r");
+  if (fp == NULL) return PGFINDLIB_ERROR_AUDIT_LOG;
+  struct stat sb;
+  if ((fstat(fileno(fp), &sb) != 0) || ((unsigned long long) sb.st_size > 0x7fffffffULL)) { fclose(fp); return PGFINDLIB_ERROR_AUDIT_LOG; }
+  size_t log_size= (size_t) sb.st_size;
+  char *log= (char *)malloc(log_size + 1);
+  if (log == NULL) { fclose(fp); return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; }
+  size_t read_size= fread(log, 1, log_size, fp);
+  fclose(fp);
+  /* At most one object per record, and its path is no longer than the record's */
+  unsigned int audited_max= read_size / sizeof(struct pgfindlib_audit_record) + 1;
+  context->audited= (struct pgfindlib_audited *)malloc(audited_max * sizeof(struct pgfindlib_audited));
+  context->audited_paths= (char *)malloc(read_size + audited_max);
+  if ((context->audited == NULL) || (context->audited_paths == NULL)) { free(log); return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; }
+  unsigned int paths_length= 0;
+  int rval= PGFINDLIB_OK;
+  size_t offset= 0; /* chunks and records are multiples of 8 bytes so the casts are aligned */
+  while (offset + sizeof(struct pgfindlib_audit_chunk) <= read_size)
+  {
+    const struct pgfindlib_audit_chunk *chunk= (const struct pgfindlib_audit_chunk *)(log + offset);
+    if ((chunk->magic != PGFINDLIB_AUDIT_MAGIC) || (chunk->length > read_size - offset - sizeof(struct pgfindlib_audit_chunk)))
+    {
+      if (offset == 0) rval= PGFINDLIB_ERROR_AUDIT_LOG;
+      break;
+    }
+    unsigned int slot;
+    for (slot= 0; (slot < pending_count) && (pending[slot].pid != chunk->pid); ++slot) ;
+    if (slot == pending_count)
+    {
+      if (pending_count < PGFINDLIB_AUDIT_PENDING_MAX) ++pending_count;
+      else { slot= pending_next; pending_next= (pending_next + 1) % PGFINDLIB_AUDIT_PENDING_MAX; }
+      pending[slot].pid= chunk->pid;
+      pending[slot].is_searching= 0;
+    }
+    const char *p= (const char *)(chunk + 1);
+    const char *end= p + chunk->length;
+    while (p + sizeof(struct pgfindlib_audit_record) <= end)
+    {
+      const struct pgfindlib_audit_record *record= (const struct pgfindlib_audit_record *)p;
+      unsigned int record_length= (sizeof(struct pgfindlib_audit_record) + record->path_length + 7) & ~7U;
+      if ((size_t) (end - p) < record_length) break;
+      if (record->type == PGFINDLIB_AUDIT_SEARCH)
+      {
+        /* A name with a / gets LA_SER_ORIG again when it's opened, that's the same search */
+        if ((pending[slot].is_searching == 0) || (pending[slot].tries > 0))
+        {
+          pending[slot].is_searching= 1;
+          pending[slot].tries= 0;
+          pending[slot].start= record->nanoseconds;
+        }
+      }
+      else if (record->type == PGFINDLIB_AUDIT_TRY)
+      {
+        ++pending[slot].tries;
+      }
+      else if ((record->type == PGFINDLIB_AUDIT_OPEN) && (pending[slot].is_searching))
+      {
+        struct pgfindlib_audited *audited= &context->audited[context->audited_count];
+        audited->path= context->audited_paths + paths_length;
+        pgfindlib_audit_path_copy(context->audited_paths + paths_length, (const char *)(record + 1), record->path_length);
+        paths_length+= strlen(audited->path) + 1;
+        audited->failures= (pending[slot].tries > 0) ? pending[slot].tries - 1 : 0; /* the last try is the one that was mapped */
+        audited->nanoseconds= (record->nanoseconds > pending[slot].start) ? record->nanoseconds - pending[slot].start : 0;
+        audited->sequence= context->audited_count;
+        ++context->audited_count;
+        pending[slot].is_searching= 0;
+      }
+      p+= record_length;
+    }
+    offset+= sizeof(struct pgfindlib_audit_chunk) + chunk->length;
+  }
+  free(log);
+  /* Sort by path, and of the objects with the same path keep the last, e.g. the log has several runs of the program */
+  qsort(context->audited, context->audited_count, sizeof(struct pgfindlib_audited), pgfindlib_audited_compare);
+  unsigned int kept= 0;
+  for (unsigned int i= 0; i < context->audited_count; ++i)
+  {
+    if ((i + 1 < context->audited_count) && (strcmp(context->audited[i].path, context->audited[i + 1].path) == 0)) continue;
+    context->audited[kept++]= context->audited[i];
+  }
+  context->audited_count= kept;
+  return rval;
+}
+
+/* Return what options->audit_log says about the row with path, or NULL. It's a binary search of the sorted paths. */
+const struct pgfindlib_audited *pgfindlib_audit_find(struct pgfindlib_context *context, const char *path)
+{
+  unsigned int length= strlen(path);
+  if (length > PGFINDLIB_MAX_PATH_LENGTH) return NULL;
+  pgfindlib_audit_path_copy(context->audit_path, path, length);
+  unsigned int low= 0;
+  unsigned int high= context->audited_count;
+  while (low < high)
+  {
+    unsigned int middle= low + (high - low) / 2;
+    int c= strcmp(context->audited[middle].path, context->audit_path);
+    if (c == 0) return &context->audited[middle];
+    if (c < 0) low= middle + 1; else high= middle;
+  }
+  return NULL;
+}
+#endif
+
+#if (PGFINDLIB_INCLUDE_DLOPEN != 0) || (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+/*
+  Split one output row (already \0-terminated) into columns at the column delimiter.
+  pgfindlib_strcat() trims spaces so ", " is in the buffer as ",".
+  A comment can contain the delimiter, e.g. "060 access(filename, R_OK) failed", so after a comment a delimiter
+  only ends it if what follows is empty or could start the next column: 3 digits for a comment, / for the target.
+  Return 1 if there are exactly MAX_COLUMNS_PER_ROW columns, else 0 e.g. a path contains the delimiter, and row is unchanged.
+*/
+static int pgfindlib_split_row(char *row, const char *delimiter, unsigned int delimiter_length, char *columns[])
+{
+  unsigned int column_count= 0;
+  char *p= row;
+  char *search_from= row;
+  for (;;)
+  {
+    char *d= strstr(search_from, delimiter);
+    if (d == NULL) break;
+    if (column_count == MAX_COLUMNS_PER_ROW) { p= d; break; }
+    const char *next= d + delimiter_length;
+    if ((column_count >= COLUMN_FOR_COMMENT_1) && (column_count <= COLUMN_FOR_COMMENT_3)
+     && ((p[0] >= '0') && (p[0] <= '9')) && (strncmp(next, delimiter, delimiter_length) != 0) && (*next != '\0'))
+    {
+      int is_next_column;
+      if (column_count == COLUMN_FOR_COMMENT_3) is_next_column= (*next == '/');
+      else is_next_column= ((next[0] >= '0') && (next[0] <= '9') && (next[1] >= '0') && (next[1] <= '9') && (next[2] >= '0') && (next[2] <= '9'));
+      if (!is_next_column) { search_from= (char *) next; continue; } /* the delimiter is in this comment */
+    }
+    *d= '\0';
+    columns[column_count++]= p;
+    p= d + delimiter_length;
+    search_from= p;
+  }
+  if ((column_count == MAX_COLUMNS_PER_ROW) && (*p == '\0')) return 1;
+  for (unsigned int i= 0; i < column_count; ++i) columns[i][strlen(columns[i])]= delimiter[0]; /* the row as it was */
+  return 0;
+}
+#endif
+
+#if (PGFINDLIB_INCLUDE_DLOPEN != 0)
+/*
+  The decision table of pgfindlib_dlopen(): (soname, FROM, order, reject, options) -> the path that dlopen() accepted.
+  It's the only state that outlives a call. It lasts for the process lifetime so it has a mutex.
+*/
+struct pgfindlib_dlopen_decision
+{
+  char *soname;
+  char *from;               /* "" if policy->from was NULL */
+  unsigned int order;
+  unsigned int reject;
+  unsigned long long options_key; /* pgfindlib_dlopen_options_key() of policy->options */
+  char *path;
+};
+
+static struct pgfindlib_dlopen_decision *pgfindlib_dlopen_decisions= NULL;
+static unsigned int pgfindlib_dlopen_decisions_count= 0;
+static unsigned int pgfindlib_dlopen_decisions_max= 0;
+static pthread_mutex_t pgfindlib_dlopen_mutex= PTHREAD_MUTEX_INITIALIZER;
+
+/* Where the loader looks for a soname, in its order. LD_RUN_PATH and LD_PGFINDLIB_PATH are only informational. */
+#define PGFINDLIB_DLOPEN_DEFAULT_FROM "DT_RPATH, LD_LIBRARY_PATH, DT_RUNPATH, ld.so.cache, default_paths"
+
+/* One row of pgfindlib_ex() output that pgfindlib_dlopen() might try */
+struct pgfindlib_dlopen_row
+{
+  const char *path;         /* points into the output buffer, where the column delimiter was replaced by \0 */
+  int is_loaded;            /* the source is "loaded" or there is a 016 comment */
+  unsigned int same_file;   /* the row number of the first row that's the same file, from 014 or 015, else its own */
+};
+
+/*
+  FNV-1a of what in the options can change which rows pgfindlib_ex() makes: flags, the environment's strings,
+  sysroot, backend and architectures. options == NULL gets the same key as options that say the defaults.
+  Two calls with different envp pointers but the same strings get the same key.
+*/
+static unsigned long long pgfindlib_dlopen_options_key_add(unsigned long long key, const void *bytes, unsigned int length)
+{
+  for (unsigned int i= 0; i < length; ++i) key= (key ^ ((const unsigned char *) bytes)[i]) * 1099511628211ULL;
+  return key;
+}
+
+static unsigned long long pgfindlib_dlopen_options_key(const struct pgfindlib_options *options)
+{
+  unsigned long long key= 14695981039346656037ULL;
+  unsigned int flags= (options == NULL) ? PGFINDLIB_OPTIONS_DEFAULT : options->flags;
+  const struct pgfindlib_backend *backend= ((options == NULL) || (options->backend == NULL)) ? &pgfindlib_backend_posix : options->backend;
+  key= pgfindlib_dlopen_options_key_add(key, &flags, sizeof(flags));
+  key= pgfindlib_dlopen_options_key_add(key, &backend, sizeof(backend));
+  if (options == NULL) return key;
+  if (options->envp != NULL) /* with NULL it's environ, as for options == NULL */
+  {
+    for (char *const *e= options->envp; *e != NULL; ++e) key= pgfindlib_dlopen_options_key_add(key, *e, strlen(*e) + 1);
+    key= pgfindlib_dlopen_options_key_add(key, "\1", 1); /* so envp { } differs from envp NULL */
+  }
+  if (options->sysroot != NULL) key= pgfindlib_dlopen_options_key_add(key, options->sysroot, strlen(options->sysroot) + 1);
+  if (options->architectures != NULL)
+  {
+    for (unsigned int i= 0; i < options->architectures_count; ++i)
+    {
+      key= pgfindlib_dlopen_options_key_add(key, &options->architectures[i].elf_class, sizeof(options->architectures[i].elf_class));
+      key= pgfindlib_dlopen_options_key_add(key, &options->architectures[i].e_machine, sizeof(options->architectures[i].e_machine));
+    }
+  }
+  return key;
+}
+
+/* Return the decision number, or -1. Caller holds the mutex. */
+static int pgfindlib_dlopen_decision_find(const char *soname, const char *from, unsigned int order, unsigned int reject,
+                                          unsigned long long options_key)
+{
+  for (unsigned int i= 0; i < pgfindlib_dlopen_decisions_count; ++i)
+  {
+    const struct pgfindlib_dlopen_decision *d= &pgfindlib_dlopen_decisions[i];
+    if ((d->order == order) && (d->reject == reject) && (d->options_key == options_key)
+     && (strcmp(d->soname, soname) == 0) && (strcmp(d->from, from) == 0))
+      return i;
+  }
+  return -1;
+}
+
+/* Remove decision i. Caller holds the mutex. */
+static void pgfindlib_dlopen_decision_remove(unsigned int i)
+{
+  free(pgfindlib_dlopen_decisions[i].soname); /* soname, from and path are one malloc */
+  --pgfindlib_dlopen_decisions_count;
+  pgfindlib_dlopen_decisions[i]= pgfindlib_dlopen_decisions[pgfindlib_dlopen_decisions_count];
+}
+
+/*
+  Copy the remembered path for the key to path, return 1 if there is one.
+  It's copied while the mutex is held because another thread could forget it.
+*/
+static int pgfindlib_dlopen_decision_get(const char *soname, const char *from, unsigned int order, unsigned int reject,
+                                         unsigned long long options_key, char *path)
+{
+  int is_found= 0;
+  pthread_mutex_lock(&pgfindlib_dlopen_mutex);
+  int i= pgfindlib_dlopen_decision_find(soname, from, order, reject, options_key);
+  if (i >= 0)
+  {
+    strcpy(path, pgfindlib_dlopen_decisions[i].path);
+    is_found= 1;
+  }
+  pthread_mutex_unlock(&pgfindlib_dlopen_mutex);
+  return is_found;
+}
+
+/*
+  Forget the decision for the key if it's still path, e.g. dlopen() of it failed. Other keys for the same soname stay,
+  and so does the key if another thread has meanwhile remembered something else for it.
+*/
+static void pgfindlib_dlopen_decision_unset(const char *soname, const char *from, unsigned int order, unsigned int reject,
+                                            unsigned long long options_key, const char *path)
+{
+  pthread_mutex_lock(&pgfindlib_dlopen_mutex);
+  int i= pgfindlib_dlopen_decision_find(soname, from, order, reject, options_key);
+  if ((i >= 0) && (strcmp(pgfindlib_dlopen_decisions[i].path, path) == 0)) pgfindlib_dlopen_decision_remove(i);
+  pthread_mutex_unlock(&pgfindlib_dlopen_mutex);
+}
+
+/* Remember path for the key, replacing what was there. If malloc fails it's just not remembered. */
+static void pgfindlib_dlopen_decision_set(const char *soname, const char *from, unsigned int order, unsigned int reject,
+                                          unsigned long long options_key, const char *path)
+{
+  unsigned int soname_length= strlen(soname) + 1, from_length= strlen(from) + 1, path_length= strlen(path) + 1;
+  char *strings= (char *)malloc(soname_length + from_length + path_length);
+  if (strings == NULL) return;
+  memcpy(strings, soname, soname_length);
+  memcpy(strings + soname_length, from, from_length);
+  memcpy(strings + soname_length + from_length, path, path_length);
+  pthread_mutex_lock(&pgfindlib_dlopen_mutex);
+  int i= pgfindlib_dlopen_decision_find(soname, from, order, reject, options_key);
+  if (i >= 0) pgfindlib_dlopen_decision_remove(i);
+  if (pgfindlib_dlopen_decisions_count == pgfindlib_dlopen_decisions_max)
+  {
+    unsigned int new_max= (pgfindlib_dlopen_decisions_max == 0) ? 16 : pgfindlib_dlopen_decisions_max * 2;
+    struct pgfindlib_dlopen_decision *new_decisions;
+    new_decisions= (struct pgfindlib_dlopen_decision *)realloc(pgfindlib_dlopen_decisions, new_max * sizeof(struct pgfindlib_dlopen_decision));
+    if (new_decisions == NULL) { pthread_mutex_unlock(&pgfindlib_dlopen_mutex); free(strings); return; }
+    pgfindlib_dlopen_decisions= new_decisions;
+    pgfindlib_dlopen_decisions_max= new_max;
+  }
+  struct pgfindlib_dlopen_decision *d= &pgfindlib_dlopen_decisions[pgfindlib_dlopen_decisions_count++];
+  d->soname= strings;
+  d->from= strings + soname_length;
+  d->path= strings + soname_length + from_length;
+  d->order= order;
+  d->reject= reject;
+  d->options_key= options_key;
+  pthread_mutex_unlock(&pgfindlib_dlopen_mutex);
+}
+
+/* Forget every decision for soname, or every decision if soname == NULL. */
+void pgfindlib_dlopen_forget(const char *soname)
+{
+  pthread_mutex_lock(&pgfindlib_dlopen_mutex);
+  for (unsigned int i= 0; i < pgfindlib_dlopen_decisions_count;)
+  {
+    if ((soname == NULL) || (strcmp(pgfindlib_dlopen_decisions[i].soname, soname) == 0)) pgfindlib_dlopen_decision_remove(i);
+    else ++i;
+  }
+  if (pgfindlib_dlopen_decisions_count == 0)
+  {
+    free(pgfindlib_dlopen_decisions);
+    pgfindlib_dlopen_decisions= NULL;
+    pgfindlib_dlopen_decisions_max= 0;
+  }
+  pthread_mutex_unlock(&pgfindlib_dlopen_mutex);
+}
+
+/* Like strcmp() but runs of digits compare as numbers, so libx.so.10 > libx.so.9 */
+static int pgfindlib_version_compare(const char *a, const char *b)
+{
+  while ((*a != '\0') && (*b != '\0'))
+  {
+    if ((*a >= '0') && (*a <= '9') && (*b >= '0') && (*b <= '9'))
+    {
+      while (*a == '0') ++a;
+      while (*b == '0') ++b;
+      const char *a_end= a;
+      const char *b_end= b;
+      while ((*a_end >= '0') && (*a_end <= '9')) ++a_end;
+      while ((*b_end >= '0') && (*b_end <= '9')) ++b_end;
+      if ((a_end - a) != (b_end - b)) return ((a_end - a) < (b_end - b)) ? -1 : 1;
+      int c= memcmp(a, b, a_end - a);
+      if (c != 0) return c;
+      a= a_end;
+      b= b_end;
+      continue;
+    }
+    if (*a != *b) return ((unsigned char) *a < (unsigned char) *b) ? -1 : 1;
+    ++a;
+    ++b;
+  }
+  if (*a == *b) return 0;
+  return (*a == '\0') ? -1 : 1;
+}
+
+/*
+  Return 1 if the row's comments or name break a rejection rule in reject, see PGFINDLIB_DLOPEN_REJECT_...
+  Not PGFINDLIB_DLOPEN_REJECT_DUPLICATE, that depends on which rows were tried, after ordering.
+*/
+static int pgfindlib_dlopen_is_rejected(char *columns[], const char *soname, unsigned int reject)
+{
+  const char *path= columns[COLUMN_FOR_PATH];
+  if (path[0] != '/') return 1; /* comment row, or relative path that dlopen() would resolve against the cwd */
+  if (strlen(path) >= PGFINDLIB_MAX_PATH_LENGTH) return 1;
+  if (((reject & PGFINDLIB_DLOPEN_REJECT_NOT_EXACT_NAME) != 0) && (strcmp(pgfindlib_file_part(path), soname) != 0)) return 1;
+  for (int i= COLUMN_FOR_COMMENT_1; i <= COLUMN_FOR_COMMENT_3; ++i)
+  {
+    const char *comment= columns[i];
+    if ((comment[0] < '0') || (comment[0] > '9')) continue;
+    int comment_number= atoi(comment);
+    if ((comment_number >= 70) && (comment_number <= 79) && ((reject & PGFINDLIB_DLOPEN_REJECT_ELF) != 0)) return 1;
+    if ((comment_number == PGFINDLIB_COMMENT_ACCESS_FAILED) && ((reject & PGFINDLIB_DLOPEN_REJECT_ACCESS) != 0)) return 1;
+    if (((comment_number == PGFINDLIB_COMMENT_LSTAT_FAILED) || (comment_number == PGFINDLIB_COMMENT_SYMLINK_BROKEN))
+     && ((reject & PGFINDLIB_DLOPEN_REJECT_BROKEN) != 0)) return 1;
+  }
+  return 0;
+}
+
+/*
+  Find soname with pgfindlib_ex() and dlopen() the first acceptable row, see "Re pgfindlib_dlopen" in README.md.
+  On success *handle is what dlopen() returned and path (if not NULL) is the absolute path that was loaded.
+  The path is remembered, so the next call with the same soname and policy dlopen()s it directly,
+  with no search by us and no path probing by the loader. If that dlopen() fails the path is forgotten and we search again.
+  Return PGFINDLIB_ERROR_NOT_FOUND if no row was acceptable, PGFINDLIB_ERROR_DLOPEN_FAILED if every acceptable row
+  failed (then dlerror() says why the last one failed), or an error from pgfindlib_ex().
+*/
+int pgfindlib_dlopen(const char *soname, int dlopen_flags, const struct pgfindlib_dlopen_policy *policy,
+                     void **handle, char *path, unsigned int path_max_length)
+{
+  if ((soname == NULL) || (handle == NULL)) return PGFINDLIB_ERROR_BUFFER_NULL;
+  *handle= NULL;
+  if ((path != NULL) && (path_max_length < PGFINDLIB_MAX_PATH_LENGTH)) return PGFINDLIB_ERROR_MAX_PATH_LENGTH_TOO_SMALL;
+  /* A soname is one token of a WHERE clause. Something with / is a path, so call dlopen() directly. */
+  if ((soname[0] == '\0') || (strpbrk(soname, " ,'\":/") != NULL)) return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+  if (strlen(soname) >= PGFINDLIB_MAX_TOKEN_LENGTH) return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+
+  const char *from= "";
+  unsigned int order= PGFINDLIB_DLOPEN_ORDER_SEARCH;
+  unsigned int reject= PGFINDLIB_DLOPEN_REJECT_DEFAULT;
+  const struct pgfindlib_options *options= NULL;
+  if (policy != NULL)
+  {
+    if (policy->from != NULL) from= policy->from;
+    order= policy->order;
+    reject= policy->reject;
+    options= policy->options;
+  }
+  if (from[0] == '\0') from= PGFINDLIB_DLOPEN_DEFAULT_FROM; /* where the loader looks for a soname, not LD_RUN_PATH etc. */
+  /* The rows are read from the buffer here, and with PROBE_COST the 017 rows say what the loader would open */
+  struct pgfindlib_options search_options;
+  if (options != NULL) search_options= *options;
+  else
+  {
+    memset(&search_options, 0, sizeof(search_options));
+    search_options.flags= PGFINDLIB_OPTIONS_DEFAULT;
+  }
+  search_options.rows_ready= NULL;
+#if (PGFINDLIB_INCLUDE_PROBE_COST != 0)
+  search_options.flags|= PGFINDLIB_OPTION_PROBE_COST;
+  const char *loader_path= NULL;
+#endif
+
+  int rval;
+  char *buffer= NULL;
+  char *statement= NULL;
+  struct pgfindlib_dlopen_row *rows= NULL;
+  char *decided_path= (char *)malloc(PGFINDLIB_MAX_PATH_LENGTH);
+  if (decided_path == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+
+  unsigned long long options_key= pgfindlib_dlopen_options_key(options);
+  if (pgfindlib_dlopen_decision_get(soname, from, order, reject, options_key, decided_path) == 1)
+  {
+    *handle= dlopen(decided_path, dlopen_flags);
+    if (*handle != NULL) { rval= PGFINDLIB_OK; goto copy_path_and_return; }
+    pgfindlib_dlopen_decision_unset(soname, from, order, reject, options_key, decided_path); /* e.g. the file was removed, so search again */
+  }
+
+  /* FROM <from>[, loaded] WHERE <soname> */
+  unsigned int statement_max_length= strlen(from) + strlen(soname) + 64;
+  statement= (char *)malloc(statement_max_length);
+  if (statement == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto free_and_return; }
+  strcpy(statement, "FROM ");
+  strcat(statement, from);
+  if (order == PGFINDLIB_DLOPEN_ORDER_LOADED_FIRST) strcat(statement, ", loaded");
+  strcat(statement, " WHERE ");
+  strcat(statement, soname);
+
+  unsigned int buffer_max_length= 65536;
+  for (;;)
+  {
+    buffer= (char *)malloc(buffer_max_length);
+    if (buffer == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto free_and_return; }
+    rval= pgfindlib_ex(statement, buffer, buffer_max_length, &search_options);
+    if ((rval != PGFINDLIB_ERROR_BUFFER_MAX_LENGTH_TOO_SMALL) || (buffer_max_length >= 0x1000000)) break;
+    free(buffer); buffer= NULL;
+    buffer_max_length*= 4;
+  }
+  if (rval != PGFINDLIB_OK) goto free_and_return;
+
+  /* The rows that pass the rejection rules, in output order */
+  char delimiter[sizeof(PGFINDLIB_COLUMN_DELIMITER)];
+  unsigned int delimiter_length= 0;
+  pgfindlib_strcat(delimiter, &delimiter_length, PGFINDLIB_COLUMN_DELIMITER, sizeof(delimiter) - 1); /* trim spaces as the rows were */
+  unsigned int rows_max= 1;
+  for (const char *p= buffer; (p= strstr(p, PGFINDLIB_ROW_DELIMITER)) != NULL; ++p) ++rows_max;
+  rows= (struct pgfindlib_dlopen_row *)malloc(rows_max * sizeof(struct pgfindlib_dlopen_row));
+  if (rows == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW; goto free_and_return; }
+  unsigned int rows_count= 0;
+  for (char *row= buffer; *row != '\0';)
+  {
+    char *row_end= strstr(row, PGFINDLIB_ROW_DELIMITER);
+    char *next_row= (row_end == NULL) ? row + strlen(row) : row_end + strlen(PGFINDLIB_ROW_DELIMITER);
+    if (row_end != NULL) *row_end= '\0';
+    char *columns[MAX_COLUMNS_PER_ROW];
+    if (pgfindlib_split_row(row, delimiter, delimiter_length, columns) != 1) { row= next_row; continue; }
+#if (PGFINDLIB_INCLUDE_PROBE_COST != 0)
+    if (atoi(columns[COLUMN_FOR_COMMENT_1]) == PGFINDLIB_COMMENT_PROBE_MISSES)
+    {
+      loader_path= columns[COLUMN_FOR_PATH]; /* "" if not found */
+      row= next_row;
+      continue;
+    }
+#endif
+    if (pgfindlib_dlopen_is_rejected(columns, soname, reject) == 0)
+    {
+      rows[rows_count].path= columns[COLUMN_FOR_PATH];
+      rows[rows_count].is_loaded= (strcmp(columns[COLUMN_FOR_SOURCE], "loaded") == 0);
+      rows[rows_count].same_file= atoi(columns[COLUMN_FOR_ROW_NUMBER]);
+      for (int i= COLUMN_FOR_COMMENT_1; i <= COLUMN_FOR_COMMENT_3; ++i)
+      {
+        int comment_number= atoi(columns[i]);
+        if (comment_number == PGFINDLIB_COMMENT_ALREADY_MAPPED) rows[rows_count].is_loaded= 1;
+        if ((comment_number == PGFINDLIB_COMMENT_DUPLICATE) || (comment_number == PGFINDLIB_COMMENT_SAME_TARGET))
+        {
+          const char *of= strrchr(columns[i], ' '); /* "014 duplicate of 7" or "015 same target as 7" */
+          if (of != NULL) rows[rows_count].same_file= atoi(of + 1);
+        }
+      }
+      ++rows_count;
+    }
+    row= next_row;
+  }
+  if (rows_count == 0) { rval= PGFINDLIB_ERROR_NOT_FOUND; goto free_and_return; }
+
+#if (PGFINDLIB_INCLUDE_PROBE_COST != 0)
+  /*
+    Rows are sorted by path within a source, not by where the directory is in the source's list,
+    so e.g. LD_LIBRARY_PATH=/z:/a has /a's row first. The loader model's pick goes first, the rest stay in row order.
+  */
+  if (loader_path != NULL)
+  {
+    for (unsigned int i= 0; i < rows_count; ++i)
+    {
+      if (strcmp(rows[i].path, loader_path) != 0) continue;
+      struct pgfindlib_dlopen_row tmp= rows[i];
+      memmove(&rows[1], &rows[0], i * sizeof(struct pgfindlib_dlopen_row));
+      rows[0]= tmp;
+      break;
+    }
+  }
+#endif
+
+  /* Stable insertion sort by the policy's order, there are seldom more than a few rows */
+  if (order != PGFINDLIB_DLOPEN_ORDER_SEARCH)
+  {
+    for (unsigned int i= 1; i < rows_count; ++i)
+    {
+      struct pgfindlib_dlopen_row tmp= rows[i];
+      unsigned int j= i;
+      for (; j > 0; --j)
+      {
+        int is_before;
+        if (order == PGFINDLIB_DLOPEN_ORDER_LOADED_FIRST) is_before= (tmp.is_loaded > rows[j - 1].is_loaded);
+        else is_before= (pgfindlib_version_compare(pgfindlib_file_part(tmp.path), pgfindlib_file_part(rows[j - 1].path)) > 0);
+        if (!is_before) break;
+        rows[j]= rows[j - 1];
+      }
+      rows[j]= tmp;
+    }
+  }
+
+  /* A file that dlopen() refused once is refused by every name, so with REJECT_DUPLICATE it's tried once, by the first name in order */
+  rval= PGFINDLIB_ERROR_NOT_FOUND;
+  for (unsigned int i= 0; i < rows_count; ++i)
+  {
+    if ((reject & PGFINDLIB_DLOPEN_REJECT_DUPLICATE) != 0)
+    {
+      unsigned int j;
+      for (j= 0; j < i; ++j) if (rows[j].same_file == rows[i].same_file) break;
+      if (j < i) continue;
+    }
+    rval= PGFINDLIB_ERROR_DLOPEN_FAILED;
+    *handle= dlopen(rows[i].path, dlopen_flags);
+    if (*handle == NULL) continue;
+    strcpy(decided_path, rows[i].path);
+    pgfindlib_dlopen_decision_set(soname, from, order, reject, options_key, decided_path);
+    rval= PGFINDLIB_OK;
+    break;
+  }
+copy_path_and_return:
+  if ((rval == PGFINDLIB_OK) && (path != NULL)) strcpy(path, decided_path);
+free_and_return:
+  if (rows != NULL) free(rows);
+  if (buffer != NULL) free(buffer);
+  if (statement != NULL) free(statement);
+  free(decided_path);
+  return rval;
+}
+#endif
+
+#if (PGFINDLIB_INCLUDE_WARMUP != 0)
+/* What pgfindlib_warmup_start() passes to the background thread. paths and the strings are in the same malloc. */
+struct pgfindlib_warmup
+{
+  pthread_t thread;
+  int is_thread;            /* 0 if pthread_create() failed and the work was done in pgfindlib_warmup_start() */
+  unsigned int flags;
+  const char **paths;
+  unsigned int paths_count;
+  struct pgfindlib_warmup_result result;
+};
+
+/*
+  Prefetch one file's PT_LOAD segments that are executable or read-only, the ones the loader will map
+  and then fault in. Writable segments are copy-on-write and are small, so they're skipped.
+  Return the number of bytes asked for, or -1 if the file can't be opened or isn't a native ELF.
+*/
+static long long pgfindlib_warmup_file(const char *path, unsigned int flags)
+{
+  long long bytes= 0;
+  char *phdrs= NULL;
+  int fd= open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return -1;
+  ElfW(Ehdr) elf_header;
+  struct stat st;
+  if ((pread(fd, &elf_header, sizeof(elf_header), 0) != sizeof(elf_header))
+   || (memcmp(elf_header.e_ident, ELFMAG, SELFMAG) != 0)
+   || (elf_header.e_ident[EI_CLASS] != ((sizeof(void *) == 8) ? ELFCLASS64 : ELFCLASS32))
+   || (elf_header.e_phentsize != sizeof(ElfW(Phdr)))
+   || (fstat(fd, &st) == -1))
+  { bytes= -1; goto close_and_return; }
+  unsigned int phdrs_size= elf_header.e_phnum * sizeof(ElfW(Phdr));
+  phdrs= (char *)malloc(phdrs_size + 1);
+  if ((phdrs == NULL) || (pread(fd, phdrs, phdrs_size, elf_header.e_phoff) != (ssize_t) phdrs_size)) { bytes= -1; goto close_and_return; }
+  long page_size= sysconf(_SC_PAGESIZE);
+  for (unsigned int i= 0; i < elf_header.e_phnum; ++i)
+  {
+    const ElfW(Phdr) *phdr= (const ElfW(Phdr) *)(phdrs + i * sizeof(ElfW(Phdr)));
+    if (phdr->p_type != PT_LOAD) continue;
+    if (((phdr->p_flags & PF_W) != 0) && ((phdr->p_flags & PF_X) == 0)) continue;
+    off_t offset= phdr->p_offset & ~(page_size - 1); /* mmap() and the page cache work in pages */
+    if (offset >= st.st_size) continue;
+    off_t end= phdr->p_offset + phdr->p_filesz;
+    if (end > st.st_size) end= st.st_size;
+    size_t length= end - offset;
+    if (length == 0) continue;
+    if ((flags & PGFINDLIB_WARMUP_POPULATE) != 0)
+    {
+      /* Faulting the pages in reads them, so the thread waits for the disk here rather than the loader later */
+      void *map= mmap(NULL, length, PROT_READ, MAP_PRIVATE | PGFINDLIB_MAP_POPULATE, fd, offset);
+      if (map != MAP_FAILED) { munmap(map, length); bytes+= length; continue; }
+    }
+#ifdef PGFINDLIB_FREEBSD
+    if (posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED) == 0) bytes+= length;
+#else
+    if (readahead(fd, offset, length) == 0) bytes+= length;
+    else if (posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED) == 0) bytes+= length;
+#endif
+  }
+close_and_return:
+  if (phdrs != NULL) free(phdrs);
+  close(fd);
+  return bytes;
+}
+
+static void *pgfindlib_warmup_thread(void *arg)
+{
+  struct pgfindlib_warmup *warmup= (struct pgfindlib_warmup *)arg;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned int i= 0; i < warmup->paths_count; ++i)
+  {
+    long long bytes= pgfindlib_warmup_file(warmup->paths[i], warmup->flags);
+    if (bytes < 0) { ++warmup->result.errors_count; continue; }
+    ++warmup->result.files_count;
+    warmup->result.bytes_prefetched+= bytes;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  warmup->result.microseconds= (end.tv_sec - start.tv_sec) * 1000000LL + (end.tv_nsec - start.tv_nsec) / 1000;
+  return NULL;
+}
+
+/*
+  Start prefetching paths (e.g. the rows that will be dlopen()ed) into the page cache in a background thread.
+  flags is PGFINDLIB_WARMUP_... bits. paths are copied, so the caller's array can go away.
+  Every successful start must be followed by pgfindlib_warmup_wait(), which gives the result.
+*/
+int pgfindlib_warmup_start(const char *const paths[], unsigned int paths_count, unsigned int flags, struct pgfindlib_warmup **warmup)
+{
+  if ((paths == NULL) || (warmup == NULL)) return PGFINDLIB_ERROR_BUFFER_NULL;
+  size_t malloc_length= sizeof(struct pgfindlib_warmup) + paths_count * sizeof(const char *);
+  for (unsigned int i= 0; i < paths_count; ++i) malloc_length+= strlen(paths[i]) + 1;
+  struct pgfindlib_warmup *w= (struct pgfindlib_warmup *)malloc(malloc_length);
+  *warmup= w;
+  if (w == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  memset(&w->result, 0, sizeof(w->result));
+  w->flags= flags;
+  w->paths= (const char **)(w + 1);
+  w->paths_count= paths_count;
+  char *strings= (char *)(w->paths + paths_count);
+  for (unsigned int i= 0; i < paths_count; ++i)
+  {
+    unsigned int length= strlen(paths[i]) + 1;
+    memcpy(strings, paths[i], length);
+    w->paths[i]= strings;
+    strings+= length;
+  }
+  w->is_thread= (pthread_create(&w->thread, NULL, pgfindlib_warmup_thread, w) == 0);
+  if (!w->is_thread) pgfindlib_warmup_thread(w); /* no thread, so at least it's done before the dlopen() */
+  return PGFINDLIB_OK;
+}
+
+/* Wait for the warm-up to finish, copy its result (if result != NULL), and free it. */
+int pgfindlib_warmup_wait(struct pgfindlib_warmup *warmup, struct pgfindlib_warmup_result *result)
+{
+  if (warmup == NULL) return PGFINDLIB_ERROR_BUFFER_NULL;
+  if (warmup->is_thread) pthread_join(warmup->thread, NULL);
+  if (result != NULL) *result= warmup->result;
+  free(warmup);
+  return PGFINDLIB_OK;
+}
+#endif
+
+#if (PGFINDLIB_INCLUDE_ASYNC != 0)
+/* What pgfindlib_async_submit() passes to the background thread. The statement copy is in the same malloc. */
+struct pgfindlib_async
+{
+  pthread_t thread;
+  int is_thread;            /* 0 if pthread_create() failed and the search was done in pgfindlib_async_submit() */
+  int cancelled;            /* set by pgfindlib_async_cancel(), the context points to it */
+  int fd;                   /* the caller's, eventfd or read end of the pipe */
+  int write_fd;             /* the pipe's write end, or -1 if fd is an eventfd */
+  const char *statement;
+  char *buffer;
+  unsigned int buffer_max_length;
+  struct pgfindlib_options options;
+  const struct pgfindlib_options *options_pointer; /* &options, or NULL if pgfindlib_async_submit() had options == NULL */
+  struct pgfindlib_context *context;               /* made by pgfindlib_async_submit() so envp is a snapshot at submit time */
+  int rval;
+};
+
+static void *pgfindlib_async_thread(void *arg)
+{
+  struct pgfindlib_async *async= (struct pgfindlib_async *)arg;
+  struct pgfindlib_prepared *prepared= NULL;
+  int rval= pgfindlib_prepare_in_context(async->statement, async->buffer, async->buffer_max_length, async->options_pointer,
+                                         async->context, &prepared);
+  if (rval == PGFINDLIB_OK) rval= pgfindlib_execute_in_context(prepared, async->buffer, async->buffer_max_length, async->context);
+  pgfindlib_prepared_free(prepared);
+  pgfindlib_context_free(async->context);
+  async->context= NULL;
+  async->rval= rval;
+  /* Same 8 bytes whether it's an eventfd or a pipe, pgfindlib_async_result() doesn't read them */
+  unsigned long long one= 1;
+  int write_fd= (async->write_fd >= 0) ? async->write_fd : async->fd;
+  while ((write(write_fd, &one, sizeof(one)) == -1) && (errno == EINTR)) ;
+  return NULL;
+}
+
+int pgfindlib_async_submit(const char *statement, char *buffer, unsigned int buffer_max_length, const struct pgfindlib_options *options,
+                           struct pgfindlib_async **async, int *fd)
+{
+  if ((async == NULL) || (fd == NULL)) return PGFINDLIB_ERROR_BUFFER_NULL;
+  *async= NULL; *fd= -1;
+  if ((buffer == NULL) || (statement == NULL)) return PGFINDLIB_ERROR_BUFFER_NULL;
+  unsigned int statement_length= strlen(statement) + 1;
+  struct pgfindlib_async *a= (struct pgfindlib_async *)malloc(sizeof(struct pgfindlib_async) + statement_length);
+  if (a == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  memcpy((char *)(a + 1), statement, statement_length);
+  a->statement= (const char *)(a + 1);
+  a->buffer= buffer;
+  a->buffer_max_length= buffer_max_length;
+  a->options_pointer= NULL;
+  if (options != NULL) { a->options= *options; a->options_pointer= &a->options; }
+  a->cancelled= 0;
+  a->rval= PGFINDLIB_OK;
+  int rval= pgfindlib_context_init(&a->context, a->options_pointer);
+  if (rval != PGFINDLIB_OK) { pgfindlib_context_free(a->context); free(a); return rval; }
+  a->context->cancelled= &a->cancelled;
+#if (PGFINDLIB_EVENTFD != 0)
+  a->fd= eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  a->write_fd= -1;
+  if (a->fd == -1) goto fd_error_return;
+#else
+  int pipe_fds[2];
+  if (pipe2(pipe_fds, O_CLOEXEC | O_NONBLOCK) == -1) goto fd_error_return; /* one call, so no fork() sees them without O_CLOEXEC */
+  a->fd= pipe_fds[0];
+  a->write_fd= pipe_fds[1];
+#endif
+  a->is_thread= (pthread_create(&a->thread, NULL, pgfindlib_async_thread, a) == 0);
+  if (!a->is_thread) pgfindlib_async_thread(a); /* no thread, so it's done now and *fd is already readable */
+  *async= a;
+  *fd= a->fd;
+  return PGFINDLIB_OK;
+fd_error_return:
+  {
+    int saved_errno= errno; /* so the caller can tell EMFILE from e.g. ENOMEM */
+    pgfindlib_context_free(a->context);
+    free(a);
+    errno= saved_errno;
+  }
+  return PGFINDLIB_ERROR_FILE_DESCRIPTORS;
+}
+
+/* Wait for the search to finish if it hasn't, close fd, free async, and return what pgfindlib_ex() would have. */
+int pgfindlib_async_result(struct pgfindlib_async *async)
+{
+  if (async == NULL) return PGFINDLIB_ERROR_BUFFER_NULL;
+  if (async->is_thread) pthread_join(async->thread, NULL);
+  int rval= async->rval;
+  close(async->fd);
+  if (async->write_fd >= 0) close(async->write_fd);
+  free(async);
+  return rval;
+}
+
+/* Only asks, so an event loop isn't blocked. *fd becomes readable when the search has stopped, as usual. */
+int pgfindlib_async_cancel(struct pgfindlib_async *async)
+{
+  if (async == NULL) return PGFINDLIB_ERROR_BUFFER_NULL;
+  __atomic_store_n(&async->cancelled, 1, __ATOMIC_RELAXED);
+  return PGFINDLIB_OK;
+}
+#endif
+
+#if (PGFINDLIB_INCLUDE_PROBE_COST != 0)
+/*
+  Probe-cost report, see "Re probe cost" in README.md.
+  The loader tries open() of directory/subdirectory/soname for every directory of DT_RPATH, LD_LIBRARY_PATH and DT_RUNPATH,
+  then looks in ld.so.cache, then in the system directories. The subdirectories are the glibc-hwcaps ones and (before glibc 2.37)
+  every combination of the legacy hwcaps, then the directory itself. When an open() fails and the directory doesn't exist
+  it's marked, and never tried again in the process, so a missing directory costs one miss for the first soname only.
+  Whether directory/soname exists is looked up in what phase 1 read, see pgfindlib_probe_cost_exists(), so the
+  model itself makes system calls only for directories that phase 1 didn't read, e.g. the hwcaps subdirectories.
+*/
+#define PGFINDLIB_PROBE_MAX_NAMES 16
+#define PGFINDLIB_PROBE_MAX_LEGACY_NAMES 8 /* 2**8 combinations */
+#define PGFINDLIB_PROBE_MAX_NAME_LENGTH 64
+
+struct pgfindlib_probe_directory
+{
+  char *path;               /* e.g. /usr/lib/x86_64-linux-gnu/glibc-hwcaps/x86-64-v3 */
+  int status;               /* 0 unknown, 1 exists, 2 doesn't exist so the loader won't try it again */
+  int listing;              /* 0 unknown, 1 phase 1 read it, 2 phase 1 didn't read it, 3 it isn't a directory */
+  int directory_number;     /* if listing is 1: the candidate directory with its names, -1 if none matched WHERE */
+};
+
+/* What the loader would find for one exact WHERE item */
+struct pgfindlib_probe_winner
+{
+  unsigned int where_number;  /* tokener number of the WHERE item */
+  char *path;                 /* malloc'd, NULL if not found */
+  int source_number;          /* tokener number of the source, -1 if not found */
+  int directory_number;       /* which directory of the source's list (blanks don't count), -1 for ld.so.cache or not found */
+  unsigned int misses;
+};
+
+struct pgfindlib_probe_cost
+{
+  char hwcaps[PGFINDLIB_PROBE_MAX_NAMES][PGFINDLIB_PROBE_MAX_NAME_LENGTH]; unsigned int hwcaps_count;
+  char legacy[PGFINDLIB_PROBE_MAX_LEGACY_NAMES][PGFINDLIB_PROBE_MAX_NAME_LENGTH]; unsigned int legacy_count;
+  char system_path[PGFINDLIB_MAX_PATH_LENGTH];    /* colon-separated */
+  char directory[PGFINDLIB_MAX_PATH_LENGTH * 2];
+  char file[PGFINDLIB_MAX_PATH_LENGTH * 3];
+  char soname[PGFINDLIB_MAX_TOKEN_LENGTH + 1];
+  char source_name[PGFINDLIB_MAX_TOKEN_LENGTH + 1];
+  char original[PGFINDLIB_MAX_PATH_LENGTH + 1];
+  struct pgfindlib_probe_directory *directories; unsigned int directories_count; unsigned int directories_max;
+  struct pgfindlib_probe_winner *winners; unsigned int winners_count;
+  const char *malloc_buffer_1;                        /* phase 1's candidates, hashed by (directory number, name) */
+  const struct pgfindlib_candidate *candidates;
+  int *listed_buckets; int *listed_next; unsigned int listed_buckets_count;
+  char *is_directory_listed;                          /* per candidate directory number */
+};
+
+/*
+  Ask the loader (ld.so --help, glibc 2.33 or later) for its system directories and the hwcaps subdirectories it searches.
+  If that doesn't work then the system directories are default_paths and there are no subdirectories.
+*/
+static void pgfindlib_probe_cost_ask_loader(struct pgfindlib_context *context, struct pgfindlib_probe_cost *probe)
+{
+  strcpy(probe->system_path, "/lib:/lib64:/usr/lib:/usr/lib64");
+  extern ElfW(Ehdr) __executable_start;
+  const ElfW(Ehdr) *ehdr= &__executable_start;
+  const char *dynamic_loader_name= NULL;
+  if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) == 0) dynamic_loader_name= pgfindlib_interpreter_name(ehdr);
+  if ((dynamic_loader_name == NULL) || (access(dynamic_loader_name, X_OK) != 0)) return;
+  const char *spawn_argv[3]= { dynamic_loader_name, "--help", NULL };
+  const char *environment_changes[2]= { "LD_LIBRARY_PATH", NULL }; /* else its directories are in the search path it says */
+  pid_t pid;
+  FILE *fp= pgfindlib_spawn(context, spawn_argv, environment_changes, 0, &pid);
+  if (fp == NULL) return;
+  int section= 0; /* 1 search path, 2 glibc-hwcaps, 3 legacy */
+  unsigned int system_path_length= 0;
+  char *system_path= probe->file; /* not needed till probing starts */
+  unsigned int system_path_max_length= PGFINDLIB_MAX_PATH_LENGTH;
+  system_path[0]= '\0';
+  while (fgets(context->spawn_line, sizeof(context->spawn_line), fp) != NULL)
+  {
+    char *line= context->spawn_line;
+    line[strcspn(line, "\n")]= '\0';
+    if (strncmp(line, "Shared library search path:", 27) == 0) { section= 1; continue; }
+    if (strncmp(line, "Subdirectories of glibc-hwcaps directories", 42) == 0) { section= 2; continue; }
+    if (strncmp(line, "Legacy HWCAP subdirectories", 27) == 0) { section= 3; continue; }
+    if (strncmp(line, "  ", 2) != 0) { section= 0; continue; }
+    char *name= line + 2;
+    char *comment= strstr(name, " (");
+    if (comment != NULL) *comment= '\0';
+    unsigned int name_length= strlen(name);
+    if (section == 1)
+    {
+      if ((name[0] != '/') || (system_path_length + name_length + 2 > system_path_max_length)) continue; /* e.g. "(libraries located via /etc/ld.so.cache)" */
+      if (system_path_length > 0) system_path[system_path_length++]= ':';
+      memcpy(system_path + system_path_length, name, name_length + 1);
+      system_path_length+= name_length;
+    }
+    if ((section == 2) || (section == 3))
+    {
+      if ((comment == NULL) || (strstr(comment + 1, "searched") == NULL) || (name_length >= PGFINDLIB_PROBE_MAX_NAME_LENGTH)) continue;
+      if ((section == 2) && (probe->hwcaps_count < PGFINDLIB_PROBE_MAX_NAMES)) strcpy(probe->hwcaps[probe->hwcaps_count++], name);
+      if ((section == 3) && (probe->legacy_count < PGFINDLIB_PROBE_MAX_LEGACY_NAMES)) strcpy(probe->legacy[probe->legacy_count++], name);
+    }
+  }
+  pgfindlib_spawn_close(fp, pid);
+  if (system_path_length > 0) strcpy(probe->system_path, system_path);
+}
+
+/* Return the memo entry for a directory, adding it with status unknown if it's new, or NULL if malloc fails. */
+static struct pgfindlib_probe_directory *pgfindlib_probe_cost_directory(struct pgfindlib_probe_cost *probe, const char *path)
+{
+  for (unsigned int i= 0; i < probe->directories_count; ++i)
+    if (strcmp(probe->directories[i].path, path) == 0) return &probe->directories[i];
+  if (probe->directories_count == probe->directories_max)
+  {
+    unsigned int new_max= (probe->directories_max == 0) ? 64 : probe->directories_max * 2;
+    struct pgfindlib_probe_directory *new_directories;
+    new_directories= (struct pgfindlib_probe_directory *)realloc(probe->directories, new_max * sizeof(struct pgfindlib_probe_directory));
+    if (new_directories == NULL) return NULL;
+    probe->directories= new_directories;
+    probe->directories_max= new_max;
+  }
+  char *path_copy= strdup(path);
+  if (path_copy == NULL) return NULL;
+  struct pgfindlib_probe_directory *directory= &probe->directories[probe->directories_count++];
+  directory->path= path_copy;
+  directory->status= 0;
+  directory->listing= 0;
+  directory->directory_number= -1;
+  return directory;
+}
+
+static unsigned int pgfindlib_probe_cost_listed_hash(unsigned int directory_number, const char *name)
+{
+  unsigned int hash= 2166136261u;
+  hash= (hash ^ directory_number) * 16777619u;
+  for (const char *p= name; *p != '\0'; ++p) hash= (hash ^ (unsigned char) *p) * 16777619u;
+  return hash;
+}
+
+/*
+  Hash the candidates that pgfindlib_directory_scan() found, i.e. not ld.so.cache's or loaded's, which are
+  only what those say. Every exact WHERE item that's in a directory phase 1 read is one of them.
+*/
+static int pgfindlib_probe_cost_listing_init(struct pgfindlib_context *context, struct pgfindlib_probe_cost *probe,
+                                             const struct tokener tokener_list[], const char *malloc_buffer_1,
+                                             const struct pgfindlib_candidate *candidates, unsigned int candidates_count)
+{
+  probe->malloc_buffer_1= malloc_buffer_1;
+  probe->candidates= candidates;
+  probe->listed_buckets_count= 16;
+  while (probe->listed_buckets_count < candidates_count * 2) probe->listed_buckets_count*= 2;
+  probe->listed_buckets= (int *)malloc(probe->listed_buckets_count * sizeof(int));
+  probe->listed_next= (int *)malloc((candidates_count + 1) * sizeof(int));
+  probe->is_directory_listed= (char *)calloc(context->candidate_directories_count + 1, 1);
+  if ((probe->listed_buckets == NULL) || (probe->listed_next == NULL) || (probe->is_directory_listed == NULL))
+    return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  for (unsigned int i= 0; i < probe->listed_buckets_count; ++i) probe->listed_buckets[i]= -1;
+  for (unsigned int i= 0; i < candidates_count; ++i)
+  {
+    int comment_number= tokener_list[candidates[i].source_number].tokener_comment_id;
+    if ((comment_number == PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE) || (comment_number == PGFINDLIB_TOKEN_SOURCE_LOADED)) continue;
+    unsigned int hash= pgfindlib_probe_cost_listed_hash(candidates[i].directory_number, malloc_buffer_1 + candidates[i].name_offset);
+    hash&= probe->listed_buckets_count - 1;
+    probe->listed_next[i]= probe->listed_buckets[hash];
+    probe->listed_buckets[hash]= i;
+    probe->is_directory_listed[candidates[i].directory_number]= 1;
+  }
+  return PGFINDLIB_OK;
+}
+
+/*
+  Set memo->listing, the first time the directory is needed. If phase 1 read a directory with this path and found
+  a WHERE match, its prefix is a candidate directory, and no system call is needed. Else stat() it, once,
+  and if it's a directory that phase 1 read by another path or found nothing in, its (dev, ino) is in context->scanned.
+*/
+static void pgfindlib_probe_cost_listing(const struct pgfindlib_context *context, struct pgfindlib_probe_cost *probe,
+                                         struct pgfindlib_probe_directory *memo)
+{
+  unsigned int path_length= strlen(memo->path);
+  for (unsigned int d= 0; d < context->candidate_directories_count; ++d)
+  {
+    const struct pgfindlib_candidate_directory *directory= &context->candidate_directories[d];
+    if ((probe->is_directory_listed[d] == 0) || (directory->length != path_length + 1)) continue;
+    const char *prefix= probe->malloc_buffer_1 + directory->offset;
+    if ((memcmp(prefix, memo->path, path_length) != 0) || (prefix[path_length] != '/')) continue;
+    memo->listing= 1;
+    memo->directory_number= d;
+    return;
+  }
+  struct stat st;
+  if ((pgfindlib_stat(context->backend, context->sysroot_fd, memo->path, &st, 0) != 0) || (!S_ISDIR(st.st_mode))) { memo->listing= 3; return; }
+  memo->listing= 2;
+  for (unsigned int s= 0; s < context->scanned_count; ++s)
+  {
+    const struct pgfindlib_scanned_directory *scanned= &context->scanned[s];
+    if ((scanned->dev != st.st_dev) || (scanned->ino != st.st_ino)) continue;
+    memo->listing= 1;
+    memo->directory_number= (scanned->count == 0) ? -1 : scanned->directory_number;
+    return;
+  }
+}
+
+/*
+  Return 1 if memo's directory has soname in it, i.e. the loader's open() would work, and put the path in probe->file.
+  Phase 1's listing answers for directories it read, access() only for the others.
+*/
+static int pgfindlib_probe_cost_exists(const struct pgfindlib_context *context, struct pgfindlib_probe_cost *probe,
+                                       struct pgfindlib_probe_directory *memo, const char *soname)
+{
+  snprintf(probe->file, sizeof(probe->file), "%s/%s", memo->path, soname);
+  if (memo->listing == 0) pgfindlib_probe_cost_listing(context, probe, memo);
+  if (memo->listing == 3) return 0;
+  if (memo->listing == 2) return (pgfindlib_access(context->backend, context->sysroot_fd, probe->file, F_OK) == 0) ? 1 : 0;
+  if (memo->directory_number < 0) return 0;
+  unsigned int hash= pgfindlib_probe_cost_listed_hash(memo->directory_number, soname) & (probe->listed_buckets_count - 1);
+  for (int i= probe->listed_buckets[hash]; i != -1; i= probe->listed_next[i])
+  {
+    const struct pgfindlib_candidate *candidate= &probe->candidates[i];
+    if ((candidate->directory_number == (unsigned int) memo->directory_number)
+     && (strcmp(probe->malloc_buffer_1 + candidate->name_offset, soname) == 0))
+      return 1;
+  }
+  return 0;
+}
+
+/* Put directory/subdirectory k in probe->directory: glibc-hwcaps ones first, then legacy combinations (most names first), the last is "" */
+static void pgfindlib_probe_cost_subdirectory(struct pgfindlib_probe_cost *probe, const char *directory, unsigned int k)
+{
+  strcpy(probe->directory, directory);
+  if (k < probe->hwcaps_count)
+  {
+    strcat(probe->directory, "/glibc-hwcaps/");
+    strcat(probe->directory, probe->hwcaps[k]);
+    return;
+  }
+  unsigned int mask= (1U << probe->legacy_count) - 1 - (k - probe->hwcaps_count);
+  for (unsigned int i= 0; i < probe->legacy_count; ++i)
+  {
+    if ((mask & (1U << i)) == 0) continue;
+    strcat(probe->directory, "/");
+    strcat(probe->directory, probe->legacy[i]);
+  }
+}
+
+/*
+  Get directory number n of librarylist (blanks don't count) into context->one_library_or_file with $ORIGIN etc. replaced.
+  If original != NULL it gets the text before replacement. Return PGFINDLIB_OK, or PGFINDLIB_ERROR_NOT_FOUND if there's no such directory.
+*/
+static int pgfindlib_probe_cost_element(struct pgfindlib_context *context, const char *librarylist, unsigned int n,
+                                        const char *lib, const char *platform, const char *origin, char *original)
+{
+  char *one_library_or_file= context->one_library_or_file; /* phase 1 is over so it's free */
+  unsigned int element_number= 0;
+  for (const char *p= librarylist; (p != NULL) && (*p != '\0');)
+  {
+    unsigned int length= strcspn(p, ":;");
+    const char *element= p;
+    p+= length;
+    if (*p != '\0') ++p;
+    if (length == 0) continue; /* the loader would try the current directory, but pgfindlib skips blanks */
+    if (element_number++ != n) continue;
+    if (length > PGFINDLIB_MAX_PATH_LENGTH) return PGFINDLIB_ERROR_MAX_PATH_LENGTH_TOO_SMALL;
+    memcpy(one_library_or_file, element, length);
+    one_library_or_file[length]= '\0';
+    if (original != NULL) strcpy(original, one_library_or_file);
+    unsigned int replacements_count;
+    return pgfindlib_replace_lib_or_platform_or_origin(one_library_or_file, &replacements_count, lib, platform, origin, context);
+  }
+  return PGFINDLIB_ERROR_NOT_FOUND;
+}
+
+/*
+  Probe one directory list for soname as the loader would. Return PGFINDLIB_OK, and set *is_hit and *directory_number
+  if it was found (then probe->file is the path), else add the failed open()s to *misses.
+*/
+static int pgfindlib_probe_cost_list(struct pgfindlib_context *context, struct pgfindlib_probe_cost *probe, const char *librarylist,
+                                     const char *soname, const char *lib, const char *platform, const char *origin,
+                                     unsigned int *misses, int *is_hit, int *directory_number)
+{
+  unsigned int subdirectories_count= probe->hwcaps_count + (1U << probe->legacy_count);
+  for (unsigned int n= 0; ; ++n)
+  {
+    int rval= pgfindlib_probe_cost_element(context, librarylist, n, lib, platform, origin, NULL);
+    if (rval == PGFINDLIB_ERROR_NOT_FOUND) break;
+    if (rval != PGFINDLIB_OK) return rval;
+    for (unsigned int k= 0; k < subdirectories_count; ++k)
+    {
+      pgfindlib_probe_cost_subdirectory(probe, context->one_library_or_file, k);
+      struct pgfindlib_probe_directory *memo= pgfindlib_probe_cost_directory(probe, probe->directory);
+      if (memo == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+      if (memo->status == 2) continue;
+      if (pgfindlib_probe_cost_exists(context, probe, memo, soname)) { *is_hit= 1; *directory_number= n; return PGFINDLIB_OK; }
+      ++*misses;
+      if (memo->status == 0) memo->status= (memo->listing == 3) ? 2 : 1; /* pgfindlib_probe_cost_listing() said */
+    }
+  }
+  return PGFINDLIB_OK;
+}
+
+/*
+  Run the loader model for every exact (non-glob) WHERE item, as if in a new process, filling probe->winners.
+  The directory lists are arguments so that the optimizer can try a proposed LD_LIBRARY_PATH and DT_RUNPATH.
+  ld.so.cache hits are looked up in the phase 1 candidates, so ld.so.cache is free of probes just as for the loader.
+*/
+static int pgfindlib_probe_cost_model(struct pgfindlib_context *context, struct pgfindlib_probe_cost *probe,
+                                      const struct tokener tokener_list[], const char *malloc_buffer_1,
+                                      const struct pgfindlib_candidate *candidates, unsigned int candidates_count,
+                                      const char *lib, const char *platform, const char *origin,
+                                      const char *rpath, const char *ld_library_path, const char *runpath, unsigned int *total_misses)
+{
+  for (unsigned int i= 0; i < probe->directories_count; ++i) probe->directories[i].status= 0;
+  *total_misses= 0;
+  for (unsigned int w= 0; w < probe->winners_count; ++w)
+  {
+    struct pgfindlib_probe_winner *winner= &probe->winners[w];
+    const struct tokener *where_item= &tokener_list[winner->where_number];
+    char *soname= probe->soname;
+    memcpy(soname, where_item->tokener_name, where_item->tokener_length);
+    soname[where_item->tokener_length]= '\0';
+    if (winner->path != NULL) { free(winner->path); winner->path= NULL; }
+    winner->source_number= -1;
+    winner->directory_number= -1;
+    winner->misses= 0;
+    int is_hit= 0;
+    for (unsigned int s= 0; (tokener_list[s].tokener_comment_id != PGFINDLIB_TOKEN_END) && (is_hit == 0); ++s)
+    {
+      int comment_number= tokener_list[s].tokener_comment_id;
+      const char *librarylist= NULL;
+      if (comment_number == PGFINDLIB_TOKEN_SOURCE_DT_RPATH) librarylist= rpath;
+      else if (comment_number == PGFINDLIB_TOKEN_SOURCE_LD_LIBRARY_PATH) librarylist= ld_library_path;
+      else if (comment_number == PGFINDLIB_TOKEN_SOURCE_DT_RUNPATH) librarylist= runpath;
+      else if (comment_number == PGFINDLIB_TOKEN_SOURCE_DEFAULT_PATHS) librarylist= probe->system_path;
+      else if (comment_number == PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE)
+      {
+        for (unsigned int i= 0; i < candidates_count; ++i)
         {
-          const char *pre_ookpik= strstr(buffer_for_ookpik, "PRE_OOKPIK/");
-          if (pre_ookpik == NULL) continue;
-          const char *post_ookpik= strstr(pre_ookpik, "POST_OOKPIK");
-          if (post_ookpik == NULL) continue;
-          pre_ookpik+= strlen("PRE_OOKPIK/");
-          unsigned int len= post_ookpik - (pre_ookpik + 1);
-          if (i == REPLACEE_IS_LIB) { memcpy(lib, pre_ookpik, len); *(lib + len)= '\0'; ++lib_change_count; }
-          else { memcpy(platform, pre_ookpik, len); *(platform + len)= '\0'; ++platform_change_count; }
-          ++change_count;
+          if (tokener_list[candidates[i].source_number].tokener_comment_id != PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE) continue;
+          const char *file_part= malloc_buffer_1 + candidates[i].name_offset;
+          unsigned int length= strcspn(file_part, "\n"); /* ldconfig -p lines still end with \n */
+          if ((length != strlen(soname)) || (memcmp(file_part, soname, length) != 0)) continue;
+          if (pgfindlib_candidate_path(context, malloc_buffer_1, &candidates[i], probe->file, sizeof(probe->file)) != PGFINDLIB_OK) continue;
+          probe->file[strcspn(probe->file, "\n")]= '\0';
+          is_hit= 1;
           break;
         }
-        pclose(fp);
       }
-      /* second attempt */
-      if (change_count == 0)
+      else continue; /* not somewhere the loader searches for a soname */
+      if (librarylist != NULL)
       {
-        sprintf(popen_arg,
-        "env -u LD_DEBUG_OUTPUT LD_LIBRARY_PATH='/PRE_OOKPIK/%s/POST_OOKPIK' LD_DEBUG=libs %s 2>/dev/stdout",
-        replacee, utility_name);
-        fp= popen(popen_arg, "r");
-        if (fp != NULL)
-        {
-          char buffer_for_ookpik[PGFINDLIB_MAX_PATH_LENGTH + 1];
-          while (fgets(buffer_for_ookpik, sizeof(buffer_for_ookpik), fp) != NULL)
-          {
-            const char *pre_ookpik= strstr(buffer_for_ookpik, "PRE_OOKPIK/");
-            if (pre_ookpik == NULL) continue;
-            const char *post_ookpik= strstr(pre_ookpik, "POST_OOKPIK");
-            if (post_ookpik == NULL) continue;
-            pre_ookpik+= strlen("PRE_OOKPIK/");
-            unsigned int len= post_ookpik - (pre_ookpik + 1);
-            if (i == REPLACEE_IS_LIB) { memcpy(lib, pre_ookpik, len); *(lib + len)= '\0'; ++lib_change_count; }
-            else { memcpy(platform, pre_ookpik, len); *(platform + len)= '\0'; ++platform_change_count; }
-            break;
-          }
-          pclose(fp);
-        }
+        int rval= pgfindlib_probe_cost_list(context, probe, librarylist, soname, lib, platform, origin,
+                                            &winner->misses, &is_hit, &winner->directory_number);
+        if (rval != PGFINDLIB_OK) return rval;
+      }
+      if (is_hit)
+      {
+        winner->source_number= s;
+        winner->path= strdup(probe->file);
+        if (winner->path == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
       }
     }
+    *total_misses+= winner->misses;
   }
-#endif /* if (PGFINDLIB_IF_GET_LIB_OR_PLATFORM != 0) */
-  if (lib_change_count == 0)
+  return PGFINDLIB_OK;
+}
+
+/* Add a row with path, source name (from tokener_list[source_number] if it's >= 0), comment, and target */
+static int pgfindlib_probe_cost_row(char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                                    unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count,
+                                    const struct tokener tokener_list[], int source_number, const char *path, const char *comment,
+                                    const char *target, struct pgfindlib_probe_cost *probe)
+{
+  probe->source_name[0]= '\0';
+  if (source_number >= 0)
   {
-    if ((sizeof(void*)) == 8) strcpy(lib, "lib64"); /* default $LIB if pgfindlib__get_lib_or_platform doesn't work */
-    else strcpy(lib, "lib");
-#if (PGFINDLIB_COMMENT_ASSUMING_LIB != 0)
-    char comment[5000];
-    sprintf(comment, "assuming $LIB is %s", lib);
-    rval= pgfindlib_comment_is_row(comment,
-                         PGFINDLIB_COMMENT_ASSUMING_LIB,
-                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+    memcpy(probe->source_name, tokener_list[source_number].tokener_name, tokener_list[source_number].tokener_length);
+    probe->source_name[tokener_list[source_number].tokener_length]= '\0';
+  }
+  const char *columns_list[MAX_COLUMNS_PER_ROW];
+  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
+  columns_list[COLUMN_FOR_PATH]= path;
+  columns_list[COLUMN_FOR_SOURCE]= probe->source_name;
+  columns_list[COLUMN_FOR_COMMENT_1]= comment;
+  columns_list[COLUMN_FOR_TARGET]= target;
+  if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
+  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+}
+
+/*
+  Set *is_contained= 1 if soname is in any subdirectory of directory, i.e. if directory were first the loader would find it there.
+  Return PGFINDLIB_OK or PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW.
+*/
+static int pgfindlib_probe_cost_contains(const struct pgfindlib_context *context, struct pgfindlib_probe_cost *probe, const char *directory,
+                                         const char *soname, int *is_contained)
+{
+  unsigned int subdirectories_count= probe->hwcaps_count + (1U << probe->legacy_count);
+  *is_contained= 0;
+  for (unsigned int k= 0; k < subdirectories_count; ++k)
+  {
+    pgfindlib_probe_cost_subdirectory(probe, directory, k);
+    struct pgfindlib_probe_directory *memo= pgfindlib_probe_cost_directory(probe, probe->directory);
+    if (memo == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+    if (pgfindlib_probe_cost_exists(context, probe, memo, soname)) { *is_contained= 1; break; }
+  }
+  return PGFINDLIB_OK;
+}
+
+/*
+  Propose a shorter librarylist for source number source_number (LD_LIBRARY_PATH or DT_RUNPATH) into *proposal (malloc'd).
+  A directory that isn't any soname's winner is dropped, and (*is_dropped)[its number] is 1; that can't change a winner.
+  The rest are ordered by how many sonames each one wins, most first, which lowers the misses of the sonames found
+  after them, but a directory never goes before the winner of a soname that it also contains, so winners stay the same.
+  Finding the best order with such constraints is hard in general, this greedy one is usually as good.
+  Return PGFINDLIB_ERROR_NOT_FOUND if librarylist has no directories, or if none would be left: an empty list isn't
+  a shorter list, for DT_RUNPATH it would turn off LD_LIBRARY_PATH. Then *proposal and *is_dropped are NULL.
+*/
+static int pgfindlib_probe_cost_propose(struct pgfindlib_context *context, struct pgfindlib_probe_cost *probe,
+                                        int source_number, const char *librarylist,
+                                        const char *lib, const char *platform, const char *origin, char **proposal, char **is_dropped)
+{
+  int rval= PGFINDLIB_OK;
+  unsigned int count= 0;
+  while (pgfindlib_probe_cost_element(context, librarylist, count, lib, platform, origin, NULL) == PGFINDLIB_OK) ++count;
+  *proposal= NULL;
+  *is_dropped= NULL;
+  if (count == 0) return PGFINDLIB_ERROR_NOT_FOUND;
+  *proposal= (char *)malloc(strlen(librarylist) + 1);
+  *is_dropped= (char *)calloc(count + 1, 1);
+  unsigned int *wins= (unsigned int *)calloc(count + 1, sizeof(unsigned int));
+  unsigned int *order= (unsigned int *)malloc((count + 1) * sizeof(unsigned int));
+  char *is_placed= (char *)calloc(count + 1, 1);
+  char *must_follow= (char *)calloc((count + 1) * (count + 1), 1); /* must_follow[a * count + b] means a must be after b */
+  if ((*proposal == NULL) || (*is_dropped == NULL) || (wins == NULL) || (order == NULL) || (is_placed == NULL) || (must_follow == NULL))
+  { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto free_and_return; }
+  (*proposal)[0]= '\0';
+  for (unsigned int w= 0; w < probe->winners_count; ++w)
+  {
+    if ((probe->winners[w].source_number == source_number) && (probe->winners[w].directory_number >= 0))
+      ++wins[probe->winners[w].directory_number];
+  }
+  for (unsigned int a= 0; a < count; ++a)
+  {
+    rval= pgfindlib_probe_cost_element(context, librarylist, a, lib, platform, origin, NULL);
+    if (rval != PGFINDLIB_OK) goto free_and_return;
+    if (wins[a] == 0) { (*is_dropped)[a]= 1; continue; }
+    /* a must follow b if a contains a soname that b wins */
+    for (unsigned int w= 0; w < probe->winners_count; ++w)
+    {
+      const struct pgfindlib_probe_winner *winner= &probe->winners[w];
+      if ((winner->source_number != source_number) || (winner->directory_number < 0) || ((unsigned int) winner->directory_number == a)) continue;
+      const char *soname= pgfindlib_file_part(winner->path);
+      int is_contained;
+      rval= pgfindlib_probe_cost_contains(context, probe, context->one_library_or_file, soname, &is_contained);
+      if (rval != PGFINDLIB_OK) goto free_and_return;
+      if (is_contained) must_follow[a * count + winner->directory_number]= 1;
+    }
+  }
+  unsigned int order_count= 0;
+  for (;;)
+  {
+    int best= -1;
+    for (unsigned int a= 0; a < count; ++a)
+    {
+      if ((wins[a] == 0) || (is_placed[a])) continue;
+      unsigned int b;
+      for (b= 0; b < count; ++b) if ((must_follow[a * count + b]) && (!is_placed[b])) break;
+      if (b < count) continue;
+      if ((best == -1) || (wins[a] > wins[best])) best= a;
+    }
+    if (best == -1) break;
+    is_placed[best]= 1;
+    order[order_count++]= best;
+  }
+  for (unsigned int i= 0; i < order_count; ++i)
+  {
+    rval= pgfindlib_probe_cost_element(context, librarylist, order[i], lib, platform, origin, probe->original);
+    if (rval != PGFINDLIB_OK) goto free_and_return;
+    if (i > 0) strcat(*proposal, ":");
+    strcat(*proposal, probe->original); /* as written, e.g. still with $ORIGIN */
+  }
+  if ((rval == PGFINDLIB_OK) && ((*proposal)[0] == '\0')) rval= PGFINDLIB_ERROR_NOT_FOUND;
+free_and_return:
+  if (rval != PGFINDLIB_OK)
+  {
+    if (*proposal != NULL) { free(*proposal); *proposal= NULL; }
+    if (*is_dropped != NULL) { free(*is_dropped); *is_dropped= NULL; }
+  }
+  if (wins != NULL) free(wins);
+  if (order != NULL) free(order);
+  if (is_placed != NULL) free(is_placed);
+  if (must_follow != NULL) free(must_follow);
+  return rval;
+}
+
+/*
+  PGFINDLIB_OPTION_OPTIMIZE_PATHS: propose LD_LIBRARY_PATH and DT_RUNPATH strings (each is only changed if it's in FROM),
+  then run the model again with them and check that every soname has the same winner as now.
+  If so, rows 019 with the proposals and 020 with the misses before and after, else row 020 says nothing is proposed.
+*/
+static int pgfindlib_probe_cost_optimize(struct pgfindlib_context *context, struct pgfindlib_probe_cost *probe,
+                                         char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                                         unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count,
+                                         const struct tokener tokener_list[], const char *malloc_buffer_1,
+                                         const struct pgfindlib_candidate *candidates, unsigned int candidates_count,
+                                         const char *lib, const char *platform, const char *origin,
+                                         const char *rpath, const char *runpath, unsigned int total_misses)
+{
+  int rval= PGFINDLIB_OK;
+  const char *ld_library_path= pgfindlib_getenv(context, "LD_LIBRARY_PATH");
+  const char *lists[2]= { ld_library_path, runpath };
+  int list_source_numbers[2]= { -1, -1 };
+  char *proposals[2]= { NULL, NULL };
+  char *is_dropped[2]= { NULL, NULL };
+  char **winner_paths= (char **)calloc(probe->winners_count + 1, sizeof(char *));
+  if (winner_paths == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  for (unsigned int w= 0; w < probe->winners_count; ++w)
+  {
+    winner_paths[w]= probe->winners[w].path; /* keep them, the second run of the model replaces them */
+    probe->winners[w].path= NULL;
+  }
+  for (unsigned int s= 0; tokener_list[s].tokener_comment_id != PGFINDLIB_TOKEN_END; ++s)
+  {
+    if ((tokener_list[s].tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_LD_LIBRARY_PATH) && (list_source_numbers[0] == -1)) list_source_numbers[0]= s;
+    if ((tokener_list[s].tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_DT_RUNPATH) && (list_source_numbers[1] == -1)) list_source_numbers[1]= s;
+  }
+  for (int l= 0; l < 2; ++l)
+  {
+    if ((list_source_numbers[l] == -1) || (lists[l] == NULL)) continue;
+    for (unsigned int w= 0; w < probe->winners_count; ++w) probe->winners[w].path= winner_paths[w];
+    rval= pgfindlib_probe_cost_propose(context, probe, list_source_numbers[l], lists[l], lib, platform, origin,
+                                       &proposals[l], &is_dropped[l]);
+    for (unsigned int w= 0; w < probe->winners_count; ++w) probe->winners[w].path= NULL;
+    if (rval == PGFINDLIB_ERROR_NOT_FOUND) { rval= PGFINDLIB_OK; continue; } /* no proposal for this list, it stays as it is */
+    if (rval != PGFINDLIB_OK) goto free_and_return;
+  }
+  unsigned int proposed_total_misses;
+  rval= pgfindlib_probe_cost_model(context, probe, tokener_list, malloc_buffer_1, candidates, candidates_count, lib, platform, origin, rpath,
+                                   (proposals[0] != NULL) ? proposals[0] : ld_library_path,
+                                   (proposals[1] != NULL) ? proposals[1] : runpath, &proposed_total_misses);
+  if (rval != PGFINDLIB_OK) goto free_and_return;
+  int is_same= 1;
+  for (unsigned int w= 0; w < probe->winners_count; ++w)
+  {
+    const char *before= (winner_paths[w] == NULL) ? "" : winner_paths[w];
+    const char *after= (probe->winners[w].path == NULL) ? "" : probe->winners[w].path;
+    if (strcmp(before, after) != 0) is_same= 0;
+  }
+  char *comment= context->comment;
+  if (is_same == 0)
+  {
+    sprintf(comment, "%03d no proposal, a soname would resolve to a different file", PGFINDLIB_COMMENT_PATH_PROPOSAL_MISSES);
+    rval= pgfindlib_probe_cost_row(buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                   tokener_list, -1, "", comment, "", probe);
+    goto free_and_return;
+  }
+  for (int l= 0; l < 2; ++l) /* the proposals are accepted, so now say what they dropped */
+  {
+    if (is_dropped[l] == NULL) continue;
+    for (unsigned int a= 0; pgfindlib_probe_cost_element(context, lists[l], a, lib, platform, origin, probe->original) == PGFINDLIB_OK; ++a)
+    {
+      if (is_dropped[l][a] == 0) continue;
+      sprintf(comment, "%03d directory resolves no soname", PGFINDLIB_COMMENT_PATH_UNUSED);
+      rval= pgfindlib_probe_cost_row(buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                     tokener_list, list_source_numbers[l], probe->original, comment, "", probe);
+      if (rval != PGFINDLIB_OK) goto free_and_return;
+    }
+  }
+  for (int l= 0; l < 2; ++l)
+  {
+    if (proposals[l] == NULL) continue;
+    sprintf(comment, "%03d proposed", PGFINDLIB_COMMENT_PATH_PROPOSAL);
+    rval= pgfindlib_probe_cost_row(buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                   tokener_list, list_source_numbers[l], proposals[l], comment, "", probe);
+    if (rval != PGFINDLIB_OK) goto free_and_return;
+  }
+  sprintf(comment, "%03d probe misses %u would be %u with the same files", PGFINDLIB_COMMENT_PATH_PROPOSAL_MISSES, total_misses, proposed_total_misses);
+  rval= pgfindlib_probe_cost_row(buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                 tokener_list, -1, "", comment, "", probe);
+free_and_return:
+  for (unsigned int w= 0; w < probe->winners_count; ++w) if (winner_paths[w] != NULL) free(winner_paths[w]);
+  free(winner_paths);
+  for (int l= 0; l < 2; ++l) if (proposals[l] != NULL) free(proposals[l]);
+  for (int l= 0; l < 2; ++l) if (is_dropped[l] != NULL) free(is_dropped[l]);
+  return rval;
+}
+
+/*
+  For the link farm: 1 if the file's DT_RUNPATH or DT_RPATH has $ORIGIN or ${ORIGIN}, which the loader would expand to
+  the link farm's directory rather than the library's, else 0, also if the file can't be read or isn't a native ELF.
+  DT_STRTAB is an address, so it's changed to a file offset with the PT_LOAD segment that has it.
+*/
+static int pgfindlib_link_farm_has_origin(const char *path)
+{
+  int is_origin= 0;
+  char *phdrs= NULL;
+  ElfW(Dyn) *dyns= NULL;
+  char *path_list= NULL;
+  int fd= open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return 0;
+  ElfW(Ehdr) elf_header;
+  if ((pread(fd, &elf_header, sizeof(elf_header), 0) != sizeof(elf_header))
+   || (memcmp(elf_header.e_ident, ELFMAG, SELFMAG) != 0)
+   || (elf_header.e_ident[EI_CLASS] != ((sizeof(void *) == 8) ? ELFCLASS64 : ELFCLASS32))
+   || (elf_header.e_phentsize != sizeof(ElfW(Phdr))))
+    goto close_and_return;
+  unsigned int phdrs_size= elf_header.e_phnum * sizeof(ElfW(Phdr));
+  phdrs= (char *)malloc(phdrs_size + 1);
+  if ((phdrs == NULL) || (pread(fd, phdrs, phdrs_size, elf_header.e_phoff) != (ssize_t) phdrs_size)) goto close_and_return;
+  const ElfW(Phdr) *dynamic= NULL;
+  for (unsigned int i= 0; i < elf_header.e_phnum; ++i)
+  {
+    const ElfW(Phdr) *phdr= (const ElfW(Phdr) *)(phdrs + i * sizeof(ElfW(Phdr)));
+    if (phdr->p_type == PT_DYNAMIC) dynamic= phdr;
+  }
+  if ((dynamic == NULL) || (dynamic->p_filesz < sizeof(ElfW(Dyn))) || (dynamic->p_filesz > 1024 * 1024)) goto close_and_return;
+  unsigned int dyns_count= dynamic->p_filesz / sizeof(ElfW(Dyn));
+  dyns= (ElfW(Dyn) *)malloc(dyns_count * sizeof(ElfW(Dyn)));
+  if ((dyns == NULL) || (pread(fd, dyns, dyns_count * sizeof(ElfW(Dyn)), dynamic->p_offset) != (ssize_t) (dyns_count * sizeof(ElfW(Dyn)))))
+    goto close_and_return;
+  ElfW(Addr) strtab= 0;
+  int is_strtab= 0;
+  for (unsigned int d= 0; (d < dyns_count) && (dyns[d].d_tag != DT_NULL); ++d)
+  {
+    if (dyns[d].d_tag == DT_STRTAB) { strtab= dyns[d].d_un.d_ptr; is_strtab= 1; }
+  }
+  if (is_strtab == 0) goto close_and_return;
+  off_t strtab_offset= -1;
+  for (unsigned int i= 0; i < elf_header.e_phnum; ++i)
+  {
+    const ElfW(Phdr) *phdr= (const ElfW(Phdr) *)(phdrs + i * sizeof(ElfW(Phdr)));
+    if ((phdr->p_type == PT_LOAD) && (strtab >= phdr->p_vaddr) && (strtab < phdr->p_vaddr + phdr->p_filesz))
+      strtab_offset= phdr->p_offset + (strtab - phdr->p_vaddr);
+  }
+  if (strtab_offset == -1) goto close_and_return;
+  path_list= (char *)malloc(PGFINDLIB_MAX_PATH_LENGTH + 1); /* not on the stack, see "Re threads" */
+  if (path_list == NULL) goto close_and_return;
+  for (unsigned int d= 0; (d < dyns_count) && (dyns[d].d_tag != DT_NULL) && (is_origin == 0); ++d)
+  {
+    if ((dyns[d].d_tag != DT_RUNPATH) && (dyns[d].d_tag != DT_RPATH)) continue;
+    ssize_t read_size= pread(fd, path_list, PGFINDLIB_MAX_PATH_LENGTH, strtab_offset + dyns[d].d_un.d_val);
+    if (read_size <= 0) continue;
+    path_list[read_size]= '\0'; /* a longer list is cut, $ORIGIN is usually first */
+    if ((strstr(path_list, "$ORIGIN") != NULL) || (strstr(path_list, "${ORIGIN}") != NULL)) is_origin= 1;
+  }
+close_and_return:
+  if (path_list != NULL) free(path_list);
+  if (dyns != NULL) free(dyns);
+  if (phdrs != NULL) free(phdrs);
+  close(fd);
+  return is_origin;
+}
+
+/* Process-wide, so two threads making the same link farm don't make the same temporary name */
+static unsigned int pgfindlib_link_farm_counter= 0;
+
+/*
+  options->link_farm: make the directory if it isn't there, and in it for each exact WHERE item that the model found
+  a symlink named the soname to the path the loader would open, with a row 030 for each. A symlink that's there already
+  with the same name is replaced (a new one is renamed over it, so a program starting meanwhile sees one or the other),
+  anything else in the directory is left alone, and a file or directory with the soname's name is an error.
+  A library whose DT_RUNPATH or DT_RPATH has $ORIGIN isn't linked, $ORIGIN would be the link farm, so it gets a row 032
+  instead and a symlink that an earlier call left for its soname is removed. The temporary name has the pid and a counter.
+  Then the model is run again as if the link farm were LD_LIBRARY_PATH, and again as if it were DT_RUNPATH and
+  LD_LIBRARY_PATH were unset, if they're in FROM, and each that finds every soname at the same file (st_dev, st_ino) as now gets a row 019,
+  and a row 020 with the probe misses before and after, else a row 020 that there's no proposal.
+  The links are made with this process's file system calls, so not with options->sysroot or another backend.
+  Return PGFINDLIB_ERROR_LINK_FARM if the directory or a link can't be made. probe->winners are as they were, after.
+*/
+static int pgfindlib_probe_cost_link_farm(struct pgfindlib_context *context, struct pgfindlib_probe_cost *probe,
+                                          char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                                          unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count,
+                                          const struct tokener tokener_list[], const char *malloc_buffer_1,
+                                          const struct pgfindlib_candidate *candidates, unsigned int candidates_count,
+                                          const char *lib, const char *platform, const char *origin,
+                                          const char *rpath, const char *runpath, unsigned int total_misses)
+{
+  int rval= PGFINDLIB_OK;
+  const char *link_farm= context->link_farm;
+  unsigned int link_farm_length= strlen(link_farm);
+  if ((context->sysroot_fd >= 0) || (context->backend != &pgfindlib_backend_posix)) return PGFINDLIB_ERROR_LINK_FARM;
+  if ((link_farm_length == 0) || (link_farm_length >= PGFINDLIB_MAX_PATH_LENGTH)) return PGFINDLIB_ERROR_LINK_FARM;
+  if ((mkdir(link_farm, 0755) != 0) && (errno != EEXIST)) return PGFINDLIB_ERROR_LINK_FARM;
+  char *temporary= (char *)malloc(link_farm_length + PGFINDLIB_MAX_TOKEN_LENGTH + 64);
+  struct pgfindlib_probe_winner *winners= (struct pgfindlib_probe_winner *)malloc((probe->winners_count + 1) * sizeof(struct pgfindlib_probe_winner));
+  if ((temporary == NULL) || (winners == NULL))
+  {
+    if (temporary != NULL) free(temporary);
+    if (winners != NULL) free(winners);
+    return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  }
+  memcpy(winners, probe->winners, probe->winners_count * sizeof(struct pgfindlib_probe_winner));
+  for (unsigned int w= 0; w < probe->winners_count; ++w) probe->winners[w].path= NULL; /* the model's runs mustn't free them */
+  char *comment= context->comment;
+  for (unsigned int w= 0; w < probe->winners_count; ++w)
+  {
+    const struct pgfindlib_probe_winner *winner= &winners[w];
+    if (winner->path == NULL) continue;
+    const struct tokener *where_item= &tokener_list[winner->where_number];
+    memcpy(probe->soname, where_item->tokener_name, where_item->tokener_length);
+    probe->soname[where_item->tokener_length]= '\0';
+    char *target= probe->directory; /* absolute, the loader would have opened a relative path from the current directory */
+    target[0]= '\0';
+    if ((winner->path[0] != '/') && ((getcwd(target, PGFINDLIB_MAX_PATH_LENGTH) == NULL) || (strlen(winner->path) >= PGFINDLIB_MAX_PATH_LENGTH)))
+    { rval= PGFINDLIB_ERROR_MAX_PATH_LENGTH_TOO_SMALL; goto free_and_return; }
+    if (winner->path[0] != '/') strcat(target, "/");
+    strcat(target, winner->path);
+    sprintf(probe->file, "%s/%s", link_farm, probe->soname);
+    sprintf(temporary, "%s/.%s.%ld.%u", link_farm, probe->soname, (long) getpid(),
+            __atomic_add_fetch(&pgfindlib_link_farm_counter, 1, __ATOMIC_RELAXED));
+    struct stat sb;
+    int is_lstat_ok= (lstat(probe->file, &sb) == 0);
+    if ((is_lstat_ok != 0) && (!S_ISLNK(sb.st_mode))) { rval= PGFINDLIB_ERROR_LINK_FARM; goto free_and_return; }
+    if (pgfindlib_link_farm_has_origin(target) != 0)
+    {
+      if ((is_lstat_ok != 0) && (unlink(probe->file) != 0) && (errno != ENOENT)) { rval= PGFINDLIB_ERROR_LINK_FARM; goto free_and_return; }
+      sprintf(comment, "%03d not linked, its DT_RUNPATH or DT_RPATH has $ORIGIN", PGFINDLIB_COMMENT_LINK_FARM_ORIGIN);
+      rval= pgfindlib_probe_cost_row(buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                     tokener_list, winner->source_number, target, comment, "", probe);
+      if (rval != PGFINDLIB_OK) goto free_and_return;
+      continue;
+    }
+    unlink(temporary);
+    if ((symlink(target, temporary) != 0) || (rename(temporary, probe->file) != 0))
+    {
+      unlink(temporary);
+      rval= PGFINDLIB_ERROR_LINK_FARM;
+      goto free_and_return;
+    }
+    sprintf(comment, "%03d link farm", PGFINDLIB_COMMENT_LINK_FARM);
+    rval= pgfindlib_probe_cost_row(buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                   tokener_list, winner->source_number, probe->file, comment, target, probe);
+    if (rval != PGFINDLIB_OK) goto free_and_return;
+  }
+  for (int l= 0; l < 2; ++l)
+  {
+    unsigned short int list_comment_id= (l == 0) ? PGFINDLIB_TOKEN_SOURCE_LD_LIBRARY_PATH : PGFINDLIB_TOKEN_SOURCE_DT_RUNPATH;
+    int list_source_number= -1;
+    for (unsigned int s= 0; (tokener_list[s].tokener_comment_id != PGFINDLIB_TOKEN_END) && (list_source_number == -1); ++s)
+    {
+      if (tokener_list[s].tokener_comment_id == list_comment_id) list_source_number= s;
+    }
+    if (list_source_number == -1) continue;
+    unsigned int link_farm_misses;
+    rval= pgfindlib_probe_cost_model(context, probe, tokener_list, malloc_buffer_1, candidates, candidates_count, lib, platform, origin, rpath,
+                                     (l == 0) ? link_farm : NULL, (l == 1) ? link_farm : runpath, &link_farm_misses);
+    if (rval != PGFINDLIB_OK) goto free_and_return;
+    int is_same= 1;
+    for (unsigned int w= 0; w < probe->winners_count; ++w)
+    {
+      const char *before= winners[w].path;
+      const char *after= probe->winners[w].path;
+      struct stat before_sb, after_sb;
+      if ((before == NULL) && (after == NULL)) continue;
+      if ((before == NULL) || (after == NULL)
+       || (stat(before, &before_sb) != 0) || (stat(after, &after_sb) != 0)
+       || (before_sb.st_dev != after_sb.st_dev) || (before_sb.st_ino != after_sb.st_ino)) is_same= 0;
+    }
+    for (unsigned int w= 0; w < probe->winners_count; ++w)
+    {
+      if (probe->winners[w].path != NULL) { free(probe->winners[w].path); probe->winners[w].path= NULL; }
+    }
+    if (is_same != 0)
+    {
+      sprintf(comment, "%03d proposed", PGFINDLIB_COMMENT_PATH_PROPOSAL);
+      rval= pgfindlib_probe_cost_row(buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                     tokener_list, list_source_number, link_farm, comment, "", probe);
+      if (rval != PGFINDLIB_OK) goto free_and_return;
+      sprintf(comment, "%03d probe misses %u would be %u with the same files", PGFINDLIB_COMMENT_PATH_PROPOSAL_MISSES, total_misses, link_farm_misses);
+    }
+    else sprintf(comment, "%03d no proposal, a soname would resolve to a different file", PGFINDLIB_COMMENT_PATH_PROPOSAL_MISSES);
+    rval= pgfindlib_probe_cost_row(buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                   tokener_list, list_source_number, "", comment, "", probe);
+    if (rval != PGFINDLIB_OK) goto free_and_return;
+  }
+free_and_return:
+  for (unsigned int w= 0; w < probe->winners_count; ++w) if (probe->winners[w].path != NULL) free(probe->winners[w].path);
+  memcpy(probe->winners, winners, probe->winners_count * sizeof(struct pgfindlib_probe_winner));
+  free(winners);
+  free(temporary);
+  return rval;
+}
+
+/*
+  PGFINDLIB_OPTION_PROBE_COST: one row per exact (non-glob) WHERE item with the path the loader would open, the source,
+  and how many open()s fail before it, following the loader's order among the FROM sources
+  DT_RPATH LD_LIBRARY_PATH DT_RUNPATH ld.so.cache default_paths. Then one row with the total, the number to reduce when tuning paths.
+  PGFINDLIB_OPTION_OPTIMIZE_PATHS: the same model, then pgfindlib_probe_cost_optimize().
+  options->link_farm: the same model, then pgfindlib_probe_cost_link_farm(), before the optimizer.
+*/
+static int pgfindlib_probe_cost(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                                unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count,
+                                const struct tokener tokener_list[], const char *malloc_buffer_1,
+                                const struct pgfindlib_candidate *candidates, unsigned int candidates_count,
+                                const char *lib, const char *platform, const char *origin, const char *rpath, const char *runpath)
+{
+  int rval= PGFINDLIB_OK;
+  struct pgfindlib_probe_cost *probe= (struct pgfindlib_probe_cost *)malloc(sizeof(struct pgfindlib_probe_cost));
+  if (probe == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  probe->hwcaps_count= 0;
+  probe->legacy_count= 0;
+  probe->directories= NULL; probe->directories_count= 0; probe->directories_max= 0;
+  probe->winners_count= 0;
+  probe->listed_buckets= NULL; probe->listed_next= NULL; probe->is_directory_listed= NULL;
+  unsigned int where_count= 0;
+  for (unsigned int w= 0; tokener_list[w].tokener_comment_id != PGFINDLIB_TOKEN_END; ++w) ++where_count;
+  probe->winners= (struct pgfindlib_probe_winner *)malloc((where_count + 1) * sizeof(struct pgfindlib_probe_winner));
+  if (probe->winners == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto free_and_return; }
+  for (unsigned int w= 0; tokener_list[w].tokener_comment_id != PGFINDLIB_TOKEN_END; ++w)
+  {
+    if (tokener_list[w].tokener_comment_id != PGFINDLIB_TOKEN_FILE) continue;
+    memcpy(probe->soname, tokener_list[w].tokener_name, tokener_list[w].tokener_length);
+    probe->soname[tokener_list[w].tokener_length]= '\0';
+    if (strpbrk(probe->soname, "*?[{\\/'\"") != NULL) continue; /* a glob isn't a name the loader would look for */
+    probe->winners[probe->winners_count].where_number= w;
+    probe->winners[probe->winners_count].path= NULL;
+    ++probe->winners_count;
+  }
+  pgfindlib_probe_cost_ask_loader(context, probe);
+  rval= pgfindlib_probe_cost_listing_init(context, probe, tokener_list, malloc_buffer_1, candidates, candidates_count);
+  if (rval != PGFINDLIB_OK) goto free_and_return;
+  unsigned int total_misses;
+  rval= pgfindlib_probe_cost_model(context, probe, tokener_list, malloc_buffer_1, candidates, candidates_count, lib, platform, origin,
+                                   rpath, pgfindlib_getenv(context, "LD_LIBRARY_PATH"), runpath, &total_misses);
+  if (rval != PGFINDLIB_OK) goto free_and_return;
+  if ((context->option_flags & PGFINDLIB_OPTION_PROBE_COST) != 0)
+  {
+    for (unsigned int w= 0; w < probe->winners_count; ++w)
+    {
+      const struct pgfindlib_probe_winner *winner= &probe->winners[w];
+      const struct tokener *where_item= &tokener_list[winner->where_number];
+      memcpy(probe->soname, where_item->tokener_name, where_item->tokener_length);
+      probe->soname[where_item->tokener_length]= '\0';
+      char *comment= context->comment;
+      sprintf(comment, "%03d %s probe misses %u%s", PGFINDLIB_COMMENT_PROBE_MISSES, probe->soname, winner->misses,
+              (winner->path != NULL) ? "" : " not found");
+      rval= pgfindlib_probe_cost_row(buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                     tokener_list, winner->source_number, (winner->path != NULL) ? winner->path : "", comment, "", probe);
+      if (rval != PGFINDLIB_OK) goto free_and_return;
+    }
+    char comment[64];
+    sprintf(comment, "probe misses total %u", total_misses);
+    rval= pgfindlib_comment_is_row(comment, PGFINDLIB_COMMENT_PROBE_MISSES_TOTAL,
+                                   buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+    if (rval != PGFINDLIB_OK) goto free_and_return;
+  }
+  if (context->link_farm != NULL)
+  {
+    rval= pgfindlib_probe_cost_link_farm(context, probe, buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                         tokener_list, malloc_buffer_1, candidates, candidates_count, lib, platform, origin, rpath, runpath, total_misses);
+    if (rval != PGFINDLIB_OK) goto free_and_return;
+  }
+  if ((context->option_flags & PGFINDLIB_OPTION_OPTIMIZE_PATHS) != 0)
+  {
+    rval= pgfindlib_probe_cost_optimize(context, probe, buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count,
+                                        tokener_list, malloc_buffer_1, candidates, candidates_count, lib, platform, origin, rpath, runpath, total_misses);
+  }
+free_and_return:
+  for (unsigned int w= 0; w < probe->winners_count; ++w) if (probe->winners[w].path != NULL) free(probe->winners[w].path);
+  if (probe->winners != NULL) free(probe->winners);
+  for (unsigned int i= 0; i < probe->directories_count; ++i) free(probe->directories[i].path);
+  if (probe->directories != NULL) free(probe->directories);
+  if (probe->listed_buckets != NULL) free(probe->listed_buckets);
+  if (probe->listed_next != NULL) free(probe->listed_next);
+  if (probe->is_directory_listed != NULL) free(probe->is_directory_listed);
+  free(probe);
+  return rval;
+}
+#endif
+
+/*
+  Add the files in directory whose names match WHERE to the malloc buffers, for pgfindlib_source_scan().
+  Names are matched first, so nothing else is done for the usual majority that don't match.
+  A matching entry is a candidate if it's a regular file or symbolic link. d_type usually says which,
+  but some XFS, NFS and FUSE mounts say DT_UNKNOWN, and then (only then) there's an fstatat(), for the type.
+  The candidate keeps d_ino (never st_ino) and d_type so pgfindlib_file() can sometimes skip lstat().
+  The directory name and "/" are a candidate directory prefix, added once, at the first match.
+  The backend reads the directory, with getdents64 if it's pgfindlib_backend_posix on Linux.
+  A directory that can't be opened is skipped, as the loader would.
+  Each physical directory is read once per call: if stat() says it's the same (st_dev, st_ino) as one that was
+  already read, e.g. /usr/lib/x86_64-linux-gnu via LD_LIBRARY_PATH and via default_paths, or /lib and /usr/lib
+  with merged /usr, then that one's candidates are copied for this source, with the directory name as this source has it,
+  and with the same names in malloc_buffer_1.
+*/
+int pgfindlib_directory_scan(const char *directory, unsigned int tokener_number, struct pgfindlib_where_matcher *matcher,
+                             char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                             struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
+                             struct pgfindlib_context *context)
+{
+  int rval= PGFINDLIB_OK;
+  char *combo= context->combo;
+  struct stat directory_sb;
+  if (pgfindlib_is_cancelled(context)) return PGFINDLIB_ERROR_CANCELLED;
+#if (PGFINDLIB_INCLUDE_DEADLINE != 0)
+  if ((context->deadline_ns != 0) || (context->directory_budget_ns != 0))
+  {
+    int is_done;
+    rval= pgfindlib_directory_scan_guarded(directory, tokener_number, matcher,
+                                           malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                           malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length, context, &is_done);
+    if ((rval != PGFINDLIB_OK) || (is_done != 0)) return rval;
+  }
+#endif
+  if ((pgfindlib_stat(context->backend, context->sysroot_fd, directory, &directory_sb, 0) != 0) || (!S_ISDIR(directory_sb.st_mode))) return PGFINDLIB_OK;
+  for (unsigned int s= 0; s < context->scanned_count; ++s)
+  {
+    const struct pgfindlib_scanned_directory scanned= context->scanned[s]; /* a copy, context->scanned isn't changed here though */
+    if ((scanned.dev != directory_sb.st_dev) || (scanned.ino != directory_sb.st_ino)) continue;
+    if (scanned.count == 0) return PGFINDLIB_OK;
+    unsigned int directory_number;
+    strcpy(combo, directory);
+    strcat(combo, "/");
+    rval= pgfindlib_candidate_directory(context, combo, strlen(combo),
+                                        malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length, &directory_number);
     if (rval != PGFINDLIB_OK) return rval;
+    for (unsigned int i= scanned.first; i < scanned.first + scanned.count; ++i)
+    {
+      if (*malloc_buffer_2_length + 1 >= malloc_buffer_2_max_length) return PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW;
+      struct pgfindlib_candidate *candidate= &malloc_buffer_2[*malloc_buffer_2_length];
+      *candidate= malloc_buffer_2[i];
+      candidate->source_number= tokener_number;
+      candidate->directory_number= directory_number;
+      *malloc_buffer_2_length+= 1;
+    }
+    return PGFINDLIB_OK;
+  }
+  if (context->scanned_count == context->scanned_max)
+  {
+    unsigned int new_max= context->scanned_max * 2 + 16;
+    struct pgfindlib_scanned_directory *new_scanned;
+    new_scanned= (struct pgfindlib_scanned_directory *)realloc(context->scanned, new_max * sizeof(struct pgfindlib_scanned_directory));
+    if (new_scanned == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+    context->scanned= new_scanned;
+    context->scanned_max= new_max;
+  }
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+  if (context->snapshot != NULL)
+  {
+    int is_reused;
+    rval= pgfindlib_snapshot_directory_scan(directory, &directory_sb, tokener_number,
+                                            malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                            malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length, context, &is_reused);
+    if ((rval != PGFINDLIB_OK) || (is_reused != 0)) return rval;
+  }
+#endif
+  unsigned int first= *malloc_buffer_2_length;
+  const struct pgfindlib_backend *backend= context->backend;
+  int fd= pgfindlib_open(backend, context->sysroot_fd, directory, O_RDONLY | O_DIRECTORY);
+  if (fd == -1) return PGFINDLIB_OK; /* perhaps would be -1 if directory not found */
+  void *dir= backend->opendir(backend->state, fd);
+  if (dir == NULL) return PGFINDLIB_OK;
+  const struct pgfindlib_backend_entry *entry;
+  unsigned int directory_number= 0;
+  int is_directory_added= 0;
+  for (unsigned int entries_count= 1; (entry= backend->readdir(backend->state, dir)) != NULL; ++entries_count)
+  {
+    if (((entries_count % 1024) == 0) && (pgfindlib_is_cancelled(context))) { rval= PGFINDLIB_ERROR_CANCELLED; break; }
+    const char *d_name= entry->d_name;
+    unsigned char d_type= entry->d_type;
+    ino_t d_ino= entry->d_ino;
+    if (pgfindlib_find_line_in_statement(matcher, d_name) == 0) continue; /* doesn't match requirement */
+    if (d_type == DT_UNKNOWN)
+    {
+      struct stat sb;
+      if (backend->fstatat(backend->state, fd, d_name, &sb) == -1) continue;
+      if (S_ISREG(sb.st_mode)) d_type= DT_REG;
+      else if (S_ISLNK(sb.st_mode)) d_type= DT_LNK;
+    }
+    if ((d_type != DT_REG) && (d_type != DT_LNK)) continue; /* not regular file or symbolic link */
+    if (is_directory_added == 0)
+    {
+      strcpy(combo, directory);
+      strcat(combo, "/");
+      rval= pgfindlib_candidate_directory(context, combo, strlen(combo),
+                                          malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length, &directory_number);
+      if (rval != PGFINDLIB_OK) break;
+      is_directory_added= 1;
+    }
+    rval= pgfindlib_add_candidate(directory_number, d_name, tokener_number, d_ino, d_type,
+                                  malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                  malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
+    if (rval != PGFINDLIB_OK) break;
+  }
+  backend->closedir(backend->state, dir);
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+  if ((rval == PGFINDLIB_OK) && (is_directory_added == 0) && (context->snapshot != NULL))
+  {
+    /* So the snapshot says the directory had no candidates, and next time it isn't read either */
+    strcpy(combo, directory);
+    strcat(combo, "/");
+    rval= pgfindlib_candidate_directory(context, combo, strlen(combo),
+                                        malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length, &directory_number);
+    is_directory_added= 1;
+  }
 #endif
+  if (rval == PGFINDLIB_OK)
+  {
+    struct pgfindlib_scanned_directory *scanned= &context->scanned[context->scanned_count];
+    scanned->dev= directory_sb.st_dev;
+    scanned->ino= directory_sb.st_ino;
+    scanned->first= first;
+    scanned->count= *malloc_buffer_2_length - first;
+    scanned->directory_number= (is_directory_added != 0) ? (int) directory_number : -1;
+    scanned->mtime_sec= (long long) directory_sb.st_mtim.tv_sec;
+    scanned->mtime_nsec= (long long) directory_sb.st_mtim.tv_nsec;
+    ++context->scanned_count;
+  }
+  return rval;
+}
+
+#if (PGFINDLIB_INCLUDE_SNAPSHOT != 0)
+static unsigned long long pgfindlib_snapshot_hash(unsigned long long hash, const void *bytes, size_t length)
+{
+  for (size_t i= 0; i < length; ++i) hash= (hash ^ ((const unsigned char *) bytes)[i]) * 1099511628211ULL;
+  return hash;
+}
+
+static unsigned int pgfindlib_snapshot_bucket(const struct pgfindlib_snapshot *snapshot, const char *string)
+{
+  return (unsigned int) (pgfindlib_snapshot_hash(14695981039346656037ULL, string, strlen(string)) % snapshot->buckets_count);
+}
+
+/* 0 if string has a tab or a newline, which would break the snapshot's lines */
+static int pgfindlib_snapshot_is_writable(const char *string)
+{
+  return (strpbrk(string, "\t\n") == NULL) ? 1 : 0;
+}
+
+/*
+  Everything that decides which files are candidates and what's known about them, apart from the file system:
+  the version, the statement's sources and WHERE items, the flags, the sysroot, the link farm, and this program's architecture.
+  A snapshot with a different key is ignored.
+*/
+static unsigned long long pgfindlib_snapshot_key(const struct pgfindlib_context *context, const struct pgfindlib_prepared *prepared)
+{
+  unsigned long long key= 14695981039346656037ULL;
+  int numbers[5]= { PGFINDLIB_VERSION_MAJOR, PGFINDLIB_VERSION_MINOR, PGFINDLIB_VERSION_PATCH,
+                    (int) (context->option_flags & ~PGFINDLIB_OPTION_DELTA), prepared->program_e_machine };
+  key= pgfindlib_snapshot_hash(key, numbers, sizeof(numbers));
+  if (context->sysroot != NULL) key= pgfindlib_snapshot_hash(key, context->sysroot, strlen(context->sysroot) + 1);
+  if (context->link_farm != NULL) key= pgfindlib_snapshot_hash(key, context->link_farm, strlen(context->link_farm) + 1);
+  for (unsigned int i= 0; i < context->architectures_count; ++i)
+  {
+    unsigned int architecture[2]= { context->architectures[i].elf_class, context->architectures[i].e_machine };
+    key= pgfindlib_snapshot_hash(key, architecture, sizeof(architecture));
+  }
+  for (unsigned int t= 0; prepared->tokener_list[t].tokener_comment_id != PGFINDLIB_TOKEN_END; ++t)
+  {
+    key= pgfindlib_snapshot_hash(key, &prepared->tokener_list[t].tokener_comment_id, 1);
+    key= pgfindlib_snapshot_hash(key, prepared->tokener_list[t].tokener_name, prepared->tokener_list[t].tokener_length + 1);
+  }
+  return key;
+}
+
+/* Split line at tabs into at most fields_max fields, return how many */
+static unsigned int pgfindlib_snapshot_fields(char *line, char *fields[], unsigned int fields_max)
+{
+  unsigned int fields_count= 0;
+  for (char *p= line; fields_count < fields_max; )
+  {
+    fields[fields_count++]= p;
+    p= strchr(p, '\t');
+    if (p == NULL) break;
+    *p++= '\0';
+  }
+  return fields_count;
+}
+
+/*
+  Whether a directory (or /etc/ld.so.cache) is as the last snapshot saw it. Not if its mtime isn't strictly older than
+  when that snapshot's call started, because a change in the same clock tick as that call's stat() would leave the
+  mtime as it was, so such a directory is treated as changed, as git treats a "racily clean" index entry.
+*/
+static int pgfindlib_snapshot_is_same(const struct pgfindlib_snapshot *snapshot,
+                                      const struct pgfindlib_snapshot_directory *old, const struct pgfindlib_snapshot_prefix *now)
+{
+  if ((old->mtime_sec > snapshot->written_sec)
+   || ((old->mtime_sec == snapshot->written_sec) && (old->mtime_nsec >= snapshot->written_nsec))) return 0;
+  return ((old->dev == now->dev) && (old->ino == now->ino)
+       && (old->mtime_sec == now->mtime_sec) && (old->mtime_nsec == now->mtime_nsec)) ? 1 : 0;
+}
+
+static void pgfindlib_snapshot_prefix_from_stat(struct pgfindlib_snapshot_prefix *prefix, const struct stat *sb)
+{
+  prefix->dev= sb->st_dev;
+  prefix->ino= sb->st_ino;
+  prefix->mtime_sec= (long long) sb->st_mtim.tv_sec;
+  prefix->mtime_nsec= (long long) sb->st_mtim.tv_nsec;
+}
+
+static const struct pgfindlib_snapshot_directory *pgfindlib_snapshot_find_directory(const struct pgfindlib_snapshot *snapshot, const char *prefix)
+{
+  if (snapshot->directories_count == 0) return NULL;
+  for (int d= snapshot->directory_buckets[pgfindlib_snapshot_bucket(snapshot, prefix)]; d != -1; d= snapshot->directories[d].next_in_bucket)
+  {
+    if (strcmp(snapshot->directories[d].prefix, prefix) == 0) return &snapshot->directories[d];
+  }
+  return NULL;
+}
+
+/*
+  Read the last snapshot. If there's none, or it's not the same key, or a line is wrong, it's as if there was none,
+  so the only error is malloc() failing. The snapshot file is the caller's, so it's not read through the backend.
+*/
+static int pgfindlib_snapshot_read(struct pgfindlib_snapshot *snapshot, unsigned long long key)
+{
+  FILE *fp= fopen(snapshot->path, "r");
+  if (fp == NULL) return PGFINDLIB_OK;
+  struct stat sb;
+  if ((fstat(fileno(fp), &sb) != 0) || (sb.st_size <= 0) || ((unsigned long long) sb.st_size > 0x7fffffffULL)) { fclose(fp); return PGFINDLIB_OK; }
+  size_t text_size= (size_t) sb.st_size;
+  snapshot->text= (char *)malloc(text_size + 1);
+  if (snapshot->text == NULL) { fclose(fp); return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; }
+  size_t read_size= fread(snapshot->text, 1, text_size, fp);
+  fclose(fp);
+  char *text= snapshot->text;
+  text[read_size]= '\0';
+  char header[64];
+  sprintf(header, "pgfindlib snapshot 1\t%016llx\n", key);
+  if (strncmp(text, header, strlen(header)) != 0) return PGFINDLIB_OK;
+  /* Count the records, then fill them */
+  unsigned int counts[128];
+  memset(counts, 0, sizeof(counts));
+  for (char *line= text; *line != '\0'; )
+  {
+    ++counts[(unsigned char) *line & 0x7f];
+    char *end= strchr(line, '\n');
+    if (end == NULL) return PGFINDLIB_OK; /* not written to the end */
+    line= end + 1;
   }
-
-  if (platform_change_count == 0)
+  snapshot->buckets_count= counts['d'] + counts['f'] + 64;
+  snapshot->directories= (struct pgfindlib_snapshot_directory *)malloc((counts['d'] + 1) * sizeof(struct pgfindlib_snapshot_directory));
+  snapshot->entries= (struct pgfindlib_snapshot_entry *)malloc((counts['e'] + counts['l'] + 1) * sizeof(struct pgfindlib_snapshot_entry));
+  snapshot->files= (struct pgfindlib_snapshot_file *)malloc((counts['f'] + 1) * sizeof(struct pgfindlib_snapshot_file));
+  snapshot->rows= (char **)malloc((counts['r'] + 1) * sizeof(char *));
+  snapshot->directory_buckets= (int *)malloc(snapshot->buckets_count * sizeof(int));
+  snapshot->file_buckets= (int *)malloc(snapshot->buckets_count * sizeof(int));
+  if ((snapshot->directories == NULL) || (snapshot->entries == NULL) || (snapshot->files == NULL) || (snapshot->rows == NULL)
+   || (snapshot->directory_buckets == NULL) || (snapshot->file_buckets == NULL)) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  for (unsigned int b= 0; b < snapshot->buckets_count; ++b) { snapshot->directory_buckets[b]= -1; snapshot->file_buckets[b]= -1; }
+  struct pgfindlib_snapshot_directory *listed= NULL; /* the "d" or "c" that "e" or "l" lines belong to */
+  char *line= strchr(text, '\n') + 1;
+  while (*line != '\0')
   {
-    char buffer_for_replacement[PGFINDLIB_MAX_PATH_LENGTH + 1]= "?";
-    FILE *fp= popen("LD_LIBRARY_PATH= LD_DEBUG= LD_PRELOAD= uname -m 2>/dev/null", "r");
-    if (fp != NULL)
+    char *end= strchr(line, '\n');
+    *end= '\0';
+    char *fields[16];
+    unsigned int fields_count;
+    char type= line[0];
+    if ((type == '\0') || (line[1] != '\t')) goto wrong;
+    if (type == 'r')
     {
-      if (fgets(buffer_for_replacement, sizeof(buffer_for_replacement), fp) == NULL)
-        {;}
-      pclose(fp);
+      snapshot->rows[snapshot->rows_count++]= line + 2;
     }
-#if (PGFINDLIB_COMMENT_UNAME_FAILED != 0)
-    if (strcmp(buffer_for_replacement, "?") == 0)
+    else if (type == 't')
     {
-      rval= pgfindlib_comment_is_row("uname -m failed",
-                         PGFINDLIB_COMMENT_UNAME_FAILED,
-                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-      if (rval != PGFINDLIB_OK) return rval;
+      fields_count= pgfindlib_snapshot_fields(line + 2, fields, 16);
+      if (fields_count != 2) goto wrong;
+      snapshot->written_sec= strtoll(fields[0], NULL, 10);
+      snapshot->written_nsec= strtoll(fields[1], NULL, 10);
+    }
+    else if (type == 'd')
+    {
+      fields_count= pgfindlib_snapshot_fields(line + 2, fields, 16);
+      if (fields_count != 6) goto wrong;
+      struct pgfindlib_snapshot_directory *directory= &snapshot->directories[snapshot->directories_count];
+      directory->prefix= fields[0];
+      directory->dev= (dev_t) strtoull(fields[1], NULL, 10);
+      directory->ino= (ino_t) strtoull(fields[2], NULL, 10);
+      directory->mtime_sec= strtoll(fields[3], NULL, 10);
+      directory->mtime_nsec= strtoll(fields[4], NULL, 10);
+      directory->is_listed= atoi(fields[5]);
+      directory->first_entry= snapshot->entries_count;
+      directory->entries_count= 0;
+      unsigned int bucket= pgfindlib_snapshot_bucket(snapshot, directory->prefix);
+      directory->next_in_bucket= snapshot->directory_buckets[bucket];
+      snapshot->directory_buckets[bucket]= snapshot->directories_count++;
+      listed= (directory->is_listed != 0) ? directory : NULL;
+    }
+    else if (type == 'c')
+    {
+      fields_count= pgfindlib_snapshot_fields(line + 2, fields, 16);
+      if ((fields_count != 4) || (snapshot->is_cache != 0)) goto wrong;
+      snapshot->is_cache= 1;
+      snapshot->cache.dev= (dev_t) strtoull(fields[0], NULL, 10);
+      snapshot->cache.ino= (ino_t) strtoull(fields[1], NULL, 10);
+      snapshot->cache.mtime_sec= strtoll(fields[2], NULL, 10);
+      snapshot->cache.mtime_nsec= strtoll(fields[3], NULL, 10);
+      snapshot->cache.first_entry= snapshot->entries_count;
+      snapshot->cache.entries_count= 0;
+      listed= &snapshot->cache;
+    }
+    else if ((type == 'e') || (type == 'l'))
+    {
+      fields_count= pgfindlib_snapshot_fields(line + 2, fields, 16);
+      if ((fields_count != ((type == 'e') ? 3 : 2)) || (listed == NULL) || ((type == 'l') != (listed == &snapshot->cache))) goto wrong;
+      struct pgfindlib_snapshot_entry *entry= &snapshot->entries[snapshot->entries_count++];
+      entry->name= fields[0];
+      entry->d_ino= (type == 'e') ? (ino_t) strtoull(fields[1], NULL, 10) : 0;
+      entry->d_type= (unsigned char) atoi(fields[fields_count - 1]);
+      ++listed->entries_count;
+    }
+    else if (type == 'f')
+    {
+      fields_count= pgfindlib_snapshot_fields(line + 2, fields, 16);
+      if (fields_count != 14) goto wrong;
+      struct pgfindlib_snapshot_file *file= &snapshot->files[snapshot->files_count];
+      struct pgfindlib_file_facts *facts= &file->facts;
+      file->path= fields[0];
+      facts->facts= (unsigned int) strtoul(fields[1], NULL, 16);
+      facts->is_access_failed= atoi(fields[2]);
+      facts->is_lstat_failed= atoi(fields[3]);
+      facts->st_mode= (mode_t) strtoul(fields[4], NULL, 8);
+      facts->st_dev= (dev_t) strtoull(fields[5], NULL, 10);
+      facts->st_ino= (ino_t) strtoull(fields[6], NULL, 10);
+      facts->is_symlink_resolved= atoi(fields[7]);
+      facts->is_broken= atoi(fields[8]);
+      facts->target_dev= (dev_t) strtoull(fields[9], NULL, 10);
+      facts->target_ino= (ino_t) strtoull(fields[10], NULL, 10);
+      facts->elf_rval= atoi(fields[11]);
+      facts->build_id.length= 0;
+      for (const char *hex= (strcmp(fields[12], "-") == 0) ? "" : fields[12]; (hex[0] != '\0') && (hex[1] != '\0'); hex+= 2)
+      {
+        if (facts->build_id.length == PGFINDLIB_MAX_BUILD_ID_LENGTH) goto wrong;
+        char byte[3]= { hex[0], hex[1], '\0' };
+        facts->build_id.bytes[facts->build_id.length++]= (unsigned char) strtoul(byte, NULL, 16);
+      }
+      facts->final_target= fields[13];
+      unsigned int bucket= pgfindlib_snapshot_bucket(snapshot, file->path);
+      file->next_in_bucket= snapshot->file_buckets[bucket];
+      snapshot->file_buckets[bucket]= snapshot->files_count++;
     }
+    else goto wrong;
+    if ((type != 'e') && (type != 'l') && (type != 'd') && (type != 'c')) listed= NULL;
+    line= end + 1;
+  }
+  return PGFINDLIB_OK;
+wrong:
+  snapshot->directories_count= 0;
+  snapshot->entries_count= 0;
+  snapshot->files_count= 0;
+  snapshot->rows_count= 0;
+  snapshot->is_cache= 0;
+  snapshot->written_sec= 0;
+  snapshot->written_nsec= 0;
+  return PGFINDLIB_OK;
+}
+
+/*
+  For pgfindlib_execute(): read options->snapshot_path, and start writing the new snapshot to a temporary file beside it.
+  Return PGFINDLIB_OK, PGFINDLIB_ERROR_SNAPSHOT if the temporary file can't be made, or PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW.
+*/
+static int pgfindlib_snapshot_open(struct pgfindlib_context *context, const struct pgfindlib_prepared *prepared)
+{
+  struct pgfindlib_snapshot *snapshot= (struct pgfindlib_snapshot *)calloc(1, sizeof(struct pgfindlib_snapshot));
+  if (snapshot == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  context->snapshot= snapshot;
+  snapshot->path= context->snapshot_path;
+  unsigned long long key= pgfindlib_snapshot_key(context, prepared);
+  int rval= pgfindlib_snapshot_read(snapshot, key);
+  if (rval != PGFINDLIB_OK) return rval;
+  snapshot->temporary_path= (char *)malloc(strlen(snapshot->path) + sizeof(".XXXXXX"));
+  if (snapshot->temporary_path == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  strcpy(snapshot->temporary_path, snapshot->path);
+  strcat(snapshot->temporary_path, ".XXXXXX");
+  int fd= mkstemp(snapshot->temporary_path);
+  if (fd == -1) { free(snapshot->temporary_path); snapshot->temporary_path= NULL; return PGFINDLIB_ERROR_SNAPSHOT; }
+  snapshot->fp= fdopen(fd, "w");
+  if (snapshot->fp == NULL) { close(fd); return PGFINDLIB_ERROR_SNAPSHOT; }
+  fprintf(snapshot->fp, "pgfindlib snapshot 1\t%016llx\n", key);
+  /* Before anything is stat()ed. File times are from the kernel's coarse clock, which can be behind CLOCK_REALTIME. */
+  struct timespec started;
+#ifdef CLOCK_REALTIME_COARSE
+  clock_gettime(CLOCK_REALTIME_COARSE, &started);
+#else
+  clock_gettime(CLOCK_REALTIME, &started);
 #endif
-    char *pointer_to_n= strchr(buffer_for_replacement, '\n');
-    if (pointer_to_n != NULL) *pointer_to_n= '\0';
-    strcpy(platform, buffer_for_replacement);
-#if (PGFINDLIB_COMMENT_ASSUMING_PLATFORM != 0)
-    char comment[5000];
-    sprintf(comment, "assuming $PLATFORM is %s", platform);
-    rval= pgfindlib_comment_is_row(comment,
-                         PGFINDLIB_COMMENT_ASSUMING_PLATFORM,
-                         buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
+  fprintf(snapshot->fp, "t\t%lld\t%lld\n", (long long) started.tv_sec, (long long) started.tv_nsec);
+  return PGFINDLIB_OK;
+}
+
+/* Free, and if the new snapshot wasn't finished then remove its temporary file so the last snapshot stays */
+static void pgfindlib_snapshot_free(struct pgfindlib_snapshot *snapshot)
+{
+  if (snapshot == NULL) return;
+  if (snapshot->fp != NULL) fclose(snapshot->fp);
+  if (snapshot->temporary_path != NULL) { unlink(snapshot->temporary_path); free(snapshot->temporary_path); }
+  if (snapshot->text != NULL) free(snapshot->text);
+  if (snapshot->directories != NULL) free(snapshot->directories);
+  if (snapshot->entries != NULL) free(snapshot->entries);
+  if (snapshot->files != NULL) free(snapshot->files);
+  if (snapshot->rows != NULL) free(snapshot->rows);
+  if (snapshot->directory_buckets != NULL) free(snapshot->directory_buckets);
+  if (snapshot->file_buckets != NULL) free(snapshot->file_buckets);
+  if (snapshot->prefixes != NULL) free(snapshot->prefixes);
+  free(snapshot);
+}
+
+/*
+  For pgfindlib_directory_scan(), after it stat()ed directory: if the last snapshot listed it with the same (dev, ino, mtime)
+  then its candidates are the snapshot's, and *is_reused= 1 so it isn't read. A file that's added, removed or renamed
+  changes the directory's mtime, a file that's changed in place doesn't, see "Re snapshots" in README.md.
+  The caller made room for one more context->scanned.
+*/
+static int pgfindlib_snapshot_directory_scan(const char *directory, const struct stat *directory_sb, unsigned int tokener_number,
+                                             char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                             struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
+                                             struct pgfindlib_context *context, int *is_reused)
+{
+  const struct pgfindlib_snapshot *snapshot= context->snapshot;
+  *is_reused= 0;
+  char *combo= context->combo;
+  strcpy(combo, directory);
+  strcat(combo, "/");
+  const struct pgfindlib_snapshot_directory *old= pgfindlib_snapshot_find_directory(snapshot, combo);
+  struct pgfindlib_snapshot_prefix now;
+  pgfindlib_snapshot_prefix_from_stat(&now, directory_sb);
+  if ((old == NULL) || (old->is_listed == 0) || (pgfindlib_snapshot_is_same(snapshot, old, &now) == 0)) return PGFINDLIB_OK;
+  unsigned int directory_number;
+  int rval= pgfindlib_candidate_directory(context, combo, strlen(combo),
+                                          malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length, &directory_number);
+  if (rval != PGFINDLIB_OK) return rval;
+  unsigned int first= *malloc_buffer_2_length;
+  for (unsigned int e= old->first_entry; e < old->first_entry + old->entries_count; ++e)
+  {
+    const struct pgfindlib_snapshot_entry *entry= &snapshot->entries[e];
+    rval= pgfindlib_add_candidate(directory_number, entry->name, tokener_number, entry->d_ino, entry->d_type,
+                                  malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                  malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
     if (rval != PGFINDLIB_OK) return rval;
-#endif
   }
-  return rval; /* which is doubtless PGFINDLIB_OK */
+  struct pgfindlib_scanned_directory *scanned= &context->scanned[context->scanned_count++];
+  scanned->dev= now.dev;
+  scanned->ino= now.ino;
+  scanned->first= first;
+  scanned->count= *malloc_buffer_2_length - first;
+  scanned->directory_number= (int) directory_number;
+  scanned->mtime_sec= now.mtime_sec;
+  scanned->mtime_nsec= now.mtime_nsec;
+  *is_reused= 1;
+  return PGFINDLIB_OK;
 }
 
 /*
- *For a comment column
-  Put column of row in buffer.
-  All warnings and comments must have form: 3-decimal-digit-number text delimiter
-  The number should never change, the text should rarely change.
-  Todo: flag to ignore column because column_number
-        flag to exclude text and only show number
-        limit text length
-        enclose in ''s or ""s if contains delimiter
+  For the ld.so.cache source: if /etc/ld.so.cache has the same (dev, ino, mtime) as in the last snapshot then the candidates
+  are the snapshot's, and *is_reused= 1 so ldconfig isn't started. Else the caller gets them as usual, and then
+  pgfindlib_snapshot_so_cache_candidates() says which they are.
 */
-int pgfindlib_comment_in_row(char *comment, unsigned int comment_number, int additional_number)
+static int pgfindlib_snapshot_so_cache(struct pgfindlib_context *context, int tokener_number,
+                                       char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                       struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
+                                       int *is_reused)
 {
-  const char *text;
-  if (comment_number == PGFINDLIB_COMMENT_DUPLICATE) sprintf(comment, "%03d %s %d", comment_number, "duplicate of", additional_number);
-  else
+  struct pgfindlib_snapshot *snapshot= context->snapshot;
+  *is_reused= 0;
+  struct stat sb;
+  if (pgfindlib_stat(context->backend, context->sysroot_fd, "/etc/ld.so.cache", &sb, 0) != 0) return PGFINDLIB_OK;
+  struct pgfindlib_snapshot_prefix now;
+  pgfindlib_snapshot_prefix_from_stat(&now, &sb);
+  if (snapshot->is_cache_recorded == 0) { snapshot->new_cache= now; snapshot->is_cache_statted= 1; }
+  if ((snapshot->is_cache == 0) || (pgfindlib_snapshot_is_same(snapshot, &snapshot->cache, &now) == 0)) return PGFINDLIB_OK;
+  char *line= context->spawn_line;
+  for (unsigned int e= snapshot->cache.first_entry; e < snapshot->cache.first_entry + snapshot->cache.entries_count; ++e)
   {
-    if (comment_number == PGFINDLIB_COMMENT_ACCESS_FAILED) text= "access(filename, R_OK) failed";
-    if (comment_number == PGFINDLIB_COMMENT_LSTAT_FAILED) text= "lstat(filename) failed";
-    if (comment_number == PGFINDLIB_COMMENT_SYMLINK) text= "symlink";
-    if (comment_number == PGFINDLIB_COMMENT_MAX_INODE_COUNT_TOO_SMALL) text= "MAX_INODE_COUNT is too small";
-    if (comment_number == PGFINDLIB_COMMENT_ELF_OPEN_FAILED) text= "elf open failed";
-    if (comment_number == PGFINDLIB_COMMENT_ELF_READ_FAILED) text= "elf read failed";
-    if (comment_number == PGFINDLIB_COMMENT_ELF_HAS_INVALID_IDENT) text= "elf has invalid ident";
-    if (comment_number == PGFINDLIB_COMMENT_ELF_IS_NOT_EXEC_OR_DYN) text= "elf is not exec or dyn";
-    if (comment_number == PGFINDLIB_COMMENT_ELF_SHT_DYNAMIC_NOT_FOUND) text= "elf sht_dynamic not found";
-    if (comment_number == PGFINDLIB_COMMENT_ELF_MACHINE_DOES_NOT_MATCH) text= "elf machine does not match";
-    sprintf(comment, "%03d %s", comment_number, text);
+    const struct pgfindlib_snapshot_entry *entry= &snapshot->entries[e];
+    if (strlen(entry->name) + 2 > sizeof(context->spawn_line)) return PGFINDLIB_ERROR_MAX_PATH_LENGTH_TOO_SMALL;
+    strcpy(line, entry->name);
+    if (entry->d_type != 0) strcat(line, "\n"); /* as ldconfig -p said it, so the candidates sort the same */
+    int rval= pgfindlib_add_to_malloc_buffers(context, line, tokener_number,
+                                              malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                              malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
+    if (rval != PGFINDLIB_OK) return rval;
   }
+  *is_reused= 1;
   return PGFINDLIB_OK;
 }
 
-/* This can be called when a warning|error will be the only item in the row, e.g. when about to return syntax error
-   But notice the fixed size of comment_with_number, don't call unless it's certain that the message is short
+/* malloc_buffer_2[first .. end - 1] are the ld.so.cache candidates. Only the first ld.so.cache in FROM counts. */
+static void pgfindlib_snapshot_so_cache_candidates(struct pgfindlib_snapshot *snapshot, unsigned int first, unsigned int end)
+{
+  if ((snapshot->is_cache_recorded != 0) || (snapshot->is_cache_statted == 0)) return;
+  snapshot->is_cache_recorded= 1;
+  snapshot->cache_first= first;
+  snapshot->cache_count= end - first;
+}
+
+static void pgfindlib_snapshot_write_directory(struct pgfindlib_snapshot *snapshot, const char *prefix,
+                                               const struct pgfindlib_snapshot_prefix *now, int is_listed)
+{
+  fprintf(snapshot->fp, "d\t%s\t%llu\t%llu\t%lld\t%lld\t%d\n", prefix, (unsigned long long) now->dev, (unsigned long long) now->ino,
+          now->mtime_sec, now->mtime_nsec, is_listed);
+}
+
+/*
+  At the end of phase 1, before the candidates are sorted: write the directories that were read or reused
+  with their candidates, and the ld.so.cache candidates. context->snapshot->prefixes starts here.
 */
-int pgfindlib_comment_is_row(const char *comment, unsigned int comment_number,
-                             char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length, unsigned int *row_number,
-                             ino_t inode_list[], unsigned int *inode_count)
+static int pgfindlib_snapshot_write_listings(struct pgfindlib_context *context, const char *malloc_buffer_1,
+                                             const struct pgfindlib_candidate *malloc_buffer_2)
 {
-  if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
-  const char *columns_list[MAX_COLUMNS_PER_ROW];  
-  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
-  char comment_with_number[256];
-  sprintf(comment_with_number, "%03d %s", comment_number, comment);
-  columns_list[COLUMN_FOR_COMMENT_1]= comment_with_number;
-  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+  struct pgfindlib_snapshot *snapshot= context->snapshot;
+  if (snapshot->prefixes != NULL) free(snapshot->prefixes);
+  snapshot->prefixes_count= context->candidate_directories_count;
+  snapshot->prefixes= (struct pgfindlib_snapshot_prefix *)calloc(snapshot->prefixes_count + 1, sizeof(struct pgfindlib_snapshot_prefix));
+  if (snapshot->prefixes == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  for (unsigned int s= 0; s < context->scanned_count; ++s)
+  {
+    const struct pgfindlib_scanned_directory *scanned= &context->scanned[s];
+    if (scanned->directory_number < 0) continue;
+    const char *prefix= malloc_buffer_1 + context->candidate_directories[scanned->directory_number].offset;
+    struct pgfindlib_snapshot_prefix *now= &snapshot->prefixes[scanned->directory_number];
+    now->dev= scanned->dev;
+    now->ino= scanned->ino;
+    now->mtime_sec= scanned->mtime_sec;
+    now->mtime_nsec= scanned->mtime_nsec;
+    if (pgfindlib_snapshot_is_writable(prefix) == 0) { now->state= PGFINDLIB_SNAPSHOT_PREFIX_UNUSABLE; continue; }
+    const struct pgfindlib_snapshot_directory *old= pgfindlib_snapshot_find_directory(snapshot, prefix);
+    now->state= ((old != NULL) && (pgfindlib_snapshot_is_same(snapshot, old, now) != 0)) ? PGFINDLIB_SNAPSHOT_PREFIX_UNCHANGED : PGFINDLIB_SNAPSHOT_PREFIX_CHANGED;
+    int is_listed= 1;
+    for (unsigned int i= scanned->first; i < scanned->first + scanned->count; ++i)
+    {
+      if (pgfindlib_snapshot_is_writable(malloc_buffer_1 + malloc_buffer_2[i].name_offset) == 0) is_listed= 0;
+    }
+    pgfindlib_snapshot_write_directory(snapshot, prefix, now, is_listed);
+    for (unsigned int i= scanned->first; (is_listed != 0) && (i < scanned->first + scanned->count); ++i)
+    {
+      fprintf(snapshot->fp, "e\t%s\t%llu\t%d\n", malloc_buffer_1 + malloc_buffer_2[i].name_offset,
+              (unsigned long long) malloc_buffer_2[i].d_ino, malloc_buffer_2[i].d_type);
+    }
+  }
+  if (snapshot->is_cache_recorded != 0)
+  {
+    const struct pgfindlib_snapshot_prefix *now= &snapshot->new_cache;
+    fprintf(snapshot->fp, "c\t%llu\t%llu\t%lld\t%lld\n", (unsigned long long) now->dev, (unsigned long long) now->ino,
+            now->mtime_sec, now->mtime_nsec);
+    char *path= context->candidate_path;
+    for (unsigned int i= snapshot->cache_first; i < snapshot->cache_first + snapshot->cache_count; ++i)
+    {
+      int rval= pgfindlib_candidate_path(context, malloc_buffer_1, &malloc_buffer_2[i], path, sizeof(context->line_copy)); /* as for its row */
+      if (rval != PGFINDLIB_OK) return rval;
+      size_t length= strlen(path);
+      int has_newline= ((length > 0) && (path[length - 1] == '\n')) ? 1 : 0;
+      if (has_newline != 0) path[length - 1]= '\0';
+      if (pgfindlib_snapshot_is_writable(path) != 0) fprintf(snapshot->fp, "l\t%s\t%d\n", path, has_newline);
+    }
+  }
+  return PGFINDLIB_OK;
 }
 
 /*
-  called "bottom level" because ultimately all pgfindlib_row_* functions should call here
-  todo: move overflow check to here
+  For phase 2, before pgfindlib_file() of path, whose candidate directory is directory_number:
+  *learned is where pgfindlib_file() puts what it learns for the new snapshot, or NULL if it can't be written.
+  *known is what the last snapshot says pgfindlib_file() learned, or NULL, and it's only used if the directory
+  has the same (dev, ino, mtime) as then. The directory is stat()ed before the file is looked at, if that wasn't
+  done in phase 1, so anything that changes after that is seen next time.
 */
-int pgfindlib_row_bottom_level(char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length, unsigned int *row_number, 
-                               const char *columns_list[])
+static void pgfindlib_snapshot_facts(struct pgfindlib_context *context, const char *malloc_buffer_1, unsigned int directory_number,
+                                     const char *path, const struct pgfindlib_file_facts **known, struct pgfindlib_file_facts **learned)
 {
-  int rval;
-  char row_number_string[8];
-  unsigned int buffer_length_save= *buffer_length;
-  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i)
+  struct pgfindlib_snapshot *snapshot= context->snapshot;
+  *known= NULL;
+  *learned= NULL;
+  if (directory_number >= snapshot->prefixes_count) return;
+  struct pgfindlib_snapshot_prefix *now= &snapshot->prefixes[directory_number];
+  if (now->state == PGFINDLIB_SNAPSHOT_PREFIX_UNKNOWN)
   {
-    if (i == COLUMN_FOR_ROW_NUMBER)
+    const char *prefix= malloc_buffer_1 + context->candidate_directories[directory_number].offset;
+    struct stat sb;
+    now->state= PGFINDLIB_SNAPSHOT_PREFIX_UNUSABLE;
+    if ((prefix[0] != '\0') && (pgfindlib_snapshot_is_writable(prefix) != 0)
+     && (pgfindlib_stat(context->backend, context->sysroot_fd, prefix, &sb, 0) == 0) && (S_ISDIR(sb.st_mode)))
     {
-      sprintf(row_number_string, "%d", *row_number);
-      rval= pgfindlib_strcat(buffer, buffer_length, row_number_string, buffer_max_length);
+      pgfindlib_snapshot_prefix_from_stat(now, &sb);
+      const struct pgfindlib_snapshot_directory *old= pgfindlib_snapshot_find_directory(snapshot, prefix);
+      now->state= ((old != NULL) && (pgfindlib_snapshot_is_same(snapshot, old, now) != 0)) ? PGFINDLIB_SNAPSHOT_PREFIX_UNCHANGED : PGFINDLIB_SNAPSHOT_PREFIX_CHANGED;
+      pgfindlib_snapshot_write_directory(snapshot, prefix, now, 0);
     }
-    else rval= pgfindlib_strcat(buffer, buffer_length, columns_list[i], buffer_max_length);
-    if (rval != PGFINDLIB_OK) goto overflow;
-    rval= pgfindlib_strcat(buffer, buffer_length, PGFINDLIB_COLUMN_DELIMITER, buffer_max_length); /* ":" */
-    if (rval != PGFINDLIB_OK) goto overflow;
   }
-  rval= pgfindlib_strcat(buffer, buffer_length, PGFINDLIB_ROW_DELIMITER, buffer_max_length); /* "\n" */
-  if (rval != PGFINDLIB_OK) goto overflow;
-  ++*row_number;
-  return rval;
-overflow:
-/* todo: this should be a row and there should be a guarantee that it will fit i.e. the regular strcat check is buffer_length - what's needed for overflow message */
-  *buffer_length= buffer_length_save;
-  pgfindlib_strcat(buffer, buffer_length, "OVFLW", buffer_max_length);
-  return rval; /* i.e. return the rval that caused overflow */
+  if (now->state == PGFINDLIB_SNAPSHOT_PREFIX_UNUSABLE) return;
+  size_t path_length= strcspn(path, "\n"); /* ld.so.cache candidates end with \n, pgfindlib_file() ignores it */
+  if (path_length >= sizeof(snapshot->file_path)) return;
+  memcpy(snapshot->file_path, path, path_length);
+  snapshot->file_path[path_length]= '\0';
+  if (pgfindlib_snapshot_is_writable(snapshot->file_path) == 0) return;
+  memset(&snapshot->learned, 0, sizeof(snapshot->learned));
+  *learned= &snapshot->learned;
+  if ((now->state != PGFINDLIB_SNAPSHOT_PREFIX_UNCHANGED) || (snapshot->files_count == 0)) return;
+  for (int f= snapshot->file_buckets[pgfindlib_snapshot_bucket(snapshot, snapshot->file_path)]; f != -1; f= snapshot->files[f].next_in_bucket)
+  {
+    if (strcmp(snapshot->files[f].path, snapshot->file_path) == 0) { *known= &snapshot->files[f].facts; break; }
+  }
 }
 
-static int pgfindlib_row_version(char *buffer, unsigned int *buffer_length, unsigned buffer_max_length, unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count)
+/* After pgfindlib_file(), write what it learned about the path that pgfindlib_snapshot_facts() saw */
+static void pgfindlib_snapshot_write_facts(struct pgfindlib_snapshot *snapshot, const struct pgfindlib_file_facts *facts)
 {
-  if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
-  char row_program[64];
-  sprintf(row_program, "%03d pgfindlib", PGFINDLIB_COMMENT_PGFINDLIB);
-  char row_version[64];
-  sprintf(row_version, "%03d version %d.%d.%d", PGFINDLIB_COMMENT_VERSION, PGFINDLIB_VERSION_MAJOR, PGFINDLIB_VERSION_MINOR, PGFINDLIB_VERSION_PATCH);
-  char row_url[64];
-  sprintf(row_url, "%03d https://github.com/pgulutzan/pgfindlib", PGFINDLIB_COMMENT_URL);
-  const char *columns_list[MAX_COLUMNS_PER_ROW];
-  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
-  columns_list[COLUMN_FOR_COMMENT_1]= row_program;
-  columns_list[COLUMN_FOR_COMMENT_2]= row_version;
-  columns_list[COLUMN_FOR_COMMENT_3]= row_url;
-  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+  unsigned int facts_bits= facts->facts;
+  const char *final_target= "";
+  if ((facts->is_symlink_resolved != 0) && ((facts_bits & PGFINDLIB_FACT_SYMLINK) != 0))
+  {
+    final_target= facts->final_target;
+    if (pgfindlib_snapshot_is_writable(final_target) == 0) { facts_bits&= ~PGFINDLIB_FACT_SYMLINK; final_target= ""; }
+  }
+  char build_id[PGFINDLIB_MAX_BUILD_ID_LENGTH * 2 + 2]= "-";
+  for (unsigned int i= 0; i < facts->build_id.length; ++i) sprintf(build_id + i * 2, "%02x", facts->build_id.bytes[i]);
+  fprintf(snapshot->fp, "f\t%s\t%x\t%d\t%d\t%o\t%llu\t%llu\t%d\t%d\t%llu\t%llu\t%d\t%s\t%s\n",
+          snapshot->file_path, facts_bits, facts->is_access_failed, facts->is_lstat_failed, (unsigned int) facts->st_mode,
+          (unsigned long long) facts->st_dev, (unsigned long long) facts->st_ino,
+          facts->is_symlink_resolved, facts->is_broken, (unsigned long long) facts->target_dev, (unsigned long long) facts->target_ino,
+          facts->elf_rval, build_id, final_target);
 }
 
-int pgfindlib_row_lib(char *buffer, unsigned int *buffer_length, unsigned buffer_max_length, unsigned int *row_number,
-                      ino_t inode_list[], unsigned int *inode_count,
-                      const char *lib, const char *platform, const char *origin)
+/*
+  At the end of a successful pgfindlib_execute(): write the rows and close the temporary file.
+  It only replaces the last snapshot in pgfindlib_snapshot_commit(), after the delta, which needs the last snapshot's rows,
+  so if anything fails the last snapshot stays and pgfindlib_snapshot_free() removes the temporary file.
+  Return PGFINDLIB_OK or PGFINDLIB_ERROR_SNAPSHOT if it couldn't be written.
+*/
+static int pgfindlib_snapshot_close(struct pgfindlib_snapshot *snapshot, const char *buffer)
 {
-  if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
-  char column_lib[PGFINDLIB_MAX_PATH_LENGTH + 100];
-  char column_platform[PGFINDLIB_MAX_PATH_LENGTH + 100];
-  char column_origin[PGFINDLIB_MAX_PATH_LENGTH + 100];
-  sprintf(column_lib, "%03d $LIB=%s", PGFINDLIB_COMMENT_LIB_STRING, lib);
-  sprintf(column_platform, "%03d $PLATFORM=%s", PGFINDLIB_COMMENT_PLATFORM_STRING, platform);
-  sprintf(column_origin, "%03d $ORIGIN=%s", PGFINDLIB_COMMENT_ORIGIN_STRING, origin);
-  const char *columns_list[MAX_COLUMNS_PER_ROW];
-  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
-  columns_list[COLUMN_FOR_COMMENT_1]= column_lib;
-  columns_list[COLUMN_FOR_COMMENT_2]= column_platform;
-  columns_list[COLUMN_FOR_COMMENT_3]= column_origin;
-  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+  const char *row= buffer;
+  for (const char *row_end; (row_end= strstr(row, PGFINDLIB_ROW_DELIMITER)) != NULL; row= row_end + strlen(PGFINDLIB_ROW_DELIMITER))
+  {
+    fprintf(snapshot->fp, "r\t%.*s\n", (int) (row_end - row), row);
+  }
+  int is_error= ferror(snapshot->fp);
+  if (fclose(snapshot->fp) != 0) is_error= 1;
+  snapshot->fp= NULL;
+  if (is_error != 0) return PGFINDLIB_ERROR_SNAPSHOT;
+  return PGFINDLIB_OK;
 }
 
-/* Dump source name as a row-level comment. By default PGFINDLIB_INCLUDE_ROW_SOURCE_NAME == 0 so this is disabled */
-int pgfindlib_row_source_name(char *buffer, unsigned int *buffer_length, unsigned buffer_max_length, unsigned int *row_number,
-                             ino_t inode_list[], unsigned int *inode_count,
-                             const char *source_name)
+/* Replace the last snapshot with the new one. Return PGFINDLIB_OK or PGFINDLIB_ERROR_SNAPSHOT. */
+static int pgfindlib_snapshot_commit(struct pgfindlib_snapshot *snapshot)
 {
-#if (PGFINDLIB_INCLUDE_ROW_SOURCE_NAME == 1)
-  if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
-  const char *columns_list[MAX_COLUMNS_PER_ROW];
-  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
-  columns_list[COLUMN_FOR_SOURCE]= source_name;
-  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
-#else
-  (void) buffer; (void) buffer_length; (void) buffer_max_length; (void) row_number; (void) inode_list; (void) inode_count; (void) source_name;
+  if (rename(snapshot->temporary_path, snapshot->path) != 0) return PGFINDLIB_ERROR_SNAPSHOT;
+  free(snapshot->temporary_path);
+  snapshot->temporary_path= NULL;
   return PGFINDLIB_OK;
-#endif
+}
+
+/* A row of the last output or this one, for pgfindlib_snapshot_delta() */
+struct pgfindlib_delta_row
+{
+  char *columns[MAX_COLUMNS_PER_ROW];
+  char *key;                /* path and source, or the comments and target if there's no path */
+  unsigned int occurrence;  /* 0 for the first row with key, 1 for the second, etc. */
+  char *content;            /* comments and target, with a row number in a comment replaced by that row's key */
+  int other;                /* the row with the same key and occurrence in the other output, or -1 */
+  int is_in_order;          /* it's in the longest sequence of rows that are in the same order in both outputs */
+  int next_in_bucket;
+};
+
+/* Join strings with tabs into a malloc'd string */
+static char *pgfindlib_delta_join(const char *const strings[], unsigned int strings_count)
+{
+  size_t length= 1;
+  for (unsigned int i= 0; i < strings_count; ++i) length+= strlen(strings[i]) + 1;
+  char *joined= (char *)malloc(length);
+  if (joined == NULL) return NULL;
+  joined[0]= '\0';
+  for (unsigned int i= 0; i < strings_count; ++i)
+  {
+    if (i > 0) strcat(joined, "\t");
+    strcat(joined, strings[i]);
+  }
+  return joined;
+}
+
+static void pgfindlib_delta_rows_free(struct pgfindlib_delta_row *rows, unsigned int rows_count)
+{
+  if (rows == NULL) return;
+  for (unsigned int i= 0; i < rows_count; ++i)
+  {
+    if (rows[i].key != NULL) free(rows[i].key);
+    if (rows[i].content != NULL) free(rows[i].content);
+  }
+  free(rows);
 }
 
 /*
-  Put file name in buffer. Precede with, or include, comments if there are any.
-  todo: pgfindlib_comment = source name if first in source and not done before
-  todo: some parameters unused e.g. inode_warning_count
-  todo: can use st_nlink to see how many hardlinks a file has (expect it to have at least 1)
-  todo: maybe there's a way to follow a symlink -- we use lstat on the file, maybe stat() would do better
+  Make rows from row_strings, which are split in place. A row that doesn't split into MAX_COLUMNS_PER_ROW columns,
+  e.g. because a path contains the delimiter, is all in COLUMN_FOR_COMMENT_1.
+  014, 015 and 025 comments say "of N" or "as N", but N changes whenever an earlier row is added or removed,
+  so content has N's key instead. 016 comments say an address, which changes with every process, so content hasn't it.
 */
-int pgfindlib_file(char *buffer, unsigned int *buffer_length, const char *line, unsigned int buffer_max_length,
-                          unsigned int *row_number,
-                          ino_t inode_list[], unsigned int *inode_count, unsigned int *inode_warning_count,
-                          struct tokener tokener_list_item,
-                          int program_e_machine)
+static int pgfindlib_delta_rows(char *row_strings[], unsigned int rows_count, struct pgfindlib_delta_row **rows_pointer, int *buckets,
+                                unsigned int buckets_count)
 {
-  (void) inode_warning_count;
-  char line_copy[PGFINDLIB_MAX_PATH_LENGTH + 1]; /* todo: change following to "get rid of trailing \n" */
+  struct pgfindlib_delta_row *rows= (struct pgfindlib_delta_row *)calloc(rows_count + 1, sizeof(struct pgfindlib_delta_row));
+  *rows_pointer= rows;
+  if (rows == NULL) return PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW;
+  char delimiter[sizeof(PGFINDLIB_COLUMN_DELIMITER)];
+  unsigned int delimiter_length= 0;
+  pgfindlib_strcat(delimiter, &delimiter_length, PGFINDLIB_COLUMN_DELIMITER, sizeof(delimiter) - 1); /* trim spaces as the rows were */
+  for (unsigned int b= 0; b < buckets_count; ++b) buckets[b]= -1;
+  for (unsigned int i= 0; i < rows_count; ++i)
   {
-    int i= 0; int j= 0;
-    for (;;)
+    struct pgfindlib_delta_row *row= &rows[i];
+    char *string= row_strings[i];
+    if (pgfindlib_split_row(string, delimiter, delimiter_length, row->columns) == 0)
     {
-      if (*(line + i) != '\n') { *(line_copy + j)= *(line + i); ++j; }
-      if (*(line + i) == '\0') break;
-      ++i;
+      for (int c= 0; c < MAX_COLUMNS_PER_ROW; ++c) row->columns[c]= (char *) "";
+      char *rest= strstr(string, delimiter);
+      if (rest != NULL) { *rest= '\0'; rest+= delimiter_length; }
+      row->columns[COLUMN_FOR_ROW_NUMBER]= string;
+      row->columns[COLUMN_FOR_COMMENT_1]= (rest != NULL) ? rest : (char *) "";
+    }
+    const char *key_strings[4];
+    if (row->columns[COLUMN_FOR_PATH][0] != '\0')
+    {
+      key_strings[0]= row->columns[COLUMN_FOR_PATH];
+      key_strings[1]= row->columns[COLUMN_FOR_SOURCE];
+      row->key= pgfindlib_delta_join(key_strings, 2);
+    }
+    else
+    {
+      for (int c= COLUMN_FOR_COMMENT_1; c <= COLUMN_FOR_TARGET; ++c) key_strings[c - COLUMN_FOR_COMMENT_1]= row->columns[c];
+      row->key= pgfindlib_delta_join(key_strings, 4);
     }
+    if (row->key == NULL) return PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW;
+    unsigned int bucket= (unsigned int) (pgfindlib_snapshot_hash(14695981039346656037ULL, row->key, strlen(row->key)) % buckets_count);
+    for (int r= buckets[bucket]; r != -1; r= rows[r].next_in_bucket)
+    {
+      if (strcmp(rows[r].key, row->key) == 0) { row->occurrence= rows[r].occurrence + 1; break; }
+    }
+    row->next_in_bucket= buckets[bucket];
+    buckets[bucket]= (int) i;
+    row->other= -1;
   }
+  for (unsigned int i= 0; i < rows_count; ++i)
+  {
+    struct pgfindlib_delta_row *row= &rows[i];
+    const char *content_strings[4];
+    char *comments[3]= { NULL, NULL, NULL };
+    for (int c= COLUMN_FOR_COMMENT_1; c <= COLUMN_FOR_COMMENT_3; ++c)
+    {
+      const char *comment= row->columns[c];
+      int comment_number= atoi(comment);
+      content_strings[c - COLUMN_FOR_COMMENT_1]= comment;
+      const char *last_space= strrchr(comment, ' ');
+      if (((comment_number == PGFINDLIB_COMMENT_DUPLICATE) || (comment_number == PGFINDLIB_COMMENT_SAME_TARGET)
+        || (comment_number == PGFINDLIB_COMMENT_SAME_BUILD)) && (last_space != NULL))
+      {
+        unsigned int row_number= (unsigned int) atoi(last_space + 1);
+        const struct pgfindlib_delta_row *referred= NULL;
+        for (unsigned int r= 0; (r < rows_count) && (referred == NULL); ++r) /* row numbers usually start at 1 so r is row_number - 1 */
+        {
+          unsigned int guess= (r + row_number - 1) % rows_count;
+          if ((unsigned int) atoi(rows[guess].columns[COLUMN_FOR_ROW_NUMBER]) == row_number) referred= &rows[guess];
+        }
+        if (referred != NULL)
+        {
+          size_t length= (last_space - comment) + strlen(referred->key) + 16;
+          comments[c - COLUMN_FOR_COMMENT_1]= (char *)malloc(length);
+          if (comments[c - COLUMN_FOR_COMMENT_1] == NULL) return PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW;
+          sprintf(comments[c - COLUMN_FOR_COMMENT_1], "%.*s %s#%u", (int) (last_space - comment), comment, referred->key, referred->occurrence);
+          content_strings[c - COLUMN_FOR_COMMENT_1]= comments[c - COLUMN_FOR_COMMENT_1];
+        }
+      }
+      else if (comment_number == PGFINDLIB_COMMENT_ALREADY_MAPPED)
+      {
+        content_strings[c - COLUMN_FOR_COMMENT_1]= "016";
+      }
+      else if (comment_number == PGFINDLIB_COMMENT_AUDIT_OBSERVED) /* the nanoseconds differ every run */
+      {
+        content_strings[c - COLUMN_FOR_COMMENT_1]= "031";
+      }
+    }
+    content_strings[3]= row->columns[COLUMN_FOR_TARGET];
+    row->content= pgfindlib_delta_join(content_strings, 4);
+    for (int c= 0; c < 3; ++c) if (comments[c] != NULL) free(comments[c]);
+    if (row->content == NULL) return PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW;
+  }
+  return PGFINDLIB_OK;
+}
 
-  const char *columns_list[MAX_COLUMNS_PER_ROW];
-  for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
-  unsigned int columns_list_number= COLUMN_FOR_COMMENT_1;
-
-  char warning_max_inode_count_is_too_small[64]= ""; /* Do not move warnings into "if ... {} ...", columns_list needs their addresses */
-  char warning_lstat_failed[64]= "";
-  char warning_access_failed[64]= "";
-  char warning_symlink[64]= "";
-  char warning_duplicate[64]= "";
-  char warning_elf[64]= "";
-  if (access(line_copy, R_OK) != 0) /* It's poorly documented but tests indicate X_OK doesn't matter and R_OK matters */
+/*
+  For PGFINDLIB_OPTION_DELTA: replace the rows in buffer with the rows that differ from the last snapshot's rows.
+  Rows are the same if they have the same path and source (or, if there's no path, the same comments and target).
+  Each row that's in this output only is "026 added as row N", each row that's in the last output only is
+  "027 removed from row N", a row whose comments or target differ is "028 changed in row N", and a row that's
+  in a different order relative to the others is "029 moved to row N". N is the row number in the whole output
+  that it's from. The 026-029 comment comes first, then the row's first two comments, so a third comment is lost.
+  Rows that are the same and in the same order aren't there, so if nothing changed buffer is empty.
+  The added, changed and moved rows are in this output's order, followed by the removed rows in the last output's order.
+*/
+static int pgfindlib_snapshot_delta(const struct pgfindlib_snapshot *snapshot, char *buffer, unsigned int *buffer_length,
+                                    unsigned int buffer_max_length)
+{
+  int rval;
+  struct pgfindlib_delta_row *old_rows= NULL;
+  struct pgfindlib_delta_row *new_rows= NULL;
+  unsigned int new_rows_count= 0;
+  char *new_text= (char *)malloc(*buffer_length + 1);
+  char **new_strings= NULL;
+  int *buckets= NULL;
+  int *tails= NULL;
+  int *previous= NULL;
+  if (new_text == NULL) return PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW;
+  memcpy(new_text, buffer, *buffer_length);
+  new_text[*buffer_length]= '\0';
+  for (const char *p= new_text; (p= strstr(p, PGFINDLIB_ROW_DELIMITER)) != NULL; p+= strlen(PGFINDLIB_ROW_DELIMITER)) ++new_rows_count;
+  unsigned int buckets_count= snapshot->rows_count + new_rows_count + 64;
+  new_strings= (char **)malloc((new_rows_count + 1) * sizeof(char *));
+  buckets= (int *)malloc(buckets_count * sizeof(int));
+  tails= (int *)malloc((new_rows_count + 1) * sizeof(int));
+  previous= (int *)malloc((new_rows_count + 1) * sizeof(int));
+  if ((new_strings == NULL) || (buckets == NULL) || (tails == NULL) || (previous == NULL)) { rval= PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW; goto free_and_return; }
   {
-#if (PGFINDLIB_COMMENT_ACCESS_FAILED != 0)
-    pgfindlib_comment_in_row(warning_access_failed, PGFINDLIB_COMMENT_ACCESS_FAILED, 0);
-    columns_list[columns_list_number++]= warning_access_failed;
-#endif
+    char *row= new_text;
+    for (unsigned int i= 0; i < new_rows_count; ++i)
+    {
+      char *row_end= strstr(row, PGFINDLIB_ROW_DELIMITER);
+      *row_end= '\0';
+      new_strings[i]= row;
+      row= row_end + strlen(PGFINDLIB_ROW_DELIMITER);
+    }
   }
-  ino_t inode;
-  struct stat sb;
-  if (lstat(line_copy, &sb) == -1)
+  /* The old rows have buckets only while they're made, then the new rows' buckets are used to look up old rows */
+  rval= pgfindlib_delta_rows(snapshot->rows, snapshot->rows_count, &old_rows, buckets, buckets_count);
+  if (rval != PGFINDLIB_OK) goto free_and_return;
+  rval= pgfindlib_delta_rows(new_strings, new_rows_count, &new_rows, buckets, buckets_count);
+  if (rval != PGFINDLIB_OK) goto free_and_return;
+  for (unsigned int o= 0; o < snapshot->rows_count; ++o)
   {
-#if (PGFINDLIB_COMMENT_LSTAT_FAILED != 0)
-    pgfindlib_comment_in_row(warning_lstat_failed, PGFINDLIB_COMMENT_LSTAT_FAILED, 0);
-    columns_list[columns_list_number++]= warning_lstat_failed;
-#endif
-    inode= -1; /* a dummy so count of inodes is right but this won't be found later */
+    struct pgfindlib_delta_row *old_row= &old_rows[o];
+    unsigned int bucket= (unsigned int) (pgfindlib_snapshot_hash(14695981039346656037ULL, old_row->key, strlen(old_row->key)) % buckets_count);
+    for (int n= buckets[bucket]; n != -1; n= new_rows[n].next_in_bucket)
+    {
+      if ((new_rows[n].occurrence == old_row->occurrence) && (strcmp(new_rows[n].key, old_row->key) == 0))
+      {
+        old_row->other= n;
+        new_rows[n].other= (int) o;
+        break;
+      }
+    }
   }
-  else
+  /*
+    The unchanged rows that aren't moved are the longest sequence, in this output's order, whose old row numbers increase.
+    tails[k] is the row that ends the best sequence of length k + 1 so far, previous[] is the row before it in the sequence.
+  */
   {
-    mode_t st_mode= sb.st_mode & S_IFMT;
-    if ((st_mode !=S_IFREG) && (st_mode != S_IFLNK)) return PGFINDLIB_OK; /* not file or symlink so not candidate */
-    /* Here, if (st_mode == S_IFLNK) and include_symlinks is off, return */
-    /* Here, if (duplicate) and include duplicates is off, return */
-    if (st_mode == S_IFLNK)
+    unsigned int tails_count= 0;
+    for (unsigned int n= 0; n < new_rows_count; ++n)
     {
-#if (PGFINDLIB_COMMENT_SYMLINK != 0)
-      /* todo: find out: symlink of what? */
-      pgfindlib_comment_in_row(warning_symlink, PGFINDLIB_COMMENT_SYMLINK, 0);
-      columns_list[columns_list_number++]= warning_symlink;
-#endif
+      if ((new_rows[n].other == -1) || (strcmp(new_rows[n].content, old_rows[new_rows[n].other].content) != 0)) continue;
+      unsigned int low= 0, high= tails_count;
+      while (low < high)
+      {
+        unsigned int middle= (low + high) / 2;
+        if (new_rows[tails[middle]].other < new_rows[n].other) low= middle + 1; else high= middle;
+      }
+      previous[n]= (low > 0) ? tails[low - 1] : -1;
+      tails[low]= (int) n;
+      if (low == tails_count) ++tails_count;
     }
-    inode= sb.st_ino;
-    for (unsigned int i= 0; i < *inode_count; ++i)
+    for (int n= (tails_count > 0) ? tails[tails_count - 1] : -1; n != -1; n= previous[n]) new_rows[n].is_in_order= 1;
+  }
+  *buffer_length= 0;
+  buffer[0]= '\0';
+  {
+    unsigned int row_number= 1;
+    for (unsigned int pass= 0; pass < 2; ++pass)
     {
-      if (inode_list[i] == inode)
+      const struct pgfindlib_delta_row *rows= (pass == 0) ? new_rows : old_rows;
+      unsigned int rows_count= (pass == 0) ? new_rows_count : snapshot->rows_count;
+      for (unsigned int i= 0; i < rows_count; ++i)
       {
-#if (PGFINDLIB_COMMENT_DUPLICATE != 0)
-       pgfindlib_comment_in_row(warning_duplicate, PGFINDLIB_COMMENT_DUPLICATE, i + 1); /* "+ 1" because row_number starts at 1 */
-       columns_list[columns_list_number++]= warning_duplicate;
-#endif
-       break;
+        const struct pgfindlib_delta_row *row= &rows[i];
+        unsigned int comment_number;
+        if (pass == 1)
+        {
+          if (row->other != -1) continue;
+          comment_number= PGFINDLIB_COMMENT_DELTA_REMOVED;
+        }
+        else if (row->other == -1) comment_number= PGFINDLIB_COMMENT_DELTA_ADDED;
+        else if (strcmp(row->content, old_rows[row->other].content) != 0) comment_number= PGFINDLIB_COMMENT_DELTA_CHANGED;
+        else if (row->is_in_order == 0) comment_number= PGFINDLIB_COMMENT_DELTA_MOVED;
+        else continue;
+        char marker[64];
+        pgfindlib_comment_in_row(marker, comment_number, atoi(row->columns[COLUMN_FOR_ROW_NUMBER]));
+        const char *columns_list[MAX_COLUMNS_PER_ROW];
+        for (int c= 0; c < MAX_COLUMNS_PER_ROW; ++c) columns_list[c]= "";
+        columns_list[COLUMN_FOR_PATH]= row->columns[COLUMN_FOR_PATH];
+        columns_list[COLUMN_FOR_SOURCE]= row->columns[COLUMN_FOR_SOURCE];
+        columns_list[COLUMN_FOR_COMMENT_1]= marker;
+        columns_list[COLUMN_FOR_COMMENT_2]= row->columns[COLUMN_FOR_COMMENT_1];
+        columns_list[COLUMN_FOR_COMMENT_3]= row->columns[COLUMN_FOR_COMMENT_2];
+        columns_list[COLUMN_FOR_TARGET]= row->columns[COLUMN_FOR_TARGET];
+        rval= pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, &row_number, columns_list);
+        if (rval != PGFINDLIB_OK) goto free_and_return;
       }
     }
   }
+free_and_return:
+  pgfindlib_delta_rows_free(old_rows, snapshot->rows_count);
+  pgfindlib_delta_rows_free(new_rows, new_rows_count);
+  free(new_text);
+  if (new_strings != NULL) free(new_strings);
+  if (buckets != NULL) free(buckets);
+  if (tails != NULL) free(tails);
+  if (previous != NULL) free(previous);
+  return rval;
+}
+#endif
+
+#if (PGFINDLIB_INCLUDE_DEADLINE != 0)
+long long pgfindlib_now_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*
+  Read the mount table into context->mounts. This doesn't touch any mounted file system, unlike statfs(),
+  which waits for an NFS server that doesn't answer just as opendir() does.
+*/
+static int pgfindlib_mounts_read(struct pgfindlib_context *context)
+{
+  static const char *const remote_types[]= { "nfs", "nfs4", "cifs", "smb3", "smbfs", "ncpfs", "9p", "ceph", "afs",
+                                             "glusterfs", "lustre", "gpfs", "autofs", "fuse", "fusefs", "fuseblk", NULL };
+  context->is_mounts_read= 1;
+  unsigned int mounts_max= 0;
+#ifdef PGFINDLIB_FREEBSD
+  struct statfs *mounts;
+  int mounts_count= getmntinfo(&mounts, MNT_NOWAIT);
+  for (int m= 0; m < mounts_count; ++m)
   {
-    struct tokener tokener_list[1]; /* won't be used */
-    int elf_rval= pgfindlib_read_elf(tokener_list, line_copy, PGFINDLIB_REASON_SO_CHECK, program_e_machine);
-    if (elf_rval != 0)
+    const char *mount_point= mounts[m].f_mntonname;
+    const char *fs_type= mounts[m].f_fstypename;
+#else
+  FILE *fp= setmntent("/proc/self/mounts", "r");
+  if (fp == NULL) return PGFINDLIB_OK; /* so every directory is local */
+  struct mntent mount_entry;
+  char *mount_line= context->spawn_line;
+  while (getmntent_r(fp, &mount_entry, mount_line, sizeof(context->spawn_line)) != NULL)
+  {
+    const char *mount_point= mount_entry.mnt_dir;
+    const char *fs_type= mount_entry.mnt_type;
+#endif
+    if (context->mounts_count == mounts_max)
     {
-      int unknown_failures= 0;
-      /* These all have the same warning_elf so suppressing with "#if ... #endif" would be complicated. */
-      if (elf_rval == PGFINDLIB_COMMENT_ELF_OPEN_FAILED)
-        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_OPEN_FAILED, 0);
-      else if (elf_rval == PGFINDLIB_COMMENT_ELF_READ_FAILED)
-        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_READ_FAILED, 0);
-      else if (elf_rval == PGFINDLIB_COMMENT_ELF_HAS_INVALID_IDENT)
-        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_HAS_INVALID_IDENT, 0);
-      else if (elf_rval == PGFINDLIB_COMMENT_ELF_IS_NOT_EXEC_OR_DYN)
-        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_IS_NOT_EXEC_OR_DYN, 0);
-      else if (elf_rval == PGFINDLIB_COMMENT_ELF_SHT_DYNAMIC_NOT_FOUND)
-        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_SHT_DYNAMIC_NOT_FOUND, 0);
-      else if (elf_rval == PGFINDLIB_COMMENT_ELF_MACHINE_DOES_NOT_MATCH)
-        pgfindlib_comment_in_row(warning_elf, PGFINDLIB_COMMENT_ELF_MACHINE_DOES_NOT_MATCH, 0);
-      else ++unknown_failures; /* if this happens it's a bug */
-      if (unknown_failures == 0) columns_list[columns_list_number++]= warning_elf;
+      unsigned int new_max= mounts_max * 2 + 32;
+      struct pgfindlib_mount *new_mounts= (struct pgfindlib_mount *)realloc(context->mounts, new_max * sizeof(struct pgfindlib_mount));
+      if (new_mounts == NULL) break;
+      context->mounts= new_mounts;
+      mounts_max= new_max;
     }
+    unsigned int mount_point_length= strlen(mount_point);
+    unsigned int fs_type_length= strlen(fs_type);
+    struct pgfindlib_mount *mount= &context->mounts[context->mounts_count];
+    mount->mount_point= (char *)malloc(mount_point_length + fs_type_length + 2);
+    if (mount->mount_point == NULL) break;
+    memcpy(mount->mount_point, mount_point, mount_point_length + 1);
+    while ((mount_point_length > 0) && (mount->mount_point[mount_point_length - 1] == '/')) --mount_point_length; /* "/" becomes "" */
+    mount->mount_point_length= mount_point_length;
+    memcpy(mount->mount_point + mount_point_length + 1, fs_type, fs_type_length + 1);
+    mount->fs_type= mount->mount_point + mount_point_length + 1;
+    mount->is_remote= ((strncmp(fs_type, "fuse.", 5) == 0) || (strncmp(fs_type, "fusefs.", 7) == 0));
+    for (unsigned int i= 0; remote_types[i] != NULL; ++i)
+    {
+      if (strcmp(fs_type, remote_types[i]) == 0) mount->is_remote= 1;
+    }
+    ++context->mounts_count;
   }
+#ifndef PGFINDLIB_FREEBSD
+  endmntent(fp);
+#endif
+  return PGFINDLIB_OK;
+}
 
-  if (*inode_count == PGFINDLIB_MAX_INODE_COUNT)
+/*
+  The file system type if directory is on a remote file system, else NULL. It's the type of the longest mount point
+  that the path (with the sysroot and the current directory if any) begins with, so a symlink to somewhere else isn't seen.
+*/
+static const char *pgfindlib_mount_type(struct pgfindlib_context *context, const char *directory)
+{
+  if (context->is_mounts_read == 0) pgfindlib_mounts_read(context);
+  char *path= context->combo;
+  path[0]= '\0';
+  if (context->sysroot != NULL) strcpy(path, context->sysroot);
+  else if ((directory[0] != '/') && (getcwd(path, PGFINDLIB_MAX_PATH_LENGTH) == NULL)) return NULL;
+  if (strlen(path) + 1 + strlen(directory) > sizeof(context->combo) - 1) return NULL;
+  if ((path[0] != '\0') && (directory[0] != '/')) strcat(path, "/");
+  strcat(path, directory);
+  const struct pgfindlib_mount *best_mount= NULL;
+  for (unsigned int m= 0; m < context->mounts_count; ++m)
   {
-#if (PGFINDLIB_COMMENT_MAX_INODE_COUNT_TOO_SMALL != 0)
-    pgfindlib_comment_in_row(warning_max_inode_count_is_too_small, PGFINDLIB_COMMENT_MAX_INODE_COUNT_TOO_SMALL, 0);
-    columns_list[columns_list_number++]= warning_max_inode_count_is_too_small;
-#endif
+    const struct pgfindlib_mount *mount= &context->mounts[m];
+    if ((best_mount != NULL) && (mount->mount_point_length < best_mount->mount_point_length)) continue;
+    if (strncmp(path, mount->mount_point, mount->mount_point_length) != 0) continue;
+    char after= path[mount->mount_point_length];
+    if ((after != '/') && (after != '\0')) continue; /* /mnt/nfs isn't a prefix of /mnt/nfs2 */
+    best_mount= mount; /* an equal length is a later mount over the earlier one */
   }
-  else
+  if ((best_mount == NULL) || (best_mount->is_remote == 0)) return NULL;
+  return best_mount->fs_type;
+}
+
+static int pgfindlib_directory_skip(struct pgfindlib_context *context, const char *directory, unsigned int tokener_number,
+                                    const char *comment)
+{
+  if (context->skipped_count == context->skipped_max)
   {
-    inode_list[*inode_count]= inode;
-    ++*inode_count;  
+    unsigned int new_max= context->skipped_max * 2 + 8;
+    struct pgfindlib_skipped_directory *new_skipped;
+    new_skipped= (struct pgfindlib_skipped_directory *)realloc(context->skipped, new_max * sizeof(struct pgfindlib_skipped_directory));
+    if (new_skipped == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+    context->skipped= new_skipped;
+    context->skipped_max= new_max;
   }
-  char comment_string[256]; /* todo: check: too small */ /* "LD_AUDIT" "LD_PRELOAD" etc. */
-  memcpy(comment_string, tokener_list_item.tokener_name, tokener_list_item.tokener_length);
-  comment_string[tokener_list_item.tokener_length]= '\0';
+  unsigned int directory_length= strlen(directory);
+  unsigned int comment_length= strlen(comment);
+  struct pgfindlib_skipped_directory *skipped= &context->skipped[context->skipped_count];
+  skipped->path= (char *)malloc(directory_length + comment_length + 2);
+  if (skipped->path == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  memcpy(skipped->path, directory, directory_length + 1);
+  memcpy(skipped->path + directory_length + 1, comment, comment_length + 1);
+  skipped->comment= skipped->path + directory_length + 1;
+  skipped->tokener_number= tokener_number;
+  ++context->skipped_count;
+  return PGFINDLIB_OK;
+}
 
-  columns_list[COLUMN_FOR_PATH]= line_copy;
-  columns_list[COLUMN_FOR_SOURCE]= comment_string;
+/*
+  What a thread that reads a remote directory or file shares with the call that waits for it, the first member of
+  struct pgfindlib_guarded_read and struct pgfindlib_guarded_probe. references starts at 2, one for the waiter and one
+  for the thread, and whichever lets go last frees the block: the waiter if the thread finished in time,
+  else the thread when it finishes, maybe never. So nothing the thread uses belongs to the call.
+*/
+struct pgfindlib_guard
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int is_done;
+  int references;
+  int sysroot_fd;           /* a dup() of context->sysroot_fd, which might be closed before the thread finishes */
+  const struct pgfindlib_backend *backend;
+  void (*free_rest)(struct pgfindlib_guard *guard); /* frees what the block points to, or NULL */
+};
 
-  return pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+static void pgfindlib_guard_init(struct pgfindlib_guard *guard, const struct pgfindlib_context *context)
+{
+  guard->is_done= 0;
+  guard->references= 2;
+  guard->sysroot_fd= (context->sysroot_fd >= 0) ? fcntl(context->sysroot_fd, F_DUPFD_CLOEXEC, 0) : -1;
+  guard->backend= context->backend;
+  guard->free_rest= NULL;
+  pthread_mutex_init(&guard->mutex, NULL);
+  pthread_condattr_t condattr;
+  pthread_condattr_init(&condattr);
+  pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+  pthread_cond_init(&guard->cond, &condattr);
+  pthread_condattr_destroy(&condattr);
+}
+
+static void pgfindlib_guard_release(struct pgfindlib_guard *guard)
+{
+  pthread_mutex_lock(&guard->mutex);
+  int references= --guard->references;
+  pthread_mutex_unlock(&guard->mutex);
+  if (references > 0) return;
+  pthread_mutex_destroy(&guard->mutex);
+  pthread_cond_destroy(&guard->cond);
+  if (guard->sysroot_fd >= 0) close(guard->sysroot_fd);
+  if (guard->free_rest != NULL) guard->free_rest(guard);
+  free(guard);
+}
+
+/* The thread's last act */
+static void pgfindlib_guard_done(struct pgfindlib_guard *guard)
+{
+  pthread_mutex_lock(&guard->mutex);
+  guard->is_done= 1;
+  pthread_cond_signal(&guard->cond);
+  pthread_mutex_unlock(&guard->mutex);
+  pgfindlib_guard_release(guard);
 }
 
 /*
-  Tokenize comments
-  [SELECT *]                   Possible future addition
-  [FROM source [, source ...]  There's a default if it's missing
-  [WHERE file [, file ...]     There's no default if it's missing but maybe there should be
-  [ORDER BY id]                Possible future addition
-  [LIMIT n]                    Possible future addition
-  Keywords can be any case, source and file are case sensitive.
-  Source and file can be enclosed in either ""s or ''s or ::s, which are stripped.
-    (Although ' and " look more natural, running main 'a b' will fail because argv strips them already,
-    so only : is reliable, say main ':a b:')
-  Source can be: LD_LIBRARY_PATH etc. (the standard sources) but anything not in standard sources is considered a path
-  Spaces are ignored, except that a keyword must be followed by at least one space
-  Only possible end-of-token marks are space and comma and \0
-  Possible errors:
-    ' or " without ending ' or "
-    , without following source name or file name
-    source name or file name is too long (max = 255)
-  End with _END
-    const char *tokener_name;
-    char tokener_length;
-    char tokener_comment_id;
-};
+  Return 1 if the deadline is past, so the directory or file is skipped. Else *fs_type is NULL if it's local,
+  or the remote file system's type, and *wait_ns is the budget or what's left before the deadline, whichever is less.
 */
-/* Compare for equality with an ascii keyword already lower case,  */
-int pgfindlib_keycmp(const char *a, unsigned int a_len, const char *b)
+static int pgfindlib_guard_wait_ns(struct pgfindlib_context *context, const char *path, const char **fs_type, long long *wait_ns)
 {
-  if (a_len != strlen(b)) return -1;
-  for (unsigned int i= 0; i < a_len; ++i)
-  {
-    if ((*a != *b) && (*a != (*b) - 32)) return -1;
-    ++a; ++b;
-  }
+  long long now= pgfindlib_now_ns();
+  *fs_type= NULL;
+  *wait_ns= 0;
+  if ((context->deadline_ns != 0) && (now >= context->deadline_ns)) return 1;
+  *fs_type= pgfindlib_mount_type(context, path);
+  if (*fs_type == NULL) return 0;
+  *wait_ns= context->directory_budget_ns;
+  if ((context->deadline_ns != 0) && ((*wait_ns == 0) || (context->deadline_ns - now < *wait_ns))) *wait_ns= context->deadline_ns - now;
   return 0;
 }
-int pgfindlib_tokenize(const char *statement, struct tokener tokener_list[],
-                       unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count,
-                       char *buffer, unsigned int *buffer_length, unsigned buffer_max_length)
-{
-  const char *p= statement;
-  const char *p_next;
-  unsigned int token_number= 0;
 
-  if (p == NULL)
+/* Start thread_function on a detached thread and wait. Return 1 if it didn't finish in time, and then it's abandoned. */
+static int pgfindlib_guard_run(struct pgfindlib_guard *guard, void *(*thread_function)(void *), long long wait_ns)
+{
+  long long until_ns= pgfindlib_now_ns() + wait_ns;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_t thread;
+  int is_thread= (pthread_create(&thread, &attr, thread_function, guard) == 0);
+  pthread_attr_destroy(&attr);
+  if (!is_thread) thread_function(guard); /* no thread, so it's done here without a time limit */
+  struct timespec until;
+  until.tv_sec= until_ns / 1000000000LL;
+  until.tv_nsec= until_ns % 1000000000LL;
+  pthread_mutex_lock(&guard->mutex);
+  while (guard->is_done == 0)
   {
-    pgfindlib_comment_is_row("Syntax error. Statement is NULL", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_STATEMENT_IS_NULL,
-                            buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-    return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+    if (pthread_cond_timedwait(&guard->cond, &guard->mutex, &until) == ETIMEDOUT) break;
   }
-  const char *statement_end= p + strlen(p);
-  for (;;)
+  int is_timed_out= (guard->is_done == 0);
+  pthread_mutex_unlock(&guard->mutex);
+  return is_timed_out;
+}
+
+/* What a thread that reads a remote directory makes. entries are d_ino, d_type, and d_name with its \0, for each regular file or symbolic link. */
+struct pgfindlib_guarded_read
+{
+  struct pgfindlib_guard guard;
+  int is_directory;
+  char *entries; unsigned int entries_length; unsigned int entries_max;
+  char directory[1];        /* the rest of the malloc */
+};
+
+static void pgfindlib_guarded_read_free_rest(struct pgfindlib_guard *guard)
+{
+  struct pgfindlib_guarded_read *g= (struct pgfindlib_guarded_read *)guard;
+  if (g->entries != NULL) free(g->entries);
+}
+
+static void *pgfindlib_guarded_read_thread(void *arg)
+{
+  struct pgfindlib_guarded_read *g= (struct pgfindlib_guarded_read *)arg;
+  const struct pgfindlib_backend *backend= g->guard.backend;
+  struct stat sb;
+  if ((pgfindlib_stat(backend, g->guard.sysroot_fd, g->directory, &sb, 0) == 0) && (S_ISDIR(sb.st_mode)))
   {
-    if (p > statement_end)
-    {
-      pgfindlib_comment_is_row("Syntax error. p > statement end", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_P_GREATER_STATEMENT_END,
-                            buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-      return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
-    }
-    if (*p == ' ') { ++p; continue; }
-    else if (*p == '\0') break;
-    else if ((*p == '"') || (*p == 0x27) || (*p == ':')) /* if " or ' then skip to next " or ' */
+    g->is_directory= 1;
+    int fd= pgfindlib_open(backend, g->guard.sysroot_fd, g->directory, O_RDONLY | O_DIRECTORY);
+    void *dir= (fd == -1) ? NULL : backend->opendir(backend->state, fd);
+    const struct pgfindlib_backend_entry *dirent;
+    while ((dir != NULL) && ((dirent= backend->readdir(backend->state, dir)) != NULL))
     {
-      p_next= strchr(p + 1, *p);
-      if (p_next == NULL)
+      unsigned char d_type= dirent->d_type;
+      ino_t d_ino= dirent->d_ino;
+      if (d_type == DT_UNKNOWN)
       {
-        pgfindlib_comment_is_row("Syntax error. Quote without end quote", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_QUOTE_WITHOUT_END_QUOTE,
-                                 buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-        return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
+        struct stat entry_sb;
+        if (backend->fstatat(backend->state, fd, dirent->d_name, &entry_sb) == -1) continue;
+        if (S_ISREG(entry_sb.st_mode)) d_type= DT_REG;
+        else if (S_ISLNK(entry_sb.st_mode)) d_type= DT_LNK;
       }
-    }
-    else if (*p == ',')
-      p_next= p + 1;
-    else
-    {
-      p_next= p + 1;
-      for (;;)
+      if ((d_type != DT_REG) && (d_type != DT_LNK)) continue;
+      unsigned int name_length= strlen(dirent->d_name) + 1;
+      unsigned int entry_length= sizeof(ino_t) + 1 + name_length;
+      if (g->entries_length + entry_length > g->entries_max)
       {
-        if ((*p_next == ' ') || (*p_next == ',') || (*p_next == '\0')) break;
-        ++p_next;
+        unsigned int new_max= g->entries_max * 2 + entry_length + 4096;
+        char *new_entries= (char *)realloc(g->entries, new_max);
+        if (new_entries == NULL) break;
+        g->entries= new_entries;
+        g->entries_max= new_max;
       }
+      memcpy(g->entries + g->entries_length, &d_ino, sizeof(ino_t));
+      g->entries[g->entries_length + sizeof(ino_t)]= (char) d_type;
+      memcpy(g->entries + g->entries_length + sizeof(ino_t) + 1, dirent->d_name, name_length);
+      g->entries_length+= entry_length;
     }
-    tokener_list[token_number].tokener_name= p;
-    tokener_list[token_number].tokener_length= p_next - p;
-    if (tokener_list[token_number].tokener_length >= PGFINDLIB_MAX_TOKEN_LENGTH)
-    {
-      pgfindlib_comment_is_row("Syntax error. Token too long", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_TOKEN_TOO_LONG,
-                               buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-      return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
-    }
-    ++token_number;
-    if (token_number >= PGFINDLIB_MAX_TOKENS_COUNT)
-    {
-      pgfindlib_comment_is_row("Syntax error. Too many tokens", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_TOO_MANY_TOKENS,
-                               buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-      return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
-    }
-    if (*p_next == '\0') break;
-    if (*p_next == ',')
+    if (dir != NULL) backend->closedir(backend->state, dir);
+  }
+  pgfindlib_guard_done(&g->guard);
+  return NULL;
+}
+
+/*
+  pgfindlib_directory_scan() when there's a deadline or a budget. *is_done= 0 means it's a local directory, read as usual.
+  Else it's skipped if the deadline is past, and if it's on a remote file system it's read by a thread of its own,
+  with a wait of at most the budget or what's left before the deadline. If that's not enough it's skipped too,
+  and the thread is left to finish (or not) and free what it has. A skipped directory gets a 063 row from pgfindlib_rows_skipped().
+  The candidates aren't in context->scanned, reading the same remote directory twice is rare.
+*/
+int pgfindlib_directory_scan_guarded(const char *directory, unsigned int tokener_number, struct pgfindlib_where_matcher *matcher,
+                                     char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                     struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
+                                     struct pgfindlib_context *context, int *is_done)
+{
+  int rval= PGFINDLIB_OK;
+  *is_done= 1;
+  for (unsigned int s= 0; s < context->skipped_count; ++s)
+  {
+    if (strcmp(context->skipped[s].path, directory) == 0) return PGFINDLIB_OK; /* e.g. phase 1 is repeating after malloc overflow */
+  }
+  const char *fs_type;
+  long long wait_ns;
+  if (pgfindlib_guard_wait_ns(context, directory, &fs_type, &wait_ns) != 0)
+    return pgfindlib_directory_skip(context, directory, tokener_number, "skipped, past the deadline");
+  if (fs_type == NULL) { *is_done= 0; return PGFINDLIB_OK; }
+  unsigned int directory_length= strlen(directory);
+  struct pgfindlib_guarded_read *g= (struct pgfindlib_guarded_read *)malloc(sizeof(struct pgfindlib_guarded_read) + directory_length);
+  if (g == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  memcpy(g->directory, directory, directory_length + 1);
+  g->is_directory= 0;
+  g->entries= NULL; g->entries_length= 0; g->entries_max= 0;
+  pgfindlib_guard_init(&g->guard, context);
+  g->guard.free_rest= pgfindlib_guarded_read_free_rest;
+  if (pgfindlib_guard_run(&g->guard, pgfindlib_guarded_read_thread, wait_ns))
+  {
+    pgfindlib_guard_release(&g->guard);
+    char comment[128];
+    sprintf(comment, "skipped, %.32s, no answer in %lld ms", fs_type, wait_ns / 1000000);
+    return pgfindlib_directory_skip(context, directory, tokener_number, comment);
+  }
+  char *combo= context->combo;
+  unsigned int directory_number= 0;
+  int is_directory_added= 0;
+  for (unsigned int offset= 0; offset < g->entries_length;)
+  {
+    ino_t d_ino;
+    memcpy(&d_ino, g->entries + offset, sizeof(ino_t));
+    unsigned char d_type= (unsigned char) g->entries[offset + sizeof(ino_t)];
+    const char *d_name= g->entries + offset + sizeof(ino_t) + 1;
+    offset+= sizeof(ino_t) + 1 + strlen(d_name) + 1;
+    if (pgfindlib_find_line_in_statement(matcher, d_name) == 0) continue; /* doesn't match requirement */
+    if (is_directory_added == 0)
     {
-      tokener_list[token_number].tokener_name= p_next;
-      tokener_list[token_number].tokener_length= 1;
-      ++token_number;
-      if (token_number >= PGFINDLIB_MAX_TOKENS_COUNT)
-      {
-        pgfindlib_comment_is_row("Syntax error. Comma without item", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_COMMA_WITHOUT_ITEM,
-                                 buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-        return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
-      }
+      strcpy(combo, directory);
+      strcat(combo, "/");
+      rval= pgfindlib_candidate_directory(context, combo, strlen(combo),
+                                          malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length, &directory_number);
+      if (rval != PGFINDLIB_OK) break;
+      is_directory_added= 1;
     }
-    p= p_next + 1;
+    rval= pgfindlib_add_candidate(directory_number, d_name, tokener_number, d_ino, d_type,
+                                  malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                  malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
+    if (rval != PGFINDLIB_OK) break;
   }
-  /* tokener_list[token_number].tokener_name= "END!"; */
-  /* tokener_list[token_number].tokener_length= 4; */
-  tokener_list[token_number].tokener_comment_id= PGFINDLIB_TOKEN_END;
-  unsigned int current_clause= 0;
-  unsigned int from_count= 0;
-  unsigned int where_count= 0; 
-  for (int i= 0; tokener_list[i].tokener_comment_id != PGFINDLIB_TOKEN_END; ++i)
+  pgfindlib_guard_release(&g->guard);
+  return rval;
+}
+
+/*
+  What a thread that probes a file on a remote file system makes for pgfindlib_file_guarded(): the answers to
+  access(), lstat() and the ELF header read, whichever are wanted. The machine check isn't here, it needs the call's options.
+*/
+struct pgfindlib_guarded_probe
+{
+  struct pgfindlib_guard guard;
+  unsigned int wanted;      /* PGFINDLIB_FACT_... */
+  int is_build_id_wanted;
+  int is_access_failed;
+  int is_lstat_failed;
+  struct stat sb;
+  int header_rval;          /* pgfindlib_read_elf_header()'s, or PGFINDLIB_COMMENT_ELF_OPEN_FAILED */
+  unsigned char elf_class;
+  unsigned int e_machine;
+  struct pgfindlib_build_id build_id;
+  char path[1];             /* the rest of the malloc */
+};
+
+static void *pgfindlib_guarded_probe_thread(void *arg)
+{
+  struct pgfindlib_guarded_probe *g= (struct pgfindlib_guarded_probe *)arg;
+  const struct pgfindlib_backend *backend= g->guard.backend;
+  int sysroot_fd= g->guard.sysroot_fd;
+  if ((g->wanted & PGFINDLIB_FACT_ACCESS) != 0)
+    g->is_access_failed= (pgfindlib_access(backend, sysroot_fd, g->path, R_OK) != 0);
+  if ((g->wanted & PGFINDLIB_FACT_LSTAT) != 0)
+    g->is_lstat_failed= (pgfindlib_stat(backend, sysroot_fd, g->path, &g->sb, 1) == -1);
+  if ((g->wanted & (PGFINDLIB_FACT_ELF | PGFINDLIB_FACT_BUILD_ID)) != 0)
   {
-    if (pgfindlib_keycmp(tokener_list[i].tokener_name, tokener_list[i].tokener_length, "from") == 0)
+    g->header_rval= PGFINDLIB_COMMENT_ELF_OPEN_FAILED;
+    int file_fd= pgfindlib_open(backend, sysroot_fd, g->path, O_RDONLY);
+    FILE *fd= (file_fd == -1) ? NULL : backend->fdopen(backend->state, file_fd);
+    if ((fd == NULL) && (file_fd != -1)) backend->close(backend->state, file_fd);
+    if (fd != NULL)
     {
-      if (current_clause != 0)
-      {
-        pgfindlib_comment_is_row("Syntax error. FROM out of order", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_FROM_OUT_OF_ORDER,
-                                 buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-        return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
-      }
-      tokener_list[i].tokener_comment_id= PGFINDLIB_TOKEN_FROM;
-      current_clause= PGFINDLIB_TOKEN_FROM;
-      ++from_count;
+      ElfW(Ehdr) elf_header;
+      memset(&elf_header, 0, sizeof(elf_header));
+      g->header_rval= pgfindlib_read_elf_header(fd, &elf_header, &g->elf_class, &g->e_machine,
+                                                (g->is_build_id_wanted) ? &g->build_id : NULL, NULL);
+      fclose(fd);
     }
-    else if (pgfindlib_keycmp(tokener_list[i].tokener_name, tokener_list[i].tokener_length, "where") == 0)
+  }
+  pgfindlib_guard_done(&g->guard);
+  return NULL;
+}
+
+/*
+  pgfindlib_file()'s access(), lstat() and ELF header read when there's a deadline or a budget, so that a file on a
+  remote file system that doesn't answer can't hold up the call any more than a directory can. wanted is the
+  PGFINDLIB_FACT_... bits that facts doesn't have yet, elf_reason is PGFINDLIB_REASON_SO_CHECK or PGFINDLIB_REASON_SO_IDENTIFY.
+  If the file is local nothing is done. If it's remote they're done by a thread of its own, as for a directory,
+  and facts gets the answers, so pgfindlib_file() treats them as known. If the deadline is past or there's no answer in time,
+  comment gets e.g. "064 checks skipped, nfs4, no answer in 200 ms" and pgfindlib_file() makes the row without them.
+  ELF verdicts aren't shared with pgfindlib_batch() for these, the thread mustn't outlive the verdicts.
+*/
+int pgfindlib_file_guarded(struct pgfindlib_context *context, const char *path, unsigned int wanted, int elf_reason,
+                           int program_e_machine, struct pgfindlib_file_facts *facts, char *comment)
+{
+  const char *fs_type;
+  long long wait_ns;
+  if (pgfindlib_guard_wait_ns(context, path, &fs_type, &wait_ns) != 0)
+  {
+    sprintf(comment, "%03d checks skipped, past the deadline", PGFINDLIB_COMMENT_CHECKS_SKIPPED);
+    return PGFINDLIB_OK;
+  }
+  if (fs_type == NULL) return PGFINDLIB_OK;
+  unsigned int path_length= strlen(path);
+  struct pgfindlib_guarded_probe *g= (struct pgfindlib_guarded_probe *)malloc(sizeof(struct pgfindlib_guarded_probe) + path_length);
+  if (g == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  memcpy(g->path, path, path_length + 1);
+  g->wanted= wanted;
+  g->is_build_id_wanted= ((wanted & PGFINDLIB_FACT_BUILD_ID) != 0);
+  g->build_id.length= 0;
+  g->elf_class= 0;
+  g->e_machine= 0;
+  pgfindlib_guard_init(&g->guard, context);
+  if (pgfindlib_guard_run(&g->guard, pgfindlib_guarded_probe_thread, wait_ns))
+  {
+    pgfindlib_guard_release(&g->guard);
+    sprintf(comment, "%03d checks skipped, %.32s, no answer in %lld ms", PGFINDLIB_COMMENT_CHECKS_SKIPPED, fs_type, wait_ns / 1000000);
+    return PGFINDLIB_OK;
+  }
+  if ((wanted & PGFINDLIB_FACT_ACCESS) != 0) facts->is_access_failed= g->is_access_failed;
+  if ((wanted & PGFINDLIB_FACT_LSTAT) != 0)
+  {
+    facts->is_lstat_failed= g->is_lstat_failed;
+    facts->st_mode= g->sb.st_mode;
+    facts->st_dev= g->sb.st_dev;
+    facts->st_ino= g->sb.st_ino;
+  }
+  if ((wanted & (PGFINDLIB_FACT_ELF | PGFINDLIB_FACT_BUILD_ID)) != 0)
+  {
+    facts->elf_rval= g->header_rval;
+    if ((facts->elf_rval == PGFINDLIB_OK) && (elf_reason == PGFINDLIB_REASON_SO_CHECK))
+      facts->elf_rval= pgfindlib_elf_machine_check(context, program_e_machine, g->elf_class, g->e_machine);
+    facts->build_id= g->build_id;
+  }
+  facts->facts|= wanted;
+  pgfindlib_guard_release(&g->guard);
+  return PGFINDLIB_OK;
+}
+
+/* A 063 row for each directory that was skipped since the last call, e.g. "063 /mnt/nfs/lib skipped, nfs4, no answer in 200 ms" */
+int pgfindlib_rows_skipped(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                           unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count, const struct tokener tokener_list[])
+{
+  for (; context->skipped_reported_count < context->skipped_count; ++context->skipped_reported_count)
+  {
+    const struct pgfindlib_skipped_directory *skipped= &context->skipped[context->skipped_reported_count];
+    if (strlen(skipped->path) > PGFINDLIB_MAX_PATH_LENGTH) continue;
+    if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
+    const char *columns_list[MAX_COLUMNS_PER_ROW];
+    for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
+    char source_name[64];
+    unsigned int source_name_length= tokener_list[skipped->tokener_number].tokener_length;
+    if (source_name_length > 64 - 1) source_name_length= 64 - 1;
+    memcpy(source_name, tokener_list[skipped->tokener_number].tokener_name, source_name_length);
+    source_name[source_name_length]= '\0';
+    columns_list[COLUMN_FOR_SOURCE]= source_name;
+    char *comment= context->comment;
+    sprintf(comment, "%03d %s %.100s", PGFINDLIB_COMMENT_DIRECTORY_SKIPPED, skipped->path, skipped->comment);
+    columns_list[COLUMN_FOR_COMMENT_1]= comment;
+    int rval= pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+    if (rval != PGFINDLIB_OK) return rval;
+  }
+  return PGFINDLIB_OK;
+}
+#endif
+
+#if (PGFINDLIB_INCLUDE_ARCHITECTURES != 0)
+/* A name for a (class, machine) pair in comments, e.g. "elf64 x86-64", else with the numbers */
+static void pgfindlib_architecture_name(char *name, unsigned char elf_class, unsigned int e_machine)
+{
+  const char *machine_name= NULL;
+  if (e_machine == EM_386) machine_name= "i386";
+  else if (e_machine == EM_X86_64) machine_name= (elf_class == ELFCLASS32) ? "x32" : "x86-64";
+  else if (e_machine == EM_ARM) machine_name= "arm";
+  else if (e_machine == EM_AARCH64) machine_name= "aarch64";
+  else if (e_machine == EM_PPC) machine_name= "ppc";
+  else if (e_machine == EM_PPC64) machine_name= "ppc64";
+  else if (e_machine == EM_S390) machine_name= "s390";
+  else if (e_machine == EM_MIPS) machine_name= "mips";
+#ifdef EM_RISCV
+  else if (e_machine == EM_RISCV) machine_name= "riscv";
+#endif
+  if (machine_name != NULL) sprintf(name, "elf%d %s", (elf_class == ELFCLASS32) ? 32 : 64, machine_name);
+  else sprintf(name, "elf%d machine %u", (elf_class == ELFCLASS32) ? 32 : 64, e_machine);
+}
+
+/*
+  Return where the directory that candidate was found in is in its source's directory list (blanks don't count),
+  as pgfindlib_source_scan() split and expanded it, i.e. the order the loader would search in.
+  Rows are by path within a source, so this is what says /z comes before /a with LD_LIBRARY_PATH=/z:/a.
+  Return 0 for a source that isn't a directory list, e.g. ld.so.cache or loaded.
+*/
+static unsigned int pgfindlib_architecture_position(struct pgfindlib_context *context, const struct tokener tokener_list[],
+                                                    const char *malloc_buffer_1, const struct pgfindlib_candidate *candidate,
+                                                    const char *lib, const char *platform, const char *origin, const char *rpath, const char *runpath)
+{
+  const struct tokener *source= &tokener_list[candidate->source_number];
+  const char *librarylist= NULL;
+  if (source->tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_DT_RPATH) librarylist= rpath;
+  else if (source->tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_DT_RUNPATH) librarylist= runpath;
+  else if (source->tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_DEFAULT_PATHS) librarylist= "/lib:/lib64:/usr/lib:/usr/lib64";
+  else if (source->tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_NONSTANDARD) librarylist= source->tokener_name;
+  else if ((source->tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_LD_LIBRARY_PATH) || (source->tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_LD_RUN_PATH)
+        || (source->tokener_comment_id == PGFINDLIB_TOKEN_SOURCE_LD_PGFINDLIB_PATH))
+    librarylist= pgfindlib_getenv(context, source->tokener_name);
+  if (librarylist == NULL) return 0;
+  const struct pgfindlib_candidate_directory *directory= &context->candidate_directories[candidate->directory_number];
+  const char *prefix= malloc_buffer_1 + directory->offset;
+  char *element= context->combo; /* phase 1 is over so it's free */
+  unsigned int position= 0;
+  for (const char *p= librarylist; *p != '\0';)
+  {
+    unsigned int length= strcspn(p, ":;");
+    const char *start= p;
+    p+= length;
+    if (*p != '\0') ++p;
+    while ((length > 0) && (*start == ' ')) { ++start; --length; }
+    while ((length > 0) && (start[length - 1] == ' ')) --length;
+    if (length == 0) continue;
+    if (length > PGFINDLIB_MAX_PATH_LENGTH) { ++position; continue; }
+    memcpy(element, start, length);
+    element[length]= '\0';
+    unsigned int replacements_count;
+    if (pgfindlib_replace_lib_or_platform_or_origin(element, &replacements_count, lib, platform, origin, context) == PGFINDLIB_OK)
     {
-      if ((current_clause != 0) && (current_clause != PGFINDLIB_TOKEN_FROM))
-      {
-        pgfindlib_comment_is_row("Syntax error. WHERE out of order", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_WHERE_OUT_OF_ORDER,
-                                 buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-        return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
-      }
-      tokener_list[i].tokener_comment_id= PGFINDLIB_COMMENT_STATEMENT_SYNTAX_WHERE_OUT_OF_ORDER;
-      current_clause= PGFINDLIB_TOKEN_WHERE;
-      ++where_count;
+      length= strlen(element);
+      if ((length + 1 == directory->length) && (memcmp(element, prefix, length) == 0)) return position;
     }
-    else if (tokener_list[i].tokener_name[0] == ',')
-      tokener_list[i].tokener_comment_id= PGFINDLIB_TOKEN_COMMA;
-    else
+    ++position;
+  }
+  return position; /* not in the list, so after it */
+}
+
+/*
+  options->architectures: after the usual rows, for each requested (class, machine) and each exact (non-glob) WHERE item,
+  a row with the candidate that a loader would take among those that have that file name and that class and machine,
+  i.e. the first by source, then by the directory's position in the source's list (not the row order, which is by path),
+  then by row order, and "022 elf32 i386 view libz.so.1" (or "... not found"). That's what a program
+  of that architecture would get from the same sources, as with the 017 rows of PGFINDLIB_OPTION_PROBE_COST.
+  It's one pass over the candidates that phase 1 already found, and each candidate's ELF header is read at most once
+  whatever the number of views. The sources were expanded once, with this program's $LIB and $PLATFORM and ld.so.cache.
+*/
+static int pgfindlib_architecture_views(struct pgfindlib_context *context, char *buffer, unsigned int *buffer_length, unsigned int buffer_max_length,
+                                        unsigned int *row_number, ino_t inode_list[], unsigned int *inode_count,
+                                        const struct tokener tokener_list[], const char *malloc_buffer_1,
+                                        const struct pgfindlib_candidate *candidates, unsigned int candidates_count,
+                                        const char *lib, const char *platform, const char *origin, const char *rpath, const char *runpath)
+{
+  int rval= PGFINDLIB_OK;
+  /* per candidate: 0 = not read yet, 1 = read and it's ELF, 2 = read and it isn't */
+  struct pgfindlib_candidate_elf { unsigned char state; unsigned char elf_class; unsigned int e_machine; };
+  struct pgfindlib_candidate_elf *elf_list= (struct pgfindlib_candidate_elf *)calloc(candidates_count + 1, sizeof(struct pgfindlib_candidate_elf));
+  if (elf_list == NULL) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  char *soname= context->orig_one_library_or_file; /* phase 1 is over so these are free */
+  char *path= context->one_library_or_file;
+  for (unsigned int a= 0; a < context->architectures_count; ++a)
+  {
+    const struct pgfindlib_architecture *architecture= &context->architectures[a];
+    for (unsigned int w= 0; tokener_list[w].tokener_comment_id != PGFINDLIB_TOKEN_END; ++w)
     {
-      if (current_clause == PGFINDLIB_TOKEN_FROM)
+      if (tokener_list[w].tokener_comment_id != PGFINDLIB_TOKEN_FILE) continue;
+      if (tokener_list[w].tokener_length > PGFINDLIB_MAX_PATH_LENGTH) continue;
+      memcpy(soname, tokener_list[w].tokener_name, tokener_list[w].tokener_length);
+      soname[tokener_list[w].tokener_length]= '\0';
+      if (strpbrk(soname, "*?[{\\/'\"") != NULL) continue; /* a glob isn't a name a loader would look for */
+      int winner= -1;
+      unsigned int winner_position= 0;
+      for (unsigned int i= 0; i < candidates_count; ++i)
       {
-        for (int k= 0; ; ++k)
+        if ((winner != -1) && (candidates[i].source_number != candidates[winner].source_number)) break; /* sorted by source first */
+        const char *file_part= malloc_buffer_1 + candidates[i].name_offset;
+        unsigned int length= strcspn(file_part, "\n"); /* ldconfig -p lines still end with \n */
+        if ((length != (unsigned int) tokener_list[w].tokener_length) || (memcmp(file_part, soname, length) != 0)) continue;
+        if (elf_list[i].state == 0)
         {
-          const char *c= pgfindlib_standard_source_array[k];
-          if (strcmp(c, "") == 0) break;
-          tokener_list[i].tokener_comment_id= PGFINDLIB_TOKEN_SOURCE_NONSTANDARD;
-          if ((strlen(c) == (unsigned int) tokener_list[i].tokener_length) && (memcmp(c, tokener_list[i].tokener_name, tokener_list[i].tokener_length) == 0))
-          {
-            tokener_list[i].tokener_comment_id= pgfindlib_standard_source_array_n[k];
-            break;
-          }
+          elf_list[i].state= 2;
+          if (pgfindlib_candidate_path(context, malloc_buffer_1, &candidates[i], path, PGFINDLIB_MAX_PATH_LENGTH + 1) != PGFINDLIB_OK) continue;
+          path[strcspn(path, "\n")]= '\0';
+          if (pgfindlib_read_elf(tokener_list, path, PGFINDLIB_REASON_SO_IDENTIFY, 0, NULL,
+                                 &elf_list[i].elf_class, &elf_list[i].e_machine, NULL) == PGFINDLIB_OK)
+            elf_list[i].state= 1;
         }
+        if ((elf_list[i].state != 1) || (elf_list[i].elf_class != architecture->elf_class) || (elf_list[i].e_machine != architecture->e_machine))
+          continue;
+        unsigned int position= pgfindlib_architecture_position(context, tokener_list, malloc_buffer_1, &candidates[i], lib, platform, origin, rpath, runpath);
+        if ((winner == -1) || (position < winner_position)) { winner= i; winner_position= position; }
       }
-      else if (current_clause == PGFINDLIB_TOKEN_WHERE)
+      const char *columns_list[MAX_COLUMNS_PER_ROW];
+      for (int i= 0; i < MAX_COLUMNS_PER_ROW; ++i) columns_list[i]= "";
+      char *source_name= context->source_name;
+      source_name[0]= '\0';
+      path[0]= '\0';
+      if (winner != -1)
       {
-        tokener_list[i].tokener_comment_id= PGFINDLIB_TOKEN_FILE;
+        pgfindlib_candidate_path(context, malloc_buffer_1, &candidates[winner], path, PGFINDLIB_MAX_PATH_LENGTH + 1); /* it fit before */
+        path[strcspn(path, "\n")]= '\0';
+        const struct tokener *source= &tokener_list[candidates[winner].source_number];
+        memcpy(source_name, source->tokener_name, source->tokener_length);
+        source_name[source->tokener_length]= '\0';
       }
-      else /* presumably an error */
-        tokener_list[i].tokener_comment_id= PGFINDLIB_TOKEN_UNKNOWN;
+      char architecture_name[64];
+      pgfindlib_architecture_name(architecture_name, architecture->elf_class, architecture->e_machine);
+      char *comment= context->comment;
+      sprintf(comment, "%03d %s view %s%s", PGFINDLIB_COMMENT_ARCHITECTURE_VIEW, architecture_name, soname,
+              (winner == -1) ? " not found" : "");
+      columns_list[COLUMN_FOR_PATH]= path;
+      columns_list[COLUMN_FOR_SOURCE]= source_name;
+      columns_list[COLUMN_FOR_COMMENT_1]= comment;
+      if (*inode_count != PGFINDLIB_MAX_INODE_COUNT) { inode_list[*inode_count]= -1; ++*inode_count; }
+      rval= pgfindlib_row_bottom_level(buffer, buffer_length, buffer_max_length, row_number, columns_list);
+      if (rval != PGFINDLIB_OK) goto free_and_return;
     }
   }
-  /* If there was no FROM, make a list from standard sources and put it at end.
-     (Later the eval doesn't care if FROM is after WHERE, though arbitrarily it's a syntax error if user inputs thus.) */
-  if (from_count == 0)
+free_and_return:
+  free(elf_list);
+  return rval;
+}
+#endif
+
+#if (PGFINDLIB_SYSROOT != 0)
+/*
+  Add the ld.so.cache entries of sysroot/etc/ld.so.cache that match WHERE, read directly because
+  the host's ldconfig -p would show the host's cache (and might not know the image's format).
+  This is glibc's format since 2.32, also the format after the old one in caches from glibc 2.31 or earlier.
+  String offsets are from the start of the new-format header. Every entry is added whatever its hwcap and flags,
+  as ldconfig -p would show it. Return PGFINDLIB_ERROR_NOT_FOUND if there's no cache that can be read.
+*/
+static int pgfindlib_so_cache_file(struct pgfindlib_context *context, struct pgfindlib_where_matcher *matcher, int tokener_number,
+                                   char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                   struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length)
+{
+  int rval= PGFINDLIB_ERROR_NOT_FOUND;
+  const struct pgfindlib_backend *backend= context->backend;
+  int fd= pgfindlib_open(backend, context->sysroot_fd, "/etc/ld.so.cache", O_RDONLY);
+  if (fd == -1) return PGFINDLIB_ERROR_NOT_FOUND;
+  struct stat sb;
+  char *cache= NULL;
+  FILE *fp= NULL;
+  if ((backend->fstat(backend->state, fd, &sb) == -1) || (sb.st_size < 48) || (sb.st_size > 256 * 1024 * 1024)) goto close_and_return;
+  size_t cache_size= (size_t) sb.st_size;
+  cache= (char *)malloc(cache_size + 1);
+  if (cache == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto close_and_return; }
+  fp= backend->fdopen(backend->state, fd);
+  if ((fp == NULL) || (fread(cache, 1, cache_size, fp) != cache_size)) goto close_and_return;
+  cache[cache_size]= '\0'; /* so the last string ends */
+  size_t new_offset= 0;
+  if (memcmp(cache, "ld.so-1.7.0", 11) == 0) /* old format: 12-byte header, 12-byte entries, then maybe the new format */
   {
-    /* token_number should still be at end, which will be overwritten */
-    for (int i= 0; pgfindlib_standard_source_array_n[i] != 0; ++i)
-    {
-      if (token_number >= PGFINDLIB_MAX_TOKENS_COUNT - 1)
-      {
-        pgfindlib_comment_is_row("Syntax error. Too many tokens when adding default", PGFINDLIB_COMMENT_STATEMENT_SYNTAX_TOO_MANY_TOKENS_WHEN_ADDING_DEFAULT,
-        buffer, buffer_length, buffer_max_length, row_number, inode_list, inode_count);
-        return PGFINDLIB_ERROR_STATEMENT_SYNTAX;
-      }
-      tokener_list[token_number].tokener_name= pgfindlib_standard_source_array[i];
-      tokener_list[token_number].tokener_length= strlen(pgfindlib_standard_source_array[i]);
-      tokener_list[token_number].tokener_comment_id= pgfindlib_standard_source_array_n[i];
-      ++token_number;
-    }
-    tokener_list[token_number].tokener_comment_id= PGFINDLIB_TOKEN_END;
+    unsigned int old_count;
+    memcpy(&old_count, cache + 12, 4);
+    new_offset= 16 + (size_t) old_count * 12;
+    new_offset= (new_offset + 7) & ~(size_t) 7; /* glibc's ALIGN_CACHE */
   }
-  for (int i= 0;; ++i)
+  if ((new_offset + 48 > cache_size) || (memcmp(cache + new_offset, "glibc-ld.so.cache1.1", 20) != 0)) goto close_and_return;
+  unsigned int entries_count;
+  memcpy(&entries_count, cache + new_offset + 20, 4);
+  if (entries_count > (cache_size - new_offset - 48) / 24) goto close_and_return;
+  const char *strings= cache + new_offset;
+  rval= PGFINDLIB_OK;
+  for (unsigned int i= 0; i < entries_count; ++i)
   {
-    /* char token_x[256]; */
-    if (tokener_list[i].tokener_comment_id == PGFINDLIB_TOKEN_END) break;
+    const char *entry= cache + new_offset + 48 + (size_t) i * 24; /* int32 flags, uint32 key, uint32 value, uint32 unused, uint64 hwcap */
+    unsigned int key, value;
+    memcpy(&key, entry + 4, 4);
+    memcpy(&value, entry + 8, 4);
+    if ((key >= cache_size - new_offset) || (value >= cache_size - new_offset)) continue;
+    if (pgfindlib_find_line_in_statement(matcher, strings + key) == 0) continue; /* doesn't match requirement */
+    rval= pgfindlib_add_to_malloc_buffers(context, strings + value, tokener_number,
+                                          malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                          malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
+    if (rval != PGFINDLIB_OK) break;
   }
-  return PGFINDLIB_OK;
+close_and_return:
+  if (cache != NULL) free(cache);
+  if (fp != NULL) fclose(fp);
+  else backend->close(backend->state, fd);
+  return rval;
 }
 
-#if (PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE != 0)
-int pgfindlib_so_cache(const struct tokener tokener_list[], int tokener_number,
-                       char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
-                       char **malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length)
+#define PGFINDLIB_MAX_LD_SO_CONF_DEPTH 4
+
+/* For qsort() of char * */
+static int pgfindlib_string_compare(const void *p1, const void *p2)
+{
+  return strcmp(*(const char *const *) p1, *(const char *const *) p2);
+}
+
+/*
+  For the ld.so.cache source in a sysroot that has no usable cache: the directories of sysroot/etc/ld.so.conf,
+  which is what ldconfig would put in the cache. "include" lines are followed (relative ones are relative to /etc,
+  a * or ? or [ is allowed in the file name part only), "hwcap" lines are skipped.
+  conf_path is in the sysroot.
+*/
+static int pgfindlib_ld_so_conf(struct pgfindlib_context *context, const char *conf_path, unsigned int depth,
+                                struct pgfindlib_where_matcher *matcher, int tokener_number,
+                                char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length)
 {
+  if (depth > PGFINDLIB_MAX_LD_SO_CONF_DEPTH) return PGFINDLIB_OK;
+  const struct pgfindlib_backend *backend= context->backend;
+  int fd= pgfindlib_open(backend, context->sysroot_fd, conf_path, O_RDONLY);
+  if (fd == -1) return PGFINDLIB_OK;
+  FILE *fp= backend->fdopen(backend->state, fd);
+  if (fp == NULL) { backend->close(backend->state, fd); return PGFINDLIB_OK; }
   int rval= PGFINDLIB_OK;
-  const char *ldconfig; /* must be able to access ldconfig in some standard directory or user's path */
-  for (int i= 0; i <= 5; ++i)
-  {
-    if (i == 0) ldconfig= "/sbin/ldconfig";
-    else if (i == 1) ldconfig= "/usr/sbin/ldconfig";
-    else if (i == 2) ldconfig= "/bin/ldconfig";
-    else if (i == 3) ldconfig= "/usr/bin/ldconfig";
-    else if (i == 4) ldconfig= "ldconfig";
-    else if (i == 5) { ldconfig= NULL; break; }
-    if (access(ldconfig, X_OK) == 0) break;
-  }
+  char *line= (char *)malloc(PGFINDLIB_MAX_PATH_LENGTH * 2 + 2);
+  char *pattern= (char *)malloc(PGFINDLIB_MAX_PATH_LENGTH * 2 + 2);
+  if ((line == NULL) || (pattern == NULL)) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; goto close_and_return; }
+  while (fgets(line, PGFINDLIB_MAX_PATH_LENGTH * 2 + 2, fp) != NULL)
   {
-    /* Assume library is whatever's between first and last / on a line */
-    /* Line 1 is probably "[n] libs found in cache `/etc/ld.so.cache'" */
-    /* First ldconfig attempt will be Linux-style ldconfig -p, second will be FreeBSD-style ldconfig -r */
-    int counter= 0;
-    for (int ldconfig_attempts= 0; ldconfig_attempts < 2; ++ldconfig_attempts)
+    line[strcspn(line, "#\n")]= '\0';
+    char *p= line + strspn(line, " \t");
+    if (strncmp(p, "hwcap", 5) == 0) continue;
+    if ((strncmp(p, "include", 7) == 0) && ((p[7] == ' ') || (p[7] == '\t')))
     {
-      char ld_so_cache_line[PGFINDLIB_MAX_PATH_LENGTH * 5];
-      char popen_arg[PGFINDLIB_MAX_PATH_LENGTH];
-      if (ldconfig_attempts == 0) sprintf(popen_arg, "LD_LIBRARY_PATH= LD_DEBUG= LD_PRELOAD= %s -p 2>/dev/null ", ldconfig);
-      else sprintf(popen_arg, "%s -r 2>/dev/null ", ldconfig);
-      counter= 0;
-      FILE *fp;
-      fp= popen(popen_arg, "r");
-      if (fp != NULL) /* popen failure unlikely even if ldconfig not found */
+      p+= 7 + strspn(p + 7, " \t");
+      p[strcspn(p, " \t")]= '\0';
+      if (*p == '/') strcpy(pattern, p);
+      else sprintf(pattern, "/etc/%s", p);
+      char *slash= strrchr(pattern, '/');
+      *slash= '\0';
+      const char *name_pattern= slash + 1;
+      int directory_fd= pgfindlib_open(backend, context->sysroot_fd, (pattern[0] == '\0') ? "/" : pattern, O_RDONLY | O_DIRECTORY);
+      if (directory_fd == -1) continue;
+      void *dir= backend->opendir(backend->state, directory_fd);
+      if (dir == NULL) continue;
+      /* glob() would sort, and would follow symlinks out of the sysroot, so read the directory and sort the names here */
+      unsigned int names_count= 0, names_max= 0;
+      char **names= NULL;
+      const struct pgfindlib_backend_entry *dirent;
+      while ((dirent= backend->readdir(backend->state, dir)) != NULL)
       {
-        while (fgets(ld_so_cache_line, sizeof(ld_so_cache_line), fp) != NULL)
+        if ((dirent->d_name[0] == '.') || (fnmatch(name_pattern, dirent->d_name, 0) != 0)) continue;
+        if (names_count == names_max)
         {
-          ++counter;
-          char *pointer_to_ld_so_cache_line= ld_so_cache_line + strlen(ld_so_cache_line);
-          for (;;)
-          {
-            if (*pointer_to_ld_so_cache_line == '/') break;
-            if (pointer_to_ld_so_cache_line <= ld_so_cache_line) break;
-            --pointer_to_ld_so_cache_line;
-          }
-          if (pointer_to_ld_so_cache_line == ld_so_cache_line) continue; /* blank line */
-          ++pointer_to_ld_so_cache_line; /* So pointer is just after the final / which should be at the file name */
-          if (pgfindlib_find_line_in_statement(tokener_list, pointer_to_ld_so_cache_line) == 0) continue;/* doesn't match requirement */
-          char *address= strchr(ld_so_cache_line,'/');
-          if (address != NULL)
-          {
-            rval= pgfindlib_add_to_malloc_buffers(address, tokener_number,
-                                                  malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
-                                                  malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
-            if (rval != PGFINDLIB_OK)
-            {
-              pclose(fp);
-              return rval;
-            }
-          }
+          char **new_names= (char **)realloc(names, (names_max * 2 + 16) * sizeof(char *));
+          if (new_names == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; break; }
+          names= new_names;
+          names_max= names_max * 2 + 16;
         }
-        pclose(fp);
+        names[names_count]= strdup(dirent->d_name);
+        if (names[names_count] == NULL) { rval= PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW; break; }
+        ++names_count;
       }
-      if (counter > 0) break; /* So if ldconfig -p succeeds, don't try ldconfig -r */
+      backend->closedir(backend->state, dir);
+      if (names_count > 1) qsort(names, names_count, sizeof(char *), pgfindlib_string_compare);
+      for (unsigned int i= 0; i < names_count; ++i)
+      {
+        unsigned int pattern_length= strlen(pattern);
+        unsigned int name_length= strlen(names[i]);
+        if ((rval == PGFINDLIB_OK) && (pattern_length + name_length + 1 <= PGFINDLIB_MAX_PATH_LENGTH * 2))
+        {
+          memcpy(line, pattern, pattern_length);
+          line[pattern_length]= '/';
+          memcpy(line + pattern_length + 1, names[i], name_length + 1);
+          rval= pgfindlib_ld_so_conf(context, line, depth + 1, matcher, tokener_number,
+                                     malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                     malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
+        }
+        free(names[i]);
+      }
+      if (names != NULL) free(names);
+      if (rval != PGFINDLIB_OK) goto close_and_return;
+      continue;
     }
-#ifdef OBSOLETE
-#if (PGFINDLIB_COMMENT_LDCONFIG_FAILED != 0)
-    if (counter == 0)
+    /* directories, separated by spaces or tabs or colons or commas as ldconfig allows */
+    char *save_pointer;
+    for (char *directory= strtok_r(p, " \t:,", &save_pointer); directory != NULL; directory= strtok_r(NULL, " \t:,", &save_pointer))
     {
-      char comment[256];
-      sprintf(comment, "%s -p or %s -r failed", ldconfig, ldconfig); 
-      rval= pgfindlib_comment_is_row(comment,
-                         PGFINDLIB_COMMENT_LDCONFIG_FAILED,
-                         buffer, &buffer_length, buffer_max_length, &row_number, inode_list, &inode_count);
-      if (rval != PGFINDLIB_OK) return rval;
+      if (strlen(directory) > PGFINDLIB_MAX_PATH_LENGTH) continue;
+      strcpy(pattern, directory);
+      rval= pgfindlib_directory_scan(pattern, tokener_number, matcher,
+                                     malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                     malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length, context);
+      if (rval != PGFINDLIB_OK) goto close_and_return;
     }
-#endif
-#endif
   }
-  return PGFINDLIB_OK;
+close_and_return:
+  if (line != NULL) free(line);
+  if (pattern != NULL) free(pattern);
+  fclose(fp);
+  return rval;
+}
+
+/* The ld.so.cache source when there is a sysroot: its cache, or if that can't be read, its ld.so.conf */
+static int pgfindlib_so_cache_sysroot(struct pgfindlib_context *context, struct pgfindlib_where_matcher *matcher, int tokener_number,
+                                      char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
+                                      struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length)
+{
+  int rval= pgfindlib_so_cache_file(context, matcher, tokener_number,
+                                    malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                    malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
+  if (rval != PGFINDLIB_ERROR_NOT_FOUND) return rval;
+  return pgfindlib_ld_so_conf(context, "/etc/ld.so.conf", 0, matcher, tokener_number,
+                              malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                              malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
 }
-#endif /* #if (PGFINDLIB_TOKEN_SOURCE_LD_SO_CACHE != 0) */
 
 /*
-  Return rval = PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW or PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW
-                if it won't fit, and this should percolate upward to force a new malloc.
-  NB: malloc_buffer_2 is char **so length is #-of-items rather than #-of-chars
-  At the front we add a char = source_number + 32 (because assumption is we won't have 127 - 32 sources)
+  The ELF verdicts that pgfindlib_batch() shares among its pgfindlib_ex() calls. A file is identified by
+  (st_dev, st_ino, st_size, st_mtime), so images that share files (hard links, shared layers, bind mounts) read each
+  file's ELF header once. Hashing content would cost more than reading the header, which is all a verdict needs.
 */
-int pgfindlib_add_to_malloc_buffers(const char *new_item, int source_number,
-                                    char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
-                                    char **malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length)
+#define PGFINDLIB_ELF_VERDICT_BUCKETS 4096
+struct pgfindlib_elf_verdict
 {
-  unsigned int strlen_new_item= strlen(new_item) + 2; /* because we'll allocate char-of-source at start and \0 at end */
-  if (*malloc_buffer_1_length + strlen_new_item >= malloc_buffer_1_max_length) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
-  char c= source_number + 32;
-  *(malloc_buffer_1 + *malloc_buffer_1_length)= c;
-  strcpy(malloc_buffer_1 + *malloc_buffer_1_length + 1, new_item);
-  if (*malloc_buffer_2_length + 1 >= malloc_buffer_2_max_length) return PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW;
-  malloc_buffer_2[*malloc_buffer_2_length]= malloc_buffer_1 + *malloc_buffer_1_length; 
-  *malloc_buffer_1_length+= strlen_new_item;
-  *malloc_buffer_2_length+= 1;
-  return PGFINDLIB_OK;
+  dev_t dev; ino_t ino; off_t size; time_t mtime; long mtime_nsec;
+  int rval;                 /* of the identify part of pgfindlib_read_elf() */
+  unsigned char elf_class;
+  unsigned int e_machine;
+  int is_build_id_read;
+  struct pgfindlib_build_id build_id;
+  int next_in_bucket;
+};
+struct pgfindlib_elf_verdicts
+{
+  pthread_mutex_t mutex;
+  struct pgfindlib_elf_verdict *list; unsigned int count; unsigned int max;
+  int buckets[PGFINDLIB_ELF_VERDICT_BUCKETS];
+};
+
+static unsigned int pgfindlib_elf_verdict_hash(const struct stat *sb)
+{
+  return (unsigned int) (((unsigned long long) sb->st_dev * 16777619u) ^ (unsigned long long) sb->st_ino) % PGFINDLIB_ELF_VERDICT_BUCKETS;
+}
+
+/* Return 1 and fill rval, elf_class, e_machine, and build_id unless it's NULL, if the file has a verdict already */
+static int pgfindlib_elf_verdict_get(struct pgfindlib_elf_verdicts *verdicts, const struct stat *sb,
+                                     int *rval, unsigned char *elf_class, unsigned int *e_machine, struct pgfindlib_build_id *build_id)
+{
+  int is_found= 0;
+  pthread_mutex_lock(&verdicts->mutex);
+  for (int v= verdicts->buckets[pgfindlib_elf_verdict_hash(sb)]; v != -1; v= verdicts->list[v].next_in_bucket)
+  {
+    const struct pgfindlib_elf_verdict *verdict= &verdicts->list[v];
+    if ((verdict->dev != sb->st_dev) || (verdict->ino != sb->st_ino) || (verdict->size != sb->st_size)
+     || (verdict->mtime != sb->st_mtim.tv_sec) || (verdict->mtime_nsec != sb->st_mtim.tv_nsec)) continue;
+    if ((build_id != NULL) && (verdict->is_build_id_read == 0)) continue;
+    *rval= verdict->rval; *elf_class= verdict->elf_class; *e_machine= verdict->e_machine;
+    if (build_id != NULL) *build_id= verdict->build_id;
+    is_found= 1;
+    break;
+  }
+  pthread_mutex_unlock(&verdicts->mutex);
+  return is_found;
+}
+
+/* Remember a verdict. If malloc fails it's simply not remembered. */
+static void pgfindlib_elf_verdict_set(struct pgfindlib_elf_verdicts *verdicts, const struct stat *sb,
+                                      int rval, unsigned char elf_class, unsigned int e_machine, const struct pgfindlib_build_id *build_id)
+{
+  pthread_mutex_lock(&verdicts->mutex);
+  if (verdicts->count == verdicts->max)
+  {
+    unsigned int new_max= verdicts->max * 2 + 256;
+    struct pgfindlib_elf_verdict *new_list= (struct pgfindlib_elf_verdict *)realloc(verdicts->list, new_max * sizeof(struct pgfindlib_elf_verdict));
+    if (new_list == NULL) { pthread_mutex_unlock(&verdicts->mutex); return; }
+    verdicts->list= new_list;
+    verdicts->max= new_max;
+  }
+  struct pgfindlib_elf_verdict *verdict= &verdicts->list[verdicts->count];
+  verdict->dev= sb->st_dev; verdict->ino= sb->st_ino; verdict->size= sb->st_size;
+  verdict->mtime= sb->st_mtim.tv_sec; verdict->mtime_nsec= sb->st_mtim.tv_nsec;
+  verdict->rval= rval; verdict->elf_class= elf_class; verdict->e_machine= e_machine;
+  verdict->is_build_id_read= (build_id != NULL);
+  if (build_id != NULL) verdict->build_id= *build_id;
+  else verdict->build_id.length= 0;
+  unsigned int hash= pgfindlib_elf_verdict_hash(sb);
+  verdict->next_in_bucket= verdicts->buckets[hash];
+  verdicts->buckets[hash]= verdicts->count;
+  ++verdicts->count;
+  pthread_mutex_unlock(&verdicts->mutex);
 }
 
-/* Assume unsigned comparison per https://stackoverflow.com/questions/1356741/strcmp-and-signed-unsigned-chars */ 
-int pgfindlib_qsort_compare(const void *p1, const void *p2)
+struct pgfindlib_batch_shared
+{
+  const char *statement;
+  struct pgfindlib_batch_item *items; unsigned int items_count;
+  const struct pgfindlib_options *options;
+  struct pgfindlib_elf_verdicts *verdicts;
+  pthread_mutex_t mutex; unsigned int next_item;
+};
+
+/* One of pgfindlib_batch()'s threads: take the next item until there are none */
+static void *pgfindlib_batch_thread(void *arg)
 {
-  return strcmp(*(char *const *) p1, *(char *const *) p2);
+  struct pgfindlib_batch_shared *shared= (struct pgfindlib_batch_shared *) arg;
+  for (;;)
+  {
+    pthread_mutex_lock(&shared->mutex);
+    unsigned int i= shared->next_item++;
+    pthread_mutex_unlock(&shared->mutex);
+    if (i >= shared->items_count) break;
+    struct pgfindlib_batch_item *item= &shared->items[i];
+    struct pgfindlib_options options;
+    memset(&options, 0, sizeof(options));
+    if (shared->options != NULL) options= *shared->options;
+    options.sysroot= item->sysroot;
+    options.snapshot_path= NULL;
+    options.link_farm= NULL;
+    options.audit_log= NULL;
+    options.rows_ready= NULL;
+    item->rval= pgfindlib_ex_with_verdicts(shared->statement, item->buffer, item->buffer_max_length, &options, shared->verdicts);
+  }
+  return NULL;
 }
 
 /*
-  Given something like /tmp/libcrypto.so, return only the last part i.e. libcrypto.so.
-  Todo: Check whether there are places which could call this but instead are duplicating the instructions.
+  pgfindlib_ex() with options->sysroot= items[i].sysroot for every item, output in items[i].buffer, return code in items[i].rval,
+  on threads_count threads (0 means 4) that share ELF verdicts. Return PGFINDLIB_OK even if some items failed,
+  or PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW if it can't start, in which case no item was done.
 */
-static const char *pgfindlib_file_part(const char *one_library_or_file)
+int pgfindlib_batch(const char *statement, struct pgfindlib_batch_item *items, unsigned int items_count,
+                    unsigned int threads_count, const struct pgfindlib_options *options)
 {
-  const char *p= one_library_or_file + strlen(one_library_or_file);
-  for (;;)
+  if (threads_count == 0) threads_count= 4;
+  if (threads_count > items_count) threads_count= items_count;
+  for (unsigned int i= 0; i < items_count; ++i) items[i].rval= PGFINDLIB_ERROR_NOT_FOUND;
+  if (items_count == 0) return PGFINDLIB_OK;
+  struct pgfindlib_batch_shared shared;
+  shared.statement= statement;
+  shared.items= items; shared.items_count= items_count;
+  shared.options= options;
+  shared.next_item= 0;
+  shared.verdicts= (struct pgfindlib_elf_verdicts *)malloc(sizeof(struct pgfindlib_elf_verdicts));
+  pthread_t *threads= (pthread_t *)malloc(threads_count * sizeof(pthread_t));
+  if ((shared.verdicts == NULL) || (threads == NULL))
   {
-    --p;
-    if ((p < one_library_or_file) || (*p == '/')) { ++p; break; }
+    if (shared.verdicts != NULL) free(shared.verdicts);
+    if (threads != NULL) free(threads);
+    return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
   }
-  return p;
+  pthread_mutex_init(&shared.mutex, NULL);
+  pthread_mutex_init(&shared.verdicts->mutex, NULL);
+  shared.verdicts->list= NULL; shared.verdicts->count= 0; shared.verdicts->max= 0;
+  for (unsigned int i= 0; i < PGFINDLIB_ELF_VERDICT_BUCKETS; ++i) shared.verdicts->buckets[i]= -1;
+  unsigned int started_count= 0;
+  for (; started_count < threads_count; ++started_count)
+  {
+    if (pthread_create(&threads[started_count], NULL, pgfindlib_batch_thread, &shared) != 0) break;
+  }
+  if (started_count == 0) pgfindlib_batch_thread(&shared); /* no thread could start, so do it all on this one */
+  for (unsigned int i= 0; i < started_count; ++i) pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&shared.mutex);
+  pthread_mutex_destroy(&shared.verdicts->mutex);
+  if (shared.verdicts->list != NULL) free(shared.verdicts->list);
+  free(shared.verdicts);
+  free(threads);
+  return PGFINDLIB_OK;
 }
+#endif /* #if (PGFINDLIB_SYSROOT != 0) */
 
 /* Pass: list of libraries separated by colons (or spaces or semicolons depending on source)
    I don't check wheher the colon is enclosed within ""s and don't expect a path name to contain a colon.
@@ -1340,10 +8406,11 @@ int pgfindlib_source_scan(const char *librarylist, char *buffer, unsigned int *b
                                 const char *lib, const char *platform, const char *origin,
                                 unsigned int *row_number,
                                 ino_t inode_list[], unsigned int *inode_count, unsigned int *inode_warning_count,
-                                struct tokener tokener_list[],
+                                struct tokener tokener_list[], struct pgfindlib_where_matcher *matcher,
                                 char *malloc_buffer_1, unsigned int *malloc_buffer_1_length, unsigned malloc_buffer_1_max_length,
-                                char **malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
-                                int program_e_machine)
+                                struct pgfindlib_candidate *malloc_buffer_2, unsigned int *malloc_buffer_2_length, unsigned malloc_buffer_2_max_length,
+                                int program_e_machine, struct pgfindlib_symlink_memo *symlink_memo,
+                                struct pgfindlib_context *context)
 {
   int rval;
   char delimiter1, delimiter2;
@@ -1366,13 +8433,7 @@ int pgfindlib_source_scan(const char *librarylist, char *buffer, unsigned int *b
   { delimiter1= ':'; delimiter2= ';';  } /* colon or semicolon */
   else /* presumably PGFINDLIB_TOKEN_SOURCE_NONSTANDARD a user-defined path */
   { delimiter1= ':'; delimiter2= ':';  } /* colon or colon, can be undocumented */
-  {
-    char source[PGFINDLIB_MAX_TOKEN_LENGTH + 1];
-    int source_length= tokener_list[tokener_number].tokener_length;
-    memcpy(source, tokener_list[tokener_number].tokener_name, source_length);
-    source[source_length]= '\0';
-  }
-  char one_library_or_file[PGFINDLIB_MAX_PATH_LENGTH + 1];
+  char *one_library_or_file= context->one_library_or_file;
 
   if (librarylist == NULL) return PGFINDLIB_OK;
   const char *p_in= librarylist;
@@ -1406,9 +8467,9 @@ int pgfindlib_source_scan(const char *librarylist, char *buffer, unsigned int *b
     if (strlen(one_library_or_file) > 0) /* If it's a blank we skip it. Is that right? */
     {
       unsigned int replacements_count;
-      char orig_one_library_or_file[PGFINDLIB_MAX_PATH_LENGTH + 1];
+      char *orig_one_library_or_file= context->orig_one_library_or_file;
       strcpy(orig_one_library_or_file, one_library_or_file);
-      rval= pgfindlib_replace_lib_or_platform_or_origin(one_library_or_file, &replacements_count, lib, platform, origin);
+      rval= pgfindlib_replace_lib_or_platform_or_origin(one_library_or_file, &replacements_count, lib, platform, origin, context);
       if (rval !=PGFINDLIB_OK) return rval;
 #if (PGFINDLIB_COMMENT_REPLACE_STRING != 0)
       if (replacements_count > 0)
@@ -1418,7 +8479,7 @@ int pgfindlib_source_scan(const char *librarylist, char *buffer, unsigned int *b
         if (source_name_length > 32 - 1) source_name_length= 32 - 1;
         memcpy(source_name, tokener_list[tokener_number].tokener_name, source_name_length);
         source_name[source_name_length]= '\0';
-        char comment[PGFINDLIB_MAX_PATH_LENGTH*2 + 128];
+        char *comment= context->comment;
         sprintf(comment, "in source %s replaced %s with %s", source_name, orig_one_library_or_file, one_library_or_file);
         rval= pgfindlib_comment_is_row(comment,
                          PGFINDLIB_COMMENT_REPLACE_STRING,
@@ -1430,45 +8491,201 @@ int pgfindlib_source_scan(const char *librarylist, char *buffer, unsigned int *b
       if ((comment_number == PGFINDLIB_TOKEN_SOURCE_LD_AUDIT) || (comment_number == PGFINDLIB_TOKEN_SOURCE_LD_PRELOAD)) 
       {
         const char *file_part= pgfindlib_file_part(one_library_or_file);
-        if (pgfindlib_find_line_in_statement(tokener_list, file_part) == 0) continue; /* doesn't match requirement */
+        if (pgfindlib_find_line_in_statement(matcher, file_part) == 0) continue; /* doesn't match requirement */
         rval= pgfindlib_file(buffer, buffer_length, one_library_or_file, buffer_max_length, row_number,
-                             inode_list, inode_count, inode_warning_count, tokener_list[tokener_number], program_e_machine);
+                             inode_list, inode_count, inode_warning_count, tokener_list[tokener_number], program_e_machine,
+                             0, DT_UNKNOWN, symlink_memo, context, NULL, NULL);
         if (rval != PGFINDLIB_OK) return rval;
       }
       else
       /* not LD_AUDIT or LD_PRELOAD so it should be a directory name */
       {
-        /* char ls_line[PGFINDLIB_MAX_PATH_LENGTH * 5]; */
-        DIR* dir= opendir(one_library_or_file);
-        if (dir != NULL) /* perhaps would be null if directory not found */
-        {
-          struct dirent* dirent;
-          while ((dirent= readdir(dir)) != NULL)
-          {
-            if ((dirent->d_type !=  DT_REG) &&  (dirent->d_type !=  DT_LNK)) continue; /* not regular file or symbolic link */
-             if (pgfindlib_find_line_in_statement(tokener_list, dirent->d_name) == 0) continue; /* doesn't match requirement */
-            {
-              char combo[PGFINDLIB_MAX_PATH_LENGTH * 2 + 1];
-              strcpy(combo, one_library_or_file);
-              strcat(combo, "/");
-              strcat(combo, dirent->d_name);
-              rval= pgfindlib_add_to_malloc_buffers(combo, tokener_number,
-                                                    malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
-                                                    malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length);
-              if (rval != PGFINDLIB_OK)
-              {
-                closedir(dir);
-                return rval;
-              }
-            }
-          }
-          closedir(dir);
-        }
+        rval= pgfindlib_directory_scan(one_library_or_file, tokener_number, matcher,
+                                       malloc_buffer_1, malloc_buffer_1_length, malloc_buffer_1_max_length,
+                                       malloc_buffer_2, malloc_buffer_2_length, malloc_buffer_2_max_length, context);
+        if (rval != PGFINDLIB_OK) return rval;
+      }
+    }
+  }
+  return PGFINDLIB_OK;
+}
+
+/*
+  Read the ELF header and check the part that depends only on the file: ident, and e_type is ET_EXEC or ET_DYN.
+  Return PGFINDLIB_OK or a PGFINDLIB_COMMENT_ELF_... number. elf_class and e_machine are set if the ident is valid.
+  e_type and e_machine are at the same offsets in Elf32_Ehdr and Elf64_Ehdr, but might not be in this host's byte order.
+*/
+#if (PGFINDLIB_INCLUDE_BUILD_ID != 0)
+/* An ELF field of size 2, 4 or 8 bytes in the file's byte order */
+static unsigned long long pgfindlib_elf_number(const unsigned char *p, unsigned int size, int is_msb)
+{
+  unsigned long long number= 0;
+  for (unsigned int i= 0; i < size; ++i) number|= (unsigned long long) p[is_msb ? i : size - 1 - i] << (8 * (size - 1 - i));
+  return number;
+}
+
+/*
+  Return a pointer to length bytes at offset in the file: in page (the file's first page_length bytes) if they're there,
+  else read into buffer. Return NULL if they can't be read.
+*/
+static const unsigned char *pgfindlib_elf_bytes(FILE *fd, const unsigned char *page, size_t page_length,
+                                                unsigned long long offset, size_t length, unsigned char *buffer)
+{
+  if ((offset <= page_length) && (length <= page_length - offset)) return page + offset;
+  if ((fseeko(fd, (off_t) offset, SEEK_SET) != 0) || (fread(buffer, 1, length, fd) != length)) return NULL;
+  return buffer;
+}
+
+/*
+  Find NT_GNU_BUILD_ID in the PT_NOTE segments, for either class and byte order.
+  page is the file's first page_length bytes, which were read with the ELF header in one read(),
+  and a shared library's program headers and notes are nearly always there, so usually there's no other system call.
+  build_id->length stays 0 if there's no build-id or it's longer than PGFINDLIB_MAX_BUILD_ID_LENGTH.
+*/
+static void pgfindlib_read_build_id(FILE *fd, const unsigned char *page, size_t page_length, struct pgfindlib_build_id *build_id,
+                                    unsigned char *scratch)
+{
+  int is_64= (page[EI_CLASS] == ELFCLASS64);
+  int is_msb= (page[EI_DATA] == ELFDATA2MSB);
+  if (page_length < (is_64 ? 64u : 52u)) return;
+  unsigned long long phoff= pgfindlib_elf_number(page + (is_64 ? 32 : 28), is_64 ? 8 : 4, is_msb);
+  unsigned int phentsize= (unsigned int) pgfindlib_elf_number(page + (is_64 ? 54 : 42), 2, is_msb);
+  unsigned int phnum= (unsigned int) pgfindlib_elf_number(page + (is_64 ? 56 : 44), 2, is_msb);
+  if ((phnum == 0) || (phnum > PGFINDLIB_MAX_PHDRS) || (phentsize < (is_64 ? 56u : 32u)) || (phentsize > 128)) return;
+  unsigned char *phdrs_buffer= scratch;
+  const unsigned char *phdrs= pgfindlib_elf_bytes(fd, page, page_length, phoff, (size_t) phentsize * phnum, phdrs_buffer);
+  if (phdrs == NULL) return;
+  unsigned char *notes_buffer= scratch + PGFINDLIB_MAX_PHDRS * 128;
+  for (unsigned int i= 0; i < phnum; ++i)
+  {
+    const unsigned char *phdr= phdrs + i * phentsize;
+    if (pgfindlib_elf_number(phdr, 4, is_msb) != PT_NOTE) continue;
+    unsigned long long offset= pgfindlib_elf_number(phdr + (is_64 ? 8 : 4), is_64 ? 8 : 4, is_msb);
+    unsigned long long size= pgfindlib_elf_number(phdr + (is_64 ? 32 : 16), is_64 ? 8 : 4, is_msb);
+    unsigned long long align= pgfindlib_elf_number(phdr + (is_64 ? 48 : 28), is_64 ? 8 : 4, is_msb);
+    if (size > PGFINDLIB_MAX_NOTES_LENGTH) size= PGFINDLIB_MAX_NOTES_LENGTH;
+    const unsigned char *notes= pgfindlib_elf_bytes(fd, page, page_length, offset, (size_t) size, notes_buffer);
+    if (notes == NULL) continue;
+    unsigned int pad= (align == 8) ? 7 : 3; /* a description and the next note start at a multiple of p_align, 4 or 8, as glibc's */
+    for (unsigned long long n= 0; n + 12 <= size;)
+    {
+      unsigned long long namesz= pgfindlib_elf_number(notes + n, 4, is_msb);
+      unsigned long long descsz= pgfindlib_elf_number(notes + n + 4, 4, is_msb);
+      unsigned long long type= pgfindlib_elf_number(notes + n + 8, 4, is_msb);
+      unsigned long long desc= (n + 12 + namesz + pad) & ~(unsigned long long) pad;
+      if (desc + descsz > size) break;
+      if ((type == NT_GNU_BUILD_ID) && (namesz == 4) && (memcmp(notes + n + 12, "GNU", 4) == 0))
+      {
+        if ((descsz == 0) || (descsz > PGFINDLIB_MAX_BUILD_ID_LENGTH)) return;
+        memcpy(build_id->bytes, notes + desc, descsz);
+        build_id->length= (unsigned int) descsz;
+        return;
       }
+      n= desc + ((descsz + pad) & ~(unsigned long long) pad);
     }
   }
+}
+#endif
+
+/* The part of pgfindlib_read_elf_header() after the read: the ident, the type, and the class and machine */
+static int pgfindlib_elf_header_check(const ElfW(Ehdr) *elf_header, size_t read_size, unsigned char *elf_class, unsigned int *e_machine)
+{
+  if (read_size < EI_NIDENT + 4) return PGFINDLIB_COMMENT_ELF_READ_FAILED;
+  if (memcmp(elf_header->e_ident, ELFMAG, SELFMAG) != 0) return PGFINDLIB_COMMENT_ELF_HAS_INVALID_IDENT;
+  const unsigned char *header_bytes= (const unsigned char *) elf_header;
+  unsigned int header_e_type;
+  if (elf_header->e_ident[EI_DATA] == ELFDATA2MSB)
+  {
+    header_e_type= (header_bytes[16] << 8) | header_bytes[17];
+    *e_machine= (header_bytes[18] << 8) | header_bytes[19];
+  }
+  else
+  {
+    header_e_type= header_bytes[16] | (header_bytes[17] << 8);
+    *e_machine= header_bytes[18] | (header_bytes[19] << 8);
+  }
+  *elf_class= elf_header->e_ident[EI_CLASS];
+  if ((header_e_type != ET_EXEC) && (header_e_type != ET_DYN)) return PGFINDLIB_COMMENT_ELF_IS_NOT_EXEC_OR_DYN;
+  return PGFINDLIB_OK;
+}
+
+/*
+  If build_id isn't NULL, the first page is read rather than only the header, and the GNU build-id is looked for in it.
+  Then scratch is PGFINDLIB_ELF_SCRATCH_LENGTH bytes, e.g. the context's, or NULL and it's malloc'd here,
+  so that there's no page on the stack, see "Re threads".
+*/
+static int pgfindlib_read_elf_header(FILE *fd, ElfW(Ehdr) *elf_header, unsigned char *elf_class, unsigned int *e_machine,
+                                     struct pgfindlib_build_id *build_id, unsigned char *scratch)
+{
+  size_t read_size;
+#if (PGFINDLIB_INCLUDE_BUILD_ID != 0)
+  unsigned char *malloced_scratch= NULL;
+  unsigned char *page= NULL;
+  if (build_id != NULL)
+  {
+    if (scratch == NULL) scratch= malloced_scratch= (unsigned char *)malloc(PGFINDLIB_ELF_SCRATCH_LENGTH);
+    if (scratch == NULL) build_id= NULL; /* so the header is still read, without a build-id */
+  }
+  if (build_id != NULL)
+  {
+    page= scratch + PGFINDLIB_MAX_PHDRS * 128 + PGFINDLIB_MAX_NOTES_LENGTH;
+    read_size= fread(page, 1, PGFINDLIB_ELF_PAGE_SIZE, fd);
+    memcpy(elf_header, page, (read_size < sizeof(ElfW(Ehdr))) ? read_size : sizeof(ElfW(Ehdr)));
+  }
+  else
+#else
+  (void) scratch;
+#endif
+  read_size= fread(elf_header, 1, sizeof(ElfW(Ehdr)), fd); /* an Elf32_Ehdr is smaller, only e_ident e_type e_machine must be there */
+  int rval= pgfindlib_elf_header_check(elf_header, read_size, elf_class, e_machine);
+#if (PGFINDLIB_INCLUDE_BUILD_ID != 0)
+  if ((rval == PGFINDLIB_OK) && (build_id != NULL)) pgfindlib_read_build_id(fd, page, read_size, build_id, scratch);
+  if (malloced_scratch != NULL) free(malloced_scratch);
+#else
+  (void) build_id;
+#endif
+  return rval;
+}
+
+#if (PGFINDLIB_INCLUDE_BUILD_ID != 0)
+int pgfindlib_build_id(const char *path, unsigned char *build_id, unsigned int *build_id_length)
+{
+  if ((path == NULL) || (build_id == NULL) || (build_id_length == NULL)) return PGFINDLIB_ERROR_BUFFER_NULL;
+  *build_id_length= 0;
+  struct tokener tokener_list[1]; /* won't be used */
+  struct pgfindlib_build_id file_build_id;
+  pgfindlib_read_elf(tokener_list, path, PGFINDLIB_REASON_SO_IDENTIFY, 0, NULL, NULL, NULL, &file_build_id);
+  if (file_build_id.length == 0) return PGFINDLIB_ERROR_NOT_FOUND;
+  memcpy(build_id, file_build_id.bytes, file_build_id.length);
+  *build_id_length= file_build_id.length;
   return PGFINDLIB_OK;
 }
+#endif
+
+/*
+  PGFINDLIB_COMMENT_ELF_MACHINE_DOES_NOT_MATCH unless the header's class and machine will do.
+  With options->architectures, any of them will do, else it must be this program's, x32 and x86-64 differ by class.
+*/
+int pgfindlib_elf_machine_check(const struct pgfindlib_context *context, int program_e_machine,
+                                unsigned char elf_class, unsigned int e_machine)
+{
+#if (PGFINDLIB_INCLUDE_ARCHITECTURES != 0)
+  if ((context != NULL) && (context->architectures_count > 0))
+  {
+    for (unsigned int a= 0; a < context->architectures_count; ++a)
+    {
+      if ((context->architectures[a].elf_class == elf_class) && (context->architectures[a].e_machine == e_machine))
+        return PGFINDLIB_OK;
+    }
+    return PGFINDLIB_COMMENT_ELF_MACHINE_DOES_NOT_MATCH;
+  }
+#else
+  (void) context;
+#endif
+  if (((unsigned int) program_e_machine == e_machine)
+   && (elf_class == ((sizeof(void *) == 8) ? ELFCLASS64 : ELFCLASS32))) return PGFINDLIB_OK;
+  return PGFINDLIB_COMMENT_ELF_MACHINE_DOES_NOT_MATCH;
+}
 
 /*
    Read an elf file. Possible reasons:
@@ -1490,7 +8707,9 @@ int pgfindlib_source_scan(const char *librarylist, char *buffer, unsigned int *b
       Surely PT_DYNAMIC would have better information, this was checked but abandoned.
       There should be a warning.
 */
-int pgfindlib_read_elf(const struct tokener tokener_list[], const char* possible_elf_file, int reason, int program_e_machine)
+int pgfindlib_read_elf(const struct tokener tokener_list[], const char* possible_elf_file, int reason, int program_e_machine,
+                       const struct pgfindlib_context *context, unsigned char *elf_class, unsigned int *e_machine,
+                       struct pgfindlib_build_id *build_id)
 {
 #ifndef PGFINDLIB_HANDLE_SO_LIST
   (void) tokener_list;
@@ -1498,14 +8717,43 @@ int pgfindlib_read_elf(const struct tokener tokener_list[], const char* possible
   ElfW(Ehdr) elf_header;
   int rval= PGFINDLIB_OK;
   FILE *fd= NULL;
-  fd= fopen(possible_elf_file, "rb");
-  if (fd == NULL) {rval= PGFINDLIB_COMMENT_ELF_OPEN_FAILED; goto close_and_return; }
-  size_t read_size;
-  read_size= fread(&elf_header, sizeof(elf_header), 1, fd);
-  if (read_size == 0) { rval= PGFINDLIB_COMMENT_ELF_READ_FAILED; goto close_and_return; }
-  if (memcmp(elf_header.e_ident, ELFMAG, SELFMAG) != 0) { rval= PGFINDLIB_COMMENT_ELF_HAS_INVALID_IDENT; goto close_and_return; }
-  if ((elf_header.e_type != ET_EXEC) && (elf_header.e_type != ET_DYN)) { rval= PGFINDLIB_COMMENT_ELF_IS_NOT_EXEC_OR_DYN; goto close_and_return; }
-  if ((reason == PGFINDLIB_REASON_SO_CHECK) && (program_e_machine != elf_header.e_machine)) { rval= PGFINDLIB_COMMENT_ELF_MACHINE_DOES_NOT_MATCH; goto close_and_return; }
+  int header_rval; /* the verdict that depends only on the file, which pgfindlib_batch() calls can share */
+  unsigned char header_elf_class= 0;
+  unsigned int header_e_machine= 0;
+  if (build_id != NULL) build_id->length= 0;
+  const struct pgfindlib_backend *backend= (context != NULL) ? context->backend : &pgfindlib_backend_posix;
+  int file_fd= pgfindlib_open(backend, (context != NULL) ? context->sysroot_fd : -1, possible_elf_file, O_RDONLY);
+  if (file_fd == -1) {rval= PGFINDLIB_COMMENT_ELF_OPEN_FAILED; goto close_and_return; }
+#if (PGFINDLIB_SYSROOT != 0)
+  struct stat verdict_sb; /* before fdopen() takes file_fd */
+  int is_verdict_shared= ((context != NULL) && (context->elf_verdicts != NULL) && (reason != PGFINDLIB_REASON_SO_LIST)
+                       && (backend->fstat(backend->state, file_fd, &verdict_sb) == 0));
+#endif
+  fd= backend->fdopen(backend->state, file_fd);
+  if (fd == NULL) { backend->close(backend->state, file_fd); rval= PGFINDLIB_COMMENT_ELF_OPEN_FAILED; goto close_and_return; }
+  memset(&elf_header, 0, sizeof(elf_header));
+#if (PGFINDLIB_SYSROOT != 0)
+  if ((is_verdict_shared == 0)
+   || (pgfindlib_elf_verdict_get(context->elf_verdicts, &verdict_sb, &header_rval, &header_elf_class, &header_e_machine, build_id) == 0))
+  {
+    header_rval= pgfindlib_read_elf_header(fd, &elf_header, &header_elf_class, &header_e_machine, build_id,
+                                         (context != NULL) ? context->elf_scratch : NULL);
+    if (is_verdict_shared)
+      pgfindlib_elf_verdict_set(context->elf_verdicts, &verdict_sb, header_rval, header_elf_class, header_e_machine, build_id);
+  }
+#else
+  header_rval= pgfindlib_read_elf_header(fd, &elf_header, &header_elf_class, &header_e_machine, build_id,
+                                         (context != NULL) ? context->elf_scratch : NULL);
+#endif
+  if (elf_class != NULL) *elf_class= header_elf_class;
+  if (e_machine != NULL) *e_machine= header_e_machine;
+  if (header_rval != PGFINDLIB_OK) { rval= header_rval; goto close_and_return; }
+  if (reason == PGFINDLIB_REASON_SO_CHECK)
+  {
+    rval= pgfindlib_elf_machine_check(context, program_e_machine, header_elf_class, header_e_machine);
+    if (rval != PGFINDLIB_OK) goto close_and_return;
+  }
+  if (reason == PGFINDLIB_REASON_SO_IDENTIFY) goto close_and_return;
 /* Effectively the rest of this function is commented out so only PGFINDLIB_REASON_SO_CHECK actually works. Doesn't act right anyway. */
 #ifdef PGFINDLIB_HANDLE_SO_LIST
   if (reason == PGFINDLIB_REASON_SO_LIST)
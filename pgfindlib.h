@@ -23,8 +23,219 @@
 #ifndef PGFINDLIB_H
 #define PGFINDLIB_H
 
+#include <stdio.h>     /* FILE, for struct pgfindlib_backend */
+#include <sys/types.h> /* ino_t, pid_t, ssize_t */
+
 extern int pgfindlib(const char *statement, char *buffer, unsigned int buffer_max_length);
 
+/* One architecture for options->architectures, e.g. { ELFCLASS32, EM_386 } with the ELFCLASS... and EM_... values of elf.h */
+struct pgfindlib_architecture
+{
+  unsigned char elf_class;
+  unsigned int e_machine;
+};
+
+/*
+  pgfindlib_ex() is pgfindlib() with runtime options, options == NULL is the same as pgfindlib().
+  Set every member (e.g. memset the struct to 0 first) so that members added in later versions get their defaults.
+*/
+struct pgfindlib_options
+{
+  unsigned int flags; /* PGFINDLIB_OPTION_... bits, e.g. PGFINDLIB_OPTIONS_PATHS_ONLY or PGFINDLIB_OPTIONS_DEFAULT */
+  char *const *envp;  /* environment e.g. LD_LIBRARY_PATH to use, NULL means a copy of environ at the start of the call */
+  const struct pgfindlib_architecture *architectures; /* NULL means only this program's, see "Re architectures" in README.md */
+  unsigned int architectures_count;
+  const char *sysroot; /* NULL, or a root directory e.g. an unpacked container image, see "Re sysroot" in README.md */
+  unsigned int deadline_milliseconds;         /* 0, or no directory is read after this long, see "Re deadline" in README.md */
+  unsigned int directory_budget_milliseconds; /* 0, or the longest wait for one directory on NFS, CIFS, FUSE etc. */
+  const struct pgfindlib_backend *backend;    /* NULL means pgfindlib_backend_posix, see "Re backends" in README.md */
+  const char *snapshot_path;                  /* NULL, or where the last call's snapshot is and this call's goes, see "Re snapshots" */
+  const char *link_farm;                      /* NULL, or a directory to fill with a symlink per soname, see "Re link farm" */
+  const char *audit_log;                      /* NULL, or a log that pgfindlib_audit.so wrote, see "Re audit log" */
+  int (*rows_ready)(void *state, const char *rows, unsigned int rows_length); /* NULL, or gets the rows as they're made, see "Re streaming" */
+  void *rows_ready_state;
+};
+extern int pgfindlib_ex(const char *statement, char *buffer, unsigned int buffer_max_length, const struct pgfindlib_options *options);
+
+/*
+  Every file system call and subprocess of a search goes through a backend. Each function gets state first,
+  and otherwise is like the POSIX function it's named after, returning -1 or NULL with errno set if it fails.
+  sysroot_fd is -1, or options->sysroot opened with O_PATH, and then path is in the sysroot.
+  fd is what open() returned. opendir() and fdopen() take over fd, as fdopendir() and fdopen() do,
+  but fd stays usable for fstatat() until closedir(), which pgfindlib calls if readdir() says DT_UNKNOWN.
+  spawn() sets *pid= 0 if there's no process to wait for. options->sysroot is only for pgfindlib_backend_posix.
+  A backend that several threads use, e.g. with pgfindlib_batch(), must be thread-safe.
+  Not through the backend: what pgfindlib learns about this process, e.g. its own path, its loaded objects, $LIB.
+*/
+struct stat;
+struct pgfindlib_backend_entry
+{
+  const char *d_name;
+  unsigned char d_type;     /* DT_REG, DT_LNK, DT_DIR etc. */
+  ino_t d_ino;
+};
+struct pgfindlib_backend
+{
+  void *state;
+  int (*open)(void *state, int sysroot_fd, const char *path, int flags);
+  int (*close)(void *state, int fd);
+  int (*fstat)(void *state, int fd, struct stat *sb);
+  int (*fstatat)(void *state, int fd, const char *name, struct stat *sb);   /* always AT_SYMLINK_NOFOLLOW */
+  ssize_t (*readlinkat)(void *state, int fd, const char *name, char *buffer, size_t buffer_size);
+  int (*stat)(void *state, int sysroot_fd, const char *path, struct stat *sb, int is_lstat);
+  int (*access)(void *state, int sysroot_fd, const char *path, int mode);
+  void *(*opendir)(void *state, int fd);
+  const struct pgfindlib_backend_entry *(*readdir)(void *state, void *dir); /* NULL at the end */
+  void (*closedir)(void *state, void *dir);
+  FILE *(*fdopen)(void *state, int fd);                                      /* for reading */
+  FILE *(*spawn)(void *state, const char *const argv[], char *const envp[], int is_stderr_wanted, pid_t *pid);
+};
+extern const struct pgfindlib_backend pgfindlib_backend_posix;
+
+/*
+  A backend with no real files: a tree of directories, files and symlinks, and the output of programs like ldconfig -p,
+  described by a manifest file, with optional latency per operation. For benchmarks and tests at any scale.
+  pgfindlib_backend_memory_open() returns PGFINDLIB_OK, PGFINDLIB_ERROR_NOT_FOUND if the manifest can't be read,
+  or PGFINDLIB_ERROR_STATEMENT_SYNTAX with *error_line set if a manifest line is wrong. The backend must outlive
+  every search that uses it. See "Re backends" in README.md for the manifest format.
+*/
+extern int pgfindlib_backend_memory_open(const char *manifest_path, struct pgfindlib_backend **backend, unsigned int *error_line);
+extern void pgfindlib_backend_memory_close(struct pgfindlib_backend *backend);
+
+/*
+  pgfindlib_dlopen() finds soname with pgfindlib_ex(), skips rows that break the policy's rejection rules,
+  and dlopen()s the rest in the policy's order until one succeeds. policy == NULL means all members are 0 or NULL
+  except reject, which is PGFINDLIB_DLOPEN_REJECT_DEFAULT. The winning path is remembered for the process lifetime,
+  for the same policy and options, pgfindlib_dlopen_forget(soname) or pgfindlib_dlopen_forget(NULL) makes the next call search again.
+*/
+struct pgfindlib_dlopen_policy
+{
+  const char *from;                         /* FROM list e.g. "LD_LIBRARY_PATH, ld.so.cache", NULL means where the loader looks */
+  unsigned int order;                       /* PGFINDLIB_DLOPEN_ORDER_... */
+  unsigned int reject;                      /* PGFINDLIB_DLOPEN_REJECT_... bits */
+  const struct pgfindlib_options *options;  /* passed to pgfindlib_ex() */
+};
+extern int pgfindlib_dlopen(const char *soname, int dlopen_flags, const struct pgfindlib_dlopen_policy *policy,
+                            void **handle, char *path, unsigned int path_max_length);
+extern void pgfindlib_dlopen_forget(const char *soname);
+
+/*
+  pgfindlib_batch() is pgfindlib_ex() for many sysroots at once, on threads_count threads (0 means 4),
+  sharing what's learned from ELF headers. options->sysroot is ignored, each item has its own.
+  So are options->snapshot_path, options->link_farm, options->audit_log and options->rows_ready.
+*/
+struct pgfindlib_batch_item
+{
+  const char *sysroot;
+  char *buffer;
+  unsigned int buffer_max_length;
+  int rval;                         /* output: what pgfindlib_ex() returned */
+};
+extern int pgfindlib_batch(const char *statement, struct pgfindlib_batch_item *items, unsigned int items_count,
+                           unsigned int threads_count, const struct pgfindlib_options *options);
+
+/*
+  pgfindlib_prepare() is the part of pgfindlib_ex() that doesn't depend on the file system or the environment:
+  the statement is tokenized, the WHERE list is compiled, $LIB and $PLATFORM and $ORIGIN are found, and the rows
+  that come before any file (version, $LIB etc.) are made. Syntax errors go in buffer as with pgfindlib_ex().
+  pgfindlib_execute() is the rest, i.e. it searches the sources, and can be called any number of times.
+  The environment (e.g. LD_LIBRARY_PATH) is read by each pgfindlib_execute(). The options struct is copied,
+  but what its pointers point to (envp, architectures, sysroot) must last until pgfindlib_prepared_free().
+  A prepared statement must not be executed by two threads at the same time. See "Re prepared statements" in README.md.
+*/
+struct pgfindlib_prepared;
+extern int pgfindlib_prepare(const char *statement, char *buffer, unsigned int buffer_max_length, const struct pgfindlib_options *options,
+                             struct pgfindlib_prepared **prepared);
+extern int pgfindlib_execute(struct pgfindlib_prepared *prepared, char *buffer, unsigned int buffer_max_length);
+extern void pgfindlib_prepared_free(struct pgfindlib_prepared *prepared);
+
+/*
+  pgfindlib_async_submit() is pgfindlib_ex() on a thread of its own, for callers with an event loop. It returns at once,
+  and *fd becomes readable (e.g. for epoll) when the search is over. *fd is an eventfd, or a pipe on systems without one.
+  Then pgfindlib_async_result() returns what pgfindlib_ex() would have, closes *fd and frees async (if called sooner, it waits).
+  pgfindlib_async_cancel() returns at once, and makes the search stop before its next source, directory, ld.so.cache line
+  or row, then *fd becomes readable and pgfindlib_async_result() returns PGFINDLIB_ERROR_CANCELLED unless the search was over already.
+  pgfindlib_async_submit() returns PGFINDLIB_ERROR_FILE_DESCRIPTORS, with errno set, if it can't make the eventfd or pipe.
+  statement and options are copied, but buffer and what the options' pointers point to must last until pgfindlib_async_result().
+  See "Re async" in README.md.
+*/
+struct pgfindlib_async;
+extern int pgfindlib_async_submit(const char *statement, char *buffer, unsigned int buffer_max_length, const struct pgfindlib_options *options,
+                                  struct pgfindlib_async **async, int *fd);
+extern int pgfindlib_async_result(struct pgfindlib_async *async);
+extern int pgfindlib_async_cancel(struct pgfindlib_async *async);
+
+/* SEARCH = the loader's: first the file that the loader model (PGFINDLIB_OPTION_PROBE_COST's 017 row) picks, then the row order.
+   LOADED_FIRST = adds "loaded" to FROM and tries already-mapped files first.
+   HIGHEST_VERSION_FIRST = by file name with digits compared as numbers, e.g. libx.so.10 before libx.so.9 */
+#define PGFINDLIB_DLOPEN_ORDER_SEARCH                 0
+#define PGFINDLIB_DLOPEN_ORDER_LOADED_FIRST           1
+#define PGFINDLIB_DLOPEN_ORDER_HIGHEST_VERSION_FIRST  2
+
+/* A row is skipped if: ELF = a 07x comment, ACCESS = 060, BROKEN = 061 or 062, DUPLICATE = 014 or 015 (the same file was tried),
+   NOT_EXACT_NAME = the file name isn't soname, e.g. WHERE libx.so matched libx.so.1. Rows without an absolute path are always skipped. */
+#define PGFINDLIB_DLOPEN_REJECT_ELF                0x01
+#define PGFINDLIB_DLOPEN_REJECT_ACCESS             0x02
+#define PGFINDLIB_DLOPEN_REJECT_BROKEN             0x04
+#define PGFINDLIB_DLOPEN_REJECT_DUPLICATE          0x08
+#define PGFINDLIB_DLOPEN_REJECT_NOT_EXACT_NAME     0x10
+#define PGFINDLIB_DLOPEN_REJECT_DEFAULT            0x1f
+
+/*
+  pgfindlib_warmup_start() prefetches the executable and read-only PT_LOAD segments of paths into the page cache
+  in a background thread, so that a later dlopen() doesn't wait for the disk. pgfindlib_warmup_wait() gives the result.
+  READAHEAD = readahead() (posix_fadvise(WILLNEED) on FreeBSD or if readahead() fails), POPULATE = mmap() with
+  MAP_POPULATE, which waits until the pages are read, falling back to READAHEAD.
+*/
+struct pgfindlib_warmup;
+struct pgfindlib_warmup_result
+{
+  unsigned long long bytes_prefetched;
+  long long microseconds;        /* from the start to the end of the background thread's work */
+  unsigned int files_count;      /* files that were native ELF */
+  unsigned int errors_count;     /* files that couldn't be opened or weren't native ELF */
+};
+extern int pgfindlib_warmup_start(const char *const paths[], unsigned int paths_count, unsigned int flags, struct pgfindlib_warmup **warmup);
+extern int pgfindlib_warmup_wait(struct pgfindlib_warmup *warmup, struct pgfindlib_warmup_result *result);
+#define PGFINDLIB_WARMUP_READAHEAD                 0x01
+#define PGFINDLIB_WARMUP_POPULATE                  0x02
+
+/*
+  pgfindlib_build_id() puts path's GNU build-id (the NT_GNU_BUILD_ID note that ld --build-id makes, usually 20 bytes)
+  in build_id, which must have room for PGFINDLIB_MAX_BUILD_ID_LENGTH bytes, and its length in *build_id_length.
+  Files with the same build-id are the same build wherever they are, so it's a key for caching anything about
+  a library without hashing its contents. It's PGFINDLIB_ERROR_NOT_FOUND if path can't be read or isn't ELF or has no build-id.
+*/
+#define PGFINDLIB_MAX_BUILD_ID_LENGTH 64
+extern int pgfindlib_build_id(const char *path, unsigned char *build_id, unsigned int *build_id_length);
+
+/*
+  pgfindlib_audit.c is an LD_AUDIT library that logs what the loader really does, options->audit_log is such a log,
+  see "Re audit log" in README.md. The log is chunks, each written with one write(): a struct pgfindlib_audit_chunk,
+  then length bytes of records, each a struct pgfindlib_audit_record, path_length bytes of path (no \0), and padding
+  to a multiple of 8. Integers are in the writing machine's byte order, so read the log on the machine that wrote it.
+*/
+#define PGFINDLIB_AUDIT_MAGIC 0x31414750 /* "PGA1" */
+struct pgfindlib_audit_chunk
+{
+  unsigned int magic;
+  unsigned int pid;
+  unsigned int length;
+  unsigned int reserved;
+};
+struct pgfindlib_audit_record
+{
+  unsigned long long nanoseconds;  /* CLOCK_MONOTONIC when the loader called */
+  unsigned char type;              /* PGFINDLIB_AUDIT_SEARCH etc. */
+  unsigned char flag;              /* la_objsearch()'s LA_SER_... or la_activity()'s LA_ACT_... */
+  unsigned short path_length;
+  unsigned int reserved;
+};
+#define PGFINDLIB_AUDIT_SEARCH    1 /* la_objsearch() with LA_SER_ORIG, a search starts, path is the name e.g. libz.so.1 */
+#define PGFINDLIB_AUDIT_TRY       2 /* la_objsearch() with another LA_SER_..., path is a directory + the name, or ld.so.cache's path */
+#define PGFINDLIB_AUDIT_OPEN      3 /* la_objopen(), path is the mapped object's l_name */
+#define PGFINDLIB_AUDIT_ACTIVITY  4 /* la_activity(), no path */
+
 #define PGFINDLIB_OK 0
 #define PGFINDLIB_ERROR_BUFFER_MAX_LENGTH_TOO_SMALL -1
 #define PGFINDLIB_ERROR_BUFFER_NULL -2
@@ -32,6 +243,14 @@ extern int pgfindlib(const char *statement, char *buffer, unsigned int buffer_ma
 #define PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW -4
 #define PGFINDLIB_MALLOC_BUFFER_2_OVERFLOW -5
 #define PGFINDLIB_ERROR_STATEMENT_SYNTAX -6
+#define PGFINDLIB_ERROR_NOT_FOUND -7
+#define PGFINDLIB_ERROR_DLOPEN_FAILED -8
+#define PGFINDLIB_ERROR_SYSROOT -9
+#define PGFINDLIB_ERROR_CANCELLED -10
+#define PGFINDLIB_ERROR_SNAPSHOT -11
+#define PGFINDLIB_ERROR_LINK_FARM -12
+#define PGFINDLIB_ERROR_AUDIT_LOG -13
+#define PGFINDLIB_ERROR_FILE_DESCRIPTORS -14
 
 /* PGFINDLIB_INCLUDE_ items must be 0 or 1. To not include, say e.g. -DPGFINDLIB_INCLUDE_ROW_VERSIONT=0 */
 
@@ -67,6 +286,76 @@ extern int pgfindlib(const char *statement, char *buffer, unsigned int buffer_ma
 #define PGFINDLIB_INCLUDE_LD_PGFINDLIB_PATH 1
 #endif
 
+/* The "loaded" source i.e. what dl_iterate_phdr() says is already mapped. It's not in the default FROM list. */
+#ifndef PGFINDLIB_INCLUDE_LOADED
+#define PGFINDLIB_INCLUDE_LOADED 1
+#endif
+
+/* pgfindlib_dlopen(). With old glibc, link with -ldl -pthread. */
+#ifndef PGFINDLIB_INCLUDE_DLOPEN
+#define PGFINDLIB_INCLUDE_DLOPEN 1
+#endif
+
+/* pgfindlib_warmup_start() and pgfindlib_warmup_wait(). With old glibc, link with -pthread. */
+#ifndef PGFINDLIB_INCLUDE_WARMUP
+#define PGFINDLIB_INCLUDE_WARMUP 1
+#endif
+
+/* pgfindlib_async_submit() etc. With old glibc, link with -pthread. */
+#ifndef PGFINDLIB_INCLUDE_ASYNC
+#define PGFINDLIB_INCLUDE_ASYNC 1
+#endif
+
+/* options->deadline_milliseconds and options->directory_budget_milliseconds. With old glibc, link with -pthread. */
+#ifndef PGFINDLIB_INCLUDE_DEADLINE
+#define PGFINDLIB_INCLUDE_DEADLINE 1
+#endif
+
+/* pgfindlib_backend_memory_open() etc. With old glibc, link with -pthread. */
+#ifndef PGFINDLIB_INCLUDE_BACKEND_MEMORY
+#define PGFINDLIB_INCLUDE_BACKEND_MEMORY 1
+#endif
+
+/* Read directories with getdents64 rather than readdir(), only on Linux. See "Re directory reading" in README.md. */
+#ifndef PGFINDLIB_INCLUDE_GETDENTS
+#define PGFINDLIB_INCLUDE_GETDENTS 1
+#endif
+
+/* The size of the buffer for one getdents64 call */
+#ifndef PGFINDLIB_DIRENT_BUFFER_SIZE
+#define PGFINDLIB_DIRENT_BUFFER_SIZE 65536
+#endif
+
+/* options->sysroot and pgfindlib_batch(), only on Linux 5.6 or later because they need openat2() */
+#ifndef PGFINDLIB_INCLUDE_SYSROOT
+#define PGFINDLIB_INCLUDE_SYSROOT 1
+#endif
+
+/* PGFINDLIB_OPTION_BUILD_ID and pgfindlib_build_id() */
+#ifndef PGFINDLIB_INCLUDE_BUILD_ID
+#define PGFINDLIB_INCLUDE_BUILD_ID 1
+#endif
+
+/* options->snapshot_path and PGFINDLIB_OPTION_DELTA */
+#ifndef PGFINDLIB_INCLUDE_SNAPSHOT
+#define PGFINDLIB_INCLUDE_SNAPSHOT 1
+#endif
+
+/* options->audit_log */
+#ifndef PGFINDLIB_INCLUDE_AUDIT_LOG
+#define PGFINDLIB_INCLUDE_AUDIT_LOG 1
+#endif
+
+/* options->architectures */
+#ifndef PGFINDLIB_INCLUDE_ARCHITECTURES
+#define PGFINDLIB_INCLUDE_ARCHITECTURES 1
+#endif
+
+/* The reports for PGFINDLIB_OPTION_PROBE_COST and PGFINDLIB_OPTION_OPTIMIZE_PATHS, and options->link_farm */
+#ifndef PGFINDLIB_INCLUDE_PROBE_COST
+#define PGFINDLIB_INCLUDE_PROBE_COST 1
+#endif
+
 #ifndef PGFINDLIB_INCLUDE_GET_LIB_OR_PLATFORM
 #define PGFINDLIB_INCLUDE_GET_LIB_OR_PLATFORM 1
 #endif
@@ -96,6 +385,42 @@ extern int pgfindlib(const char *statement, char *buffer, unsigned int buffer_ma
 #define PGFINDLIB_IF_SYMLINKS                        1
 #define PGFINDLIB_IF_HARDLINKS                       1
 
+/*
+  Bits for pgfindlib_options.flags. A bit can switch off a check for one call, it can't switch on a check
+  that PGFINDLIB_INCLUDE_... or PGFINDLIB_COMMENT_... excluded. When a check is off its system calls are not made:
+  ACCESS = access() of each path, comment 060
+  SYMLINKS = lstat() of each path and resolving symlinks, comments 013 015 062 and the target column
+  HARDLINKS = lstat() of each path and checking for the same inode, comment 014
+  ELF = open() and read of each path's ELF header, comments 070-076
+  GET_LIB_OR_PLATFORM = popen() of the dynamic loader to learn $LIB and $PLATFORM, else they are assumed
+  ROW_VERSION = the 001 version row, ROW_LIB = the $LIB/$PLATFORM/$ORIGIN row
+  PROBE_COST = after the usual rows, rows 017 and 018 with the loader's failed open()s per WHERE item, see "Re probe cost"
+  in README.md. It's a report mode rather than a check, so it's not in PGFINDLIB_OPTIONS_DEFAULT.
+  OPTIMIZE_PATHS = after the usual rows, rows 019-021 with a proposed LD_LIBRARY_PATH and DT_RUNPATH that find the
+  same files with fewer failed open()s, see "Re path optimizer" in README.md. Also not in PGFINDLIB_OPTIONS_DEFAULT.
+  BUILD_ID = read each path's GNU build-id with the ELF header, comments 024 and 025, see "Re build-id" in README.md.
+  Not in PGFINDLIB_OPTIONS_DEFAULT because it adds a comment to nearly every row.
+  DELTA = only the rows that were added, removed, changed or moved since the snapshot in options->snapshot_path,
+  comments 026-029, see "Re snapshots" in README.md. Ignored if options->snapshot_path is NULL.
+  STREAM = sort and make the rows of each source before the next source is searched, so the first rows are ready
+  sooner (with options->rows_ready) and the candidate lists only need room for the biggest source, see "Re streaming"
+  in README.md. Ignored with PROBE_COST, OPTIMIZE_PATHS, options->link_farm, options->architectures or options->snapshot_path.
+*/
+#define PGFINDLIB_OPTION_ACCESS                   0x01
+#define PGFINDLIB_OPTION_SYMLINKS                 0x02
+#define PGFINDLIB_OPTION_HARDLINKS                0x04
+#define PGFINDLIB_OPTION_ELF                      0x08
+#define PGFINDLIB_OPTION_GET_LIB_OR_PLATFORM      0x10
+#define PGFINDLIB_OPTION_ROW_VERSION              0x20
+#define PGFINDLIB_OPTION_ROW_LIB                  0x40
+#define PGFINDLIB_OPTION_PROBE_COST               0x80
+#define PGFINDLIB_OPTION_OPTIMIZE_PATHS           0x100
+#define PGFINDLIB_OPTION_BUILD_ID                 0x200
+#define PGFINDLIB_OPTION_DELTA                    0x400
+#define PGFINDLIB_OPTION_STREAM                   0x800
+#define PGFINDLIB_OPTIONS_PATHS_ONLY              0x00
+#define PGFINDLIB_OPTIONS_DEFAULT                 0x7f
+
 /* Every column in a buffer output row ends with ", " but you can redefine e.g. to ":" if worried that filenames contain commas */
 #define PGFINDLIB_COLUMN_DELIMITER ", "
 #define PGFINDLIB_ROW_DELIMITER "\n"
@@ -106,6 +431,7 @@ extern int pgfindlib(const char *statement, char *buffer, unsigned int buffer_ma
 #define COLUMN_FOR_COMMENT_1 3
 #define COLUMN_FOR_COMMENT_2 4
 #define COLUMN_FOR_COMMENT_3 5
+#define COLUMN_FOR_TARGET 6
 
 /* Every COLUMN_FOR_COMMENT_x starts with a 3-digit number. Generlly informative ones are 1-49, severe or unexpected ones are 50-99, syntax errors are 100-150 */
 /* Many non-syntax-related comments can be suppressed by changing the #define to 0. */
@@ -123,6 +449,24 @@ extern int pgfindlib(const char *statement, char *buffer, unsigned int buffer_ma
 #define PGFINDLIB_COMMENT_REPLACE_STRING             12
 #define PGFINDLIB_COMMENT_SYMLINK                    13
 #define PGFINDLIB_COMMENT_DUPLICATE                  14
+#define PGFINDLIB_COMMENT_SAME_TARGET                15
+#define PGFINDLIB_COMMENT_ALREADY_MAPPED             16
+#define PGFINDLIB_COMMENT_PROBE_MISSES               17
+#define PGFINDLIB_COMMENT_PROBE_MISSES_TOTAL         18
+#define PGFINDLIB_COMMENT_PATH_PROPOSAL              19
+#define PGFINDLIB_COMMENT_PATH_PROPOSAL_MISSES       20
+#define PGFINDLIB_COMMENT_PATH_UNUSED                21
+#define PGFINDLIB_COMMENT_ARCHITECTURE_VIEW          22
+#define PGFINDLIB_COMMENT_SYSROOT                    23
+#define PGFINDLIB_COMMENT_BUILD_ID                   24
+#define PGFINDLIB_COMMENT_SAME_BUILD                 25
+#define PGFINDLIB_COMMENT_DELTA_ADDED                26
+#define PGFINDLIB_COMMENT_DELTA_REMOVED              27
+#define PGFINDLIB_COMMENT_DELTA_CHANGED              28
+#define PGFINDLIB_COMMENT_DELTA_MOVED                29
+#define PGFINDLIB_COMMENT_LINK_FARM                  30
+#define PGFINDLIB_COMMENT_AUDIT_OBSERVED             31
+#define PGFINDLIB_COMMENT_LINK_FARM_ORIGIN           32
 #define PGFINDLIB_COMMENT_ACCESS_LDCONFIG_FAILED     50
 #define PGFINDLIB_COMMENT_CANNOT_READ_RPATH          51
 #define PGFINDLIB_COMMENT_CANNOT_READ_RUNPATH        52
@@ -135,6 +479,9 @@ extern int pgfindlib(const char *statement, char *buffer, unsigned int buffer_ma
 #define PGFINDLIB_COMMENT_CANT_ACCESS_DYNAMIC_LOADER 59
 #define PGFINDLIB_COMMENT_ACCESS_FAILED              60
 #define PGFINDLIB_COMMENT_LSTAT_FAILED               61
+#define PGFINDLIB_COMMENT_SYMLINK_BROKEN             62
+#define PGFINDLIB_COMMENT_DIRECTORY_SKIPPED          63
+#define PGFINDLIB_COMMENT_CHECKS_SKIPPED             64
 #define PGFINDLIB_COMMENT_ELF_OPEN_FAILED            70
 #define PGFINDLIB_COMMENT_ELF_READ_FAILED            71
 #define PGFINDLIB_COMMENT_ELF_HAS_INVALID_IDENT      72
@@ -171,6 +518,7 @@ extern int pgfindlib(const char *statement, char *buffer, unsigned int buffer_ma
 #define PGFINDLIB_TOKEN_COMMA                       14
 #define PGFINDLIB_TOKEN_END                         15
 #define PGFINDLIB_TOKEN_UNKNOWN                     17
+#define PGFINDLIB_TOKEN_SOURCE_LOADED               18 /* after the others so that their numbers stay as they were */
 
 #ifndef PGFINDLIB_MAX_INODE_COUNT
 #define PGFINDLIB_MAX_INODE_COUNT 1000
@@ -180,6 +528,7 @@ extern int pgfindlib(const char *statement, char *buffer, unsigned int buffer_ma
 #define PGFINDLIB_MAX_PATH_LENGTH 4096
 #endif
 
+/* Not a maximum any more, the token list starts with room for this many and grows */
 #ifndef PGFINDLIB_MAX_TOKENS_COUNT
 #define PGFINDLIB_MAX_TOKENS_COUNT 100
 #endif
@@ -0,0 +1,122 @@
+/*
+  pgfindlib_audit.c -- an LD_AUDIT library that logs the loader's real search, for options->audit_log
+
+  Build: gcc -O2 -shared -fPIC -o pgfindlib_audit.so pgfindlib_audit.c
+  Run:   PGFINDLIB_AUDIT_LOG=/tmp/app.audit LD_AUDIT=/full/path/to/pgfindlib_audit.so ./app
+  For each object the loader looks for, the log has when the search started, each place it tried (the loader calls
+  la_objsearch() once per directory of the search list, before it tries the directory's glibc-hwcaps subdirectories and
+  the directory, and for the path ld.so.cache gave), and when the object was mapped (la_objopen()), see
+  struct pgfindlib_audit_record in pgfindlib.h and "Re audit log" in README.md.
+  Nothing is logged if PGFINDLIB_AUDIT_LOG is unset or can't be opened.
+  Records are buffered, and appended with one write() when the loader is done (la_activity() with LA_ACT_CONSISTENT),
+  so several processes can share a log. The loader holds its lock while it calls these, so there's no locking here.
+*/
+#if (!defined(_GNU_SOURCE))
+#define _GNU_SOURCE /* for the rtld-audit interface in link.h */
+#endif
+#include <link.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pgfindlib.h"
+
+#define PGFINDLIB_AUDIT_BUFFER_SIZE 65536
+
+static char pgfindlib_audit_buffer[PGFINDLIB_AUDIT_BUFFER_SIZE] __attribute__((aligned(8)));
+static unsigned int pgfindlib_audit_length= sizeof(struct pgfindlib_audit_chunk); /* the chunk header is filled in by the flush */
+static int pgfindlib_audit_fd= -1;
+static pid_t pgfindlib_audit_pid= 0; /* whose records are in the buffer */
+
+static void pgfindlib_audit_flush(void)
+{
+  if ((pgfindlib_audit_fd < 0) || (pgfindlib_audit_length == sizeof(struct pgfindlib_audit_chunk))) return;
+  struct pgfindlib_audit_chunk *chunk= (struct pgfindlib_audit_chunk *)pgfindlib_audit_buffer;
+  chunk->magic= PGFINDLIB_AUDIT_MAGIC;
+  chunk->pid= (unsigned int) pgfindlib_audit_pid;
+  chunk->length= pgfindlib_audit_length - sizeof(struct pgfindlib_audit_chunk);
+  chunk->reserved= 0;
+  ssize_t written= write(pgfindlib_audit_fd, pgfindlib_audit_buffer, pgfindlib_audit_length);
+  (void) written; /* a failed write loses the chunk, the program being loaded mustn't be disturbed */
+  pgfindlib_audit_length= sizeof(struct pgfindlib_audit_chunk);
+}
+
+/*
+  Append a record. is_start means the loader is starting something, which after fork() happens in the child
+  before anything else, so that's when a child drops the parent's records (the parent will write them).
+  The time is taken first so it doesn't include getpid().
+*/
+static void pgfindlib_audit_add(unsigned char type, unsigned char flag, const char *path, int is_start)
+{
+  if (pgfindlib_audit_fd < 0) return;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  if (is_start)
+  {
+    pid_t pid= getpid();
+    if (pid != pgfindlib_audit_pid)
+    {
+      pgfindlib_audit_length= sizeof(struct pgfindlib_audit_chunk);
+      pgfindlib_audit_pid= pid;
+    }
+  }
+  unsigned int path_length= (path == NULL) ? 0 : strlen(path);
+  if (path_length > PGFINDLIB_MAX_PATH_LENGTH) path_length= PGFINDLIB_MAX_PATH_LENGTH;
+  unsigned int record_length= (sizeof(struct pgfindlib_audit_record) + path_length + 7) & ~7U;
+  if (pgfindlib_audit_length + record_length > PGFINDLIB_AUDIT_BUFFER_SIZE) pgfindlib_audit_flush();
+  struct pgfindlib_audit_record *record= (struct pgfindlib_audit_record *)(pgfindlib_audit_buffer + pgfindlib_audit_length);
+  record->nanoseconds= (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+  record->type= type;
+  record->flag= flag;
+  record->path_length= (unsigned short) path_length;
+  record->reserved= 0;
+  char *p= (char *)(record + 1);
+  if (path_length > 0) memcpy(p, path, path_length);
+  memset(p + path_length, 0, record_length - sizeof(struct pgfindlib_audit_record) - path_length);
+  pgfindlib_audit_length+= record_length;
+}
+
+/* The loader calls this first. The log is opened with O_APPEND so every chunk goes at the end whoever else writes. */
+unsigned int la_version(unsigned int version)
+{
+  (void) version;
+  const char *log= getenv("PGFINDLIB_AUDIT_LOG");
+  if ((log != NULL) && (*log != '\0'))
+  {
+    pgfindlib_audit_fd= open(log, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | O_NOFOLLOW, 0644);
+    pgfindlib_audit_pid= getpid();
+  }
+  return LAV_CURRENT;
+}
+
+/* LA_SER_ORIG is the name as asked for, e.g. from DT_NEEDED or dlopen(), the other flags are paths the loader will try */
+char *la_objsearch(const char *name, uintptr_t *cookie, unsigned int flag)
+{
+  (void) cookie;
+  if (flag == LA_SER_ORIG) pgfindlib_audit_add(PGFINDLIB_AUDIT_SEARCH, (unsigned char) flag, name, 1);
+  else pgfindlib_audit_add(PGFINDLIB_AUDIT_TRY, (unsigned char) flag, name, 0);
+  return (char *) name;
+}
+
+unsigned int la_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie)
+{
+  (void) lmid; (void) cookie;
+  pgfindlib_audit_add(PGFINDLIB_AUDIT_OPEN, 0, map->l_name, 0);
+  return 0; /* not LA_FLG_BINDTO or LA_FLG_BINDFROM, symbol bindings aren't audited, which would slow the program */
+}
+
+void la_activity(uintptr_t *cookie, unsigned int flag)
+{
+  (void) cookie;
+  pgfindlib_audit_add(PGFINDLIB_AUDIT_ACTIVITY, (unsigned char) flag, NULL, 1);
+  if (flag == LA_ACT_CONSISTENT) pgfindlib_audit_flush();
+}
+
+/* For whatever came after the last LA_ACT_CONSISTENT, e.g. a search that failed */
+static void __attribute__((destructor)) pgfindlib_audit_fini(void)
+{
+  pgfindlib_audit_flush();
+}
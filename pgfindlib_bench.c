@@ -0,0 +1,468 @@
+/*
+  pgfindlib_bench.c -- microbenchmarks for pgfindlib's inner routines
+
+  This includes pgfindlib.c rather than linking with it, so that static functions are reachable.
+  Build: gcc -O2 -o pgfindlib_bench pgfindlib_bench.c -ldl -pthread
+  Run:   ./pgfindlib_bench [baseline file name] [repetitions]
+  The default baseline file name is pgfindlib_bench_baseline.txt, the default repetitions is 200.
+  Each case is run for warm-up, then timed repetitions times, each repetition being a batch of calls.
+  Output is one line per case: name, calls per repetition, min / p50 / p90 / p99 nanoseconds per call,
+  and p50 cycles per call (0 if there is no cycle counter). Compare two baseline files to see a delta.
+*/
+#include "pgfindlib.c"
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PGFINDLIB_BENCH_CYCLES() __rdtsc()
+#elif defined(__aarch64__)
+static inline unsigned long long pgfindlib_bench_cntvct(void)
+{
+  unsigned long long v;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+}
+#define PGFINDLIB_BENCH_CYCLES() pgfindlib_bench_cntvct()
+#else
+#define PGFINDLIB_BENCH_CYCLES() 0ULL
+#endif
+
+#define PGFINDLIB_BENCH_WARMUP 20
+#define PGFINDLIB_BENCH_MAX_REPETITIONS 10000
+
+/* The results of each call are added here so that the compiler can't discard the calls. */
+static volatile unsigned long long pgfindlib_bench_sink= 0;
+
+static unsigned long long pgfindlib_bench_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+}
+
+static int pgfindlib_bench_compare_ull(const void *p1, const void *p2)
+{
+  unsigned long long a= *(const unsigned long long *) p1;
+  unsigned long long b= *(const unsigned long long *) p2;
+  return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+/* One case: setup is optional and not timed, run does calls_per_repetition calls. */
+struct pgfindlib_bench_case
+{
+  const char *name;
+  unsigned int calls_per_repetition;
+  void (*setup)(void);
+  void (*run)(unsigned int calls);
+};
+
+static void pgfindlib_bench_one(FILE *out, const struct pgfindlib_bench_case *bench_case, unsigned int repetitions)
+{
+  static unsigned long long ns[PGFINDLIB_BENCH_MAX_REPETITIONS];
+  static unsigned long long cycles[PGFINDLIB_BENCH_MAX_REPETITIONS];
+  unsigned int calls= bench_case->calls_per_repetition;
+  for (unsigned int i= 0; i < PGFINDLIB_BENCH_WARMUP; ++i)
+  {
+    if (bench_case->setup != NULL) bench_case->setup();
+    bench_case->run(calls);
+  }
+  for (unsigned int i= 0; i < repetitions; ++i)
+  {
+    if (bench_case->setup != NULL) bench_case->setup();
+    unsigned long long c0= PGFINDLIB_BENCH_CYCLES();
+    unsigned long long t0= pgfindlib_bench_ns();
+    bench_case->run(calls);
+    unsigned long long t1= pgfindlib_bench_ns();
+    unsigned long long c1= PGFINDLIB_BENCH_CYCLES();
+    ns[i]= t1 - t0;
+    cycles[i]= c1 - c0;
+  }
+  qsort(ns, repetitions, sizeof(ns[0]), pgfindlib_bench_compare_ull);
+  qsort(cycles, repetitions, sizeof(cycles[0]), pgfindlib_bench_compare_ull);
+  double per_call= (double) calls;
+  fprintf(out, "%-44s %8u %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+          bench_case->name, calls,
+          (double) ns[0] / per_call,
+          (double) ns[repetitions / 2] / per_call,
+          (double) ns[(repetitions * 90) / 100] / per_call,
+          (double) ns[(repetitions * 99) / 100] / per_call,
+          (double) cycles[repetitions / 2] / per_call);
+}
+
+/* Shared inputs, built once by pgfindlib_bench_inputs() */
+static char bench_statement_short[256];
+static char bench_statement_long[PGFINDLIB_MAX_TOKENS_COUNT * 48];
+#define BENCH_HUGE_ITEMS_COUNT 2000
+static char bench_statement_huge[BENCH_HUGE_ITEMS_COUNT * 48 + 128];
+static char bench_statement_globs[1024];
+static char bench_row_buffer[65536];
+static unsigned int bench_row_buffer_length;
+static unsigned int bench_row_number;
+static ino_t bench_inode_list[PGFINDLIB_MAX_INODE_COUNT];
+static unsigned int bench_inode_count;
+static struct tokener *bench_tokener_list;
+static unsigned int bench_tokener_max;
+static struct pgfindlib_where_matcher bench_matcher_prefixes;
+static struct pgfindlib_where_matcher bench_matcher_huge;
+static struct pgfindlib_where_matcher bench_matcher_globs;
+#define BENCH_LINES_COUNT 64
+static char bench_lines[BENCH_LINES_COUNT][PGFINDLIB_MAX_PATH_LENGTH];
+static struct pgfindlib_context *bench_context;
+static char bench_dollar_path[PGFINDLIB_MAX_PATH_LENGTH];
+static char bench_dollar_path_work[PGFINDLIB_MAX_PATH_LENGTH + 1];
+static char bench_long_path[PGFINDLIB_MAX_PATH_LENGTH];
+#define BENCH_CANDIDATES_COUNT 4096
+static char *bench_malloc_buffer_1;
+static unsigned int bench_malloc_buffer_1_length;
+static unsigned int bench_malloc_buffer_1_max_length;
+static struct pgfindlib_candidate *bench_malloc_buffer_2;
+static unsigned int bench_malloc_buffer_2_length;
+static struct pgfindlib_candidate bench_candidates[BENCH_CANDIDATES_COUNT + 1];
+static unsigned int bench_candidates_count;
+static char bench_candidate_paths[BENCH_CANDIDATES_COUNT][160];
+static char bench_candidate_names[BENCH_CANDIDATES_COUNT * 32];
+static unsigned int bench_candidate_names_length;
+static struct pgfindlib_context *bench_candidates_context;     /* has bench_candidates' directory */
+static const char *bench_columns_list[MAX_COLUMNS_PER_ROW];
+static char bench_row_path[PGFINDLIB_MAX_PATH_LENGTH];
+#if (PGFINDLIB_INCLUDE_BACKEND_MEMORY != 0)
+#define BENCH_MEMORY_FILES_COUNT 20000
+static struct pgfindlib_backend *bench_memory_backend;
+static char bench_memory_buffer[65536];
+#endif
+
+/* Fill with "/usr/lib/x86_64-linux-gnu/aaaa/aaab/..." i.e. a long path made of short directory names. */
+static void pgfindlib_bench_long_path(char *path, unsigned int length)
+{
+  unsigned int i= 0;
+  strcpy(path, "/usr/lib/x86_64-linux-gnu");
+  i= strlen(path);
+  for (unsigned int d= 0; i + 6 < length; ++d)
+  {
+    path[i++]= '/';
+    path[i++]= 'a' + (d / 676) % 26;
+    path[i++]= 'a' + (d / 26) % 26;
+    path[i++]= 'a' + d % 26;
+    path[i++]= 'x';
+  }
+  path[i]= '\0';
+}
+
+static int pgfindlib_bench_inputs(void)
+{
+  int rval;
+  strcpy(bench_statement_short, "FROM LD_LIBRARY_PATH, ld.so.cache, default_paths WHERE libz.so.1, libc.so.6");
+  /* As many WHERE items as fit in the first PGFINDLIB_MAX_TOKENS_COUNT tokens, each soname with a comma after it is 2 tokens */
+  {
+    char *p= bench_statement_long;
+    p+= sprintf(p, "FROM DT_RPATH, LD_LIBRARY_PATH, DT_RUNPATH, ld.so.cache, default_paths WHERE ");
+    unsigned int items_max= (PGFINDLIB_MAX_TOKENS_COUNT - 14) / 2;
+    for (unsigned int i= 0; i < items_max; ++i)
+      p+= sprintf(p, "%slibbenchmark_item_with_a_long_name_%03u.so.%u", (i == 0) ? "" : ", ", i, i % 7);
+  }
+  /* More than the token list starts with room for, so it grows */
+  {
+    char *p= bench_statement_huge;
+    p+= sprintf(p, "FROM ld.so.cache WHERE ");
+    for (unsigned int i= 0; i < BENCH_HUGE_ITEMS_COUNT; ++i)
+      p+= sprintf(p, "%slibbenchmark_item_with_a_long_name_%04u.so.%u", (i == 0) ? "" : ", ", i, i % 7);
+  }
+  strcpy(bench_statement_globs, "FROM ld.so.cache WHERE lib*crypt*.so.*, libssl.so.{1,3}, libz.so.?, lib[a-m]*.so.1, libmysqlclient*.so*, libc.so.6");
+  bench_row_number= 0;
+  bench_inode_count= 0;
+  bench_row_buffer_length= 0;
+  rval= pgfindlib_tokenize(bench_statement_huge, &bench_tokener_list, &bench_tokener_max, &bench_row_number, bench_inode_list, &bench_inode_count,
+                           bench_row_buffer, &bench_row_buffer_length, sizeof(bench_row_buffer));
+  if (rval != PGFINDLIB_OK) return rval;
+  rval= pgfindlib_matcher_init(&bench_matcher_huge, bench_tokener_list);
+  if (rval != PGFINDLIB_OK) return rval;
+  rval= pgfindlib_tokenize(bench_statement_long, &bench_tokener_list, &bench_tokener_max, &bench_row_number, bench_inode_list, &bench_inode_count,
+                           bench_row_buffer, &bench_row_buffer_length, sizeof(bench_row_buffer));
+  if (rval != PGFINDLIB_OK) return rval;
+  rval= pgfindlib_matcher_init(&bench_matcher_prefixes, bench_tokener_list);
+  if (rval != PGFINDLIB_OK) return rval;
+  rval= pgfindlib_tokenize(bench_statement_globs, &bench_tokener_list, &bench_tokener_max, &bench_row_number, bench_inode_list, &bench_inode_count,
+                           bench_row_buffer, &bench_row_buffer_length, sizeof(bench_row_buffer));
+  if (rval != PGFINDLIB_OK) return rval;
+  rval= pgfindlib_matcher_init(&bench_matcher_globs, bench_tokener_list);
+  if (rval != PGFINDLIB_OK) return rval;
+  /* Lines as they come from ldconfig -p or a directory: half are near misses, one is very long */
+  for (unsigned int i= 0; i < BENCH_LINES_COUNT; ++i)
+  {
+    if ((i % 4) == 0) sprintf(bench_lines[i], "\tlibbenchmark_item_with_a_long_name_%03u.so.%u\n", i % 40, (i % 40) % 7);
+    else if ((i % 4) == 1) sprintf(bench_lines[i], "libbenchmark_item_with_a_long_name_%03u.so.9", i);
+    else if ((i % 4) == 2) sprintf(bench_lines[i], "libcrypto.so.%u", i);
+    else sprintf(bench_lines[i], "libunrelated%u.so", i);
+  }
+  pgfindlib_bench_long_path(bench_lines[BENCH_LINES_COUNT - 1], PGFINDLIB_MAX_PATH_LENGTH - 16);
+  struct pgfindlib_options options;
+  memset(&options, 0, sizeof(options));
+  options.flags= PGFINDLIB_OPTIONS_DEFAULT;
+  rval= pgfindlib_context_init(&bench_context, &options);
+  if (rval != PGFINDLIB_OK) return rval;
+  /* Many $ tokens, and $ characters that are not tokens, in a path that stays within PGFINDLIB_MAX_PATH_LENGTH */
+  {
+    char *p= bench_dollar_path;
+    const char *pieces[6]= { "/$ORIGIN/../", "${LIB}/", "$PLATFORM/", "${ORIGIN}/x", "$LIBRARY/", "$nothing/" };
+    for (unsigned int i= 0; (p - bench_dollar_path) < (PGFINDLIB_MAX_PATH_LENGTH / 4); ++i)
+      p+= sprintf(p, "%s", pieces[i % 6]);
+  }
+  pgfindlib_bench_long_path(bench_long_path, PGFINDLIB_MAX_PATH_LENGTH - 64);
+  /* Candidates with a long common prefix, in an order that is neither sorted nor reversed */
+  rval= pgfindlib_context_init(&bench_candidates_context, &options);
+  if (rval != PGFINDLIB_OK) return rval;
+  for (unsigned int i= 0; i < BENCH_CANDIDATES_COUNT; ++i)
+  {
+    unsigned int k= (i * 2654435761U) % BENCH_CANDIDATES_COUNT;
+    sprintf(bench_candidate_paths[i], "/usr/lib/x86_64-linux-gnu/very/deep/common/prefix/for/every/candidate/libbench%05u.so.%u", k, k % 3);
+    rval= pgfindlib_add_to_malloc_buffers(bench_candidates_context, bench_candidate_paths[i], 3 + (k % 2),
+                                          bench_candidate_names, &bench_candidate_names_length, sizeof(bench_candidate_names),
+                                          bench_candidates, &bench_candidates_count, BENCH_CANDIDATES_COUNT + 1);
+    if (rval != PGFINDLIB_OK) return rval;
+  }
+  bench_malloc_buffer_1_max_length= BENCH_CANDIDATES_COUNT * 160;
+  bench_malloc_buffer_1= (char *) malloc(bench_malloc_buffer_1_max_length);
+  bench_malloc_buffer_2= (struct pgfindlib_candidate *) malloc((BENCH_CANDIDATES_COUNT + 1) * sizeof(struct pgfindlib_candidate));
+  if ((bench_malloc_buffer_1 == NULL) || (bench_malloc_buffer_2 == NULL)) return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW;
+  pgfindlib_bench_long_path(bench_row_path, 200);
+  bench_columns_list[0]= bench_row_path;
+  bench_columns_list[1]= "LD_LIBRARY_PATH";
+  bench_columns_list[2]= "";
+  bench_columns_list[3]= "/usr/lib/x86_64-linux-gnu/libz.so.1.2.13";
+  bench_columns_list[4]= "";
+  bench_columns_list[5]= "";
+  bench_columns_list[6]= "";
+#if (PGFINDLIB_INCLUDE_BACKEND_MEMORY != 0)
+  /* A directory bigger than any real one, so the cost is the scan and the matching, not the disk */
+  {
+    char manifest_path[]= "/tmp/pgfindlib_bench_manifest_XXXXXX";
+    int fd= mkstemp(manifest_path);
+    if (fd == -1) return PGFINDLIB_ERROR_NOT_FOUND;
+    FILE *manifest= fdopen(fd, "w");
+    if (manifest == NULL) { close(fd); unlink(manifest_path); return PGFINDLIB_ERROR_NOT_FOUND; }
+    fprintf(manifest, "files /bench/lib libbench*.so %u elf\n", BENCH_MEMORY_FILES_COUNT);
+    fclose(manifest);
+    unsigned int error_line;
+    rval= pgfindlib_backend_memory_open(manifest_path, &bench_memory_backend, &error_line);
+    unlink(manifest_path);
+    if (rval != PGFINDLIB_OK) return rval;
+  }
+#endif
+  return PGFINDLIB_OK;
+}
+
+static void pgfindlib_bench_tokenize(const char *statement, unsigned int calls)
+{
+  for (unsigned int i= 0; i < calls; ++i)
+  {
+    bench_row_number= 0;
+    bench_inode_count= 0;
+    bench_row_buffer_length= 0;
+    int rval= pgfindlib_tokenize(statement, &bench_tokener_list, &bench_tokener_max, &bench_row_number, bench_inode_list, &bench_inode_count,
+                                 bench_row_buffer, &bench_row_buffer_length, sizeof(bench_row_buffer));
+    pgfindlib_bench_sink+= (unsigned long long) rval + bench_tokener_list[0].tokener_length;
+  }
+}
+static void run_tokenize_short(unsigned int calls) { pgfindlib_bench_tokenize(bench_statement_short, calls); }
+static void run_tokenize_long(unsigned int calls) { pgfindlib_bench_tokenize(bench_statement_long, calls); }
+static void run_tokenize_globs(unsigned int calls) { pgfindlib_bench_tokenize(bench_statement_globs, calls); }
+static void run_tokenize_huge(unsigned int calls) { pgfindlib_bench_tokenize(bench_statement_huge, calls); }
+
+/* Each call is BENCH_LINES_COUNT lines, so ns per call is for a batch of lines */
+static void pgfindlib_bench_find_line(struct pgfindlib_where_matcher *matcher, unsigned int calls)
+{
+  for (unsigned int i= 0; i < calls; ++i)
+  {
+    unsigned int hits= 0;
+    for (unsigned int j= 0; j < BENCH_LINES_COUNT; ++j) hits+= pgfindlib_find_line_in_statement(matcher, bench_lines[j]);
+    pgfindlib_bench_sink+= hits;
+  }
+}
+static void run_find_line_prefixes(unsigned int calls) { pgfindlib_bench_find_line(&bench_matcher_prefixes, calls); }
+static void run_find_line_globs(unsigned int calls) { pgfindlib_bench_find_line(&bench_matcher_globs, calls); }
+static void run_find_line_huge(unsigned int calls) { pgfindlib_bench_find_line(&bench_matcher_huge, calls); }
+
+static void pgfindlib_bench_replace(const char *path, unsigned int calls)
+{
+  for (unsigned int i= 0; i < calls; ++i)
+  {
+    unsigned int replacements_count;
+    strcpy(bench_dollar_path_work, path);
+    int rval= pgfindlib_replace_lib_or_platform_or_origin(bench_dollar_path_work, &replacements_count,
+                                                          "lib/x86_64-linux-gnu", "x86_64", "/usr/local/bin", bench_context);
+    pgfindlib_bench_sink+= (unsigned long long) rval + replacements_count;
+  }
+}
+static void run_replace_none(unsigned int calls) { pgfindlib_bench_replace(bench_long_path, calls); }
+static void run_replace_one(unsigned int calls) { pgfindlib_bench_replace("$ORIGIN/../lib", calls); }
+static void run_replace_many(unsigned int calls) { pgfindlib_bench_replace(bench_dollar_path, calls); }
+
+static void setup_add_empty(void)
+{
+  bench_malloc_buffer_1_length= 0;
+  bench_malloc_buffer_2_length= 0;
+  pgfindlib_candidates_reset(bench_context);
+}
+/* Nearly full: the final calls of each repetition return PGFINDLIB_MALLOC_BUFFER_1_OVERFLOW */
+static void setup_add_nearly_full(void)
+{
+  bench_malloc_buffer_1_length= bench_malloc_buffer_1_max_length - (64 * 100);
+  bench_malloc_buffer_2_length= 0;
+  pgfindlib_candidates_reset(bench_context);
+}
+static void run_add(unsigned int calls)
+{
+  for (unsigned int i= 0; i < calls; ++i)
+  {
+    int rval= pgfindlib_add_to_malloc_buffers(bench_context, bench_candidate_paths[i % BENCH_CANDIDATES_COUNT], 3,
+                                              bench_malloc_buffer_1, &bench_malloc_buffer_1_length, bench_malloc_buffer_1_max_length,
+                                              bench_malloc_buffer_2, &bench_malloc_buffer_2_length, BENCH_CANDIDATES_COUNT + 1);
+    pgfindlib_bench_sink+= (unsigned long long) rval;
+  }
+}
+
+/* Neighbours differ only near the end of the path, but the common prefix is their directory, so only names are compared */
+static void run_compare(unsigned int calls)
+{
+  for (unsigned int i= 0; i < calls; ++i)
+  {
+    unsigned int j= i % (BENCH_CANDIDATES_COUNT - 1);
+    pgfindlib_bench_sink+= (unsigned long long) pgfindlib_candidate_compare(bench_candidate_names, bench_candidates_context->candidate_directories,
+                                                                            &bench_candidates[j], &bench_candidates[j + 1]);
+  }
+}
+
+static struct pgfindlib_candidate bench_sort_work[BENCH_CANDIDATES_COUNT];
+static void setup_sort(void)
+{
+  memcpy(bench_sort_work, bench_candidates, sizeof(bench_sort_work));
+}
+/* The sources alternate, so it's the radix sort of everything */
+static void run_sort(unsigned int calls)
+{
+  (void) calls;
+  pgfindlib_sort_candidates(bench_candidate_names, bench_candidates_context->candidate_directories, bench_sort_work, BENCH_CANDIDATES_COUNT);
+  pgfindlib_bench_sink+= bench_sort_work[0].source_number;
+}
+
+static void setup_row_empty(void)
+{
+  bench_row_buffer_length= 0;
+  bench_row_number= 0;
+}
+/* Nearly full: the final calls of each repetition return PGFINDLIB_ERROR_BUFFER_MAX_LENGTH_TOO_SMALL */
+static void setup_row_nearly_full(void)
+{
+  memset(bench_row_buffer, 'x', sizeof(bench_row_buffer));
+  bench_row_buffer_length= sizeof(bench_row_buffer) - 4096;
+  bench_row_number= 0;
+}
+static void run_row(unsigned int calls)
+{
+  for (unsigned int i= 0; i < calls; ++i)
+  {
+    int rval= pgfindlib_row_bottom_level(bench_row_buffer, &bench_row_buffer_length, sizeof(bench_row_buffer), &bench_row_number,
+                                         bench_columns_list);
+    pgfindlib_bench_sink+= (unsigned long long) rval;
+  }
+}
+
+#if (PGFINDLIB_INCLUDE_BACKEND_MEMORY != 0)
+/* A whole search with the memory backend: 20000 directory entries, 111 matches */
+static void run_memory_backend(unsigned int calls)
+{
+  static char *const envp[]= { "LD_LIBRARY_PATH=/bench/lib", NULL };
+  struct pgfindlib_options options;
+  memset(&options, 0, sizeof(options));
+  options.flags= PGFINDLIB_OPTIONS_PATHS_ONLY;
+  options.envp= envp;
+  options.backend= bench_memory_backend;
+  for (unsigned int i= 0; i < calls; ++i)
+  {
+    int rval= pgfindlib_ex("FROM LD_LIBRARY_PATH WHERE libbench123*.so", bench_memory_buffer, sizeof(bench_memory_buffer), &options);
+    pgfindlib_bench_sink+= (unsigned long long) rval + strlen(bench_memory_buffer);
+  }
+}
+#endif
+
+static const struct pgfindlib_bench_case pgfindlib_bench_cases[]=
+{
+  { "tokenize short statement", 1000, NULL, run_tokenize_short },
+  { "tokenize 43 WHERE items", 200, NULL, run_tokenize_long },
+  { "tokenize globs", 1000, NULL, run_tokenize_globs },
+  { "tokenize 2000 WHERE items", 10, NULL, run_tokenize_huge },
+  { "find_line_in_statement prefixes x64 lines", 100, NULL, run_find_line_prefixes },
+  { "find_line_in_statement globs x64 lines", 100, NULL, run_find_line_globs },
+  { "find_line_in_statement 2000 items x64 lines", 100, NULL, run_find_line_huge },
+  { "replace_lib_or_platform_or_origin no $", 1000, NULL, run_replace_none },
+  { "replace_lib_or_platform_or_origin one $", 1000, NULL, run_replace_one },
+  { "replace_lib_or_platform_or_origin many $", 200, NULL, run_replace_many },
+  { "add_to_malloc_buffers empty", 1000, setup_add_empty, run_add },
+  { "add_to_malloc_buffers nearly full", 100, setup_add_nearly_full, run_add },
+  { "candidate_compare long common prefix", 4000, NULL, run_compare },
+  { "sort_candidates 4096 candidates", 1, setup_sort, run_sort },
+  { "row_bottom_level empty", 100, setup_row_empty, run_row },
+  { "row_bottom_level nearly full", 20, setup_row_nearly_full, run_row },
+#if (PGFINDLIB_INCLUDE_BACKEND_MEMORY != 0)
+  { "pgfindlib_ex memory backend 20000 files", 1, NULL, run_memory_backend },
+#endif
+};
+
+int main(int argc, char *argv[])
+{
+  const char *file_name= (argc > 1) ? argv[1] : "pgfindlib_bench_baseline.txt";
+  unsigned int repetitions= (argc > 2) ? (unsigned int) atoi(argv[2]) : 200;
+  if ((repetitions == 0) || (repetitions > PGFINDLIB_BENCH_MAX_REPETITIONS))
+  {
+    printf("Expected repetitions between 1 and %d\n", PGFINDLIB_BENCH_MAX_REPETITIONS);
+    return 1;
+  }
+  int rval= pgfindlib_bench_inputs();
+  if (rval != PGFINDLIB_OK)
+  {
+    printf("Setting up inputs failed, rval=%d\n", rval);
+    return 1;
+  }
+  FILE *out= fopen(file_name, "w");
+  if (out == NULL)
+  {
+    printf("Could not open %s\n", file_name);
+    return 1;
+  }
+  FILE *outs[2]= { stdout, out };
+  for (unsigned int o= 0; o < 2; ++o)
+  {
+    fprintf(outs[o], "# pgfindlib %d.%d.%d benchmark, %u repetitions, ns and cycles are per call\n",
+            PGFINDLIB_VERSION_MAJOR, PGFINDLIB_VERSION_MINOR, PGFINDLIB_VERSION_PATCH, repetitions);
+    fprintf(outs[o], "%-44s %8s %10s %10s %10s %10s %10s\n", "# case", "calls", "min_ns", "p50_ns", "p90_ns", "p99_ns", "p50_cyc");
+  }
+  for (unsigned int i= 0; i < sizeof(pgfindlib_bench_cases) / sizeof(pgfindlib_bench_cases[0]); ++i)
+  {
+    pgfindlib_bench_one(out, &pgfindlib_bench_cases[i], repetitions);
+    fflush(out);
+  }
+  fclose(out);
+  /* echo the results */
+  out= fopen(file_name, "r");
+  if (out != NULL)
+  {
+    char line[256];
+    unsigned int line_number= 0;
+    while (fgets(line, sizeof(line), out) != NULL)
+    {
+      if (++line_number > 2) fputs(line, stdout);
+    }
+    fclose(out);
+  }
+  pgfindlib_matcher_free(&bench_matcher_prefixes);
+  pgfindlib_matcher_free(&bench_matcher_globs);
+  pgfindlib_matcher_free(&bench_matcher_huge);
+  free(bench_tokener_list);
+  pgfindlib_context_free(bench_context);
+  free(bench_malloc_buffer_1);
+  free(bench_malloc_buffer_2);
+#if (PGFINDLIB_INCLUDE_BACKEND_MEMORY != 0)
+  pgfindlib_backend_memory_close(bench_memory_backend);
+#endif
+  return 0;
+}
@@ -37,6 +37,8 @@
 #    ./pgfindlib_tests.sh
 
 #The 27 tests here involve combinations of gcc flags, LD_LIBRARY_PATH, LD_RUN_PATH, and LD_PRELOAD.
+#Tests #28 to #36 are of pgfindlib itself: pgfindlib_dlopen(), 022 views, glob WHERE items, symlink comments,
+#option flags, and PGFINDLIB_OPTION_DELTA.
 #They should all work, i.e. printf "Good".
 #The method is to create multiple .so files with the same name (but different displays) in different directories,
 #then change some of the settings to point to the different directories, then execute and see from the display
@@ -63,6 +65,9 @@ printf "This creates small files in /tmp/pgfindlib_tests and destroys everything
 read -p "Type Y to continue, or anything else to exit. " yn
 if [[ "$yn" != "Y" ]]; then exit; fi
 
+#Tests #28 and later compile pgfindlib.c from the directory that this script is in
+pgfindlib_directory=$(cd "$(dirname "$0")" && pwd)
+
 rm -r -f /tmp/pgfindlib_tests || { echo "rm -r -f /tmp/pgfindlib_tests failed so execution cannot continue" && return 1; }
 mkdir /tmp/pgfindlib_tests || { echo "mkdir /tmp/pgfindlib_tests failed so execution cannot continue" && return 1; }
 cd /tmp/pgfindlib_tests
@@ -614,6 +619,197 @@ else
    echo "  Found no library -- Good."; let "good_count=good_count+1"
 fi
 
+#Tests #28 and later are of pgfindlib itself rather than the loader.
+#dlopen_test.c calls pgfindlib_dlopen(argv[1]) and then the library's shared_library(), so it prints what test would.
+echo '
+#include <stdio.h>
+#include <dlfcn.h>
+#include "pgfindlib.h"
+int main(int argc, char *argv[])
+{
+  void *handle;
+  char path[PGFINDLIB_MAX_PATH_LENGTH];
+  if (argc < 2) return 1;
+  int rval= pgfindlib_dlopen(argv[1], RTLD_NOW, NULL, &handle, path, sizeof(path));
+  if (rval != PGFINDLIB_OK) { printf("error %d", rval); return 0; }
+  void (*function)(void)= (void (*)(void)) dlsym(handle, "shared_library");
+  if (function != NULL) function();
+  return 0;
+}' > dlopen_test.c
+gcc -Wall -I"$pgfindlib_directory" -o dlopen_test dlopen_test.c "$pgfindlib_directory/pgfindlib.c" -ldl -pthread
+
+printf "Test #28 -- pgfindlib_dlopen() with LD_LIBRARY_PATH=D:A\n"
+printf "  Result should be: D as for the loader, though the rows are in path order so A's row is first.\n"
+unset LD_RUN_PATH; unset LD_PRELOAD
+export LD_LIBRARY_PATH=/tmp/pgfindlib_tests/D:/tmp/pgfindlib_tests/A
+result=$(/tmp/pgfindlib_tests/dlopen_test libshared_library.so 2>/dev/null)
+loader_result=$(/tmp/pgfindlib_tests/test 2>/dev/null)
+if [[ "$result" == "** D" ]] && [[ "$loader_result" == "** D" ]]; then
+   echo "  Found library D-- Good."; let "good_count=good_count+1"
+else
+   echo "  Found library $result, loader found $loader_result-- Bad."; let "bad_count=bad_count+1"
+fi
+
+printf "Test #29 -- pgfindlib_dlopen() with LD_LIBRARY_PATH=G:C, G/libshared_library.so is junk\n"
+printf "  Result should be: C because the row for G has a 07x comment so it is rejected.\n"
+unset LD_RUN_PATH; unset LD_PRELOAD
+export LD_LIBRARY_PATH=/tmp/pgfindlib_tests/G:/tmp/pgfindlib_tests/C
+result=$(/tmp/pgfindlib_tests/dlopen_test libshared_library.so 2>/dev/null)
+if [[ "$result" == "** C" ]]; then
+   echo "  Found library C-- Good."; let "good_count=good_count+1"
+else
+   echo "  Found library $result-- Bad."; let "bad_count=bad_count+1"
+fi
+unset LD_LIBRARY_PATH
+
+#view_test.c prints the rows of pgfindlib_ex(argv[1]) with options->architectures = this program's class and machine
+echo '
+#include <stdio.h>
+#include <string.h>
+#include <link.h>
+#include "pgfindlib.h"
+int main(int argc, char *argv[])
+{
+  static char buffer[65536];
+  ElfW(Ehdr) elf_header;
+  FILE *file= fopen("/proc/self/exe", "rb");
+  if ((argc < 2) || (file == NULL) || (fread(&elf_header, sizeof(elf_header), 1, file) != 1)) return 1;
+  fclose(file);
+  struct pgfindlib_architecture architecture;
+  architecture.elf_class= elf_header.e_ident[EI_CLASS];
+  architecture.e_machine= elf_header.e_machine;
+  struct pgfindlib_options options;
+  memset(&options, 0, sizeof(options));
+  options.flags= PGFINDLIB_OPTIONS_DEFAULT;
+  options.architectures= &architecture;
+  options.architectures_count= 1;
+  int rval= pgfindlib_ex(argv[1], buffer, sizeof(buffer), &options);
+  printf("%d\n%s", rval, buffer);
+  return 0;
+}' > view_test.c
+gcc -Wall -I"$pgfindlib_directory" -o view_test view_test.c "$pgfindlib_directory/pgfindlib.c" -ldl -pthread
+
+printf "Test #30 -- 022 architecture view with LD_LIBRARY_PATH=D:A\n"
+printf "  Result should be: D as for the loader, though the row for A is first.\n"
+unset LD_RUN_PATH; unset LD_PRELOAD
+export LD_LIBRARY_PATH=/tmp/pgfindlib_tests/D:/tmp/pgfindlib_tests/A
+result=$(/tmp/pgfindlib_tests/view_test "FROM LD_LIBRARY_PATH WHERE libshared_library.so" 2>/dev/null | grep ",022 ")
+if [[ "$result" == *"/D/libshared_library.so,LD_LIBRARY_PATH,022 "* ]]; then
+   echo "  Found library D-- Good."; let "good_count=good_count+1"
+else
+   echo "  Found $result-- Bad."; let "bad_count=bad_count+1"
+fi
+unset LD_LIBRARY_PATH
+
+#rows_test.c prints the rows of pgfindlib_ex(argv[1]) with options->flags = argv[2] and options->snapshot_path = argv[3] if any
+echo '
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pgfindlib.h"
+int main(int argc, char *argv[])
+{
+  static char buffer[65536];
+  struct pgfindlib_options options;
+  memset(&options, 0, sizeof(options));
+  if (argc < 3) return 1;
+  options.flags= (unsigned int) strtoul(argv[2], NULL, 0);
+  if (argc > 3) options.snapshot_path= argv[3];
+  int rval= pgfindlib_ex(argv[1], buffer, sizeof(buffer), &options);
+  printf("%d\n%s", rval, buffer);
+  return 0;
+}' > rows_test.c
+gcc -Wall -I"$pgfindlib_directory" -o rows_test rows_test.c "$pgfindlib_directory/pgfindlib.c" -ldl -pthread
+
+#Create subdirectory K with libshared_library.so.1 and .so.10, symlinks .so and .so.2 to .so.1, and .so.9 to a file that isn't there
+mkdir /tmp/pgfindlib_tests/K
+ cp /tmp/pgfindlib_tests/A/libshared_library.so /tmp/pgfindlib_tests/K/libshared_library.so.1
+ cp /tmp/pgfindlib_tests/B/libshared_library.so /tmp/pgfindlib_tests/K/libshared_library.so.10
+ ln -s libshared_library.so.1 /tmp/pgfindlib_tests/K/libshared_library.so
+ ln -s libshared_library.so.1 /tmp/pgfindlib_tests/K/libshared_library.so.2
+ ln -s libshared_library.so.0 /tmp/pgfindlib_tests/K/libshared_library.so.9
+
+#The paths that rows_test found in K, without the directory, e.g. "libshared_library.so.1 libshared_library.so.2 "
+k_files()
+{
+  grep ",/tmp/pgfindlib_tests/K/" | cut -d, -f2 | sed 's|/tmp/pgfindlib_tests/K/||' | tr '\n' ' '
+}
+
+printf "Test #31 -- WHERE libshared_library.so.[0-9] with LD_LIBRARY_PATH=K\n"
+printf "  Result should be: .so.1 .so.2 .so.9, a glob matches the whole name so not .so or .so.10.\n"
+unset LD_RUN_PATH; unset LD_PRELOAD
+export LD_LIBRARY_PATH=/tmp/pgfindlib_tests/K
+result=$(/tmp/pgfindlib_tests/rows_test "FROM LD_LIBRARY_PATH WHERE libshared_library.so.[0-9]" 0x7f | k_files)
+if [[ "$result" == "libshared_library.so.1 libshared_library.so.2 libshared_library.so.9 " ]]; then
+   echo "  Found $result-- Good."; let "good_count=good_count+1"
+else
+   echo "  Found $result-- Bad."; let "bad_count=bad_count+1"
+fi
+
+printf "Test #32 -- WHERE libshared_library.so.{1?,[!0-1]} with LD_LIBRARY_PATH=K\n"
+printf "  Result should be: .so.10 .so.2 .so.9, braces, ? and a negated class.\n"
+result=$(/tmp/pgfindlib_tests/rows_test "FROM LD_LIBRARY_PATH WHERE libshared_library.so.{1?,[!0-1]}" 0x7f | k_files)
+if [[ "$result" == "libshared_library.so.10 libshared_library.so.2 libshared_library.so.9 " ]]; then
+   echo "  Found $result-- Good."; let "good_count=good_count+1"
+else
+   echo "  Found $result-- Bad."; let "bad_count=bad_count+1"
+fi
+
+printf "Test #33 -- WHERE libshared_library.so with LD_LIBRARY_PATH=K, symlink comments and targets\n"
+printf "  Result should be: .so is 013 symlink to .so.1, .so.2 is 015 same target, .so.9 is 062 symlink target not found.\n"
+result=$(/tmp/pgfindlib_tests/rows_test "FROM LD_LIBRARY_PATH WHERE libshared_library.so" 0x7f)
+if [[ "$result" == *"/K/libshared_library.so,LD_LIBRARY_PATH,013 symlink,,,/tmp/pgfindlib_tests/K/libshared_library.so.1,"* ]] \
+&& [[ "$result" == *"/K/libshared_library.so.2,LD_LIBRARY_PATH,013 symlink,015 same target as "* ]] \
+&& [[ "$result" == *"/K/libshared_library.so.9,LD_LIBRARY_PATH,"*"062 symlink target not found,/tmp/pgfindlib_tests/K/libshared_library.so.0,"* ]]; then
+   echo "  Found 013, 015 and 062-- Good."; let "good_count=good_count+1"
+else
+   echo "  Found $result-- Bad."; let "bad_count=bad_count+1"
+fi
+
+printf "Test #34 -- PGFINDLIB_OPTIONS_PATHS_ONLY with LD_LIBRARY_PATH=K\n"
+printf "  Result should be: the same 5 paths with no comments or targets, and no version or \$LIB rows.\n"
+result=$(/tmp/pgfindlib_tests/rows_test "FROM LD_LIBRARY_PATH WHERE libshared_library.so" 0x00)
+paths_result=$(echo "$result" | k_files)
+if [[ "$paths_result" == "libshared_library.so libshared_library.so.1 libshared_library.so.10 libshared_library.so.2 libshared_library.so.9 " ]] \
+&& [[ $(echo "$result" | grep -c ",/tmp/pgfindlib_tests/K/[^,]*,LD_LIBRARY_PATH,,,,,$") == 5 ]] \
+&& [[ "$result" != *"001 version"* ]] && [[ "$result" != *"005 \$LIB"* ]]; then
+   echo "  Found paths only-- Good."; let "good_count=good_count+1"
+else
+   echo "  Found $result-- Bad."; let "bad_count=bad_count+1"
+fi
+
+printf "Test #35 -- PGFINDLIB_OPTIONS_DEFAULT without PGFINDLIB_OPTION_SYMLINKS with LD_LIBRARY_PATH=K\n"
+printf "  Result should be: .so.9 still has 060 from access() and 070 from open() but no 013 or 062 and no target.\n"
+result=$(/tmp/pgfindlib_tests/rows_test "FROM LD_LIBRARY_PATH WHERE libshared_library.so.9" 0x7d)
+if [[ "$result" == *"/K/libshared_library.so.9,LD_LIBRARY_PATH,060 access(filename, R_OK) failed,070 elf open failed,,,"* ]] \
+&& [[ "$result" != *"013 symlink"* ]] && [[ "$result" != *"062 "* ]]; then
+   echo "  Found 060 and 070 only-- Good."; let "good_count=good_count+1"
+else
+   echo "  Found $result-- Bad."; let "bad_count=bad_count+1"
+fi
+
+printf "Test #36 -- PGFINDLIB_OPTION_DELTA with a snapshot, LD_LIBRARY_PATH=K\n"
+printf "  Result should be: all 026 the first time, nothing the second time, then after changes in K\n"
+printf "  .so.2 027 removed, .so.3 026 added, .so.9 028 changed (now a symlink to .so.10 so no 060 or 062).\n"
+rm -f /tmp/pgfindlib_tests/snapshot
+statement="FROM LD_LIBRARY_PATH WHERE libshared_library.so.[0-9]"
+result_1=$(/tmp/pgfindlib_tests/rows_test "$statement" 0x47f /tmp/pgfindlib_tests/snapshot)
+result_2=$(/tmp/pgfindlib_tests/rows_test "$statement" 0x47f /tmp/pgfindlib_tests/snapshot)
+rm /tmp/pgfindlib_tests/K/libshared_library.so.2
+cp /tmp/pgfindlib_tests/C/libshared_library.so /tmp/pgfindlib_tests/K/libshared_library.so.3
+ln -s -f libshared_library.so.10 /tmp/pgfindlib_tests/K/libshared_library.so.9
+result_3=$(/tmp/pgfindlib_tests/rows_test "$statement" 0x47f /tmp/pgfindlib_tests/snapshot)
+if [[ $(echo "$result_1" | grep -c ",026 added as row ") == 5 ]] && [[ "$result_2" == "0" ]] \
+&& [[ "$result_3" == *"/K/libshared_library.so.2,LD_LIBRARY_PATH,027 removed from row 4,"* ]] \
+&& [[ "$result_3" == *"/K/libshared_library.so.3,LD_LIBRARY_PATH,026 added as row 4,"* ]] \
+&& [[ "$result_3" == *"/K/libshared_library.so.9,LD_LIBRARY_PATH,028 changed in row 5,013 symlink,,/tmp/pgfindlib_tests/K/libshared_library.so.10,"* ]] \
+&& [[ $(echo "$result_3" | grep -c ",02[6-9] ") == 3 ]]; then
+   echo "  Found 026, 027 and 028-- Good."; let "good_count=good_count+1"
+else
+   echo "  Found $result_1 $result_2 $result_3-- Bad."; let "bad_count=bad_count+1"
+fi
+unset LD_LIBRARY_PATH
+
 export LD_LIBRARY_PATH='$LIB/wombat'
 printf "$LD_LIBRARY_PATH"
 result=$(/tmp/pgfindlib_tests/test)
@@ -0,0 +1,149 @@
+#pgfindlib_tsan.sh -- Run pgfindlib from many threads at once under ThreadSanitizer.
+#
+#
+#Copyright (c) 2025 by Peter Gulutzan.
+#
+#All rights reserved.
+#
+#Redistribution and use in source and binary forms, with or without
+#modification, are permitted provided that the following conditions are met:
+#    * Redistributions of source code must retain the above copyright
+#      notice, this list of conditions and the following disclaimer.
+#    * Redistributions in binary form must reproduce the above copyright
+#      notice, this list of conditions and the following disclaimer in the
+#      documentation and/or other materials provided with the distribution.
+#    * Neither the name of the  nor the
+#      names of its contributors may be used to endorse or promote products
+#      derived from this software without specific prior written permission.
+#
+#THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+#ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+#WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+#DISCLAIMED. IN NO EVENT SHALL  BE LIABLE FOR ANY
+#DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+#(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+#LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+#ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+#(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+#SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#!/bin/bash
+#Comments:
+#  Required utilities: linux, bash, gcc with -fsanitize=thread (libtsan)
+#  Required permissions: to create/modify/destroy files and directories in /tmp/pgfindlib_tsan
+#  This creates small files in /tmp/pgfindlib_tsan and destroys everything in /tmp/pgfindlib_tsan.
+#  To run, from the directory that has pgfindlib.c:
+#    chmod +x pgfindlib_tsan.sh
+#    ./pgfindlib_tsan.sh [threads] [calls per thread]
+#  The default is 16 threads and 20 calls per thread.
+
+#This is the check that "Re threads" in README.md mentions.
+#Each thread, on a 64 KB stack, calls pgfindlib(), pgfindlib_ex() with options->envp, pgfindlib_dlopen()
+#(whose table of remembered paths is the one thing that threads share) and pgfindlib_dlopen_forget(),
+#and pgfindlib_batch() for two sysroots that have etc/ld.so.conf but no etc/ld.so.cache, so that its
+#worker threads read ld.so.conf files at the same time as each other and as the other threads' batches.
+#Every pgfindlib() result must be the same as the one the main thread got before the threads started.
+#ThreadSanitizer is told to stop at the first report, so the last line is "Good" only if there were none.
+
+unset LD_PRELOAD; unset LD_AUDIT
+
+source_directory=$(pwd)
+if [[ ! -f "$source_directory/pgfindlib.c" ]]; then echo "pgfindlib.c is not in the current directory"; exit 1; fi
+threads_count=${1:-16}
+calls_count=${2:-20}
+
+rm -r -f /tmp/pgfindlib_tsan || { echo "rm -r -f /tmp/pgfindlib_tsan failed so execution cannot continue" && exit 1; }
+mkdir /tmp/pgfindlib_tsan || { echo "mkdir /tmp/pgfindlib_tsan failed so execution cannot continue" && exit 1; }
+cd /tmp/pgfindlib_tsan
+
+#Two sysroots for pgfindlib_batch(), each with an ld.so.conf that has an include and a list of directories
+for root in root1 root2; do
+  mkdir -p $root/etc/ld.so.conf.d $root/lib $root/usr/lib $root/opt/lib
+  echo 'include ld.so.conf.d/*.conf' > $root/etc/ld.so.conf
+  echo '/opt/lib /lib:/usr/lib' > $root/etc/ld.so.conf.d/a.conf
+  echo 'x' > $root/lib/libz.so.1
+  echo 'x' > $root/opt/lib/libz.so.1
+done
+
+#Create tsan_test.c
+echo '
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pgfindlib.h"
+
+#define TSAN_TEST_BUFFER_SIZE 65536
+#define TSAN_TEST_STATEMENT "where libc.so.6, libm.so.6, libz.so*"
+
+static char expected[TSAN_TEST_BUFFER_SIZE];
+static unsigned int calls_count;
+
+static void *tsan_test_thread(void *arg)
+{
+  long thread_number= (long) arg;
+  char *buffer= malloc(TSAN_TEST_BUFFER_SIZE);
+  char path[PGFINDLIB_MAX_PATH_LENGTH + 1];
+  static char ld_library_path[]= "LD_LIBRARY_PATH=/tmp/pgfindlib_tsan";
+  char *const envp[]= { ld_library_path, NULL };
+  struct pgfindlib_options options;
+  struct pgfindlib_batch_item items[2];
+  long failures= 0;
+  if (buffer == NULL) return (void *) 1;
+  memset(&options, 0, sizeof(options));
+  options.envp= envp;
+  for (unsigned int i= 0; i < calls_count; ++i)
+  {
+    if ((pgfindlib(TSAN_TEST_STATEMENT, buffer, TSAN_TEST_BUFFER_SIZE) != PGFINDLIB_OK) || (strcmp(buffer, expected) != 0))
+      ++failures;
+    if (pgfindlib_ex(TSAN_TEST_STATEMENT, buffer, TSAN_TEST_BUFFER_SIZE, &options) != PGFINDLIB_OK) ++failures;
+    void *handle;
+    if (pgfindlib_dlopen("libm.so.6", RTLD_NOW, NULL, &handle, path, sizeof(path)) != PGFINDLIB_OK) ++failures;
+    else dlclose(handle);
+    if (((i + thread_number) % 4) == 0) pgfindlib_dlopen_forget("libm.so.6");
+    items[0].sysroot= "/tmp/pgfindlib_tsan/root1";
+    items[1].sysroot= "/tmp/pgfindlib_tsan/root2";
+    for (int j= 0; j < 2; ++j) { items[j].buffer= buffer; items[j].buffer_max_length= TSAN_TEST_BUFFER_SIZE / 2; }
+    items[1].buffer= buffer + TSAN_TEST_BUFFER_SIZE / 2;
+    if (pgfindlib_batch("FROM ld.so.cache WHERE libz.so.1", items, 2, 2, NULL) != PGFINDLIB_OK) ++failures;
+    else if ((strstr(items[0].buffer, "/opt/lib/libz.so.1") == NULL) || (strstr(items[1].buffer, "/lib/libz.so.1") == NULL)) ++failures;
+  }
+  free(buffer);
+  return (void *) failures;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned int threads_count= (argc > 1) ? atoi(argv[1]) : 16;
+  calls_count= (argc > 2) ? atoi(argv[2]) : 20;
+  if (pgfindlib(TSAN_TEST_STATEMENT, expected, sizeof(expected)) != PGFINDLIB_OK) { printf("Bad: pgfindlib() failed\n"); return 1; }
+  pthread_t *threads= malloc(threads_count * sizeof(pthread_t));
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 65536);
+  for (unsigned int i= 0; i < threads_count; ++i)
+  {
+    if (pthread_create(&threads[i], &attr, tsan_test_thread, (void *) (long) i) != 0) { printf("Bad: pthread_create() failed\n"); return 1; }
+  }
+  long failures= 0;
+  for (unsigned int i= 0; i < threads_count; ++i)
+  {
+    void *thread_failures;
+    pthread_join(threads[i], &thread_failures);
+    failures+= (long) thread_failures;
+  }
+  pthread_attr_destroy(&attr);
+  free(threads);
+  printf("%u threads, %u calls each, %ld failed\n", threads_count, calls_count, failures);
+  return (failures == 0) ? 0 : 1;
+}
+' > tsan_test.c
+
+gcc -fsanitize=thread -g -O1 -Wall -I"$source_directory" -o tsan_test tsan_test.c "$source_directory/pgfindlib.c" -ldl -pthread \
+  || { echo "Bad: gcc -fsanitize=thread failed" && exit 1; }
+
+TSAN_OPTIONS="halt_on_error=1 exitcode=66 second_deadlock_stack=1" ./tsan_test "$threads_count" "$calls_count"
+rval=$?
+if [[ $rval -eq 0 ]]; then echo "Good"; else echo "Bad (exit code $rval, 66 means ThreadSanitizer reported)"; fi
+exit $rval